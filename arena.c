@@ -0,0 +1,108 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// arena.c
+// Memory arena of the buffers
+// Author: Kenji Rikitake
+
+// The arena is laid out once, in the order of the parts below, with
+// the 8 bytes of slack of each file buffer as before.  See arena.h for
+// the policy.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "cdefs.h"
+#include "kermit.h"
+#include "sendlist.h"
+
+// Bytes of a packet buffer, and of the data field buffer
+#define PKTBYTES (P_PKTLEN + 8)
+#define DATABYTES (P_PKTLEN + 2)
+
+static UCHAR *base;           /* The arena */
+static unsigned int size;     /* and its bytes */
+static short slots;           /* Window slots of incoming packets */
+static unsigned int obuflen;  /* File output buffer */
+static unsigned int ibuflen;  /* File input buffer */
+static unsigned int poolsize; /* Send list pool */
+static UCHAR *ipkt, *opkt;    /* Where the parts are */
+static UCHAR *xdata, *obuf, *ibuf, *pool;
+
+// Bytes of the parts as they are
+
+static unsigned int used(void) {
+  return ((unsigned int)slots * PKTBYTES + PKTBYTES + DATABYTES +
+          (obuflen + 8) + (ibuflen + 8) + poolsize);
+}
+
+// Lay out the parts in size bytes at p.
+// Returns 0, or -1 if the minimum sizes do not fit.
+
+int arenainit(UCHAR *p, unsigned int n) {
+  base = p;
+  size = n;
+  slots = ARENA_SLOTS;
+  obuflen = OBUFLEN;
+  ibuflen = IBUFLEN;
+  poolsize = SENDPOOL;
+  if (used() > size) {
+    return (-1);
+  }
+  if (size - used() >= ARENA_POOLMAX - poolsize) {
+    poolsize = ARENA_POOLMAX;
+  } else {
+    poolsize += size - used();
+  }
+  obuflen += (size - used()) / 2;
+  if (obuflen > ARENA_BUFMAX) {
+    obuflen = ARENA_BUFMAX;
+  }
+  ibuflen += size - used();
+  if (ibuflen > ARENA_BUFMAX) {
+    ibuflen = ARENA_BUFMAX;
+  }
+
+  ipkt = p;
+  p += (unsigned int)slots * PKTBYTES;
+  opkt = p;
+  p += PKTBYTES;
+  xdata = p;
+  p += DATABYTES;
+  obuf = p;
+  p += obuflen + 8;
+  ibuf = p;
+  p += ibuflen + 8;
+  pool = p;
+  sendlistinit(pool, (int)poolsize);
+  return (0);
+}
+
+// Give the engine its packet and file buffers
+
+void arenaattach(struct k_data *k) {
+  k->ipktbuf = ipkt;
+  k->opktbuf = opkt;
+  k->xdatabuf = xdata;
+  k->pktmax = P_PKTLEN; /* Fixed, see arena.h */
+  k->wmax = slots;
+  k->zinbuf = ibuf;
+  k->zinlen = (int)ibuflen;
+  k->obuf = obuf;
+  k->obuflen = (int)obuflen;
+}
+
+// Show the layout, in the 53 columns of the Neo6502 console
+
+void arenashow(void) {
+  printf("Memory: %u bytes at $%04lX\n", size,
+         (unsigned long)(uintptr_t)base);
+  printf("  %d window slot%s of %d bytes %10u\n", slots,
+         (slots == 1) ? " " : "s", PKTBYTES, (unsigned int)slots * PKTBYTES);
+  printf("  Packet to send and its data %10u\n", PKTBYTES + DATABYTES);
+  printf("  File output buffer %19u\n", obuflen + 8);
+  printf("  File input buffer %20u\n", ibuflen + 8);
+  printf("  Send list pool %23u\n", poolsize);
+  printf("  Not used %29u\n", size - used());
+}
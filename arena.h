@@ -0,0 +1,52 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// arena.h -- Memory arena of the buffers
+
+// The buffers whose sizes can be traded for each other are carved at
+// startup out of one arena, the free RAM left after the program and its
+// data: the packet buffers of the engine (one for each window slot of
+// the incoming packets, and the ones for the packet to send and its
+// data field, see KARENA in kermit.h), the file input and output
+// buffers, and the pool of the send list.  So a build makes the most of
+// the RAM of the board it runs on, with no sizes to be tuned.
+//
+// The policy: every part first gets its minimum, that is ARENA_SLOTS
+// window slots, and the sizes of the fixed buffers before the arena
+// (IBUFLEN, OBUFLEN, and SENDPOOL); the arena is too small if they do
+// not fit.  Then the send list pool is grown up to ARENA_POOLMAX, and
+// all the rest is shared by the file output and input buffers, up to
+// ARENA_BUFMAX each: the larger they are, the fewer file API calls a
+// transfer takes.
+//
+// Only one window slot is funded, as the engine sends a packet and
+// waits for its ACK, and takes each packet it receives out of its slot
+// before it reads the next one: more slots would stay unused.  The
+// packet length is not traded either: the slot holds a packet of
+// P_PKTLEN, the longest the engine is built for, and k->pktmax is
+// always P_PKTLEN.
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "cdefs.h"
+#include "kermit.h"
+
+#ifndef ARENA_SLOTS
+#define ARENA_SLOTS (1) /* Window slots, up to P_WSLOTS */
+#endif                  /* ARENA_SLOTS */
+// A file buffer is at most what an int of the 6502 and one call of the
+// file API can take
+#ifndef ARENA_BUFMAX
+#define ARENA_BUFMAX (16384)
+#endif /* ARENA_BUFMAX */
+// 64 names or patterns, more than are typed in for a batch
+#ifndef ARENA_POOLMAX
+#define ARENA_POOLMAX (64 * (FN_MAX + 1))
+#endif /* ARENA_POOLMAX */
+
+int arenainit(UCHAR *, unsigned int);
+void arenaattach(struct k_data *);
+void arenashow(void);
+
+#endif /* __ARENA_H__ */
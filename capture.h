@@ -0,0 +1,56 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// capture.h -- Binary capture of Kermit packets in the debug build
+
+// In the -DDEBUG build, dodebug() records each DB_PKT call as a binary
+// record of the raw packet bytes to CAPTURE_FILE, next to the text log,
+// instead of formatting it.  The records are appended to a small RAM
+// buffer and written out when it fills up or the log is closed, so the
+// file can be read while it grows; decode it on a host by
+// kermit-capture.
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "cdefs.h"
+
+// Record kinds, given by the first character of the DB_PKT label:
+// debug(DB_PKT, "RPKT", bytes, length) for a packet received,
+// "SPKT" for one sent, "TPKT" for one retransmitted, and
+// debug(DB_PKT, "VPKT", 0, verdict) for the verdict of the block check
+// on the last packet received.  The bytes are those between the SOH and
+// the packet terminator (LEN, SEQ, TYPE, data and block check).
+
+#define CAP_RECV 'R'    /* Packet received */
+#define CAP_SEND 'S'    /* Packet sent */
+#define CAP_RESEND 'T'  /* Packet retransmitted */
+#define CAP_VERDICT 'V' /* Verdict of the last packet received */
+
+// Verdicts
+
+#define CAP_UNCHECKED 0 /* Not checked (yet), e.g. an echo */
+#define CAP_OK 1        /* Block check good */
+#define CAP_SHORT 2     /* Too short to be a packet */
+#define CAP_BADHDR 3    /* Long packet header checksum bad */
+#define CAP_BADCHK 4    /* Block check bad */
+
+// Record header, 6 bytes, little endian on both the Neo6502 and hosts,
+// followed by len bytes of the packet
+
+struct capture_record {
+  UCHAR kind;    /* Record kind */
+  UCHAR verdict; /* Verdict (CAP_VERDICT only) */
+  USHORT len;    /* Packet bytes following */
+  USHORT time;   /* Timer ticks (100 Hz), modulo 65536 */
+};
+
+// File layout: CAPTURE_MAGIC, then the records, oldest first
+
+#define CAPTURE_MAGIC "KCP1"
+#define CAPTURE_FILE "KCAPTURE.BIN"
+#ifndef CAPTURE_BUFLEN
+#define CAPTURE_BUFLEN (512) /* RAM buffer, at least a record long */
+#endif /* CAPTURE_BUFLEN */
+
+#endif /* __CAPTURE_H__ */
@@ -18,6 +18,34 @@
 #endif /* STATIC */
 #endif /* XAC */
 
+/*
+  INLINE marks the bodies of functions that kermit.c compiles more than
+  once, each time with different constant arguments (see codecsel()), so
+  that each copy is specialized for its constants, and profiled as part of
+  it.  Compilers that cannot be told to inline them just call them.
+*/
+#ifndef INLINE
+#if defined(__GNUC__) || defined(__clang__)
+#define INLINE                                                                 \
+  static inline __attribute__((always_inline, no_instrument_function))
+#else /* __GNUC__ || __clang__ */
+#define INLINE static
+#endif /* __GNUC__ || __clang__ */
+#endif /* INLINE */
+
+/*
+  ZEROPAGE places a variable in the zero page of the 6502, which the
+  LLVM-MOS compiler then reaches with the zero-page addressing modes.
+  Elsewhere it places nothing.  See ZPHOT in kermit.h.
+*/
+#ifndef ZEROPAGE
+#ifdef __mos__
+#define ZEROPAGE __attribute__((section(".zp.bss")))
+#else /* __mos__ */
+#define ZEROPAGE
+#endif /* __mos__ */
+#endif /* ZEROPAGE */
+
 /*
   By default we assume the compiler supports unsigned char and
   unsigned long.  If not you can override these definitions on
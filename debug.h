@@ -19,25 +19,67 @@
 #define DB_LOG 2 /* Write label+string or int to log */
 #define DB_MSG 3 /* Write message to log */
 #define DB_CHR 4 /* Write label + char to log */
-#define DB_PKT 5 /* Record a Kermit packet in log */
+#define DB_PKT 5 /* Capture a Kermit packet (see capture.h) */
 #define DB_CLS 6 /* Close log */
+#define DB_FC(a) ((a)&0x0f) /* Function code of the first arg */
+
+/*
+  Categories and levels, or'ed into the function code, as in
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "readfile exit zincnt", 0, n).
+  A message without a category is always logged.
+*/
+#define DBC_PKT 0x0100   /* Packets */
+#define DBC_STATE 0x0200 /* Protocol states and parameters */
+#define DBC_FILE 0x0400  /* File I/O */
+#define DBC_CRC 0x0800   /* Block checks */
+#define DBC_ENC 0x1000   /* Encoding and decoding */
+#define DBC_ALL 0x1f00
+
+#define DBL_ERROR 0x10  /* Errors */
+#define DBL_EVENT 0x20  /* Once per packet or file */
+#define DBL_DETAIL 0x30 /* Fields, and once per byte */
+#define DBL_MASK 0x30
+
+/*
+  Categories and the highest level compiled in; the other messages
+  disappear entirely.  Override them on the cc command line, e.g.
+  -DDEBUG_CATEGORIES=DBC_PKT -DDEBUG_LEVEL=DBL_EVENT
+*/
+#ifndef DEBUG_CATEGORIES
+#define DEBUG_CATEGORIES DBC_ALL
+#endif /* DEBUG_CATEGORIES */
+#ifndef DEBUG_LEVEL
+#define DEBUG_LEVEL DBL_DETAIL
+#endif /* DEBUG_LEVEL */
+
+#define DB_COMPILED(a)                                 \
+    ((!((a)&DBC_ALL) || ((a) & (DEBUG_CATEGORIES))) && \
+     (((a)&DBL_MASK) <= (DEBUG_LEVEL)))
+
+/* Categories enabled at run time (defined with dodebug()) */
+extern unsigned int debugmask;
+#define DB_ENABLED(a) (!((a)&DBC_ALL) || ((a)&debugmask))
 
 void dodebug(int, UCHAR*, UCHAR*, long); /* Prototype */
 /*
   dodebug() is accessed throug a macro that:
    . Coerces its args to the required types.
    . Accesses dodebug() directly or thru a pointer according to context.
-   . Makes it disappear entirely if DEBUG not defined.
+   . Makes it disappear entirely if DEBUG not defined,
+     or if its category or level is not compiled in.
 */
 #ifdef KERMIT_C
-/* In kermit.c we debug only through a function pointer */
-#define debug(a, b, c, d) \
-    if (*(k->dbf))        \
+/* In kermit.c we debug only through a function pointer, */
+/* and dodebug() checks debugmask (no globals in kermit.c) */
+#define debug(a, b, c, d)            \
+    if (DB_COMPILED(a) && *(k->dbf)) \
     (*(k->dbf))(a, (UCHAR*)b, (UCHAR*)c, (long)(d))
 
 #else /* KERMIT_C */
 /* Elsewhere we can call the debug function directly */
-#define debug(a, b, c, d) dodebug(a, (UCHAR*)b, (UCHAR*)c, (long)(d))
+#define debug(a, b, c, d)                \
+    if (DB_COMPILED(a) && DB_ENABLED(a)) \
+    dodebug(a, (UCHAR*)b, (UCHAR*)c, (long)(d))
 #endif /* KERMIT_C */
 
 #else /* Debugging not included... */
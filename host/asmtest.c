@@ -0,0 +1,440 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// asmtest.c
+// Equivalence test of the assembler kernels with their C versions
+// Author: Kenji Rikitake
+
+// The kernels of kasm.s are run from the ELF file of kermit.neo, built
+// with KASM, on the W65C02S emulator in cpu65c02.c, and the kernels of
+// kasm.c on the host, with the same random inputs: checksums of strings
+// of every length up to a few pages and at every alignment, data fields
+// made of prefixed and repeated bytes, or of random ones, decoded into
+// outputs of random sizes as decode() flushes them, and UART input with
+// the stop bytes here and there.  Every result, the state left in the
+// structure, and every byte of the output must be the same; the exit
+// status tells if they were.  The cycles per byte of each kernel are
+// shown, without the API calls of krecv().
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <neo/api.h>
+
+#include "cdefs.h"
+#include "kasm.h"
+#include "kermit.h"
+#include "cpu65c02.h"
+#include "load65.h"
+
+static char *cmdname = "kermit-asmtest";
+
+// Neo6502 kernel entry points, as in prof65.c
+#define K_SENDMESSAGE (0xfff7)
+#define K_WAITMESSAGE (0xfff4)
+#define K_TRAP (0xff00)
+#define API_GROUP (0xff00)
+#define API_PARAMS (0xff04)
+
+#define RETADDR (0xfff0)       /* The kernel returns here */
+#define CYCLEMAX (50000000ULL) /* Cycles of a call before giving up */
+
+// Where the arguments are in the emulated memory
+#define ST_ADDR (0xc000)  /* struct kdec or krx */
+#define IN_ADDR (0xc100)  /* String or data field */
+#define OUT_ADDR (0xd000) /* Output of kdecode() or krecv() */
+#define TEST_END (0xf000)
+
+#define INMAX (0x900)  /* Bytes at IN_ADDR */
+#define OUTMAX (0x400) /* Bytes at OUT_ADDR that are compared */
+
+static uint8_t mem[65536];
+static struct cpu65c02 cpu;
+
+// The kernels, and the zero page imaginary register __rc2
+
+enum { K_CHK2, K_CHK3, K_DECODE, K_RECV, KERNELS };
+
+static struct {
+  const char *name;
+  uint32_t addr;
+  long cases, differ;
+  uint64_t cycles, bytes;
+} kern[KERNELS] = {
+    {"kchk2", 0, 0, 0, 0, 0},
+    {"kchk3", 0, 0, 0, 0, 0},
+    {"kdecode", 0, 0, 0, 0, 0},
+    {"krecv", 0, 0, 0, 0, 0},
+};
+static long rc2 = -1;
+
+static void addsym(const char *name, uint32_t addr, uint32_t size) {
+  int i;
+
+  for (i = 0; i < KERNELS; i++) {
+    if (!strcmp(name, kern[i].name)) {
+      kern[i].addr = addr;
+    }
+  }
+  if (!strcmp(name, "__rc2")) {
+    rc2 = addr;
+  }
+}
+
+// Random numbers: xorshift, as in kthreads.c
+
+static unsigned long rstate = 2463534242UL;
+
+static unsigned long rnd(void) {
+  rstate ^= (rstate << 13) & 0xffffffffUL;
+  rstate ^= rstate >> 17;
+  rstate ^= (rstate << 5) & 0xffffffffUL;
+  return (rstate);
+}
+
+static int rndint(int n) { return ((int)(rnd() % (unsigned long)n)); }
+
+// UART input of krecv(), the same for both versions
+
+static UCHAR rxscript[INMAX];
+static int rxlen, rxpos;
+
+uint8_t neo_uext_uart_available(void) { return (rxpos < rxlen); }
+
+uint8_t neo_uext_uart_read(void) {
+  return ((rxpos < rxlen) ? rxscript[rxpos++] : 0);
+}
+
+// Kernel entry points: the API calls of krecv(), with the byte not
+// available now and then, so that its wait loop is run too
+
+static int kernel(void) {
+  uint16_t ret;
+  uint8_t group, fn;
+
+  ret = cpu65c02_pull(&cpu);
+  ret |= cpu65c02_pull(&cpu) << 8;
+  ret++;
+  switch (cpu.pc) {
+  case K_SENDMESSAGE:
+    group = mem[ret];
+    fn = mem[ret + 1];
+    ret += 2;
+    if ((group == 10) && (fn == 18)) {
+      mem[API_PARAMS] = neo_uext_uart_available() && rndint(4);
+    } else if ((group == 10) && (fn == 17)) {
+      mem[API_PARAMS] = neo_uext_uart_read();
+    } else {
+      fprintf(stderr, "%s: unknown API call %d,%d\n", cmdname, group, fn);
+      return (-1);
+    }
+    mem[API_GROUP] = 0;
+    break;
+  case K_WAITMESSAGE:
+    break;
+  default:
+    fprintf(stderr, "%s: unknown kernel call $%04X\n", cmdname, cpu.pc);
+    return (-1);
+  }
+  cpu.pc = ret;
+  return (0);
+}
+
+// Call a kernel with a pointer; returns A and X, or -1 if it did not
+// return
+
+static long call(int kn, uint16_t arg) {
+  uint64_t cycles;
+
+  mem[rc2] = arg & 0xff;
+  mem[rc2 + 1] = arg >> 8;
+  cpu65c02_reset(&cpu, mem, kern[kn].addr);
+  cpu65c02_push(&cpu, (RETADDR - 1) >> 8);
+  cpu65c02_push(&cpu, (RETADDR - 1) & 0xff);
+  cycles = 0;
+  while (cpu.pc != RETADDR) {
+    if (cpu.pc >= K_TRAP) {
+      if (kernel() < 0) {
+        return (-1);
+      }
+      continue;
+    }
+    if (cpu.stopped || (cycles > CYCLEMAX)) {
+      fprintf(stderr, "%s: %s did not return, at $%04X\n", cmdname,
+              kern[kn].name, cpu.pc);
+      return (-1);
+    }
+    cycles += cpu65c02_step(&cpu);
+  }
+  kern[kn].cycles += cycles;
+  return (cpu.a | (cpu.x << 8));
+}
+
+static uint16_t rd16(uint16_t addr) {
+  return (mem[addr] | (mem[addr + 1] << 8));
+}
+
+static void wr16(uint16_t addr, uint16_t v) {
+  mem[addr] = v & 0xff;
+  mem[addr + 1] = v >> 8;
+}
+
+// kchk2() and kchk3(): strings of random bytes but NUL, at any offset
+// in a page
+
+static void testchk(int kn, int cases) {
+  static UCHAR s[INMAX];
+  int i, len, off;
+  long a;
+  USHORT c;
+
+  for (i = 0; i < cases; i++) {
+    off = rndint(256);
+    len = rndint(INMAX - 256 - 1);
+    if (i < 256) { /* Every short length first */
+      len = i;
+    }
+    memset(s, 0, sizeof(s));
+    while (len > 0) {
+      s[off + --len] = 1 + rndint(255);
+    }
+    memcpy(mem + IN_ADDR, s, INMAX);
+    c = (kn == K_CHK2) ? kchk2(s + off) : kchk3(s + off);
+    a = call(kn, IN_ADDR + off);
+    if (a < 0) {
+      exit(FAILURE);
+    }
+    kern[kn].cases++;
+    kern[kn].bytes += strlen((char *)s + off);
+    if ((USHORT)a != c) {
+      if (!kern[kn].differ++) {
+        fprintf(stderr, "%s: %d bytes: $%04X, C $%04X\n", kern[kn].name,
+                (int)strlen((char *)s + off), (unsigned int)a, c);
+      }
+    }
+  }
+}
+
+// kdecode(): a data field, decoded into outputs of random sizes
+
+static void mkfield(UCHAR *s, int max, UCHAR ctlq, UCHAR rptq) {
+  int n, c, len;
+
+  len = rndint(max);
+  if (rndint(8) == 0) { /* Random bytes, maybe with prefixes at the end */
+    for (n = len; n > 0; n--) {
+      s[n - 1] = 1 + rndint(255);
+    }
+    return;
+  }
+  n = 0;
+  while (n + 5 < len) {
+    if (rptq && (rndint(6) == 0)) {
+      s[n++] = rptq;
+      s[n++] = 32 + rndint(96); /* Count, maybe 0 */
+    }
+    c = rndint(256);
+    if ((c < 32) || (c >= 127 && c < 160) || (c == 255) || (c == ctlq) ||
+        (c == rptq)) {
+      s[n++] = ctlq;
+      s[n++] = ((c == ctlq) || (c == rptq)) ? c : (c ^ 64);
+    } else {
+      s[n++] = c;
+    }
+  }
+}
+
+static int samedec(struct kdec *d, UCHAR *in, UCHAR *out) {
+  if ((rd16(ST_ADDR) - IN_ADDR != d->in - in) ||
+      (rd16(ST_ADDR + 2) - OUT_ADDR != d->out - out) ||
+      (mem[ST_ADDR + 8] != d->rpt) ||
+      (d->rpt && (mem[ST_ADDR + 9] != d->byte))) {
+    return (0);
+  }
+  return (!memcmp(mem + OUT_ADDR, out, OUTMAX));
+}
+
+static void testdecode(int cases) {
+  static UCHAR in[INMAX], out[OUTMAX];
+  struct kdec d;
+  int i, calls, size;
+  UCHAR ctlq, rptq;
+
+  for (i = 0; i < cases; i++) {
+    ctlq = '#';
+    rptq = rndint(2) ? '~' : 0;
+    memset(in, 0, sizeof(in));
+    mkfield(in, INMAX - 8, ctlq, rptq);
+    memcpy(mem + IN_ADDR, in, INMAX);
+    d.in = in;
+    d.ctlq = ctlq;
+    d.rptq = rptq;
+    d.rpt = 0;
+    d.byte = 0;
+    wr16(ST_ADDR, IN_ADDR);
+    mem[ST_ADDR + 6] = ctlq;
+    mem[ST_ADDR + 7] = rptq;
+    mem[ST_ADDR + 8] = 0;
+    mem[ST_ADDR + 9] = 0;
+    kern[K_DECODE].cases++;
+    for (calls = 0;; calls++) { /* A call for each output */
+      size = 1 + rndint((rndint(4) == 0) ? 8 : OUTMAX - 16);
+      memset(out, 0xa5, OUTMAX);
+      memset(mem + OUT_ADDR, 0xa5, OUTMAX);
+      d.out = out;
+      d.end = out + size;
+      wr16(ST_ADDR + 2, OUT_ADDR);
+      wr16(ST_ADDR + 4, OUT_ADDR + size);
+      kdecode(&d);
+      if (call(K_DECODE, ST_ADDR) < 0) {
+        exit(FAILURE);
+      }
+      kern[K_DECODE].bytes += d.out - out;
+      if (!samedec(&d, in, out)) {
+        if (!kern[K_DECODE].differ++) {
+          fprintf(stderr,
+                  "kdecode: call %d: in +%d out +%d rpt %d, "
+                  "C in +%d out +%d rpt %d\n",
+                  calls, rd16(ST_ADDR) - IN_ADDR, rd16(ST_ADDR + 2) - OUT_ADDR,
+                  mem[ST_ADDR + 8], (int)(d.in - in), (int)(d.out - out),
+                  d.rpt);
+        }
+        break;
+      }
+      if (d.out != d.end) { /* The data field has ended */
+        break;
+      }
+    }
+  }
+}
+
+// krecv(): random UART input with a stop byte now and then
+
+static void testrecv(int cases) {
+  static UCHAR out[OUTMAX];
+  struct krx x;
+  int i, n;
+
+  for (i = 0; i < cases; i++) {
+    n = 1 + rndint(OUTMAX - 16);
+    for (rxlen = 0; rxlen < n + 8; rxlen++) {
+      rxscript[rxlen] = rndint(256);
+      if (rndint(n) == 0) {
+        rxscript[rxlen] = rndint(2) ? SOH : CR;
+      }
+    }
+    memset(out, 0xa5, OUTMAX);
+    memset(mem + OUT_ADDR, 0xa5, OUTMAX);
+    x.p = out;
+    x.n = n;
+    x.soh = SOH;
+    x.eom = CR;
+    x.brk = rndint(2) ? 3 : SOH;
+    x.stop = 0;
+    wr16(ST_ADDR, OUT_ADDR);
+    wr16(ST_ADDR + 2, n);
+    mem[ST_ADDR + 4] = x.soh;
+    mem[ST_ADDR + 5] = x.eom;
+    mem[ST_ADDR + 6] = x.brk;
+    mem[ST_ADDR + 7] = 0;
+    rxpos = 0;
+    krecv(&x);
+    rxpos = 0;
+    if (call(K_RECV, ST_ADDR) < 0) {
+      exit(FAILURE);
+    }
+    kern[K_RECV].cases++;
+    kern[K_RECV].bytes += x.p - out + (x.n > 0);
+    if ((rd16(ST_ADDR) - OUT_ADDR != x.p - out) ||
+        (rd16(ST_ADDR + 2) != x.n) || (x.n && (mem[ST_ADDR + 7] != x.stop)) ||
+        memcmp(mem + OUT_ADDR, out, OUTMAX)) {
+      if (!kern[K_RECV].differ++) {
+        fprintf(stderr, "krecv: n %d: p +%d n %d, C p +%d n %d\n", n,
+                rd16(ST_ADDR) - OUT_ADDR, rd16(ST_ADDR + 2), (int)(x.p - out),
+                x.n);
+      }
+    }
+  }
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options] program\n"
+          "  program   ELF file of kermit.neo built with KASM\n"
+          "            (kermit.neo.elf)\n"
+          "  -n cases  random cases of each kernel (default 2000)\n"
+          "  -S seed   seed of the cases (default 1)\n",
+          cmdname);
+  exit(FAILURE);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  char *file;
+  uint8_t *prog;
+  long len;
+  uint16_t exec;
+  int i, cases, bad;
+
+  cases = 2000;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-n")) {
+      cases = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-S")) {
+      rstate += strtoul(argv[++i], (char **)0, 0) * 7919UL;
+    } else {
+      usage();
+    }
+  }
+  if ((i + 1 != argc) || (cases < 1)) {
+    usage();
+  }
+  file = argv[i];
+  prog = load65_file(file, &len);
+  if (!prog) {
+    exit(FAILURE);
+  }
+  if (load65_elf(mem, prog, len, &exec, addsym) < 0) {
+    fprintf(stderr, "%s: %s: not an ELF file\n", cmdname, file);
+    exit(FAILURE);
+  }
+  for (i = 0; i < KERNELS; i++) {
+    if (!kern[i].addr) {
+      fprintf(stderr, "%s: %s: no %s, not built with KASM?\n", cmdname, file,
+              kern[i].name);
+      exit(FAILURE);
+    }
+  }
+  if ((rc2 < 0) || (rc2 > 0xfe)) {
+    fprintf(stderr, "%s: no __rc2 in the zero page\n", cmdname);
+    exit(FAILURE);
+  }
+  for (i = ST_ADDR; i < TEST_END; i++) {
+    if (mem[i]) {
+      fprintf(stderr, "%s: the program is loaded at $%04X, over the test\n",
+              cmdname, i);
+      exit(FAILURE);
+    }
+  }
+
+  testchk(K_CHK2, cases);
+  testchk(K_CHK3, cases);
+  testdecode(cases);
+  testrecv(cases);
+
+  bad = 0;
+  for (i = 0; i < KERNELS; i++) {
+    printf("%-8s %6ld cases, %6ld differ, %6.1f cycles/byte\n", kern[i].name,
+           kern[i].cases, kern[i].differ,
+           kern[i].bytes ? (double)kern[i].cycles / kern[i].bytes : 0.0);
+    bad += (kern[i].differ > 0);
+  }
+  printf("%d of %d kernels the same as their C versions\n", KERNELS - bad,
+         KERNELS);
+  return (bad ? FAILURE : SUCCESS);
+}
@@ -0,0 +1,254 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// chanrelay.c
+// Fault-injecting relay between two Kermit programs
+// Author: Kenji Rikitake
+
+// kermit-chan runs a command, e.g. kermit-host, with pipes to its
+// stdin and stdout, and relays the bytes between the command and its
+// own stdin and stdout (or a tty or pty) through the fault-injecting
+// channel simulator in chansim.c, in real time.
+// From C-Kermit, for example:
+//   set host /pty ./kermit-chan -F drop=1e-4 ./kermit-host -r
+// Direction 0 is to the command, direction 1 is from the command.
+// The statistics are shown on stderr when the command exits.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cdefs.h"
+
+#include "chansim.h"
+
+static char *cmdname = "kermit-chan";
+
+#define QLEN (1 << 20) /* Bytes in flight per direction, power of 2 */
+#define BUFLEN (4096)
+
+// Bytes in flight with their arrival times
+
+struct queue {
+  UCHAR buf[QLEN];
+  int64_t when[QLEN];
+  unsigned long head;
+  unsigned long tail;
+};
+
+static struct queue q[CHANSIM_DIRS];
+static struct chansim csim;
+static int64_t start;
+
+static int64_t nsnow(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - start);
+}
+
+// Write out the bytes that have arrived.
+// Returns -1 on a write error.
+
+static int flush(struct queue *qp, int fd, int64_t now) {
+  UCHAR out[BUFLEN];
+  int n, x;
+
+  while (qp->head != qp->tail) {
+    for (n = 0; n < BUFLEN && qp->head + n != qp->tail &&
+                qp->when[(qp->head + n) & (QLEN - 1)] <= now;
+         n++) {
+      out[n] = qp->buf[(qp->head + n) & (QLEN - 1)];
+    }
+    if (n == 0) {
+      break;
+    }
+    x = write(fd, out, n);
+    if (x < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return (-1);
+    }
+    qp->head += x;
+  }
+  return (0);
+}
+
+// Read from fd into direction dir.
+// Returns the number of bytes read, 0 on EOF, -1 on error.
+
+static int relay(int dir, int fd, int64_t now) {
+  UCHAR in[BUFLEN], out[2 * BUFLEN];
+  int64_t when[2 * BUFLEN];
+  struct queue *qp = &q[dir];
+  int n, m, i;
+
+  n = read(fd, in, BUFLEN);
+  if (n <= 0) {
+    return ((n < 0 && (errno == EINTR || errno == EAGAIN)) ? 1 : n);
+  }
+  m = chansim_send(&csim, dir, now, in, n, out, when);
+  for (i = 0; i < m && qp->tail - qp->head < QLEN; i++) {
+    qp->buf[qp->tail & (QLEN - 1)] = out[i];
+    qp->when[qp->tail & (QLEN - 1)] = when[i];
+    qp->tail++;
+  }
+  return (n);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [-F profile] [-l line] command [args...]\n"
+          "  -F prof   fault profile, e.g.\n"
+          "            seed=1,drop=1e-4,flip=1e-4,dup=1e-5,latency=20,"
+          "bps=9600\n"
+          "            or @file (default: no faults)\n"
+          "  -l line   tty or pty of the other side "
+          "(default: stdin and stdout)\n",
+          cmdname);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  struct chansim_profile profile;
+  struct termios t;
+  struct pollfd pfd[2];
+  int tochild[2], fromchild[2];
+  int ttyin, ttyout, childin, childout;
+  int i, n, status, timo;
+  int64_t now, next;
+  char *line;
+  pid_t pid;
+
+  chansim_parse(&profile, "");
+  line = 0;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-F")) {
+      if (chansim_parse(&profile, argv[++i]) < 0) {
+        exit(EXIT_FAILURE);
+      }
+    } else if (!strcmp(argv[i], "-l")) {
+      line = argv[++i];
+    } else {
+      usage();
+    }
+  }
+  if (i >= argc) {
+    usage();
+  }
+
+  if (line) {
+    ttyin = ttyout = open(line, O_RDWR | O_NOCTTY);
+    if (ttyin < 0) {
+      perror(line);
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    ttyin = 0;
+    ttyout = 1;
+  }
+  if (isatty(ttyin) && tcgetattr(ttyin, &t) == 0) {
+    cfmakeraw(&t);
+    tcsetattr(ttyin, TCSANOW, &t);
+  }
+
+  if (pipe(tochild) < 0 || pipe(fromchild) < 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    dup2(tochild[0], 0);
+    dup2(fromchild[1], 1);
+    close(tochild[0]);
+    close(tochild[1]);
+    close(fromchild[0]);
+    close(fromchild[1]);
+    execvp(argv[i], &argv[i]);
+    perror(argv[i]);
+    _exit(127);
+  }
+  close(tochild[0]);
+  close(fromchild[1]);
+  childin = tochild[1];
+  childout = fromchild[0];
+  signal(SIGPIPE, SIG_IGN);
+
+  start = 0;
+  start = nsnow();
+  chansim_init(&csim, &profile);
+
+  while (childout >= 0 || q[1].head != q[1].tail) {
+    now = nsnow();
+    if (childin >= 0 && flush(&q[0], childin, now) < 0) {
+      close(childin);
+      childin = -1;
+    }
+    if (flush(&q[1], ttyout, now) < 0) {
+      break;
+    }
+    // The other side has gone and everything is delivered
+    if (ttyin < 0 && childin >= 0 && q[0].head == q[0].tail) {
+      close(childin);
+      childin = -1;
+    }
+
+    // Wait for input or for the next arrival
+    timo = -1;
+    for (n = 0; n < CHANSIM_DIRS; n++) {
+      if (q[n].head != q[n].tail) {
+        next = q[n].when[q[n].head & (QLEN - 1)] - now;
+        next = (next > 0) ? (next + 999999) / 1000000 : 0;
+        if (timo < 0 || next < timo) {
+          timo = (int)next;
+        }
+      }
+    }
+    pfd[0].fd = ttyin;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = childout;
+    pfd[1].events = POLLIN;
+    if (poll(pfd, 2, timo) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+    now = nsnow();
+    if (ttyin >= 0 && (pfd[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+      if (relay(0, ttyin, now) <= 0) {
+        ttyin = -1;
+      }
+    }
+    if (childout >= 0 && (pfd[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+      if (relay(1, childout, now) <= 0) {
+        close(childout);
+        childout = -1;
+      }
+    }
+  }
+  if (childin >= 0) {
+    close(childin);
+  }
+  status = 0;
+  waitpid(pid, &status, 0);
+  chansim_report(&csim, stderr, nsnow() / 1e9);
+  fprintf(stderr, "%s: %.3f sec\n", cmdname, nsnow() / 1e9);
+  exit(WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+}
@@ -0,0 +1,252 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// chansim.c
+// Fault-injecting channel simulator
+// Author: Kenji Rikitake
+
+// Bytes written to a direction of the channel are dropped, have a bit
+// flipped, or are duplicated at random with the probabilities of the
+// profile, and are given arrival times from the bandwidth cap and the
+// latency.  The random numbers come from the seed of the profile
+// only, so a run with the same input and profile is repeatable.
+//
+// A packet monitor follows the Kermit packets written to each
+// direction, before the faults, to count retransmissions (a packet
+// identical to the last one sent with the same sequence number) and
+// the recovery latency: the time from a fault to the next packet,
+// other than a NAK, sent for the first time in either direction and
+// begun after the fault.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chansim.h"
+
+#define SOH 1  /* Start of packet */
+#define EOM 13 /* End of packet */
+
+// xorshift64* random numbers
+
+static uint64_t rnext(struct chansim *c) {
+  c->rng ^= c->rng >> 12;
+  c->rng ^= c->rng << 25;
+  c->rng ^= c->rng >> 27;
+  return (c->rng * 0x2545F4914F6CDD1DULL);
+}
+
+// Uniform in [0, 1)
+
+static double runif(struct chansim *c) {
+  return ((rnext(c) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+// Parse one item of a profile.
+// Returns 0 on success, -1 on error.
+
+static int item(struct chansim_profile *pf, char *s) {
+  char *v;
+
+  v = strchr(s, '=');
+  if (!v) {
+    return (-1);
+  }
+  *v++ = '\0';
+  if (!strcmp(s, "seed")) {
+    pf->seed = strtoul(v, 0, 0);
+  } else if (!strcmp(s, "drop")) {
+    pf->drop = atof(v);
+  } else if (!strcmp(s, "flip")) {
+    pf->flip = atof(v);
+  } else if (!strcmp(s, "dup")) {
+    pf->dup = atof(v);
+  } else if (!strcmp(s, "latency")) {
+    pf->latency_us = (long)(atof(v) * 1000.0);
+  } else if (!strcmp(s, "bps")) {
+    pf->bps = atol(v);
+  } else {
+    return (-1);
+  }
+  return (0);
+}
+
+// Parse a profile string or @file.
+// Returns 0 on success, -1 on error.
+
+int chansim_parse(struct chansim_profile *pf, char *spec) {
+  char buf[4096], *s, *t;
+  FILE *fp;
+  size_t n;
+
+  memset(pf, 0, sizeof(*pf));
+  pf->seed = 1;
+  if (spec[0] == '@') {
+    fp = fopen(spec + 1, "r");
+    if (!fp) {
+      perror(spec + 1);
+      return (-1);
+    }
+    n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+  } else {
+    n = strlen(spec);
+    if (n > sizeof(buf) - 1) {
+      n = sizeof(buf) - 1;
+    }
+    memcpy(buf, spec, n);
+  }
+  buf[n] = '\0';
+  // Remove comments
+  for (s = buf; (s = strchr(s, '#')) != 0;) {
+    while (*s && *s != '\n') {
+      *s++ = ' ';
+    }
+  }
+  for (s = strtok_r(buf, ", \t\r\n", &t); s; s = strtok_r(0, ", \t\r\n", &t)) {
+    if (item(pf, s) < 0) {
+      fprintf(stderr, "chansim: bad profile item: %s\n", s);
+      return (-1);
+    }
+  }
+  return (0);
+}
+
+void chansim_init(struct chansim *c, struct chansim_profile *pf) {
+  memset(c, 0, sizeof(*c));
+  c->pf = *pf;
+  c->rng = pf->seed * 2654435761UL + 0x9E3779B97F4A7C15ULL;
+  if (c->rng == 0) {
+    c->rng = 1;
+  }
+  c->bytetime = (pf->bps > 0) ? 10000000000LL / pf->bps : 0;
+  c->faultt = -1;
+}
+
+// A whole packet was written to direction d at time now
+
+static void monpkt(struct chansim *c, struct chandir *d, int64_t now) {
+  struct chanmon *m = &d->mon;
+  int seq, type;
+
+  if (m->n < 3) {
+    return;
+  }
+  seq = (m->pkt[1] - 32) & 63;
+  type = m->pkt[2];
+  d->pkts++;
+  if (m->lastlen[seq] == m->n && !memcmp(m->last[seq], m->pkt, m->n)) {
+    d->retrpkts++;
+    d->retrbytes += m->n + 2;
+    return;
+  }
+  d->newpkts++;
+  if (type == 'D') {
+    d->databytes += m->n + 2;
+  }
+  memcpy(m->last[seq], m->pkt, m->n);
+  m->lastlen[seq] = m->n;
+  if (type != 'N' && m->after && c->faultt >= 0) { /* Recovered */
+    c->recoveries++;
+    c->recovsum += now - c->faultt;
+    if (now - c->faultt > c->recovmax) {
+      c->recovmax = now - c->faultt;
+    }
+    c->faultt = -1;
+  }
+}
+
+static void monitor(struct chansim *c, struct chandir *d, int64_t now,
+                    UCHAR x) {
+  struct chanmon *m = &d->mon;
+
+  if (x == SOH) {
+    m->flag = 1;
+    m->n = 0;
+    m->after = (c->faultt >= 0);
+  } else if (!m->flag) {
+    return;
+  } else if (x == EOM) {
+    monpkt(c, d, now);
+    m->flag = 0;
+  } else if (m->n < CHANSIM_PKTMAX) {
+    m->pkt[m->n++] = x;
+  } else {
+    m->flag = 0; /* Too long to follow */
+  }
+}
+
+// Write n bytes from in to direction dir at time now.
+// The bytes to deliver are stored in out, with their arrival times
+// in when; both must have room for 2 * n entries.
+// Returns the number of bytes to deliver.
+
+int chansim_send(struct chansim *c, int dir, int64_t now, UCHAR *in, int n,
+                 UCHAR *out, int64_t *when) {
+  struct chandir *d = &c->dir[dir];
+  int i, m, copies;
+  UCHAR x;
+
+  m = 0;
+  for (i = 0; i < n; i++) {
+    x = in[i];
+    d->bytes++;
+    monitor(c, d, now, x);
+    copies = 1;
+    if (c->pf.drop > 0.0 && runif(c) < c->pf.drop) {
+      d->drops++;
+      copies = 0;
+    } else {
+      if (c->pf.flip > 0.0 && runif(c) < c->pf.flip) {
+        d->flips++;
+        x ^= 1 << (rnext(c) & 7);
+      }
+      if (c->pf.dup > 0.0 && runif(c) < c->pf.dup) {
+        d->dups++;
+        copies = 2;
+      }
+    }
+    if ((copies != 1 || x != in[i]) && c->faultt < 0) {
+      c->faultt = now; /* Faulted */
+    }
+    while (copies-- > 0) {
+      if (d->depart < now) {
+        d->depart = now;
+      }
+      d->depart += c->bytetime;
+      out[m] = x;
+      when[m] = d->depart + c->pf.latency_us * 1000LL;
+      m++;
+    }
+  }
+  return (m);
+}
+
+// Print the statistics of a run lasting sec seconds
+
+void chansim_report(struct chansim *c, FILE *fp, double sec) {
+  struct chandir *d;
+  int i;
+
+  fprintf(fp,
+          "chansim: seed %lu, drop %g, flip %g, dup %g, latency %ld us, "
+          "%ld bps\n",
+          c->pf.seed, c->pf.drop, c->pf.flip, c->pf.dup, c->pf.latency_us,
+          c->pf.bps);
+  for (i = 0; i < CHANSIM_DIRS; i++) {
+    d = &c->dir[i];
+    fprintf(fp,
+            "chansim: dir %d: %ld bytes, %ld dropped, %ld flipped, "
+            "%ld duplicated\n",
+            i, d->bytes, d->drops, d->flips, d->dups);
+    fprintf(fp,
+            "chansim: dir %d: %ld packets, %ld retransmitted (%ld bytes), "
+            "%ld data bytes in new packets (%.0f bytes/sec)\n",
+            i, d->pkts, d->retrpkts, d->retrbytes, d->databytes,
+            (sec > 0.0) ? d->databytes / sec : 0.0);
+  }
+  fprintf(fp, "chansim: %ld recoveries, mean %.1f ms, max %.1f ms\n",
+          c->recoveries,
+          c->recoveries ? c->recovsum / 1e6 / c->recoveries : 0.0,
+          c->recovmax / 1e6);
+}
@@ -0,0 +1,73 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// chansim.h -- Fault-injecting channel simulator
+
+#ifndef __CHANSIM_H__
+#define __CHANSIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cdefs.h"
+
+// Fault profile, given as a string such as
+//   "seed=7,drop=1e-4,flip=1e-4,dup=1e-5,latency=20,bps=9600"
+// or as @file containing the same items separated by commas,
+// spaces or newlines, with # comments.
+
+struct chansim_profile {
+  unsigned long seed; /* Random seed */
+  double drop;        /* Probability of dropping a byte */
+  double flip;        /* Probability of flipping a bit in a byte */
+  double dup;         /* Probability of duplicating a byte */
+  long latency_us;    /* One-way latency */
+  long bps;           /* Bandwidth cap in bits/sec (10 bits/byte), 0 = none */
+};
+
+#define CHANSIM_DIRS (2)     /* Directions */
+#define CHANSIM_PKTMAX (512) /* Longest packet to follow */
+
+// Packet monitor of one direction, on the bytes before faults
+
+struct chanmon {
+  int flag;                            /* In a packet */
+  int n;                               /* Bytes in pkt */
+  int after;                           /* Begun after a fault */
+  UCHAR pkt[CHANSIM_PKTMAX];           /* Current packet */
+  UCHAR last[64][CHANSIM_PKTMAX];      /* Last packet for each sequence */
+  int lastlen[64];                     /* and its length */
+};
+
+struct chandir {
+  int64_t depart;    /* Time the last byte left */
+  long bytes;        /* Bytes given */
+  long drops;        /* Bytes dropped */
+  long flips;        /* Bytes with a bit flipped */
+  long dups;         /* Bytes duplicated */
+  long pkts;         /* Packets */
+  long newpkts;      /* Packets sent for the first time */
+  long retrpkts;     /* Retransmitted packets */
+  long retrbytes;    /* and their bytes */
+  long databytes;    /* Bytes of new data packets */
+  struct chanmon mon;
+};
+
+struct chansim {
+  struct chansim_profile pf;
+  uint64_t rng;     /* Random number state */
+  int64_t bytetime; /* Time of a byte on the line */
+  struct chandir dir[CHANSIM_DIRS];
+  int64_t faultt;   /* Time of the first unrecovered fault, -1 = none */
+  long recoveries;  /* Number of recoveries */
+  int64_t recovsum; /* Total recovery time */
+  int64_t recovmax; /* Longest recovery time */
+};
+
+int chansim_parse(struct chansim_profile *, char *);
+void chansim_init(struct chansim *, struct chansim_profile *);
+int chansim_send(struct chansim *, int, int64_t, UCHAR *, int, UCHAR *,
+                 int64_t *);
+void chansim_report(struct chansim *, FILE *, double);
+
+#endif /* __CHANSIM_H__ */
@@ -0,0 +1,404 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// corpus.c
+// Encoding-overhead benchmark corpus and runner
+// Author: Kenji Rikitake
+
+// With -g dir, kermit-corpus writes a corpus of typical file contents
+// into dir: zeros, random bytes, ASCII text, 6502 machine code and
+// 16x16 4-bit sprite graphics, generated from fixed seeds so that the
+// corpus is the same every time.  An already-compressed file is made
+// from the others with gzip by "make corpus".
+//
+// Otherwise, each file given is pushed through getpkt() and spkt()
+// of the protocol engine for each combination of negotiated packet
+// length, control prefixing, 8th-bit prefixing and repeat counts,
+// and the packets and wire bytes per payload byte are reported.
+
+#include "cdefs.h"  // Data types for all modules
+#include "debug.h"  // Debugging
+#include "kermit.h" // Kermit symbols and data structures
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in kermit.c (STATIC is empty)
+
+int getpkt(struct k_data *, struct k_response *);
+int spkt(char, short, int, UCHAR *, struct k_data *);
+void ctlmap(struct k_data *);
+
+static char *cmdname = "kermit-corpus";
+
+static struct k_data k;
+static struct k_response r;
+static UCHAR ibuf[IBUFLEN + 1];
+static UCHAR obuf[OBUFLEN + 1];
+
+static UCHAR *data;   /* File contents */
+static long datalen;  /* File length */
+static long datapos;  /* Read position */
+static long wire;     /* Bytes sent */
+
+// Random numbers from a fixed seed (xorshift32)
+
+static unsigned long rs;
+
+static unsigned long rnd(void) {
+  rs ^= (rs << 13) & 0xffffffffUL;
+  rs ^= rs >> 17;
+  rs ^= (rs << 5) & 0xffffffffUL;
+  return (rs);
+}
+
+// Corpus generators
+
+static void genzeros(UCHAR *p, long n) { memset(p, 0, n); }
+
+static void genrandom(UCHAR *p, long n) {
+  long i;
+
+  for (i = 0; i < n; i++) {
+    p[i] = rnd() & 0xff;
+  }
+}
+
+static void gentext(UCHAR *p, long n) {
+  static const char *words[] = {
+      "the",    "of",      "and",     "to",      "a",      "in",
+      "is",     "it",      "that",    "file",    "for",    "on",
+      "with",   "as",      "was",     "at",      "by",     "this",
+      "from",   "be",      "or",      "have",    "not",    "are",
+      "data",   "packet",  "Kermit",  "Neo6502", "board",  "serial",
+      "memory", "program", "transfer", "byte",   "screen", "sound",
+      "sprite", "level",   "player",  "score",   "table",  "value",
+      "when",   "which",   "will",    "each",    "into",   "then"};
+  long i, col;
+  const char *w;
+
+  col = 0;
+  i = 0;
+  while (i < n) {
+    w = words[rnd() % (sizeof(words) / sizeof(words[0]))];
+    if (col + (long)strlen(w) + 1 > 72) {
+      p[i++] = '\n';
+      col = 0;
+      continue;
+    }
+    if (col > 0) {
+      if (rnd() % 12 == 0 && i < n) {
+        p[i++] = (rnd() & 1) ? ',' : '.';
+        col++;
+      }
+      if (i < n) {
+        p[i++] = ' ';
+        col++;
+      }
+    }
+    while (*w && i < n) {
+      p[i++] = *w++;
+      col++;
+    }
+  }
+}
+
+// Synthetic 6502 code: instructions drawn with the frequencies of
+// typical compiled and hand-written code, with operands mostly in
+// page zero, in the program area, and in the I/O and API area.
+
+static void gencode(UCHAR *p, long n) {
+  static const struct {
+    UCHAR op;  /* Opcode */
+    int len;   /* Operand bytes */
+    int kind;  /* 0 imm, 1 zp, 2 abs, 3 rel, 4 none */
+    int w;     /* Weight */
+  } ops[] = {
+      {0xA9, 1, 0, 10}, {0xA5, 1, 1, 9}, {0x85, 1, 1, 9}, {0xAD, 2, 2, 5},
+      {0x8D, 2, 2, 5},  {0xB1, 1, 1, 4}, {0x91, 1, 1, 4}, {0xA2, 1, 0, 3},
+      {0xA0, 1, 0, 4},  {0x20, 2, 2, 7}, {0x60, 0, 4, 3}, {0x4C, 2, 2, 2},
+      {0xD0, 1, 3, 5},  {0xF0, 1, 3, 4}, {0x90, 1, 3, 2}, {0xB0, 1, 3, 2},
+      {0x18, 0, 4, 2},  {0x38, 0, 4, 2}, {0x69, 1, 0, 2}, {0xE9, 1, 0, 2},
+      {0xC9, 1, 0, 3},  {0xE8, 0, 4, 2}, {0xC8, 0, 4, 3}, {0x88, 0, 4, 2},
+      {0xCA, 0, 4, 1},  {0x48, 0, 4, 1}, {0x68, 0, 4, 1}, {0xAA, 0, 4, 1},
+      {0x8A, 0, 4, 1},  {0xA8, 0, 4, 1}, {0x98, 0, 4, 1}, {0xE6, 1, 1, 2},
+      {0x29, 1, 0, 1},  {0x09, 1, 0, 1}, {0x0A, 0, 4, 1}, {0x4A, 0, 4, 1},
+      {0x64, 1, 1, 2},  {0x9C, 2, 2, 1}, {0xBD, 2, 2, 2}, {0x9D, 2, 2, 1},
+  };
+  int nops = sizeof(ops) / sizeof(ops[0]);
+  int i, total, x;
+  long j;
+  unsigned int a;
+
+  total = 0;
+  for (i = 0; i < nops; i++) {
+    total += ops[i].w;
+  }
+  j = 0;
+  while (j < n) {
+    x = rnd() % total;
+    for (i = 0; x >= ops[i].w; i++) {
+      x -= ops[i].w;
+    }
+    p[j++] = ops[i].op;
+    switch (ops[i].kind) {
+    case 0: /* Immediate: small values and characters */
+      a = (rnd() & 1) ? rnd() % 16 : 32 + rnd() % 96;
+      break;
+    case 1: /* Page zero */
+      a = rnd() % 64;
+      break;
+    case 2: /* Program area, or API and I/O area */
+      a = (rnd() % 4) ? 0x0800 + rnd() % 0x3000 : 0xFF00 + rnd() % 16;
+      break;
+    case 3: /* Short branches */
+      a = (rnd() & 1) ? rnd() % 16 : 256 - 2 - rnd() % 32;
+      break;
+    default:
+      a = 0;
+      break;
+    }
+    if (ops[i].len >= 1 && j < n) {
+      p[j++] = a & 0xff;
+    }
+    if (ops[i].len >= 2 && j < n) {
+      p[j++] = (a >> 8) & 0xff;
+    }
+  }
+}
+
+// 16x16 sprites, 4 bits per pixel: a filled outline shape in a few
+// colours on a transparent (0) background.
+
+static void gentiles(UCHAR *p, long n) {
+  int x, y, c, fill, edge, px[16];
+  long i;
+  int r2, cx, cy, d;
+
+  i = 0;
+  while (i < n) {
+    cx = 5 + rnd() % 6;
+    cy = 5 + rnd() % 6;
+    r2 = 16 + rnd() % 30;
+    fill = 1 + rnd() % 15;
+    edge = 1 + rnd() % 15;
+    for (y = 0; y < 16; y++) {
+      for (x = 0; x < 16; x++) {
+        d = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+        if (d < r2 - 8) {
+          c = (rnd() % 8) ? fill : 1 + rnd() % 15;
+        } else if (d < r2) {
+          c = edge;
+        } else {
+          c = 0;
+        }
+        px[x] = c;
+      }
+      for (x = 0; x < 16 && i < n; x += 2) {
+        p[i++] = (px[x] << 4) | px[x + 1];
+      }
+    }
+  }
+}
+
+static const struct {
+  char *name;
+  void (*gen)(UCHAR *, long);
+  unsigned long seed;
+} corpus[] = {
+    {"zeros.bin", genzeros, 1},   {"random.bin", genrandom, 2},
+    {"text.txt", gentext, 3},     {"code6502.bin", gencode, 4},
+    {"sprites.bin", gentiles, 5},
+};
+
+static int generate(char *dir, long n) {
+  char path[1024];
+  UCHAR *p;
+  FILE *fp;
+  int i;
+
+  p = malloc(n);
+  if (!p) {
+    return (-1);
+  }
+  for (i = 0; i < (int)(sizeof(corpus) / sizeof(corpus[0])); i++) {
+    rs = corpus[i].seed * 2654435761UL & 0xffffffffUL;
+    corpus[i].gen(p, n);
+    snprintf(path, sizeof(path), "%s/%s", dir, corpus[i].name);
+    fp = fopen(path, "wb");
+    if (!fp || fwrite(p, 1, n, fp) != (size_t)n) {
+      perror(path);
+      free(p);
+      return (-1);
+    }
+    fclose(fp);
+  }
+  free(p);
+  return (0);
+}
+
+// I/O functions called by the engine
+
+static int tx_data(struct k_data *k, UCHAR *p, int n) {
+  wire += n;
+  return (X_OK);
+}
+
+static int readfile(struct k_data *k) {
+  long n;
+
+  if (khot(k)->zincnt < 1) {
+    n = datalen - datapos;
+    if (n > k->zinlen) {
+      n = k->zinlen;
+    }
+    if (n == 0) { /* EOF */
+      return (-1);
+    }
+    memcpy(k->zinbuf, data + datapos, n);
+    datapos += n;
+    khot(k)->zincnt = n;
+    khot(k)->zinptr = k->zinbuf;
+  }
+  (khot(k)->zincnt)--;
+  return (*(khot(k)->zinptr)++ & 0xff);
+}
+
+// Send the file with the given negotiated settings.
+// Returns the number of packets.
+
+static long run(int pktlen, int check, int prefixing, int ebq, int rpt) {
+  long pkts;
+  short seq;
+  int len;
+
+  memset(&k, 0, sizeof(k));
+  k.binary = 1;
+  k.zinbuf = ibuf;
+  k.zinlen = IBUFLEN;
+  k.obuf = obuf;
+  k.obuflen = OBUFLEN;
+  k.txd = tx_data;
+  k.readf = readfile;
+  (void)kermit(K_INIT, &k, 0, 0, "", &r);
+
+  // As negotiated
+  k.s_maxlen = pktlen;
+  k.bct = check;
+  k.prefixing = prefixing;
+  k.ebqflg = ebq;
+  k.ebq = '&';
+  k.rptflg = rpt;
+  k.rptq = '~';
+  ctlmap(&k);
+
+  // As opened by openfile()
+  datapos = 0;
+  k.s_first = 1;
+  k.zinbuf[0] = '\0';
+  khot(&k)->zinptr = k.zinbuf;
+  khot(&k)->zincnt = 0;
+  k.xdata = k.xdatabuf;
+
+  wire = 0;
+  pkts = 0;
+  seq = 1;
+  while ((len = getpkt(&k, &r)) > 0) {
+    (void)spkt('D', seq, len, k.xdata, &k);
+    seq = (seq + 1) & 63;
+    pkts++;
+  }
+  return (pkts);
+}
+
+static int readdata(char *file) {
+  FILE *fp;
+
+  fp = fopen(file, "rb");
+  if (!fp) {
+    perror(file);
+    return (-1);
+  }
+  fseek(fp, 0L, SEEK_END);
+  datalen = ftell(fp);
+  rewind(fp);
+  free(data);
+  data = malloc(datalen + 1);
+  if (!data || fread(data, 1, datalen, fp) != (size_t)datalen) {
+    perror(file);
+    fclose(fp);
+    return (-1);
+  }
+  fclose(fp);
+  return (0);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [-b n] file...\n"
+          "       %s -g dir [-n bytes]\n"
+          "  -b n      block check type 1, 2, or 3 (default 3)\n"
+          "  -g dir    write the corpus into dir\n"
+          "  -n bytes  length of each corpus file (default 65536)\n",
+          cmdname, cmdname);
+  exit(FAILURE);
+}
+
+int main(int argc, char **argv) {
+  static const int pktlens[] = {94, P_PKTLEN};
+  char *dir, *name;
+  long n, pkts;
+  int i, a, pfx, ebq, rpt, check, rc;
+
+  dir = 0;
+  n = 65536L;
+  check = 3;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-g")) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "-n")) {
+      n = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-b")) {
+      check = atoi(argv[++i]);
+      if ((check < 1) || (check > 3)) {
+        usage();
+      }
+    } else {
+      usage();
+    }
+  }
+  if (dir) {
+    exit((generate(dir, n) < 0) ? FAILURE : SUCCESS);
+  }
+  if (i >= argc) {
+    usage();
+  }
+
+  printf("# file              bytes pktlen pfx ebq rpt   pkts      wire"
+         "  wire/byte\n");
+  rc = SUCCESS;
+  for (; i < argc; i++) {
+    if (readdata(argv[i]) < 0) {
+      rc = FAILURE;
+      continue;
+    }
+    name = strrchr(argv[i], '/');
+    name = name ? name + 1 : argv[i];
+    for (a = 0; a < (int)(sizeof(pktlens) / sizeof(pktlens[0])); a++) {
+      for (pfx = PFX_ALL; pfx <= PFX_MINIMAL; pfx++) {
+        for (ebq = 0; ebq <= 1; ebq++) {
+          for (rpt = 0; rpt <= 1; rpt++) {
+            pkts = run(pktlens[a], check, pfx, ebq, rpt);
+            printf("%-16s %8ld %6d %3d %3d %3d %6ld %9ld %10.4f\n", name,
+                   datalen, pktlens[a], pfx, ebq, rpt, pkts, wire,
+                   datalen ? (double)wire / datalen : 0.0);
+          }
+        }
+      }
+    }
+  }
+  exit(rc);
+}
@@ -0,0 +1,716 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// cpu65c02.c
+// Cycle-counting W65C02S emulator
+// Author: Kenji Rikitake
+
+// The instruction set of the WDC W65C02S, including the Rockwell bit
+// instructions (RMB, SMB, BBR, BBS), WAI and STP, with the cycle
+// counts of the data sheet: a cycle more for indexing across a page
+// on reads, for a taken branch and a branch across a page, and for
+// ADC and SBC in decimal mode.  The undefined opcodes are NOPs of
+// the documented lengths and times.
+//
+// The memory is a flat 64K array; the caller handles anything else,
+// e.g. by trapping the program counter before each step.
+// Interrupts are not emulated.
+
+#include <string.h>
+
+#include "cpu65c02.h"
+
+// Base cycles of each opcode
+
+static const uint8_t cycles[256] = {
+    7, 6, 2, 1, 5, 3, 5, 5, 3, 2, 2, 1, 6, 4, 6, 5, /* 0x */
+    2, 5, 5, 1, 5, 4, 6, 5, 2, 4, 2, 1, 6, 4, 6, 5, /* 1x */
+    6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 4, 4, 6, 5, /* 2x */
+    2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 2, 1, 4, 4, 6, 5, /* 3x */
+    6, 6, 2, 1, 3, 3, 5, 5, 3, 2, 2, 1, 3, 4, 6, 5, /* 4x */
+    2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 1, 8, 4, 6, 5, /* 5x */
+    6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 6, 4, 6, 5, /* 6x */
+    2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 6, 4, 6, 5, /* 7x */
+    3, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5, /* 8x */
+    2, 6, 5, 1, 4, 4, 4, 5, 2, 5, 2, 1, 4, 5, 5, 5, /* 9x */
+    2, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5, /* Ax */
+    2, 5, 5, 1, 4, 4, 4, 5, 2, 4, 2, 1, 4, 4, 4, 5, /* Bx */
+    2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 3, 4, 4, 6, 5, /* Cx */
+    2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 3, 4, 4, 7, 5, /* Dx */
+    2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 1, 4, 4, 6, 5, /* Ex */
+    2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 4, 4, 7, 5, /* Fx */
+};
+
+void cpu65c02_reset(struct cpu65c02 *c, uint8_t *mem, uint16_t pc) {
+  memset(c, 0, sizeof(*c));
+  c->mem = mem;
+  c->pc = pc;
+  c->s = 0xff;
+  c->p = P_U | P_B | P_I;
+}
+
+void cpu65c02_push(struct cpu65c02 *c, uint8_t v) {
+  c->mem[0x100 | c->s] = v;
+  c->s--;
+}
+
+uint8_t cpu65c02_pull(struct cpu65c02 *c) {
+  c->s++;
+  return (c->mem[0x100 | c->s]);
+}
+
+#define M (c->mem)
+#define RD16(a) (M[(a)&0xffff] | (M[((a) + 1) & 0xffff] << 8))
+#define RDZP16(a) (M[(a)&0xff] | (M[((a) + 1) & 0xff] << 8))
+#define SETNZ(v)                                                               \
+  (c->p = (c->p & ~(P_N | P_Z)) | ((v)&P_N) | (((v)&0xff) ? 0 : P_Z))
+#define SETC(f) (c->p = (f) ? (c->p | P_C) : (c->p & ~P_C))
+#define SETV(f) (c->p = (f) ? (c->p | P_V) : (c->p & ~P_V))
+
+// Effective addresses; the indexed ones note a page crossing in pg
+
+#define ZP() (M[c->pc++])
+#define ZPX() ((M[c->pc++] + c->x) & 0xff)
+#define ZPY() ((M[c->pc++] + c->y) & 0xff)
+
+static uint16_t absa(struct cpu65c02 *c) {
+  uint16_t ea = RD16(c->pc);
+  c->pc += 2;
+  return (ea);
+}
+
+static uint16_t absi(struct cpu65c02 *c, uint8_t i, int *pg) {
+  uint16_t base = RD16(c->pc);
+  uint16_t ea = base + i;
+  c->pc += 2;
+  *pg = ((base ^ ea) & 0xff00) ? 1 : 0;
+  return (ea);
+}
+
+static uint16_t izx(struct cpu65c02 *c) {
+  uint8_t z = M[c->pc++] + c->x;
+  return (RDZP16(z));
+}
+
+static uint16_t izy(struct cpu65c02 *c, int *pg) {
+  uint16_t base = RDZP16(M[c->pc]);
+  uint16_t ea = base + c->y;
+  c->pc++;
+  *pg = ((base ^ ea) & 0xff00) ? 1 : 0;
+  return (ea);
+}
+
+static uint16_t izp(struct cpu65c02 *c) {
+  uint16_t ea = RDZP16(M[c->pc]);
+  c->pc++;
+  return (ea);
+}
+
+// ALU
+
+static int adc(struct cpu65c02 *c, uint8_t m) {
+  unsigned int a = c->a, t, cy = c->p & P_C;
+
+  if (c->p & P_D) {
+    t = (a & 0x0f) + (m & 0x0f) + cy;
+    if (t > 0x09) {
+      t += 0x06;
+    }
+    t = (t & 0x0f) + (a & 0xf0) + (m & 0xf0) + ((t > 0x0f) ? 0x10 : 0);
+    SETV(!((a ^ m) & 0x80) && ((a ^ t) & 0x80));
+    if ((t & 0x1f0) > 0x90) {
+      t += 0x60;
+    }
+    SETC((t & 0xff0) > 0xf0);
+    c->a = t & 0xff;
+    SETNZ(c->a);
+    return (1);
+  }
+  t = a + m + cy;
+  SETV(~(a ^ m) & (a ^ t) & 0x80);
+  SETC(t > 0xff);
+  c->a = t & 0xff;
+  SETNZ(c->a);
+  return (0);
+}
+
+static int sbc(struct cpu65c02 *c, uint8_t m) {
+  int a = c->a, t, lo, hi, b = (c->p & P_C) ? 0 : 1;
+
+  t = a - m - b;
+  SETV((a ^ m) & (a ^ t) & 0x80);
+  if (c->p & P_D) {
+    lo = (a & 0x0f) - (m & 0x0f) - b;
+    hi = (a >> 4) - (m >> 4);
+    if (lo < 0) {
+      lo -= 6;
+      hi--;
+    }
+    if (hi < 0) {
+      hi -= 6;
+    }
+    SETC(t >= 0);
+    c->a = ((hi << 4) | (lo & 0x0f)) & 0xff;
+    SETNZ(c->a);
+    return (1);
+  }
+  SETC(t >= 0);
+  c->a = t & 0xff;
+  SETNZ(c->a);
+  return (0);
+}
+
+static void cmp(struct cpu65c02 *c, uint8_t r, uint8_t m) {
+  SETC(r >= m);
+  SETNZ((uint8_t)(r - m));
+}
+
+static void bit(struct cpu65c02 *c, uint8_t m) {
+  c->p = (c->p & ~(P_N | P_V | P_Z)) | (m & (P_N | P_V)) |
+         ((c->a & m) ? 0 : P_Z);
+}
+
+static uint8_t asl(struct cpu65c02 *c, uint8_t v) {
+  SETC(v & 0x80);
+  v <<= 1;
+  SETNZ(v);
+  return (v);
+}
+
+static uint8_t lsr(struct cpu65c02 *c, uint8_t v) {
+  SETC(v & 0x01);
+  v >>= 1;
+  SETNZ(v);
+  return (v);
+}
+
+static uint8_t rol(struct cpu65c02 *c, uint8_t v) {
+  uint8_t cy = c->p & P_C;
+  SETC(v & 0x80);
+  v = (v << 1) | cy;
+  SETNZ(v);
+  return (v);
+}
+
+static uint8_t ror(struct cpu65c02 *c, uint8_t v) {
+  uint8_t cy = (c->p & P_C) ? 0x80 : 0;
+  SETC(v & 0x01);
+  v = (v >> 1) | cy;
+  SETNZ(v);
+  return (v);
+}
+
+// Relative branch; returns the extra cycles
+
+static int branch(struct cpu65c02 *c, int cond) {
+  int8_t d = (int8_t)M[c->pc++];
+  uint16_t t;
+
+  if (!cond) {
+    return (0);
+  }
+  t = c->pc + d;
+  d = ((t ^ c->pc) & 0xff00) ? 2 : 1;
+  c->pc = t;
+  return (d);
+}
+
+// Effective address of the ALU group (ORA, AND, EOR, ADC, STA, LDA, CMP,
+// SBC); returns 1 on a page crossing
+
+static int operand(struct cpu65c02 *c, uint8_t op, uint16_t *ea) {
+  int pg = 0;
+
+  switch (op & 0x1f) {
+  case 0x01:
+    *ea = izx(c);
+    break;
+  case 0x05:
+    *ea = ZP();
+    break;
+  case 0x09:
+    *ea = c->pc++;
+    break;
+  case 0x0d:
+    *ea = absa(c);
+    break;
+  case 0x11:
+    *ea = izy(c, &pg);
+    break;
+  case 0x12:
+    *ea = izp(c);
+    break;
+  case 0x15:
+    *ea = ZPX();
+    break;
+  case 0x19:
+    *ea = absi(c, c->y, &pg);
+    break;
+  default: /* 0x1d */
+    *ea = absi(c, c->x, &pg);
+    break;
+  }
+  return (pg);
+}
+
+// The ALU group; returns the extra cycles
+
+static int alu(struct cpu65c02 *c, uint8_t op) {
+  uint16_t ea;
+  int pg;
+
+  pg = operand(c, op, &ea);
+  switch (op >> 5) {
+  case 0: /* ORA */
+    c->a |= M[ea];
+    SETNZ(c->a);
+    break;
+  case 1: /* AND */
+    c->a &= M[ea];
+    SETNZ(c->a);
+    break;
+  case 2: /* EOR */
+    c->a ^= M[ea];
+    SETNZ(c->a);
+    break;
+  case 3: /* ADC */
+    pg += adc(c, M[ea]);
+    break;
+  case 4: /* STA, no page penalty */
+    M[ea] = c->a;
+    pg = 0;
+    break;
+  case 5: /* LDA */
+    c->a = M[ea];
+    SETNZ(c->a);
+    break;
+  case 6: /* CMP */
+    cmp(c, c->a, M[ea]);
+    break;
+  default: /* SBC */
+    pg += sbc(c, M[ea]);
+    break;
+  }
+  return (pg);
+}
+
+// Read-modify-write on memory (ASL, ROL, LSR, ROR, DEC, INC);
+// returns the extra cycles
+
+static int rmw(struct cpu65c02 *c, uint8_t op) {
+  uint16_t ea;
+  uint8_t v;
+  int pg = 0;
+
+  switch (op & 0x18) {
+  case 0x00:
+    ea = ZP();
+    break;
+  case 0x08:
+    ea = absa(c);
+    break;
+  case 0x10:
+    ea = ZPX();
+    break;
+  default:
+    ea = absi(c, c->x, &pg);
+    break;
+  }
+  v = M[ea];
+  switch (op >> 5) {
+  case 0:
+    v = asl(c, v);
+    break;
+  case 1:
+    v = rol(c, v);
+    break;
+  case 2:
+    v = lsr(c, v);
+    break;
+  case 3:
+    v = ror(c, v);
+    break;
+  case 6:
+    v--;
+    SETNZ(v);
+    pg = 0; /* DEC abs,x always takes 7 */
+    break;
+  default:
+    v++;
+    SETNZ(v);
+    pg = 0;
+    break;
+  }
+  M[ea] = v;
+  return (pg);
+}
+
+// Execute one instruction; returns its cycles
+
+int cpu65c02_step(struct cpu65c02 *c) {
+  uint8_t op, v;
+  uint16_t ea;
+  int n, pg;
+
+  if (c->stopped) {
+    c->cycles++;
+    return (1);
+  }
+  op = M[c->pc++];
+  n = cycles[op];
+
+  if (((op & 0x03) == 0x01) || ((op & 0x1f) == 0x12)) {
+    n += alu(c, op);
+    c->cycles += n;
+    return (n);
+  }
+  if (((op & 0x07) == 0x06) && ((op >> 5) != 4) && ((op >> 5) != 5)) {
+    n += rmw(c, op);
+    c->cycles += n;
+    return (n);
+  }
+
+  switch (op) {
+  // Accumulator
+  case 0x0a:
+    c->a = asl(c, c->a);
+    break;
+  case 0x2a:
+    c->a = rol(c, c->a);
+    break;
+  case 0x4a:
+    c->a = lsr(c, c->a);
+    break;
+  case 0x6a:
+    c->a = ror(c, c->a);
+    break;
+  case 0x1a:
+    c->a++;
+    SETNZ(c->a);
+    break;
+  case 0x3a:
+    c->a--;
+    SETNZ(c->a);
+    break;
+
+  // Index registers
+  case 0xe8:
+    c->x++;
+    SETNZ(c->x);
+    break;
+  case 0xca:
+    c->x--;
+    SETNZ(c->x);
+    break;
+  case 0xc8:
+    c->y++;
+    SETNZ(c->y);
+    break;
+  case 0x88:
+    c->y--;
+    SETNZ(c->y);
+    break;
+  case 0xa2:
+    c->x = M[c->pc++];
+    SETNZ(c->x);
+    break;
+  case 0xa6:
+    c->x = M[ZP()];
+    SETNZ(c->x);
+    break;
+  case 0xb6:
+    c->x = M[ZPY()];
+    SETNZ(c->x);
+    break;
+  case 0xae:
+    c->x = M[absa(c)];
+    SETNZ(c->x);
+    break;
+  case 0xbe:
+    ea = absi(c, c->y, &pg);
+    n += pg;
+    c->x = M[ea];
+    SETNZ(c->x);
+    break;
+  case 0xa0:
+    c->y = M[c->pc++];
+    SETNZ(c->y);
+    break;
+  case 0xa4:
+    c->y = M[ZP()];
+    SETNZ(c->y);
+    break;
+  case 0xb4:
+    c->y = M[ZPX()];
+    SETNZ(c->y);
+    break;
+  case 0xac:
+    c->y = M[absa(c)];
+    SETNZ(c->y);
+    break;
+  case 0xbc:
+    ea = absi(c, c->x, &pg);
+    n += pg;
+    c->y = M[ea];
+    SETNZ(c->y);
+    break;
+  case 0x86:
+    M[ZP()] = c->x;
+    break;
+  case 0x96:
+    M[ZPY()] = c->x;
+    break;
+  case 0x8e:
+    M[absa(c)] = c->x;
+    break;
+  case 0x84:
+    M[ZP()] = c->y;
+    break;
+  case 0x94:
+    M[ZPX()] = c->y;
+    break;
+  case 0x8c:
+    M[absa(c)] = c->y;
+    break;
+  case 0xe0:
+    cmp(c, c->x, M[c->pc++]);
+    break;
+  case 0xe4:
+    cmp(c, c->x, M[ZP()]);
+    break;
+  case 0xec:
+    cmp(c, c->x, M[absa(c)]);
+    break;
+  case 0xc0:
+    cmp(c, c->y, M[c->pc++]);
+    break;
+  case 0xc4:
+    cmp(c, c->y, M[ZP()]);
+    break;
+  case 0xcc:
+    cmp(c, c->y, M[absa(c)]);
+    break;
+
+  // Store zero
+  case 0x64:
+    M[ZP()] = 0;
+    break;
+  case 0x74:
+    M[ZPX()] = 0;
+    break;
+  case 0x9c:
+    M[absa(c)] = 0;
+    break;
+  case 0x9e:
+    M[absi(c, c->x, &pg)] = 0;
+    break;
+
+  // Transfers
+  case 0xaa:
+    c->x = c->a;
+    SETNZ(c->x);
+    break;
+  case 0x8a:
+    c->a = c->x;
+    SETNZ(c->a);
+    break;
+  case 0xa8:
+    c->y = c->a;
+    SETNZ(c->y);
+    break;
+  case 0x98:
+    c->a = c->y;
+    SETNZ(c->a);
+    break;
+  case 0xba:
+    c->x = c->s;
+    SETNZ(c->x);
+    break;
+  case 0x9a:
+    c->s = c->x;
+    break;
+
+  // Bit tests
+  case 0x89: /* BIT # sets Z only */
+    c->p = (c->p & ~P_Z) | ((c->a & M[c->pc++]) ? 0 : P_Z);
+    break;
+  case 0x24:
+    bit(c, M[ZP()]);
+    break;
+  case 0x34:
+    bit(c, M[ZPX()]);
+    break;
+  case 0x2c:
+    bit(c, M[absa(c)]);
+    break;
+  case 0x3c:
+    ea = absi(c, c->x, &pg);
+    n += pg;
+    bit(c, M[ea]);
+    break;
+  case 0x04: /* TSB */
+  case 0x0c:
+    ea = (op == 0x04) ? ZP() : absa(c);
+    c->p = (c->p & ~P_Z) | ((c->a & M[ea]) ? 0 : P_Z);
+    M[ea] |= c->a;
+    break;
+  case 0x14: /* TRB */
+  case 0x1c:
+    ea = (op == 0x14) ? ZP() : absa(c);
+    c->p = (c->p & ~P_Z) | ((c->a & M[ea]) ? 0 : P_Z);
+    M[ea] &= ~c->a;
+    break;
+
+  // Branches and jumps
+  case 0x10:
+    n += branch(c, !(c->p & P_N));
+    break;
+  case 0x30:
+    n += branch(c, c->p & P_N);
+    break;
+  case 0x50:
+    n += branch(c, !(c->p & P_V));
+    break;
+  case 0x70:
+    n += branch(c, c->p & P_V);
+    break;
+  case 0x90:
+    n += branch(c, !(c->p & P_C));
+    break;
+  case 0xb0:
+    n += branch(c, c->p & P_C);
+    break;
+  case 0xd0:
+    n += branch(c, !(c->p & P_Z));
+    break;
+  case 0xf0:
+    n += branch(c, c->p & P_Z);
+    break;
+  case 0x80: /* BRA: the taken cycle is in the base */
+    n += branch(c, 1) - 1;
+    break;
+  case 0x4c:
+    c->pc = absa(c);
+    break;
+  case 0x6c:
+    ea = absa(c);
+    c->pc = RD16(ea);
+    break;
+  case 0x7c:
+    ea = absa(c) + c->x;
+    c->pc = RD16(ea);
+    break;
+  case 0x20:
+    ea = absa(c);
+    c->pc--;
+    cpu65c02_push(c, c->pc >> 8);
+    cpu65c02_push(c, c->pc & 0xff);
+    c->pc = ea;
+    break;
+  case 0x60:
+    ea = cpu65c02_pull(c);
+    ea |= cpu65c02_pull(c) << 8;
+    c->pc = ea + 1;
+    break;
+  case 0x40:
+    c->p = cpu65c02_pull(c) | P_U | P_B;
+    ea = cpu65c02_pull(c);
+    ea |= cpu65c02_pull(c) << 8;
+    c->pc = ea;
+    break;
+  case 0x00:
+    c->pc++;
+    cpu65c02_push(c, c->pc >> 8);
+    cpu65c02_push(c, c->pc & 0xff);
+    cpu65c02_push(c, c->p | P_U | P_B);
+    c->p = (c->p | P_I) & ~P_D;
+    c->pc = RD16(0xfffe);
+    break;
+
+  // Stack
+  case 0x48:
+    cpu65c02_push(c, c->a);
+    break;
+  case 0x68:
+    c->a = cpu65c02_pull(c);
+    SETNZ(c->a);
+    break;
+  case 0xda:
+    cpu65c02_push(c, c->x);
+    break;
+  case 0xfa:
+    c->x = cpu65c02_pull(c);
+    SETNZ(c->x);
+    break;
+  case 0x5a:
+    cpu65c02_push(c, c->y);
+    break;
+  case 0x7a:
+    c->y = cpu65c02_pull(c);
+    SETNZ(c->y);
+    break;
+  case 0x08:
+    cpu65c02_push(c, c->p | P_U | P_B);
+    break;
+  case 0x28:
+    c->p = cpu65c02_pull(c) | P_U | P_B;
+    break;
+
+  // Flags
+  case 0x18:
+    c->p &= ~P_C;
+    break;
+  case 0x38:
+    c->p |= P_C;
+    break;
+  case 0x58:
+    c->p &= ~P_I;
+    break;
+  case 0x78:
+    c->p |= P_I;
+    break;
+  case 0xb8:
+    c->p &= ~P_V;
+    break;
+  case 0xd8:
+    c->p &= ~P_D;
+    break;
+  case 0xf8:
+    c->p |= P_D;
+    break;
+
+  // Processor control
+  case 0xcb: /* WAI: no interrupts to wait for */
+  case 0xdb: /* STP */
+    c->stopped = 1;
+    break;
+  case 0xea:
+    break;
+
+  default:
+    switch (op & 0x0f) {
+    case 0x07: /* RMB, SMB */
+      ea = ZP();
+      v = 1 << ((op >> 4) & 7);
+      M[ea] = (op & 0x80) ? (M[ea] | v) : (M[ea] & ~v);
+      break;
+    case 0x0f: /* BBR, BBS */
+      ea = ZP();
+      v = M[ea] & (1 << ((op >> 4) & 7));
+      n += branch(c, (op & 0x80) ? v : !v);
+      break;
+    case 0x02: /* NOP #, 2 bytes */
+    case 0x04: /* NOP zp and zp,x, 2 bytes */
+      c->pc++;
+      break;
+    case 0x0c: /* NOP abs, 3 bytes */
+      c->pc += 2;
+      break;
+    default: /* NOP, 1 byte */
+      break;
+    }
+    break;
+  }
+  c->cycles += n;
+  return (n);
+}
@@ -0,0 +1,34 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// cpu65c02.h -- Cycle-counting W65C02S emulator
+
+#ifndef __CPU65C02_H__
+#define __CPU65C02_H__
+
+#include <stdint.h>
+
+// Processor status bits
+#define P_N (0x80)
+#define P_V (0x40)
+#define P_U (0x20)
+#define P_B (0x10)
+#define P_D (0x08)
+#define P_I (0x04)
+#define P_Z (0x02)
+#define P_C (0x01)
+
+struct cpu65c02 {
+  uint8_t *mem;    /* 64K bytes of RAM */
+  uint16_t pc;     /* Registers */
+  uint8_t a, x, y, s, p;
+  uint64_t cycles; /* Cycles run */
+  int stopped;     /* Stopped by STP or WAI */
+};
+
+void cpu65c02_reset(struct cpu65c02 *, uint8_t *, uint16_t);
+int cpu65c02_step(struct cpu65c02 *);
+void cpu65c02_push(struct cpu65c02 *, uint8_t);
+uint8_t cpu65c02_pull(struct cpu65c02 *);
+
+#endif /* __CPU65C02_H__ */
@@ -0,0 +1,277 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// kcapture.c
+// Decoder of the binary packet capture file (KCAPTURE.BIN)
+// Author: Kenji Rikitake
+
+// The capture is written by dodebug() in neoio.c or posixio.c when
+// built with -DDEBUG; see capture.h for the format.  Each packet is
+// shown as a table row with its time since the first packet in the
+// file, the time since the previous one, the direction, the sequence
+// number, the type, the length, the verdict of the block check for
+// the packets received, and the bytes after the type field.  A summary
+// of the packets and the longest gaps between them follows.
+
+#include "cdefs.h"   // Data types for all modules
+#include "kermit.h"  // Kermit symbols and data structures
+#include "capture.h" // Capture format
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char *cmdname = "kermit-capture";
+
+// Timer ticks per second
+#define CAPTURE_HZ (100.0)
+
+// Longest gaps kept for the summary
+#define NGAPS (5)
+
+static int allbytes = 0; /* Show all the bytes (-a) */
+static int width = 40;   /* Otherwise show this many columns (-w) */
+static int mingap = 0;   /* Mark the gaps of this many ticks (-g) */
+
+// A packet record waiting for its verdict
+
+struct row {
+  struct capture_record r;
+  UCHAR buf[65536];
+  int valid;
+};
+
+// Totals of a file
+
+struct totals {
+  long packets[3];  /* Received, sent, retransmitted */
+  long bytes[3];    /* Packet bytes of each */
+  long verdicts[5]; /* Received packets by verdict */
+  double gap[NGAPS];
+  long gapat[NGAPS]; /* Row numbers of the gaps */
+  long rows;
+};
+
+static const char *kindname(int kind) {
+  switch (kind) {
+  case CAP_RECV:
+    return ("recv");
+  case CAP_SEND:
+    return ("send");
+  case CAP_RESEND:
+    return ("resend");
+  default:
+    return ("?");
+  }
+}
+
+static const char *verdictname(int verdict) {
+  static const char *names[] = {"-", "ok", "short", "badhdr", "badchk"};
+
+  return ((verdict >= 0) && (verdict <= CAP_BADCHK)) ? names[verdict] : "?";
+}
+
+static int kindindex(int kind) {
+  return (kind == CAP_RECV) ? 0 : (kind == CAP_SEND) ? 1 : 2;
+}
+
+// Show the bytes with control and 8-bit characters made visible
+
+static void showbytes(const UCHAR *s, int n) {
+  int col, c;
+  char tmp[8];
+
+  for (col = 0; n > 0; s++, n--) {
+    c = *s;
+    if (c >= 128) {
+      snprintf(tmp, sizeof(tmp), "\\x%02x", c);
+    } else if ((c < 32) || (c == 127)) {
+      snprintf(tmp, sizeof(tmp), "^%c", c ^ 64);
+    } else {
+      snprintf(tmp, sizeof(tmp), "%c", c);
+    }
+    col += strlen(tmp);
+    if (!allbytes && (col > width)) {
+      fputs("...", stdout);
+      break;
+    }
+    fputs(tmp, stdout);
+  }
+}
+
+// Keep the longest gaps, sorted
+
+static void keepgap(struct totals *t, double dt) {
+  int i, j;
+
+  for (i = 0; i < NGAPS; i++) {
+    if (dt > t->gap[i]) {
+      for (j = NGAPS - 1; j > i; j--) {
+        t->gap[j] = t->gap[j - 1];
+        t->gapat[j] = t->gapat[j - 1];
+      }
+      t->gap[i] = dt;
+      t->gapat[i] = t->rows;
+      return;
+    }
+  }
+}
+
+static void showrow(struct row *w, struct totals *t, double time, double dt) {
+  const UCHAR *b = w->buf;
+  int n = w->r.len, i;
+
+  i = kindindex(w->r.kind);
+  t->packets[i]++;
+  t->bytes[i] += n;
+  if (w->r.kind == CAP_RECV) {
+    t->verdicts[(w->r.verdict <= CAP_BADCHK) ? w->r.verdict : 0]++;
+  }
+  t->rows++;
+  keepgap(t, dt);
+  printf("%5ld %9.2f %8.2f%c %-6s ", t->rows, time, dt,
+         (mingap && (dt * CAPTURE_HZ >= mingap)) ? '*' : ' ',
+         kindname(w->r.kind));
+  if (n >= 3) {
+    printf("%3d  %c  %4d %-6s  ", xunchar(b[1]),
+           ((b[2] > 32) && (b[2] < 127)) ? b[2] : '?', n,
+           (w->r.kind == CAP_RECV) ? verdictname(w->r.verdict) : "");
+    showbytes(&b[3], n - 3);
+  } else {
+    printf("  -  -  %4d %-6s  ", n,
+           (w->r.kind == CAP_RECV) ? verdictname(w->r.verdict) : "");
+    showbytes(b, n);
+  }
+  putchar('\n');
+  w->valid = 0;
+}
+
+static void summary(struct totals *t) {
+  int i;
+
+  printf("\n%ld received (%ld bytes), %ld sent (%ld bytes), "
+         "%ld retransmitted (%ld bytes)\n",
+         t->packets[0], t->bytes[0], t->packets[1], t->bytes[1], t->packets[2],
+         t->bytes[2]);
+  printf("Received: %ld ok, %ld short, %ld bad header, %ld bad check, "
+         "%ld unchecked\n",
+         t->verdicts[CAP_OK], t->verdicts[CAP_SHORT], t->verdicts[CAP_BADHDR],
+         t->verdicts[CAP_BADCHK], t->verdicts[CAP_UNCHECKED]);
+  printf("Longest gaps:");
+  for (i = 0; (i < NGAPS) && (t->gap[i] > 0.0); i++) {
+    printf(" %.2f s before #%ld%s", t->gap[i], t->gapat[i],
+           (i < NGAPS - 1) && (t->gap[i + 1] > 0.0) ? "," : "");
+  }
+  printf("\n");
+}
+
+static int decode(const char *file) {
+  FILE *fp;
+  UCHAR head[4], h[sizeof(struct capture_record)];
+  struct capture_record r;
+  static struct row w;
+  struct totals t;
+  unsigned int prev;
+  double time, dt, wtime, wdt;
+  int first;
+
+  fp = fopen(file, "rb");
+  if (!fp) {
+    perror(file);
+    return (-1);
+  }
+  if ((fread(head, 1, sizeof(head), fp) != sizeof(head)) ||
+      memcmp(head, CAPTURE_MAGIC, 4)) {
+    fprintf(stderr, "%s: %s: not a capture file\n", cmdname, file);
+    fclose(fp);
+    return (-1);
+  }
+  printf("%s:\n", file);
+  printf("%5s %9s %8s  %-6s %3s %4s %4s %-6s  %s\n", "#", "time", "+dt",
+         "dir", "seq", "type", "len", "check", "bytes after type");
+  memset(&t, 0, sizeof(t));
+  w.valid = 0;
+  time = wtime = wdt = 0.0;
+  prev = 0;
+  first = 1;
+  while (fread(h, 1, sizeof(h), fp) == sizeof(h)) {
+    r.kind = h[0];
+    r.verdict = h[1];
+    r.len = h[2] | (h[3] << 8);
+    r.time = h[4] | (h[5] << 8);
+    if (r.kind == CAP_VERDICT) {
+      if (w.valid && (w.r.kind == CAP_RECV)) {
+        w.r.verdict = r.verdict;
+        showrow(&w, &t, wtime, wdt);
+      }
+      continue;
+    }
+    if (w.valid) {
+      showrow(&w, &t, wtime, wdt);
+    }
+    if (fread(w.buf, 1, r.len, fp) != r.len) {
+      fprintf(stderr, "%s: %s: truncated\n", cmdname, file);
+      break;
+    }
+    // The time wraps around at 65536 ticks
+    dt = first ? 0.0 : ((r.time - prev) & 0xffff) / CAPTURE_HZ;
+    first = 0;
+    time += dt;
+    prev = r.time;
+    w.r = r;
+    w.r.verdict = CAP_UNCHECKED;
+    w.valid = 1;
+    wtime = time;
+    wdt = dt;
+  }
+  if (w.valid) {
+    showrow(&w, &t, wtime, wdt);
+  }
+  fclose(fp);
+  summary(&t);
+  return (0);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [-a] [-w columns] [-g ticks] [file...]\n"
+          "  -a: show all the bytes of each packet\n"
+          "  -w: show this many columns of bytes (default %d)\n"
+          "  -g: mark the gaps of this many 10-ms ticks or longer with *\n"
+          "  (default file: %s)\n",
+          cmdname, width, CAPTURE_FILE);
+  exit(EXIT_FAILURE);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  int c, i, rc;
+
+  while ((c = getopt(argc, argv, "aw:g:")) != -1) {
+    switch (c) {
+    case 'a':
+      allbytes = 1;
+      break;
+    case 'w':
+      width = atoi(optarg);
+      break;
+    case 'g':
+      mingap = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind >= argc) {
+    return (decode(CAPTURE_FILE) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  rc = EXIT_SUCCESS;
+  for (i = optind; i < argc; i++) {
+    if (decode(argv[i]) < 0) {
+      rc = EXIT_FAILURE;
+    }
+  }
+  return (rc);
+}
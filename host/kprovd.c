@@ -0,0 +1,548 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// kprovd.c
+// Transfer daemon driving many serial ports at once
+// Author: Kenji Rikitake
+
+// Each port (a tty or pty, or a command run for each job as a stand-in
+// for a board) has an engine (kermit.c) of its own, with a session of
+// the host I/O backend (posixio.c) for sending packets and for the
+// files.  A single poll() loop waits on all the ports at once: the
+// bytes that have come in are given to the engine of the port with
+// kermit_feed(), which frames them into packets and runs them, and a
+// port with nothing coming in for its timeout gets a kermit_feed() of
+// nothing, as from readpkt().  No port ever blocks another one.
+//
+// The jobs, one batch to send or to receive for a board each, are read
+// from a file or a pipe, also while the ports are running, and each
+// port takes the next job in the queue as soon as it is free, so the
+// total time goes with the number of jobs per port.
+
+#include "cdefs.h"   // Data types for all modules
+#include "debug.h"   // Debugging
+#include "kermit.h"  // Kermit symbols and data structures
+#include "kio.h"     // I/O backend (posixio.c)
+#include "posixio.h" // Sessions of the backend
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static char *cmdname = "kermit-provd";
+
+#define PORTMAX (64)   /* Ports */
+#define JOBMAX (4096)  /* Jobs in the queue */
+#define FILEMAX (32)   /* Files of a job */
+#define JOBLINE (1024) /* Length of a job line */
+#define READLEN (1024) /* Bytes read from a port at once */
+
+// A job: a batch of files to send to a board, or to receive from it
+
+struct job {
+  int action;                /* A_SEND or A_RECV */
+  char *dir;                 /* Directory of the files */
+  UCHAR *files[FILEMAX + 1]; /* Files to send */
+  int line;                  /* Line of the job source */
+  int status;                /* X_DONE or X_ERROR when run */
+  long bytes;                /* File bytes transferred */
+  double secs;               /* Time taken */
+};
+
+// A port with its engine.  The k_data structure must be the first
+// member, since the I/O functions are called with a pointer to it.
+
+struct port {
+  struct k_data k;
+  struct k_response r;
+  struct k_io io;
+  int fd;            /* Line, or -1 for a command */
+  char *peer;        /* Command run for each job, or 0 */
+  pid_t pid;         /* Process of the command */
+  struct job *job;   /* Job running, or 0 */
+  double deadline;   /* Time of the next timeout */
+  double start;      /* Time the job started */
+  int jobs;          /* Jobs run */
+  double busy;       /* Time spent on them */
+};
+
+static struct port ports[PORTMAX];
+static int nports = 0;
+
+static struct job jobs[JOBMAX];
+static int njobs = 0;  /* Jobs read */
+static int nextjob = 0; /* Next job to run */
+static int jobfd = -1;  /* Job source, -1 after its end */
+static char jbuf[JOBLINE];
+static int jlen = 0;
+static int jline = 0;
+
+static char *topdir = "."; /* Default directory of the files */
+static int check = 3;      /* Block check type */
+static int verbose = 0;
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+// Exit function for the I/O backend
+
+void doexit(int status) { exit(status); }
+
+// Job source
+
+// Parse a job line: "send [dir] file..." or "recv [dir]",
+// with the files and dir relative to the -d directory
+
+static void jobparse(char *s) {
+  struct job *j;
+  char *w[FILEMAX + 3];
+  int n, i, f;
+
+  jline++;
+  for (n = 0; (n < FILEMAX + 3) && (w[n] = strtok(n ? 0 : s, " \t\r"));) {
+    if (w[n][0] == '#') { /* Comment to the end of the line */
+      break;
+    }
+    n++;
+  }
+  if (n == 0) {
+    return;
+  }
+  if (njobs >= JOBMAX) {
+    fprintf(stderr, "%s: line %d: too many jobs\n", cmdname, jline);
+    return;
+  }
+  j = &jobs[njobs];
+  memset(j, 0, sizeof(*j));
+  j->line = jline;
+  j->dir = topdir;
+  if (!strcmp(w[0], "send") && (n >= 2)) {
+    j->action = A_SEND;
+    i = 1;
+    if ((n >= 3) && (w[1][strlen(w[1]) - 1] == '/')) { /* dir/ file... */
+      j->dir = strdup(w[1]);
+      j->dir[strlen(j->dir) - 1] = '\0';
+      i = 2;
+    }
+    if (n - i > FILEMAX) {
+      fprintf(stderr, "%s: line %d: more than %d files\n", cmdname, jline,
+              FILEMAX);
+      return;
+    }
+    for (f = 0; i < n; i++, f++) {
+      j->files[f] = (UCHAR *)strdup(w[i]);
+    }
+  } else if (!strcmp(w[0], "recv") && (n <= 2)) {
+    j->action = A_RECV;
+    if (n == 2) {
+      j->dir = strdup(w[1]);
+    }
+  } else {
+    fprintf(stderr, "%s: line %d: send [dir/] file... or recv [dir]\n",
+            cmdname, jline);
+    return;
+  }
+  njobs++;
+}
+
+// Take in the job lines that have come in
+
+static void jobread(void) {
+  char *nl;
+  int n;
+
+  n = read(jobfd, jbuf + jlen, sizeof(jbuf) - 1 - jlen);
+  if (n <= 0) { /* End of the jobs: run the last line if unterminated */
+    if (jlen > 0) {
+      jbuf[jlen] = '\0';
+      jobparse(jbuf);
+      jlen = 0;
+    }
+    if (jobfd > 0) {
+      close(jobfd);
+    }
+    jobfd = -1;
+    return;
+  }
+  jlen += n;
+  jbuf[jlen] = '\0';
+  while ((nl = strchr(jbuf, '\n'))) {
+    *nl = '\0';
+    jobparse(jbuf);
+    jlen -= (nl + 1 - jbuf);
+    memmove(jbuf, nl + 1, jlen + 1);
+  }
+  if (jlen == sizeof(jbuf) - 1) {
+    fprintf(stderr, "%s: line %d: too long\n", cmdname, jline + 1);
+    jlen = 0;
+  }
+}
+
+// Ports
+
+// Run the command of a port for a job with pipes to its stdin and
+// stdout; %d in the command is the port number
+
+static int peerrun(struct port *p, int *in, int *out) {
+  char cmd[JOBLINE];
+  char *s;
+  int tochild[2], fromchild[2];
+
+  s = strstr(p->peer, "%d");
+  if (s) {
+    snprintf(cmd, sizeof(cmd), "%.*s%d%s", (int)(s - p->peer), p->peer,
+             (int)(p - ports), s + 2);
+  } else {
+    snprintf(cmd, sizeof(cmd), "%s", p->peer);
+  }
+  if (pipe(tochild) < 0 || pipe(fromchild) < 0) {
+    perror("pipe");
+    return (-1);
+  }
+  p->pid = fork();
+  if (p->pid < 0) {
+    perror("fork");
+    return (-1);
+  }
+  if (p->pid == 0) {
+    dup2(tochild[0], 0);
+    dup2(fromchild[1], 1);
+    close(tochild[0]);
+    close(tochild[1]);
+    close(fromchild[0]);
+    close(fromchild[1]);
+    execl("/bin/sh", "sh", "-c", cmd, (char *)0);
+    perror("/bin/sh");
+    _exit(127);
+  }
+  close(tochild[0]);
+  close(fromchild[1]);
+  // Not for the commands of the other ports, which would keep them open
+  fcntl(fromchild[0], F_SETFD, FD_CLOEXEC);
+  fcntl(tochild[1], F_SETFD, FD_CLOEXEC);
+  *in = fromchild[0];
+  *out = tochild[1];
+  return (0);
+}
+
+// Open a line in raw 8-bit mode
+
+static int lineopen(char *line) {
+  struct termios t;
+  int fd;
+
+  fd = open(line, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(line);
+    return (-1);
+  }
+  if (isatty(fd) && (tcgetattr(fd, &t) == 0)) {
+    cfmakeraw(&t);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &t);
+  }
+  return (fd);
+}
+
+// End the job of a port
+
+static void jobend(struct port *p, int status) {
+  struct job *j = p->job;
+  double t = now();
+
+  if (p->r.sofar > 0) { /* A file cut short */
+    j->bytes += p->r.sofar;
+  }
+  j->status = status;
+  j->secs = t - p->start;
+  p->jobs++;
+  p->busy += j->secs;
+  printf("port %d: job %d (line %d) %s, %ld bytes in %.2f sec\n",
+         (int)(p - ports), (int)(j - jobs), j->line,
+         (status == X_DONE) ? "done" : "FAILED", j->bytes, j->secs);
+  fflush(stdout);
+  if (p->peer) {
+    close(p->io.ttyin);
+    close(p->io.ttyout);
+    waitpid(p->pid, (int *)0, 0);
+  }
+  p->job = (struct job *)0;
+}
+
+// Handle what kermit() returned for a port (k->evf)
+
+static void result(struct k_data *k, int status, struct k_response *r) {
+  struct port *p = (struct port *)k;
+  struct job *j = p->job;
+
+  (void)r;
+  switch (status) {
+  case X_OK:
+    if (((j->action == A_SEND) && (p->r.status == S_EOF)) ||
+        ((j->action == A_RECV) && (p->r.status == R_FILE) &&
+         (p->r.filename[0] != '\0'))) {
+      // End of a file
+      if (verbose && (p->r.sofar > 0)) {
+        printf("port %d: %s %ld bytes\n", (int)(p - ports), p->r.filename,
+               p->r.sofar);
+      }
+      j->bytes += p->r.sofar;
+      p->r.sofar = 0;
+    }
+    break;
+  case X_DONE:
+  case X_ERROR:
+    jobend(p, status);
+    break;
+  }
+}
+
+// Start the next job on a port
+
+static void jobstart(struct port *p) {
+  struct job *j = &jobs[nextjob++];
+  int in, out, status;
+
+  p->job = j;
+  p->start = now();
+  if (p->peer) {
+    if (peerrun(p, &in, &out) < 0) {
+      jobend(p, X_ERROR);
+      return;
+    }
+  } else {
+    in = out = p->fd;
+  }
+  memset(&p->k, 0, sizeof(p->k));
+  memset(&p->r, 0, sizeof(p->r));
+  p->k.xfermode = 0;
+  p->k.remote = 1;
+  p->k.binary = 1;
+  p->k.parity = P_PARITY;
+  p->k.prefixing = PFX_MINIMAL;
+  p->k.bct = check;
+  p->k.bctf = 0;
+  p->k.ikeep = 0;
+  p->k.cancel = 0;
+  p->k.filelist = j->files;
+  p->k.rxd = readpkt;
+  p->k.txd = tx_data;
+  p->k.ixd = inchk;
+  p->k.openf = openfile;
+  p->k.finfo = fileinfo;
+  p->k.readf = readfile;
+  p->k.writef = writefile;
+  p->k.closef = closefile;
+  p->k.dbf = 0;
+  p->k.phf = 0;
+  p->k.nextf = 0;
+  p->k.evf = result;
+  status = kermit(K_INIT, &p->k, 0, 0, "", &p->r);
+  ioattach(&p->k, &p->io, in, out, j->dir);
+  p->deadline = now() + p->k.r_timo;
+  if ((status != X_ERROR) && (j->action == A_SEND)) {
+    status = kermit(K_SEND, &p->k, 0, 0, "", &p->r);
+  }
+  if (status == X_ERROR) {
+    jobend(p, X_ERROR);
+  }
+}
+
+// Nothing has come in for the timeout of a port
+
+static void porttimeout(struct port *p) {
+  if (verbose) {
+    printf("port %d: timeout\n", (int)(p - ports));
+  }
+  (void)kermit_feed(&p->k, (UCHAR *)0, 0, &p->r);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options] -l line... | -p cmd...\n"
+          "  -l line   tty or pty of a board (as many as ports)\n"
+          "  -p cmd    command run as the board of a port for each job,\n"
+          "            with %%d for the port number (as many as ports)\n"
+          "  -n n      run n ports with each -p command given\n"
+          "  -j file   job source (default: stdin), one job a line:\n"
+          "              send [dir/] file...   send the files\n"
+          "              recv [dir]            receive files\n"
+          "  -d dir    directory of the files (default: .)\n"
+          "  -b n      block check type 1, 2, or 3 (default 3)\n"
+          "  -v        show each file and timeout\n",
+          cmdname);
+  exit(FAILURE);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  struct pollfd pfd[PORTMAX + 1];
+  struct port *pp[PORTMAX + 1];
+  UCHAR buf[READLEN];
+  char *jobfile;
+  int i, n, np, copies, running, done, failed, timo;
+  double t0, t, next, busy;
+
+  jobfile = (char *)0;
+  copies = 1;
+  for (i = 1; i < argc; i++) {
+    if ((!strcmp(argv[i], "-l") || !strcmp(argv[i], "-p")) &&
+        (i + 1 < argc)) {
+      for (n = 0; n < copies; n++) {
+        if (nports >= PORTMAX) {
+          fprintf(stderr, "%s: more than %d ports\n", cmdname, PORTMAX);
+          return (FAILURE);
+        }
+        ports[nports].fd = -1;
+        if (argv[i][1] == 'l') {
+          ports[nports].fd = lineopen(argv[i + 1]);
+          if (ports[nports].fd < 0) {
+            return (FAILURE);
+          }
+          n = copies; /* A line is a single port */
+        } else {
+          ports[nports].peer = argv[i + 1];
+        }
+        nports++;
+      }
+      i++;
+    } else if (!strcmp(argv[i], "-n") && (i + 1 < argc)) {
+      copies = atoi(argv[++i]);
+      if (copies < 1) {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "-j") && (i + 1 < argc)) {
+      jobfile = argv[++i];
+    } else if (!strcmp(argv[i], "-d") && (i + 1 < argc)) {
+      topdir = argv[++i];
+    } else if (!strcmp(argv[i], "-b") && (i + 1 < argc)) {
+      check = atoi(argv[++i]);
+      if ((check < 1) || (check > 3)) {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "-v")) {
+      verbose = 1;
+    } else {
+      usage();
+    }
+  }
+  if (nports == 0) {
+    usage();
+  }
+  jobfd = jobfile ? open(jobfile, O_RDONLY) : 0;
+  if (jobfd < 0) {
+    perror(jobfile);
+    return (FAILURE);
+  }
+  signal(SIGPIPE, SIG_IGN); /* A board gone is an error, not a signal */
+
+  t0 = now();
+  for (;;) {
+    // Give the free ports the jobs waiting
+    for (i = 0; (i < nports) && (nextjob < njobs); i++) {
+      if (!ports[i].job) {
+        jobstart(&ports[i]);
+      }
+    }
+
+    // Wait for the ports running and for the job source
+    np = 0;
+    running = 0;
+    t = now();
+    next = t + 3600.0;
+    for (i = 0; i < nports; i++) {
+      if (ports[i].job) {
+        pfd[np].fd = ports[i].io.ttyin;
+        pfd[np].events = POLLIN;
+        pp[np++] = &ports[i];
+        if (ports[i].deadline < next) {
+          next = ports[i].deadline;
+        }
+        running++;
+      }
+    }
+    if (jobfd >= 0) {
+      pfd[np].fd = jobfd;
+      pfd[np].events = POLLIN;
+      pp[np++] = (struct port *)0;
+    }
+    if (np == 0) { /* No more jobs, and all done */
+      break;
+    }
+    if (!running && (nextjob < njobs)) {
+      continue;
+    }
+    timo = running ? (int)((next - t) * 1000.0) + 1 : -1;
+    if (timo < 0 && running) {
+      timo = 0;
+    }
+    n = poll(pfd, np, timo);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      return (FAILURE);
+    }
+
+    // Take in what has come
+    t = now();
+    for (i = 0; i < np; i++) {
+      if (!pp[i]) {
+        if (pfd[i].revents) {
+          jobread();
+        }
+        continue;
+      }
+      if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        n = read(pfd[i].fd, buf, sizeof(buf));
+        if (n <= 0) { /* The board has gone */
+          jobend(pp[i], X_ERROR);
+          continue;
+        }
+        pp[i]->deadline = t + pp[i]->k.r_timo;
+        (void)kermit_feed(&pp[i]->k, buf, n, &pp[i]->r);
+      } else if (t >= pp[i]->deadline) {
+        pp[i]->deadline = t + pp[i]->k.r_timo;
+        porttimeout(pp[i]);
+      }
+    }
+  }
+
+  // Summary
+  t = now() - t0;
+  done = failed = 0;
+  for (i = 0; i < njobs; i++) {
+    if (jobs[i].status == X_DONE) {
+      done++;
+    } else {
+      failed++;
+    }
+  }
+  busy = 0.0;
+  for (i = 0; i < nports; i++) {
+    busy += ports[i].busy;
+  }
+  printf("%d jobs done, %d failed, on %d ports in %.2f sec "
+         "(%.2f sec of jobs, %.1f at once)\n",
+         done, failed, nports, t, busy, (t > 0) ? busy / t : 0.0);
+  for (i = 0; i < nports; i++) {
+    printf("port %d: %d jobs in %.2f sec\n", i, ports[i].jobs,
+           ports[i].busy);
+  }
+  return (failed ? FAILURE : SUCCESS);
+}
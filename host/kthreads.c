@@ -0,0 +1,353 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// kthreads.c
+// Concurrent sessions of the protocol engine on threads
+// Author: Kenji Rikitake
+
+// N pairs of a sender and a receiver, each engine (kermit.c) with its
+// own session of the host I/O backend (posixio.c) on a thread, transfer
+// a file of their own over pipes, first one pair after another and then
+// all at once.  Every pair sends a file of the same name from and to its
+// own directories.  The received files and the bytes each engine sent on
+// the line must be the same in both runs, bit for bit, and the files the
+// same as the sent ones; the exit status tells if they were.
+
+#include "cdefs.h"   // Data types for all modules
+#include "debug.h"   // Debugging
+#include "kermit.h"  // Kermit symbols and data structures
+#include "kio.h"     // I/O backend (posixio.c)
+#include "posixio.h" // Sessions of the backend
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char *cmdname = "kermit-threads";
+
+#define PAIRMAX (64) /* Pairs of engines */
+#define RUNS (2)     /* Serial, then concurrent */
+
+static UCHAR fname[] = "DATA.BIN";
+
+// An engine with its I/O session and a copy of what it sent.
+// The k_data structure must be the first member, since the
+// line output function is called with a pointer to it.
+
+struct engine {
+  struct k_data k;
+  struct k_response r;
+  struct k_io io;
+  UCHAR *filelist[2];
+  int action;     /* A_SEND or A_RECV */
+  int check;      /* Block check type */
+  int status;     /* X_DONE when done, or X_ERROR */
+  UCHAR *wire;    /* Bytes sent on the line */
+  long wirelen;   /* and their number */
+  long wiresize;  /* Bytes allocated */
+  char dir[256];  /* Directory of the file */
+  pthread_t tid;
+};
+
+static struct engine engines[RUNS][PAIRMAX][2]; /* Sender, receiver */
+
+// Exit function for the I/O backend
+
+void doexit(int status) { exit(status); }
+
+// Line output: keep a copy, then send
+
+static int wiretx(struct k_data *k, UCHAR *p, int n) {
+  struct engine *e = (struct engine *)k;
+
+  if (e->wirelen + n > e->wiresize) {
+    e->wiresize = (e->wirelen + n) * 2;
+    e->wire = realloc(e->wire, e->wiresize);
+    if (!e->wire) {
+      return (X_ERROR);
+    }
+  }
+  memcpy(e->wire + e->wirelen, p, n);
+  e->wirelen += n;
+  return (tx_data(k, p, n));
+}
+
+// Run an engine to the end of its session
+
+static void *run(void *arg) {
+  struct engine *e = (struct engine *)arg;
+  UCHAR *inbuf;
+  short r_slot;
+  int rx_len, status;
+
+  e->k.xfermode = 0;
+  e->k.remote = 1;
+  e->k.binary = 1;
+  e->k.parity = P_PARITY;
+  e->k.prefixing = PFX_MINIMAL;
+  e->k.bct = e->check;
+  e->k.bctf = 0;
+  e->k.ikeep = 0;
+  e->k.cancel = 0;
+  e->k.filelist = e->filelist;
+  e->k.rxd = readpkt;
+  e->k.txd = wiretx;
+  e->k.ixd = inchk;
+  e->k.openf = openfile;
+  e->k.finfo = fileinfo;
+  e->k.readf = readfile;
+  e->k.writef = writefile;
+  e->k.closef = closefile;
+  e->k.dbf = 0;
+  e->k.phf = 0;
+  e->k.nextf = 0;
+
+  status = kermit(K_INIT, &e->k, 0, 0, "", &e->r);
+  if ((status != X_ERROR) && (e->action == A_SEND)) {
+    status = kermit(K_SEND, &e->k, 0, 0, "", &e->r);
+  }
+  while ((status != X_DONE) && (status != X_ERROR)) {
+    inbuf = getrslot(&e->k, &r_slot);
+    rx_len = e->k.rxd(&e->k, inbuf, P_PKTLEN);
+    if (rx_len < 1) {
+      freerslot(&e->k, r_slot);
+      if (rx_len < 0) {
+        status = X_ERROR;
+        break;
+      }
+    }
+    status = kermit(K_RUN, &e->k, r_slot, rx_len, "", &e->r);
+  }
+  e->status = status;
+  // Let the peer see the end of the line if it is still waiting
+  close(e->io.ttyout);
+  return ((void *)0);
+}
+
+// Set up a pair of engines connected by two pipes
+
+static int pairinit(struct engine *pair, const char *top, int run, int i,
+                    int check) {
+  int s2r[2], r2s[2];
+  int j;
+
+  if ((pipe(s2r) < 0) || (pipe(r2s) < 0)) {
+    perror("pipe");
+    return (-1);
+  }
+  for (j = 0; j < 2; j++) {
+    memset(&pair[j], 0, sizeof(pair[j]));
+    pair[j].check = check;
+  }
+  pair[0].action = A_SEND;
+  pair[0].filelist[0] = fname;
+  snprintf(pair[0].dir, sizeof(pair[0].dir), "%s/src%d", top, i);
+  ioattach(&pair[0].k, &pair[0].io, r2s[0], s2r[1], pair[0].dir);
+  pair[1].action = A_RECV;
+  snprintf(pair[1].dir, sizeof(pair[1].dir), "%s/run%d-%d", top, run, i);
+  if ((mkdir(pair[1].dir, 0755) < 0) && (errno != EEXIST)) {
+    perror(pair[1].dir);
+    return (-1);
+  }
+  ioattach(&pair[1].k, &pair[1].io, s2r[0], r2s[1], pair[1].dir);
+  return (0);
+}
+
+static void pairstart(struct engine *pair) {
+  int j;
+
+  for (j = 0; j < 2; j++) {
+    if (pthread_create(&pair[j].tid, (pthread_attr_t *)0, run, &pair[j])) {
+      fprintf(stderr, "%s: pthread_create failed\n", cmdname);
+      exit(FAILURE);
+    }
+  }
+}
+
+static void pairjoin(struct engine *pair) {
+  int j;
+
+  for (j = 0; j < 2; j++) {
+    pthread_join(pair[j].tid, (void **)0);
+    close(pair[j].io.ttyin);
+  }
+}
+
+// Make the file of a pair: xorshift bytes of a length and seed of its own
+
+static int makedata(const char *top, int i, long len) {
+  char path[512];
+  FILE *fp;
+  unsigned long x;
+  long n;
+
+  snprintf(path, sizeof(path), "%s/src%d", top, i);
+  if ((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+    perror(path);
+    return (-1);
+  }
+  snprintf(path, sizeof(path), "%s/src%d/%s", top, i, fname);
+  fp = fopen(path, "wb");
+  if (!fp) {
+    perror(path);
+    return (-1);
+  }
+  x = 2463534242UL + (unsigned long)i * 7919UL;
+  for (n = 0; n < len + i * 97; n++) {
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    // Runs of a byte now and then, so that repeat counts are sent
+    putc(((x >> 8) & 7) ? (int)(x & 0xff) : 0, fp);
+  }
+  fclose(fp);
+  return (0);
+}
+
+// Contents of a file, malloc()ed
+
+static UCHAR *slurp(const char *dir, long *len) {
+  char path[512];
+  FILE *fp;
+  UCHAR *buf;
+  long n;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, fname);
+  fp = fopen(path, "rb");
+  if (!fp) {
+    return ((UCHAR *)0);
+  }
+  fseek(fp, 0L, SEEK_END);
+  n = ftell(fp);
+  rewind(fp);
+  buf = malloc(n + 1);
+  if (buf && (fread(buf, 1, n, fp) != (size_t)n)) {
+    free(buf);
+    buf = (UCHAR *)0;
+  }
+  fclose(fp);
+  *len = n;
+  return (buf);
+}
+
+static int same(const UCHAR *a, long alen, const UCHAR *b, long blen) {
+  return (a && b && (alen == blen) && !memcmp(a, b, alen));
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -j n      pairs of engines (default 8, at most %d)\n"
+          "  -n bytes  file length (default 50000, more for each pair)\n"
+          "  -b n      block check type 1, 2, or 3 (default 3)\n"
+          "  -d dir    directory of the files (default kthreads.tmp)\n",
+          cmdname, PAIRMAX);
+  exit(FAILURE);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  int pairs, check, i, rn, bad;
+  long len, slen, rlen[RUNS];
+  char *top;
+  UCHAR *src, *rcv[RUNS];
+  struct engine *s0, *s1, *r0, *r1;
+
+  pairs = 8;
+  len = 50000;
+  check = 3;
+  top = "kthreads.tmp";
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && (i + 1 < argc)) {
+      pairs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-n") && (i + 1 < argc)) {
+      len = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-b") && (i + 1 < argc)) {
+      check = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-d") && (i + 1 < argc)) {
+      top = argv[++i];
+    } else {
+      usage();
+    }
+  }
+  if ((pairs < 1) || (pairs > PAIRMAX) || (len < 0) || (check < 1) ||
+      (check > 3)) {
+    usage();
+  }
+  // A failed session closes its line; the peer gets an error, not a signal
+  signal(SIGPIPE, SIG_IGN);
+  if ((mkdir(top, 0755) < 0) && (errno != EEXIST)) {
+    perror(top);
+    return (FAILURE);
+  }
+  for (i = 0; i < pairs; i++) {
+    if (makedata(top, i, len) < 0) {
+      return (FAILURE);
+    }
+  }
+
+  // Serial: one pair after another
+  for (i = 0; i < pairs; i++) {
+    if (pairinit(engines[0][i], top, 0, i, check) < 0) {
+      return (FAILURE);
+    }
+    pairstart(engines[0][i]);
+    pairjoin(engines[0][i]);
+  }
+
+  // Concurrent: all the pairs at once
+  for (i = 0; i < pairs; i++) {
+    if (pairinit(engines[1][i], top, 1, i, check) < 0) {
+      return (FAILURE);
+    }
+  }
+  for (i = 0; i < pairs; i++) {
+    pairstart(engines[1][i]);
+  }
+  for (i = 0; i < pairs; i++) {
+    pairjoin(engines[1][i]);
+  }
+
+  // Compare
+  bad = 0;
+  for (i = 0; i < pairs; i++) {
+    s0 = &engines[0][i][0];
+    r0 = &engines[0][i][1];
+    s1 = &engines[1][i][0];
+    r1 = &engines[1][i][1];
+    src = slurp(s0->dir, &slen);
+    for (rn = 0; rn < RUNS; rn++) {
+      rcv[rn] = slurp(engines[rn][i][1].dir, &rlen[rn]);
+    }
+    printf("pair %2d: %6ld bytes, line %6ld/%5ld bytes: ", i, slen,
+           s1->wirelen, r1->wirelen);
+    if ((s0->status != X_DONE) || (r0->status != X_DONE) ||
+        (s1->status != X_DONE) || (r1->status != X_DONE)) {
+      printf("session failed\n");
+      bad++;
+    } else if (!same(src, slen, rcv[0], rlen[0]) ||
+               !same(src, slen, rcv[1], rlen[1])) {
+      printf("received file differs\n");
+      bad++;
+    } else if (!same(s0->wire, s0->wirelen, s1->wire, s1->wirelen) ||
+               !same(r0->wire, r0->wirelen, r1->wire, r1->wirelen)) {
+      printf("line bytes differ\n");
+      bad++;
+    } else {
+      printf("identical\n");
+    }
+    free(src);
+    for (rn = 0; rn < RUNS; rn++) {
+      free(rcv[rn]);
+    }
+  }
+  printf("%d of %d pairs identical in serial and concurrent runs\n",
+         pairs - bad, pairs);
+  return (bad ? FAILURE : SUCCESS);
+}
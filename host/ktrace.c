@@ -0,0 +1,179 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// ktrace.c
+// Decoder of the binary trace file (KTRACE.BIN)
+// Author: Kenji Rikitake
+
+// The trace is written by traceflush() in neoio.c when built with
+// -DTRACE; see trace.h for the format.  Each event is shown with its
+// time since the first event in the file, the time since the previous
+// one, the protocol state, and the packet or event details.
+
+#include "cdefs.h"  // Data types for all modules
+#include "kermit.h" // Kermit symbols and data structures
+#include "trace.h"  // Trace format
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *cmdname = "kermit-trace";
+
+// Timer ticks per second
+#define TRACE_HZ (100.0)
+
+static const char *evname(int id) {
+  static const char *names[] = {"?",     "open",   "rpkt", "spkt", "rerr",
+                                "fopen", "fclose", "ferr", "done", "error"};
+
+  return ((id > 0) && (id <= TR_ERROR)) ? names[id] : names[0];
+}
+
+static const char *statename(int state) {
+  static char buf[8];
+
+  switch ((signed char)state) {
+  case R_ERROR:
+    return ("ERROR");
+  case R_NONE:
+    return ("R_NONE");
+  case R_WAIT:
+    return ("R_WAIT");
+  case R_FILE:
+    return ("R_FILE");
+  case R_ATTR:
+    return ("R_ATTR");
+  case R_DATA:
+    return ("R_DATA");
+  case S_NONE:
+    return ("S_NONE");
+  case S_INIT:
+    return ("S_INIT");
+  case S_FILE:
+    return ("S_FILE");
+  case S_ATTR:
+    return ("S_ATTR");
+  case S_DATA:
+    return ("S_DATA");
+  case S_EOF:
+    return ("S_EOF");
+  case S_EOT:
+    return ("S_EOT");
+  default:
+    snprintf(buf, sizeof(buf), "%d", (signed char)state);
+    return (buf);
+  }
+}
+
+// Details of an event, by its id
+
+static void detail(char *buf, int size, const UCHAR *e) {
+  int seq = e[2], aux = e[3], len = e[4] | (e[5] << 8);
+  static const char *reasons[] = {"?", "no buffer", "^C^C^C", "too long",
+                                  "bad header"};
+
+  switch (e[0]) {
+  case TR_OPEN:
+    snprintf(buf, size, "%s",
+             (seq == A_SEND) ? "send" : (seq == A_RECV) ? "receive" : "-");
+    break;
+  case TR_RPKT:
+  case TR_SPKT:
+    snprintf(buf, size, "seq %2d type %c len %d", seq,
+             ((aux > 32) && (aux < 127)) ? aux : '?', len);
+    break;
+  case TR_RERR:
+    snprintf(buf, size, "%s after %d bytes",
+             reasons[(aux <= TR_RERR_BADHDR) ? aux : 0], len);
+    break;
+  case TR_FOPEN:
+    snprintf(buf, size, "%s", (aux == 1) ? "read" : "write");
+    break;
+  case TR_FCLOSE:
+    snprintf(buf, size, "%s%s", (aux == 1) ? "input" : "output",
+             (len == 'D') ? ", discarded" : "");
+    break;
+  case TR_FERR:
+    snprintf(buf, size, "API error %d", aux);
+    break;
+  case TR_ERROR:
+    snprintf(buf, size, "exit status %d", len);
+    break;
+  default:
+    buf[0] = '\0';
+    break;
+  }
+}
+
+static int decode(const char *file) {
+  FILE *fp;
+  UCHAR head[10], e[sizeof(struct trace_event)];
+  unsigned long total;
+  unsigned int n, i, time, prev;
+  double t, dt;
+  char buf[64];
+
+  fp = fopen(file, "rb");
+  if (!fp) {
+    perror(file);
+    return (-1);
+  }
+  if ((fread(head, 1, sizeof(head), fp) != sizeof(head)) ||
+      memcmp(head, TRACE_MAGIC, 4)) {
+    fprintf(stderr, "%s: %s: not a trace file\n", cmdname, file);
+    fclose(fp);
+    return (-1);
+  }
+  total = head[4] | (head[5] << 8) | ((unsigned long)head[6] << 16) |
+          ((unsigned long)head[7] << 24);
+  n = head[8] | (head[9] << 8);
+  printf("%s: %lu events, last %u shown\n", file, total, n);
+  printf("%9s %8s  %-6s %-6s  %s\n", "time", "+dt", "event", "state",
+         "detail");
+  t = 0.0;
+  prev = 0;
+  for (i = 0; i < n; i++) {
+    if (fread(e, 1, sizeof(e), fp) != sizeof(e)) {
+      fprintf(stderr, "%s: %s: truncated\n", cmdname, file);
+      fclose(fp);
+      return (-1);
+    }
+    // The time wraps around at 65536 ticks
+    time = e[6] | (e[7] << 8);
+    dt = (i > 0) ? ((time - prev) & 0xffff) / TRACE_HZ : 0.0;
+    t += dt;
+    prev = time;
+    detail(buf, sizeof(buf), e);
+    printf("%9.2f %8.2f  %-6s %-6s  %s\n", t, dt, evname(e[0]),
+           statename(e[1]), buf);
+  }
+  fclose(fp);
+  return (0);
+}
+
+void usage(void) {
+  fprintf(stderr, "Usage: %s [file...]\n  (default file: %s)\n", cmdname,
+          TRACE_FILE);
+  exit(EXIT_FAILURE);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  int i, rc;
+
+  if ((argc > 1) && (argv[1][0] == '-')) {
+    usage();
+  }
+  if (argc < 2) {
+    return (decode(TRACE_FILE) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  rc = EXIT_SUCCESS;
+  for (i = 1; i < argc; i++) {
+    if (decode(argv[i]) < 0) {
+      rc = EXIT_FAILURE;
+    }
+  }
+  return (rc);
+}
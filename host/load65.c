@@ -0,0 +1,175 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// load65.c
+// Loader of Neo6502 programs into emulated memory
+// Author: Kenji Rikitake
+
+// See load65.h.  Used by the profiler (prof65.c) and the checker of
+// the assembler kernels (asmtest.c).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "load65.h"
+
+// Contents of a file, malloc()ed and NUL-terminated
+
+uint8_t *load65_file(const char *file, long *len) {
+  FILE *fp;
+  uint8_t *buf;
+
+  fp = fopen(file, "rb");
+  if (!fp) {
+    perror(file);
+    return (0);
+  }
+  fseek(fp, 0L, SEEK_END);
+  *len = ftell(fp);
+  fseek(fp, 0L, SEEK_SET);
+  buf = malloc(*len + 1);
+  if (!buf || (fread(buf, 1, *len, fp) != (size_t)*len)) {
+    fprintf(stderr, "%s: cannot read\n", file);
+    free(buf);
+    fclose(fp);
+    return (0);
+  }
+  buf[*len] = '\0';
+  fclose(fp);
+  return (buf);
+}
+
+static uint32_t rd16(const uint8_t *p) { return (p[0] | (p[1] << 8)); }
+
+static uint32_t rd32(const uint8_t *p) {
+  return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+// .neo file: blocks of control, load address, size and comment,
+// after the magic, the version and the execution address
+
+int load65_neo(uint8_t *mem, const uint8_t *b, long len, uint16_t *exec) {
+  long pos;
+  uint32_t load, size;
+  uint8_t control;
+
+  if ((len < 14) || (b[0] != 0x03) || memcmp(b + 1, "NEO", 3)) {
+    return (-1);
+  }
+  *exec = rd16(b + 6);
+  pos = 8;
+  do {
+    if (pos + 5 > len) {
+      return (-1);
+    }
+    control = b[pos];
+    load = rd16(b + pos + 1);
+    size = rd16(b + pos + 3);
+    pos += 5;
+    while ((pos < len) && b[pos]) { /* Comment */
+      pos++;
+    }
+    pos++;
+    if ((pos + size > len) || (load + size > 0x10000)) {
+      return (-1);
+    }
+    memcpy(mem + load, b + pos, size);
+    pos += size;
+  } while (control & 0x80);
+  return (0);
+}
+
+// ELF32 file: the PT_LOAD segments if exec is given, and the symbol
+// table if symf is
+
+int load65_elf(uint8_t *mem, const uint8_t *b, long len, uint16_t *exec,
+               load65_symf symf) {
+  uint32_t phoff, shoff, off, addr, filesz, link;
+  uint32_t symoff, symsize, stroff, name, value, size;
+  int phnum, phentsize, shnum, shentsize, i, type;
+  uint32_t j;
+  const uint8_t *p, *s;
+
+  if ((len < 52) || memcmp(b, "\177ELF", 4) || (b[4] != 1) || (b[5] != 1)) {
+    return (-1);
+  }
+  phoff = rd32(b + 28);
+  shoff = rd32(b + 32);
+  phentsize = rd16(b + 42);
+  phnum = rd16(b + 44);
+  shentsize = rd16(b + 46);
+  shnum = rd16(b + 48);
+  if (exec) {
+    *exec = rd32(b + 24);
+    for (i = 0; i < phnum; i++) {
+      p = b + phoff + i * phentsize;
+      if ((p + 32 > b + len) || (rd32(p) != 1)) { /* PT_LOAD */
+        continue;
+      }
+      off = rd32(p + 4);
+      addr = rd32(p + 12); /* p_paddr */
+      filesz = rd32(p + 16);
+      if ((off + filesz > len) || (addr + filesz > 0x10000)) {
+        return (-1);
+      }
+      memcpy(mem + addr, b + off, filesz);
+    }
+  }
+  if (!symf) {
+    return (0);
+  }
+  for (i = 0; i < shnum; i++) {
+    s = b + shoff + i * shentsize;
+    if ((s + 40 > b + len) || (rd32(s + 4) != 2)) { /* SHT_SYMTAB */
+      continue;
+    }
+    symoff = rd32(s + 16);
+    symsize = rd32(s + 20);
+    link = rd32(s + 24);
+    if (link >= (uint32_t)shnum) {
+      continue;
+    }
+    stroff = rd32(b + shoff + link * shentsize + 16);
+    for (j = 16; j + 16 <= symsize; j += 16) {
+      p = b + symoff + j;
+      name = rd32(p);
+      value = rd32(p + 4);
+      size = rd32(p + 8);
+      type = p[12] & 0x0f;
+      // Functions, and labels of the assembler code
+      if ((type == 2) || ((type == 0) && (rd16(p + 14) != 0))) {
+        (*symf)((const char *)b + stroff + name, value, size);
+      }
+    }
+  }
+  return (0);
+}
+
+// Symbol listing of llvm-objdump -t, e.g.
+// 00000200 g     F .text  00000012 main
+
+int load65_listing(char *t, load65_symf symf) {
+  char *line, *next, *tab, name[48];
+  unsigned int addr, size;
+
+  for (line = t; line && *line; line = next) {
+    next = strchr(line, '\n');
+    if (next) {
+      *next++ = '\0';
+    }
+    tab = strchr(line, '\t');
+    if ((strlen(line) < 17) || !tab || (sscanf(line, "%8x", &addr) != 1) ||
+        (line[8] != ' ')) {
+      continue;
+    }
+    if ((line[14] == 'd') || ((line[15] != 'F') && !strstr(line, "text"))) {
+      continue;
+    }
+    if (sscanf(tab + 1, "%x %47s", &size, name) == 2) {
+      (*symf)(name, addr, size);
+    }
+  }
+  return (0);
+}
@@ -0,0 +1,24 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// load65.h -- Loader of Neo6502 programs into emulated memory
+
+// A program is loaded into the 64K bytes of memory of cpu65c02.c from
+// a .neo file or an ELF file, and its symbols are given one at a time
+// to a function of the caller, from the ELF file or from the listing
+// of llvm-objdump -t.
+
+#ifndef __LOAD65_H__
+#define __LOAD65_H__
+
+#include <stdint.h>
+
+// Called with the name, the address and the size of each symbol
+typedef void (*load65_symf)(const char *, uint32_t, uint32_t);
+
+uint8_t *load65_file(const char *, long *);
+int load65_neo(uint8_t *, const uint8_t *, long, uint16_t *);
+int load65_elf(uint8_t *, const uint8_t *, long, uint16_t *, load65_symf);
+int load65_listing(char *, load65_symf);
+
+#endif /* __LOAD65_H__ */
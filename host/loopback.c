@@ -0,0 +1,847 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// loopback.c
+// In-process loopback benchmark of the protocol engine
+// Author: Kenji Rikitake
+
+// Two instances of the protocol engine (kermit.c) run in one process,
+// a sender doing K_SEND and a receiver doing K_RUN, connected by
+// memory channels, and transfer a payload held in memory.
+// For each combination of packet length, window size, block check
+// and control prefixing, it reports packets per second of CPU time,
+// encoded bytes on the wire per payload byte, and the CPU time spent
+// in encode(), decode() and the block check functions.
+//
+// The CPU time of the functions is measured by hooks called from
+// kermit.c when compiled with -finstrument-functions, in a second run
+// of each combination, so that the packet rates are not affected
+// by the timing itself.
+//
+// With a fault profile (see chansim.c), the channels drop, corrupt,
+// duplicate and delay bytes on a simulated clock, at the bandwidth
+// cap of the profile or FAULT_BPS, and the engines time out as they
+// would on a line.  Goodput, retransmitted bytes and recovery latency
+// are reported instead of the CPU times.
+
+#include "cdefs.h"  // Data types for all modules
+#include "debug.h"  // Debugging
+#include "kermit.h" // Kermit symbols and data structures
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chansim.h"
+
+// Functions in kermit.c to be measured (STATIC is empty): the
+// variants of encode() and decode() selected for a session, which
+// getpkt() and decode() call (see codecsel() in kermit.c)
+
+void enc0(int, int, struct k_data *);
+void encr(int, int, struct k_data *);
+void ence(int, int, struct k_data *);
+void encre(int, int, struct k_data *);
+int dec0(struct k_data *, struct k_response *, short, UCHAR *);
+int decr(struct k_data *, struct k_response *, short, UCHAR *);
+int dece(struct k_data *, struct k_response *, short, UCHAR *);
+int decre(struct k_data *, struct k_response *, short, UCHAR *);
+int chk1(UCHAR *, struct k_data *);
+USHORT chk2(UCHAR *, struct k_data *);
+USHORT chk3(UCHAR *, struct k_data *);
+
+static char *cmdname = "kermit-loopback";
+
+// Memory channel: a byte FIFO from one engine to the other
+
+#define CHANLEN (65536) /* Must be a power of 2 */
+
+struct chan {
+  UCHAR buf[CHANLEN];
+  int64_t when[CHANLEN]; /* Arrival time of each byte */
+  unsigned long head;    /* Read position */
+  unsigned long tail;    /* Write position */
+  int dir;               /* Direction in the channel simulator */
+  int skip;              /* Skipping the rest of a packet */
+};
+
+// An engine with its channels and its file in memory.
+// The k_data structure must be the first member, since the
+// I/O functions are called with a pointer to it.
+
+struct endpoint {
+  struct k_data k;
+  struct k_response r;
+  struct chan *in;  /* Channel to read packets from */
+  struct chan *out; /* Channel to send packets to */
+  int status;       /* Last return code of kermit() */
+  UCHAR ibuf[IBUFLEN + 1];
+  UCHAR obuf[OBUFLEN + 1];
+  UCHAR *data;   /* File data */
+  long datalen;  /* File length */
+  long datapos;  /* Read or write position */
+  long pkts;       /* Packets sent */
+  long bytes;      /* Bytes sent */
+  long timeouts;   /* Timeouts */
+  int idle;        /* Consecutive timeouts */
+  int64_t timeout; /* Time of the next timeout */
+};
+
+static struct chan s2r = {.dir = 0}, r2s = {.dir = 1};
+static struct endpoint snd, rcv;
+
+static UCHAR *payload;   /* Data to transfer */
+static long payloadlen;  /* and its length */
+static UCHAR *received;  /* Received data */
+static UCHAR fname[] = "LOOPBACK.DAT";
+static UCHAR *filelist[] = {fname, 0};
+
+static struct chansim_profile *faults; /* Fault profile, or 0 */
+static struct chansim csim;            /* Channel simulator */
+static int64_t now;                    /* Simulated time */
+
+// Profiling of the functions in kermit.c
+
+#define PROF_ENCODE 0
+#define PROF_DECODE 1
+#define PROF_CHK 2
+#define PROF_CAL 3 /* Calibration */
+#define PROF_MAX 4
+
+struct prof {
+  void *fn;       /* Function address */
+  int slot;       /* Accumulator (PROF_...) */
+  int64_t start;  /* Time of entry */
+};
+
+static struct prof prof[] = {
+    {0, PROF_ENCODE, 0}, {0, PROF_ENCODE, 0}, {0, PROF_ENCODE, 0},
+    {0, PROF_ENCODE, 0}, {0, PROF_DECODE, 0}, {0, PROF_DECODE, 0},
+    {0, PROF_DECODE, 0}, {0, PROF_DECODE, 0}, {0, PROF_CHK, 0},
+    {0, PROF_CHK, 0},    {0, PROF_CHK, 0},    {0, PROF_CAL, 0},
+};
+#define NPROF ((int)(sizeof(prof) / sizeof(prof[0])))
+
+static int profiling;            /* Profiling is on */
+static int64_t profns[PROF_MAX]; /* Time spent */
+static long profcalls[PROF_MAX]; /* Number of calls */
+static int64_t calns;            /* Cost of the hooks per call */
+static int64_t mintime;          /* Minimum CPU time of a measurement */
+
+// Time in nanoseconds
+
+static int64_t nsnow(clockid_t id) {
+  struct timespec ts;
+
+  clock_gettime(id, &ts);
+  return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+void __cyg_profile_func_enter(void *fn, void *site) {
+  int i;
+
+  if (!profiling) {
+    return;
+  }
+  for (i = 0; i < NPROF; i++) {
+    if (fn == prof[i].fn) {
+      prof[i].start = nsnow(CLOCK_MONOTONIC);
+      return;
+    }
+  }
+}
+
+void __cyg_profile_func_exit(void *fn, void *site) {
+  int i;
+
+  if (!profiling) {
+    return;
+  }
+  for (i = 0; i < NPROF; i++) {
+    if (fn == prof[i].fn) {
+      profns[prof[i].slot] += nsnow(CLOCK_MONOTONIC) - prof[i].start;
+      profcalls[prof[i].slot]++;
+      return;
+    }
+  }
+}
+
+// An empty function called the same way as the instrumented ones
+// in kermit.c, to measure the cost of the hooks themselves, which is
+// included once in each measured call and subtracted from the results.
+
+static void __attribute__((noinline)) profcal(void) {
+  __asm__ volatile("");
+}
+
+static void profinit(void) {
+  int i;
+
+  prof[0].fn = (void *)enc0;
+  prof[1].fn = (void *)encr;
+  prof[2].fn = (void *)ence;
+  prof[3].fn = (void *)encre;
+  prof[4].fn = (void *)dec0;
+  prof[5].fn = (void *)decr;
+  prof[6].fn = (void *)dece;
+  prof[7].fn = (void *)decre;
+  prof[8].fn = (void *)chk1;
+  prof[9].fn = (void *)chk2;
+  prof[10].fn = (void *)chk3;
+  prof[11].fn = (void *)profcal;
+
+  profiling = 1;
+  for (i = 0; i < 1000000; i++) {
+    __cyg_profile_func_enter((void *)profcal, 0);
+    profcal();
+    __cyg_profile_func_exit((void *)profcal, 0);
+  }
+  profiling = 0;
+  calns = profns[PROF_CAL] / profcalls[PROF_CAL];
+}
+
+// Channel functions
+
+// Returns nonzero if a byte has arrived
+
+static int chanready(struct chan *c) {
+  return (c->head != c->tail && c->when[c->head & (CHANLEN - 1)] <= now);
+}
+
+static void chanput(struct chan *c, UCHAR *p, int n) {
+  static UCHAR out[2 * (P_PKTLEN + 8)];
+  static int64_t when[2 * (P_PKTLEN + 8)];
+  int i;
+
+  if (faults && n <= P_PKTLEN + 8) {
+    n = chansim_send(&csim, c->dir, now, p, n, out, when);
+    p = out;
+  }
+  for (i = 0; i < n; i++) {
+    if (c->tail - c->head >= CHANLEN) {
+      return; /* Full, the rest is lost */
+    }
+    c->when[c->tail & (CHANLEN - 1)] = (faults) ? when[i] : now;
+    c->buf[c->tail++ & (CHANLEN - 1)] = p[i];
+  }
+}
+
+// Skips what has arrived of the rest of a packet read, up to its end
+// or the start of the next one, as readpkt() in neoio.c does when
+// called for the next packet.  If the end has not arrived yet, the
+// skipping goes on when more bytes arrive, so that the end is never
+// taken for another packet arriving (see chanpkt()).
+
+static void chanskip(struct chan *c, struct k_data *k) {
+  UCHAR x;
+
+  c->skip = 1;
+  while (chanready(c)) {
+    x = c->buf[c->head & (CHANLEN - 1)];
+    if (x == k->r_soh) {
+      c->skip = 0;
+      return;
+    }
+    c->head++;
+    if (x == k->r_eom) {
+      c->skip = 0;
+      return;
+    }
+  }
+}
+
+// Returns nonzero if a whole packet has arrived: framed as readpkt()
+// does, by the length in its header, so that a packet whose
+// terminator is lost is not left waiting for a timeout
+
+static int chanpkt(struct chan *c, struct k_data *k) {
+  unsigned long i;
+  UCHAR hdr[6]; /* Enough for framelen() to know the length */
+  int n, want, flag;
+  UCHAR x;
+
+  if (c->skip) {
+    chanskip(c, k);
+  }
+  flag = 0;
+  n = 0;
+  want = 0;
+  for (i = c->head; i != c->tail && c->when[i & (CHANLEN - 1)] <= now; i++) {
+    x = c->buf[i & (CHANLEN - 1)];
+    if (x == k->r_soh) { /* Start of packet, over again */
+      flag = 1;
+      n = 0;
+      want = 0;
+      continue;
+    }
+    if (!flag) {
+      continue;
+    }
+    if (x == k->r_eom) { /* End of packet before its length */
+      return (1);
+    }
+    if (!want) {
+      hdr[n++] = x;
+      want = framelen(k, hdr, n);
+      if (want < 0) { /* Bad header */
+        return (1);
+      }
+    } else {
+      n++;
+    }
+    if (want && n >= want) { /* Complete */
+      return (1);
+    }
+  }
+  return (0);
+}
+
+// Returns the arrival time of the next byte not arrived yet, or -1
+
+static int64_t channext(struct chan *c) {
+  unsigned long i;
+
+  for (i = c->head; i != c->tail; i++) {
+    if (c->when[i & (CHANLEN - 1)] > now) {
+      return (c->when[i & (CHANLEN - 1)]);
+    }
+  }
+  return (-1);
+}
+
+// I/O functions called by the engines, as in posixio.c
+
+// Reads a packet from the channel like readpkt() in neoio.c.
+// Returns the length, or 0 (timeout) if the channel runs out
+// before the end of a packet.
+
+static int readpkt(struct k_data *k, UCHAR *p, int len) {
+  struct chan *c = ((struct endpoint *)k)->in;
+  int n, want, flag;
+  UCHAR x;
+
+  if (c->skip) {
+    chanskip(c, k);
+  }
+  flag = 0;
+  n = 0;
+  want = 0;
+  while (chanready(c)) {
+    x = c->buf[c->head++ & (CHANLEN - 1)];
+    if (x == k->r_soh) { /* Start of packet */
+      flag = 1;          /* Remember */
+      n = 0;             /* and start over */
+      want = 0;
+      continue;
+    }
+    if (!flag) { /* No start of packet yet */
+      continue;  /* so discard these bytes. */
+    }
+    if (x == k->r_eom) { /* End of packet before its length */
+      return (n);
+    }
+    p[n++] = x;
+    if (!want) {
+      want = framelen(k, p, n);
+      if (want < 0) { /* Bad header: the rest of it is not read */
+        chanskip(c, k);
+        return (-want);
+      }
+    }
+    if (want && n >= want) { /* Complete, up to its end */
+      chanskip(c, k);
+      return (n);
+    }
+  }
+  return (0);
+}
+
+static int tx_data(struct k_data *k, UCHAR *p, int n) {
+  struct endpoint *e = (struct endpoint *)k;
+
+  e->pkts++;
+  e->bytes += n;
+  chanput(e->out, p, n);
+  return (X_OK);
+}
+
+static int inchk(struct k_data *k) {
+  struct chan *c = ((struct endpoint *)k)->in;
+  unsigned long i;
+
+  for (i = c->head; i != c->tail && c->when[i & (CHANLEN - 1)] <= now; i++) {
+  }
+  return ((int)(i - c->head));
+}
+
+static int openfile(struct k_data *k, UCHAR *s, int mode) {
+  struct endpoint *e = (struct endpoint *)k;
+
+  switch (mode) {
+  case 1: /* Read */
+    e->datapos = 0;
+    k->s_first = 1;              /* Set up for getkpt */
+    k->zinbuf[0] = '\0';         /* Initialize buffer */
+    khot(k)->zinptr = k->zinbuf; /* Set up buffer pointer */
+    khot(k)->zincnt = 0;         /* and count */
+    return (X_OK);
+  case 2: /* Write (create) */
+    e->datapos = 0;
+    return (X_OK);
+  default:
+    return (X_ERROR);
+  }
+}
+
+static ULONG fileinfo(struct k_data *k, UCHAR *filename, UCHAR *buf,
+                      int buflen, short *type, short mode) {
+  if (!buf || buflen < 18) {
+    return (X_ERROR);
+  }
+  strcpy((char *)buf, "20250101 00:00:00");
+  *type = 1;
+  return ((ULONG)payloadlen);
+}
+
+static int readfile(struct k_data *k) {
+  struct endpoint *e = (struct endpoint *)k;
+  long n;
+
+  if (khot(k)->zincnt < 1) {
+    // Nothing in buffer - must refill
+    n = e->datalen - e->datapos;
+    if (n > k->zinlen) {
+      n = k->zinlen;
+    }
+    if (n == 0) { /* EOF */
+      return (-1);
+    }
+    memcpy(k->zinbuf, e->data + e->datapos, n);
+    e->datapos += n;
+    khot(k)->zincnt = n;
+    khot(k)->zinptr = k->zinbuf;
+  }
+  (khot(k)->zincnt)--; /* Return first byte. */
+  return (*(khot(k)->zinptr)++ & 0xff);
+}
+
+static int writefile(struct k_data *k, UCHAR *s, int n) {
+  struct endpoint *e = (struct endpoint *)k;
+
+  if (e->datapos + n > e->datalen) {
+    return (X_ERROR);
+  }
+  memcpy(e->data + e->datapos, s, n);
+  e->datapos += n;
+  return (X_OK);
+}
+
+static int closefile(struct k_data *k, UCHAR c, int mode) {
+  return (X_OK);
+}
+
+// Set up an engine
+
+static void epinit(struct endpoint *e, struct chan *in, struct chan *out,
+                   int pktlen, int window, int check, int prefixing) {
+  memset(e, 0, sizeof(*e));
+  e->in = in;
+  e->out = out;
+  in->head = in->tail = 0;
+  in->skip = 0;
+  e->timeout = now + P_R_TIMO * 1000000000LL;
+
+  e->k.xfermode = 0;
+  e->k.remote = 1;
+  e->k.binary = 1;
+  e->k.parity = P_PARITY;
+  e->k.prefixing = prefixing;
+  e->k.bct = check;
+  e->k.bctf = 0;
+  e->k.ikeep = 0;
+  e->k.cancel = 0;
+
+  e->k.zinbuf = e->ibuf;
+  e->k.zinlen = IBUFLEN;
+  khot(&e->k)->zincnt = 0;
+  e->k.obuf = e->obuf;
+  e->k.obuflen = OBUFLEN;
+  khot(&e->k)->obufpos = 0;
+
+  e->k.rxd = readpkt;
+  e->k.txd = tx_data;
+  e->k.ixd = inchk;
+  e->k.openf = openfile;
+  e->k.finfo = fileinfo;
+  e->k.readf = readfile;
+  e->k.writef = writefile;
+  e->k.closef = closefile;
+  e->k.dbf = 0;
+  e->k.phf = 0;
+  e->k.nextf = 0;
+  e->k.io = 0;
+
+  e->status = kermit(K_INIT, &e->k, 0, 0, "", &e->r);
+
+  // Parameters to offer to the other engine
+  e->k.r_maxlen = pktlen;
+  e->k.window = window;
+}
+
+// Run an engine on the next packet in its channel, or on a timeout
+
+static void step(struct endpoint *e) {
+  UCHAR *inbuf;
+  short r_slot;
+  int rx_len;
+
+  inbuf = getrslot(&e->k, &r_slot);
+  rx_len = e->k.rxd(&e->k, inbuf, P_PKTLEN);
+  if (rx_len < 1) {
+    freerslot(&e->k, r_slot);
+    e->timeouts++;
+    e->idle++;
+  } else {
+    e->idle = 0;
+  }
+  e->status = kermit(K_RUN, &e->k, r_slot, rx_len, "", &e->r);
+  // The engine starts waiting for the next packet
+  e->timeout = now + ((e->k.r_timo > 0) ? e->k.r_timo : P_R_TIMO) *
+                         1000000000LL;
+}
+
+// Number of consecutive timeouts to give up a transfer at
+#define TIMEOUT_MAX (100)
+
+// Transfer the payload once.
+// Returns 0 if received intact, -1 otherwise.
+
+static int transfer(int pktlen, int window, int check, int prefixing) {
+  struct endpoint *e;
+  int64_t next, t;
+
+  now = 0;
+  if (faults) {
+    chansim_init(&csim, faults);
+  }
+  epinit(&snd, &r2s, &s2r, pktlen, window, check, prefixing);
+  epinit(&rcv, &s2r, &r2s, pktlen, window, check, prefixing);
+  snd.data = payload;
+  snd.datalen = payloadlen;
+  rcv.data = received;
+  rcv.datalen = payloadlen;
+  memset(received, 0, payloadlen);
+
+  snd.k.filelist = filelist;
+  snd.status = kermit(K_SEND, &snd.k, 0, 0, "", &snd.r);
+
+  while (snd.status != X_DONE && snd.status != X_ERROR &&
+         rcv.status != X_ERROR) {
+    if (rcv.status != X_DONE && chanpkt(rcv.in, &rcv.k)) {
+      step(&rcv);
+    } else if (chanpkt(snd.in, &snd.k)) {
+      step(&snd);
+    } else {
+      // Both are waiting: skip to the next arrival or timeout
+      next = channext(&s2r);
+      t = channext(&r2s);
+      if (next < 0 || (t >= 0 && t < next)) {
+        next = t;
+      }
+      t = snd.timeout;
+      if (rcv.status != X_DONE && rcv.timeout < t) {
+        t = rcv.timeout;
+      }
+      if (next >= 0 && next <= t) {
+        now = next;
+        continue;
+      }
+      now = t;
+      e = (t == snd.timeout) ? &snd : &rcv;
+      step(e);
+      if (e->idle > TIMEOUT_MAX) {
+        break; /* The engines are stuck */
+      }
+    }
+  }
+  if (snd.status != X_DONE || rcv.status != X_DONE ||
+      rcv.datapos != payloadlen || memcmp(payload, received, payloadlen)) {
+    return (-1);
+  }
+  return (0);
+}
+
+// Make a payload: random bytes from a seed, or a file
+
+static int mkpayload(char *file, long len, unsigned int seed) {
+  FILE *fp;
+  long i;
+
+  if (file) {
+    fp = fopen(file, "rb");
+    if (!fp) {
+      perror(file);
+      return (-1);
+    }
+    fseek(fp, 0L, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+  }
+  payload = malloc(len + 1);
+  received = malloc(len + 1);
+  if (!payload || !received) {
+    return (-1);
+  }
+  if (file) {
+    if (fread(payload, 1, len, fp) != (size_t)len) {
+      perror(file);
+      fclose(fp);
+      return (-1);
+    }
+    fclose(fp);
+  } else {
+    srand(seed);
+    for (i = 0; i < len; i++) {
+      payload[i] = rand() & 0xff;
+    }
+  }
+  payloadlen = len;
+  return (0);
+}
+
+// Parse a comma-separated list of numbers
+
+static int numlist(char *s, int *v, int max) {
+  int n = 0;
+
+  while (*s && n < max) {
+    v[n++] = atoi(s);
+    while (*s && *s != ',') {
+      s++;
+    }
+    if (*s == ',') {
+      s++;
+    }
+  }
+  return (n);
+}
+
+// Measure one combination on a faulty channel.
+// Returns 0 on success, -1 if the transfer failed.
+
+static int measurefaults(int pktlen, int window, int check, int prefixing) {
+  long retr, bytes, nfaults;
+  double sec;
+  int i, rc;
+
+  rc = transfer(pktlen, window, check, prefixing);
+  sec = now / 1e9;
+  retr = bytes = nfaults = 0;
+  for (i = 0; i < CHANSIM_DIRS; i++) {
+    retr += csim.dir[i].retrbytes;
+    bytes += csim.dir[i].bytes;
+    nfaults += csim.dir[i].drops + csim.dir[i].flips + csim.dir[i].dups;
+  }
+  printf(" %9.2f %8.0f %10ld %6.2f %7ld %6ld %9.1f %9.1f %4ld%s\n", sec,
+         (rc == 0 && sec > 0.0) ? payloadlen / sec : 0.0, retr,
+         bytes ? 100.0 * retr / bytes : 0.0, nfaults, csim.recoveries,
+         csim.recoveries ? csim.recovsum / 1e6 / csim.recoveries : 0.0,
+         csim.recovmax / 1e6, snd.timeouts + rcv.timeouts,
+         (rc == 0) ? "" : "  transfer failed");
+  return (rc);
+}
+
+// Measure one combination of parameters and print a line.
+// The transfer is repeated for at least mintime of CPU time.
+// Returns 0 on success, -1 if the transfer failed.
+
+static int measure(int pktlen, int window, int check, int prefixing,
+                   int quick) {
+  int64_t t, t0;
+  double sec, pkts;
+  long reps;
+  int i;
+
+  printf("%8d %6d %3d %3d", pktlen, window, check, prefixing);
+  if (faults) {
+    return (measurefaults(pktlen, window, check, prefixing));
+  }
+
+  // Packet rate and encoding overhead without profiling
+  profiling = 0;
+  reps = 0;
+  t0 = nsnow(CLOCK_PROCESS_CPUTIME_ID);
+  do {
+    if (transfer(pktlen, window, check, prefixing) < 0) {
+      printf("  transfer failed\n");
+      return (-1);
+    }
+    reps++;
+    t = nsnow(CLOCK_PROCESS_CPUTIME_ID) - t0;
+  } while (t < mintime);
+  sec = t / 1e9 / reps;
+  pkts = snd.pkts + rcv.pkts;
+  printf(" %8.0f %9.0f %10.4f %7.2f", pkts, pkts / sec,
+         (double)snd.bytes / payloadlen, sec * 1e3);
+  if (quick) {
+    printf("\n");
+    return (0);
+  }
+
+  // The same with profiling
+  memset(profns, 0, sizeof(profns));
+  memset(profcalls, 0, sizeof(profcalls));
+  profiling = 1;
+  for (i = 0; i < reps; i++) {
+    (void)transfer(pktlen, window, check, prefixing);
+  }
+  profiling = 0;
+  for (i = 0; i < PROF_MAX; i++) {
+    profns[i] -= profcalls[i] * calns;
+    if (profns[i] < 0) {
+      profns[i] = 0;
+    }
+  }
+  printf(" %10.2f %10.2f %7.2f\n", profns[PROF_ENCODE] / 1e6 / reps,
+         profns[PROF_DECODE] / 1e6 / reps, profns[PROF_CHK] / 1e6 / reps);
+  return (0);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -n bytes  payload length (default 100000)\n"
+          "  -f file   payload from a file (default: random bytes)\n"
+          "  -S seed   seed of random bytes (default 1)\n"
+          "  -l list   packet lengths (default 94,160,%d)\n"
+          "  -w list   window sizes (default 1,4,%d)\n"
+          "  -b list   block check types (default 1,2,3)\n"
+          "  -p list   control prefixing, 0 = all, 1 = minimal "
+          "(default 0,1)\n"
+          "  -t ms     minimum CPU time of each measurement (default 200)\n"
+          "  -q        do not measure CPU time of functions\n"
+          "  -F prof   fault profile of the channels, e.g.\n"
+          "            seed=1,drop=1e-4,flip=1e-4,dup=1e-5,latency=20,"
+          "bps=9600\n",
+          cmdname, P_PKTLEN, P_WSLOTS);
+  exit(FAILURE);
+}
+
+#define LISTMAX (16)
+
+// Line rate of a fault profile without a bandwidth cap: the simulated
+// clock needs the time of each byte, or the transfer takes no time
+// but that of the timeouts, and the goodput means nothing
+#define FAULT_BPS (115200L)
+
+int main(int argc, char **argv) {
+  int pktlens[LISTMAX], windows[LISTMAX], checks[LISTMAX], pfxs[LISTMAX];
+  int npktlens, nwindows, nchecks, npfxs;
+  struct chansim_profile profile;
+  int a, b, c, d, i, quick, rc;
+  char *file;
+  long len;
+  unsigned int seed;
+
+  npktlens = 3;
+  pktlens[0] = 94;
+  pktlens[1] = 160;
+  pktlens[2] = P_PKTLEN;
+  nwindows = 3;
+  windows[0] = 1;
+  windows[1] = 4;
+  windows[2] = P_WSLOTS;
+  nchecks = 3;
+  checks[0] = 1;
+  checks[1] = 2;
+  checks[2] = 3;
+  npfxs = 2;
+  pfxs[0] = PFX_ALL;
+  pfxs[1] = PFX_MINIMAL;
+  file = 0;
+  len = 100000L;
+  seed = 1;
+  quick = 0;
+  mintime = 200000000LL;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-q")) {
+      quick = 1;
+    } else if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-n")) {
+      len = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-f")) {
+      file = argv[++i];
+    } else if (!strcmp(argv[i], "-S")) {
+      seed = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-l")) {
+      npktlens = numlist(argv[++i], pktlens, LISTMAX);
+    } else if (!strcmp(argv[i], "-w")) {
+      nwindows = numlist(argv[++i], windows, LISTMAX);
+    } else if (!strcmp(argv[i], "-b")) {
+      nchecks = numlist(argv[++i], checks, LISTMAX);
+    } else if (!strcmp(argv[i], "-F")) {
+      if (chansim_parse(&profile, argv[++i]) < 0) {
+        exit(FAILURE);
+      }
+      faults = &profile;
+    } else if (!strcmp(argv[i], "-t")) {
+      mintime = atol(argv[++i]) * 1000000LL;
+    } else if (!strcmp(argv[i], "-p")) {
+      npfxs = numlist(argv[++i], pfxs, LISTMAX);
+    } else {
+      usage();
+    }
+  }
+  for (i = 0; i < npktlens; i++) {
+    if (pktlens[i] < 20 || pktlens[i] > P_PKTLEN) {
+      fprintf(stderr, "%s: packet length must be 20 to %d\n", cmdname,
+              P_PKTLEN);
+      exit(FAILURE);
+    }
+  }
+  for (i = 0; i < nwindows; i++) {
+    if (windows[i] < 1 || windows[i] > P_WSLOTS) {
+      fprintf(stderr, "%s: window size must be 1 to %d\n", cmdname,
+              P_WSLOTS);
+      exit(FAILURE);
+    }
+  }
+  if (mkpayload(file, len, seed) < 0) {
+    exit(FAILURE);
+  }
+  profinit();
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  printf("# payload %ld bytes%s%s\n", payloadlen, file ? " from " : "",
+         file ? file : "");
+  if (faults) {
+    if (faults->bps <= 0) {
+      faults->bps = FAULT_BPS;
+    }
+    printf("# line %ld bps; windows are only negotiated, the sender "
+           "waits for each ACK\n",
+           faults->bps);
+    printf("# pktlen window bct pfx   sim_sec  goodput  retr_bytes  retr%%"
+           "  faults  recov  recov_ms    max_ms  tmo\n");
+  } else {
+    printf("# pktlen window bct pfx     pkts     pkt/s  wire/byte  cpu_ms"
+           "  encode_ms  decode_ms  chk_ms\n");
+  }
+  rc = SUCCESS;
+  for (a = 0; a < npktlens; a++) {
+    for (b = 0; b < nwindows; b++) {
+      for (c = 0; c < nchecks; c++) {
+        for (d = 0; d < npfxs; d++) {
+          if (measure(pktlens[a], windows[b], checks[c], pfxs[d], quick) <
+              0) {
+            rc = FAILURE;
+          }
+        }
+      }
+    }
+  }
+  exit(rc);
+}
@@ -0,0 +1,576 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// microbench.c
+// Microbenchmarks of the protocol engine hot paths
+// Author: Kenji Rikitake
+
+// Each benchmark calls one function of kermit.c a fixed number of
+// times over packet buffers made from a payload by the engine itself,
+// as sent after a negotiation with repeat counts and minimal control
+// prefixing, for each packet length:
+//
+//   chk1, chk2, chk3  block checks of the packets, as on receiving
+//   encode            encode() of each payload byte
+//   decode            decode() of the data fields into the file buffer
+//   getpkt            getpkt() filling the data fields from the file
+//   spkt              spkt() of the data fields with a 16-bit CRC
+//   krun              kermit(K_RUN) of the data packets in R_DATA,
+//                     from parsing and checking to decoding and ACK
+//
+// The time per byte (of the buffers given to the function) is the
+// best of a few runs, so that a run is comparable to another on the
+// same machine.  The results can be saved as a baseline file, and a
+// later run compared with it, reporting the benchmarks slower than
+// the baseline by more than a threshold as regressions.
+
+#include "cdefs.h"  // Data types for all modules
+#include "debug.h"  // Debugging
+#include "kermit.h" // Kermit symbols and data structures
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Functions in kermit.c to be measured (STATIC is empty)
+
+int chk1(UCHAR *, struct k_data *);
+USHORT chk2(UCHAR *, struct k_data *);
+USHORT chk3(UCHAR *, struct k_data *);
+void encode(int, int, struct k_data *);
+int decode(struct k_data *, struct k_response *, short, UCHAR *);
+int getpkt(struct k_data *, struct k_response *);
+int spkt(char, short, int, UCHAR *, struct k_data *);
+void ctlmap(struct k_data *);
+
+static char *cmdname = "kermit-microbench";
+
+#define PKTMAX (1024)   /* Packets in the buffers */
+#define LISTMAX (8)     /* Packet lengths */
+#define BENCHMAX (64)   /* Results */
+#define CHECK (3)       /* Block check type of the packets */
+
+static struct k_data k;
+static struct k_response r;
+static UCHAR ibuf[IBUFLEN + 1];
+static UCHAR obuf[OBUFLEN + 1];
+
+static UCHAR *payload; /* Payload */
+static long paylen;    /* and its length */
+static long paypos;    /* Read position */
+
+// Packet buffers made from the payload
+
+static int npkts;
+static UCHAR *field[PKTMAX]; /* Data fields, NUL-terminated */
+static int fieldlen[PKTMAX];
+static UCHAR *wire[PKTMAX];  /* Whole packets with seq 0, 1, ... */
+static int wirelen[PKTMAX];
+static UCHAR *chkd[PKTMAX];  /* Checked part of the packets */
+
+static UCHAR *capture; /* Where tx_data() copies a packet, if any */
+static int capturelen;
+
+static volatile unsigned long sink; /* Keeps results alive */
+
+// Results
+
+static struct {
+  char name[32];
+  double nsbyte;
+} result[BENCHMAX];
+static int nresults;
+
+static int64_t nsnow(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+// I/O functions called by the engine
+
+static int tx_data(struct k_data *k, UCHAR *p, int n) {
+  if (capture) {
+    memcpy(capture, p, n);
+    capturelen = n;
+  }
+  return (X_OK);
+}
+
+static int readfile(struct k_data *k) {
+  long n;
+
+  if (khot(k)->zincnt < 1) {
+    n = paylen - paypos;
+    if (n > k->zinlen) {
+      n = k->zinlen;
+    }
+    if (n == 0) { /* EOF */
+      return (-1);
+    }
+    memcpy(k->zinbuf, payload + paypos, n);
+    paypos += n;
+    khot(k)->zincnt = n;
+    khot(k)->zinptr = k->zinbuf;
+  }
+  (khot(k)->zincnt)--;
+  return (*(khot(k)->zinptr)++ & 0xff);
+}
+
+static int writefile(struct k_data *k, UCHAR *p, int n) {
+  sink += p[0];
+  return (X_OK);
+}
+
+static int closefile(struct k_data *k, UCHAR c, int mode) { return (X_OK); }
+
+// Set up k as negotiated for packet length pktlen
+
+static void setup(int pktlen) {
+  memset(&k, 0, sizeof(k));
+  memset(&r, 0, sizeof(r));
+  k.binary = 1;
+  k.zinbuf = ibuf;
+  k.zinlen = IBUFLEN;
+  k.obuf = obuf;
+  k.obuflen = OBUFLEN;
+  k.txd = tx_data;
+  k.readf = readfile;
+  k.writef = writefile;
+  k.closef = closefile;
+  (void)kermit(K_INIT, &k, 0, 0, "", &r);
+
+  k.s_maxlen = pktlen;
+  k.bct = CHECK;
+  k.prefixing = PFX_MINIMAL;
+  k.rptflg = 1;
+  ctlmap(&k);
+}
+
+// As opened by openfile()
+
+static void rewindfile(void) {
+  paypos = 0;
+  k.s_first = 1;
+  k.zinbuf[0] = '\0';
+  khot(&k)->zinptr = k.zinbuf;
+  khot(&k)->zincnt = 0;
+  k.xdata = k.xdatabuf;
+}
+
+static void freepkts(void) {
+  int i;
+
+  for (i = 0; i < npkts; i++) {
+    free(field[i]);
+    free(wire[i]);
+    free(chkd[i]);
+  }
+  npkts = 0;
+}
+
+// Make the packet buffers for packet length pktlen.
+// Returns 0 on success, -1 on error.
+
+static int mkpkts(int pktlen) {
+  UCHAR buf[P_PKTLEN * 2 + 16];
+  int len, n;
+
+  freepkts();
+  setup(pktlen);
+  rewindfile();
+  capture = buf;
+  while ((len = getpkt(&k, &r)) > 0) {
+    if (npkts >= PKTMAX) {
+      fprintf(stderr, "%s: payload too long\n", cmdname);
+      return (-1);
+    }
+    (void)spkt('D', npkts & 63, len, k.xdata, &k);
+    field[npkts] = malloc(len + 1);
+    wire[npkts] = malloc(capturelen);
+    n = capturelen - 2 - CHECK; /* Without SOH, block check and EOM */
+    chkd[npkts] = malloc(n + 1);
+    if (!field[npkts] || !wire[npkts] || !chkd[npkts]) {
+      return (-1);
+    }
+    memcpy(field[npkts], k.xdata, len + 1);
+    fieldlen[npkts] = len;
+    memcpy(wire[npkts], buf, capturelen);
+    wirelen[npkts] = capturelen;
+    memcpy(chkd[npkts], buf + 1, n);
+    chkd[npkts][n] = '\0';
+    npkts++;
+  }
+  capture = 0;
+  return (0);
+}
+
+// The benchmarks.
+// Each makes one pass over the buffers and returns the bytes done.
+
+static long bchk1(void) {
+  long bytes = 0;
+  int i;
+
+  for (i = 0; i < npkts; i++) {
+    sink += chk1(chkd[i], &k);
+    bytes += wirelen[i] - 2 - CHECK;
+  }
+  return (bytes);
+}
+
+static long bchk2(void) {
+  long bytes = 0;
+  int i;
+
+  for (i = 0; i < npkts; i++) {
+    sink += chk2(chkd[i], &k);
+    bytes += wirelen[i] - 2 - CHECK;
+  }
+  return (bytes);
+}
+
+static long bchk3(void) {
+  long bytes = 0;
+  int i;
+
+  for (i = 0; i < npkts; i++) {
+    sink += chk3(chkd[i], &k);
+    bytes += wirelen[i] - 2 - CHECK;
+  }
+  return (bytes);
+}
+
+static long bencode(void) {
+  long i;
+  int maxlen;
+
+  maxlen = k.s_maxlen - 10;
+  k.xdata = k.xdatabuf;
+  khot(&k)->size = 0;
+  khot(&k)->s_rpt = 0;
+  for (i = 0; i < paylen; i++) {
+    encode(payload[i], (i + 1 < paylen) ? payload[i + 1] : -1, &k);
+    if (khot(&k)->size > maxlen) {
+      sink += khot(&k)->size;
+      khot(&k)->size = 0;
+    }
+  }
+  return (paylen);
+}
+
+static long bdecode(void) {
+  int i;
+
+  khot(&k)->obufpos = 0;
+  for (i = 0; i < npkts; i++) {
+    (void)decode(&k, &r, 1, field[i]);
+  }
+  sink += khot(&k)->obufpos;
+  return (paylen);
+}
+
+static long bgetpkt(void) {
+  rewindfile();
+  while (getpkt(&k, &r) > 0) {
+    sink += khot(&k)->size;
+  }
+  return (paylen);
+}
+
+static long bspkt(void) {
+  long bytes = 0;
+  int i;
+
+  for (i = 0; i < npkts; i++) {
+    (void)spkt('D', i & 63, fieldlen[i], field[i], &k);
+    bytes += wirelen[i];
+  }
+  return (bytes);
+}
+
+static long bkrun(void) {
+  long bytes = 0;
+  short slot;
+  UCHAR *p;
+  int i, rc;
+
+  k.state = R_DATA;
+  k.what = W_RECV;
+  k.r_seq = 0;
+  khot(&k)->obufpos = 0;
+  for (i = 0; i < npkts; i++) {
+    p = getrslot(&k, &slot);
+    memcpy(p, wire[i] + 1, wirelen[i] - 2);
+    rc = kermit(K_RUN, &k, slot, wirelen[i] - 2, "", &r);
+    if (rc != X_OK || k.r_seq != ((i + 1) & 63)) {
+      fprintf(stderr, "%s: krun: packet %d not accepted\n", cmdname, i);
+      exit(FAILURE);
+    }
+    bytes += wirelen[i];
+  }
+  return (bytes);
+}
+
+static const struct {
+  char *name;
+  long (*run)(void);
+} bench[] = {
+    {"chk1", bchk1},     {"chk2", bchk2},     {"chk3", bchk3},
+    {"encode", bencode}, {"decode", bdecode}, {"getpkt", bgetpkt},
+    {"spkt", bspkt},     {"krun", bkrun},
+};
+
+#define NBENCH ((int)(sizeof(bench) / sizeof(bench[0])))
+
+// Run benchmark b for packet length pktlen, the given passes each
+// time, and record the best time per byte.
+
+static void measure(int b, int pktlen, long passes, int runs) {
+  int64_t t, best;
+  long bytes, p;
+  int i;
+
+  setup(pktlen);
+  bytes = bench[b].run(); /* Warm up */
+  best = -1;
+  for (i = 0; i < runs; i++) {
+    t = nsnow();
+    for (p = 0; p < passes; p++) {
+      (void)bench[b].run();
+    }
+    t = nsnow() - t;
+    if (best < 0 || t < best) {
+      best = t;
+    }
+  }
+  snprintf(result[nresults].name, sizeof(result[0].name), "%s/%d",
+           bench[b].name, pktlen);
+  result[nresults].nsbyte = (double)best / ((double)bytes * passes);
+  printf("%-12s %6d %10ld %6ld %10.3f\n", result[nresults].name, npkts,
+         bytes, passes, result[nresults].nsbyte);
+  nresults++;
+}
+
+static int mkpayload(char *file, long len, unsigned int seed) {
+  FILE *fp;
+  long i;
+
+  if (file) {
+    fp = fopen(file, "rb");
+    if (!fp) {
+      perror(file);
+      return (-1);
+    }
+    fseek(fp, 0L, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+  }
+  payload = malloc(len + 1);
+  if (!payload) {
+    return (-1);
+  }
+  if (file) {
+    if (fread(payload, 1, len, fp) != (size_t)len) {
+      perror(file);
+      fclose(fp);
+      return (-1);
+    }
+    fclose(fp);
+  } else {
+    srand(seed);
+    for (i = 0; i < len; i++) {
+      payload[i] = rand() & 0xff;
+    }
+  }
+  paylen = len;
+  return (0);
+}
+
+static int numlist(char *s, int *v, int max) {
+  int n = 0;
+
+  while (*s && n < max) {
+    v[n++] = atoi(s);
+    while (*s && *s != ',') {
+      s++;
+    }
+    if (*s == ',') {
+      s++;
+    }
+  }
+  return (n);
+}
+
+static int save(char *file) {
+  FILE *fp;
+  int i;
+
+  fp = fopen(file, "w");
+  if (!fp) {
+    perror(file);
+    return (-1);
+  }
+  fprintf(fp, "# %s baseline, payload %ld bytes\n", cmdname, paylen);
+  fprintf(fp, "# name ns/byte\n");
+  for (i = 0; i < nresults; i++) {
+    fprintf(fp, "%s %.4f\n", result[i].name, result[i].nsbyte);
+  }
+  fclose(fp);
+  return (0);
+}
+
+// Compare the results with a baseline file.
+// Returns the number of regressions, -1 on error.
+
+static int compare(char *file, double threshold) {
+  char line[256], name[64];
+  double base, change;
+  int i, found, regressions;
+  FILE *fp;
+
+  fp = fopen(file, "r");
+  if (!fp) {
+    perror(file);
+    return (-1);
+  }
+  printf("# bench/pktlen   base ns/byte   ns/byte  change\n");
+  regressions = 0;
+  for (i = 0; i < nresults; i++) {
+    rewind(fp);
+    found = 0;
+    while (fgets(line, sizeof(line), fp)) {
+      if (line[0] != '#' && sscanf(line, "%63s %lf", name, &base) == 2 &&
+          !strcmp(name, result[i].name)) {
+        found = 1;
+        break;
+      }
+    }
+    if (!found || base <= 0.0) {
+      printf("%-12s %12s %10.3f\n", result[i].name, "-", result[i].nsbyte);
+      continue;
+    }
+    change = (result[i].nsbyte / base - 1.0) * 100.0;
+    printf("%-12s %12.3f %10.3f %+6.1f%%%s\n", result[i].name, base,
+           result[i].nsbyte, change,
+           (change > threshold) ? "  REGRESSION" : "");
+    if (change > threshold) {
+      regressions++;
+    }
+  }
+  fclose(fp);
+  return (regressions);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options] [bench...]\n"
+          "  -n bytes  payload length (default 16384)\n"
+          "  -f file   payload from a file (default: random bytes)\n"
+          "  -S seed   seed of random bytes (default 1)\n"
+          "  -l list   packet lengths (default 94,%d)\n"
+          "  -i n      passes over the buffers per run (default 200)\n"
+          "  -r n      runs of each benchmark, the best is taken "
+          "(default 10)\n"
+          "  -o file   save the results as a baseline\n"
+          "  -c file   compare the results with a baseline\n"
+          "  -T pct    regression threshold in percent (default 10)\n"
+          "Benchmarks: chk1 chk2 chk3 encode decode getpkt spkt krun "
+          "(default: all)\n",
+          cmdname, P_PKTLEN);
+  exit(FAILURE);
+}
+
+int main(int argc, char **argv) {
+  int pktlens[LISTMAX], npktlens;
+  char *file, *outfile, *basefile;
+  long len, passes;
+  unsigned int seed;
+  double threshold;
+  int i, a, b, j, runs, sel, rc;
+
+  file = outfile = basefile = 0;
+  len = 16384L;
+  seed = 1;
+  pktlens[0] = 94;
+  pktlens[1] = P_PKTLEN;
+  npktlens = 2;
+  passes = 200;
+  runs = 10;
+  threshold = 10.0;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-n")) {
+      len = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-f")) {
+      file = argv[++i];
+    } else if (!strcmp(argv[i], "-S")) {
+      seed = (unsigned int)atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-l")) {
+      npktlens = numlist(argv[++i], pktlens, LISTMAX);
+    } else if (!strcmp(argv[i], "-i")) {
+      passes = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-r")) {
+      runs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o")) {
+      outfile = argv[++i];
+    } else if (!strcmp(argv[i], "-c")) {
+      basefile = argv[++i];
+    } else if (!strcmp(argv[i], "-T")) {
+      threshold = atof(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  for (a = 0; a < npktlens; a++) {
+    if (pktlens[a] < 40 || pktlens[a] > P_PKTLEN) {
+      fprintf(stderr, "%s: packet length must be 40 to %d\n", cmdname,
+              P_PKTLEN);
+      exit(FAILURE);
+    }
+  }
+  if (passes < 1 || runs < 1 || len < 1) {
+    usage();
+  }
+  for (j = i; j < argc; j++) {
+    for (b = 0; b < NBENCH && strcmp(argv[j], bench[b].name); b++)
+      ;
+    if (b == NBENCH) {
+      usage();
+    }
+  }
+  if (mkpayload(file, len, seed) < 0) {
+    fprintf(stderr, "%s: can't make payload\n", cmdname);
+    exit(FAILURE);
+  }
+
+  printf("# bench/pktlen   pkts bytes/pass passes    ns/byte\n");
+  for (a = 0; a < npktlens; a++) {
+    if (mkpkts(pktlens[a]) < 0) {
+      exit(FAILURE);
+    }
+    for (b = 0; b < NBENCH; b++) {
+      sel = (i >= argc);
+      for (j = i; j < argc; j++) {
+        if (!strcmp(argv[j], bench[b].name)) {
+          sel = 1;
+        }
+      }
+      if (sel) {
+        measure(b, pktlens[a], passes, runs);
+      }
+    }
+  }
+
+  rc = SUCCESS;
+  if (outfile && save(outfile) < 0) {
+    rc = FAILURE;
+  }
+  if (basefile && compare(basefile, threshold) != 0) {
+    rc = FAILURE;
+  }
+  exit(rc);
+}
@@ -0,0 +1,64 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// neo/api.h -- Host stub of the LLVM-MOS Neo6502 API
+// Author: Kenji Rikitake
+
+// Only the part of the API surface used by Neo6502-Kermit is declared,
+// with the same names and argument types as in the LLVM-MOS SDK, so
+// that neoio.c compiles unmodified on a host.
+// The functions are implemented by the simulator in host/neosim.c.
+
+#ifndef __NEO_API_H__
+#define __NEO_API_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// API error codes
+
+#define API_ERROR_NONE (0)
+#define API_ERROR_UNKNOWN (1)
+
+// System
+
+uint32_t neo_system_timer(void);
+
+// Console
+
+void neo_console_clear_screen(void);
+
+// File I/O
+
+typedef struct neo_file_stat {
+  uint32_t size;
+  uint8_t attr;
+} neo_file_stat_t;
+
+#define FIO_ATTR_DIR (0x01) /* Directory */
+
+void neo_file_list_directory(void);
+void neo_file_open(uint8_t channel, const char *filename, uint8_t mode);
+void neo_file_close(uint8_t channel);
+uint16_t neo_file_read(uint8_t channel, void *dest, uint16_t len);
+uint16_t neo_file_write(uint8_t channel, const void *src, uint16_t len);
+uint32_t neo_file_size(uint8_t channel);
+void neo_file_seek(uint8_t channel, uint32_t position);
+void neo_file_delete(const char *filename);
+void neo_file_opendir(const char *filename);
+void neo_file_readdir(char *filename, neo_file_stat_t *stat);
+void neo_file_closedir(void);
+
+// UEXT UART
+
+void neo_uext_uart_configure(uint32_t baudrate, uint8_t protocol);
+void neo_uext_uart_write(uint8_t value);
+uint8_t neo_uext_uart_read(void);
+uint8_t neo_uext_uart_available(void);
+void neo_uext_uart_block_write(uint8_t device, const void *src, uint16_t len);
+
+// Error status of the last API call
+
+uint8_t neo_api_error(void);
+
+#endif /* __NEO_API_H__ */
@@ -0,0 +1,637 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// neosim.c
+// Neo6502 API simulator for running neoio.c unmodified on a host
+// Author: Kenji Rikitake
+
+// The simulator keeps its own clock (simulated nanoseconds), which
+// advances by the cost of each API call, by file I/O latency, by the
+// UART byte time while waiting for input, and optionally by the host
+// CPU time spent between API calls scaled to the 6502.
+//
+// UART: bytes from the peer (a tty, a pty, stdin, or a command run
+// with pipes) arrive one byte time apart on the simulated clock, into
+// a receive FIFO of a given depth.  A byte arriving while the FIFO is
+// full is lost (overrun), as on the board when the program is busy,
+// e.g. writing a file.
+//
+// The peer input can be saved to a file, and replayed later as a
+// script instead of a peer: the next packet of the script (up to and
+// including the next CR) is sent only when the program waits for
+// input, as a peer in a lock-step exchange would do.
+//
+// Filesystem: Neo file names are resolved in a host directory.
+// File writes and reads take a configurable simulated time.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <neo/api.h>
+
+#include "neosim.h"
+
+// Provided by the control program (kio.h)
+void doexit(int status);
+
+#define SIM_CHANNELS (8)
+#define SIM_PATHLEN (1024)
+#define SIM_PENDLEN (65536) /* Power of 2 */
+
+static struct neosim_config cf;
+
+static int64_t simtime = 0;      /* Simulated time (ns) */
+static int64_t cpumark = 0;      /* Host CPU time at last API exit */
+static uint8_t apierr = API_ERROR_NONE;
+
+// UART state
+
+static int peerin = 0;
+static int peerout = 1;
+static FILE *recfp = 0;          /* Saved peer input */
+static int64_t bytetime = 0;     /* ns per byte on the line */
+static int64_t lastarrival = 0;  /* Arrival time of the last byte */
+static uint8_t pend[SIM_PENDLEN]; /* Bytes on the line, not yet arrived */
+static int64_t pendt[SIM_PENDLEN];
+static unsigned pendhead = 0, pendtail = 0;
+static uint8_t *fifo;
+static int fifohead = 0, fifocnt = 0;
+
+// File state
+
+static int chfd[SIM_CHANNELS];
+static DIR *dirp = 0; /* Directory being read */
+
+// Statistics
+
+static struct {
+  long rxbytes, txbytes, overruns, fifomax;
+  long fwrites, fwbytes, freads, frbytes;
+  int64_t waitns, filens;
+} st;
+
+static int64_t cputime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Read the next packet of the script, only when the program waits.
+
+static int scriptread(uint8_t *buf, int len, int timeout) {
+  static uint8_t sbuf[1024];
+  static int spos = 0, slen = 0;
+  int n;
+
+  if (timeout == 0) {
+    return (0);
+  }
+  for (n = 0; n < len;) {
+    if (spos == slen) {
+      slen = read(peerin, sbuf, sizeof(sbuf));
+      spos = 0;
+      if (slen <= 0) {
+        slen = 0;
+        break;
+      }
+    }
+    buf[n++] = sbuf[spos++];
+    if (buf[n - 1] == 13) { /* End of packet */
+      break;
+    }
+  }
+  return ((n > 0) ? n : -1);
+}
+
+// Take in whatever the peer has sent so far (without blocking),
+// timestamping each byte at line speed.
+
+static int peerpoll(int timeout) {
+  struct pollfd pf;
+  uint8_t buf[1024];
+  int n, i;
+
+  if (SIM_PENDLEN - (pendtail - pendhead) < sizeof(buf)) {
+    return (0); /* Line backlog full, leave it in the kernel */
+  }
+  if (cf.script) {
+    n = scriptread(buf, sizeof(buf), timeout);
+    if (n == 0) {
+      return (0);
+    }
+  } else {
+    pf.fd = peerin;
+    pf.events = POLLIN;
+    if (poll(&pf, 1, timeout) <= 0) {
+      return (0);
+    }
+    n = read(peerin, buf, sizeof(buf));
+  }
+  if (n <= 0) {
+    return (-1);
+  }
+  if (recfp) {
+    fwrite(buf, 1, n, recfp);
+  }
+  for (i = 0; i < n; i++) {
+    lastarrival = (lastarrival + bytetime > simtime) ? lastarrival + bytetime
+                                                     : simtime;
+    pend[pendtail % SIM_PENDLEN] = buf[i];
+    pendt[pendtail % SIM_PENDLEN] = lastarrival;
+    pendtail++;
+  }
+  return (n);
+}
+
+// Move the bytes that have arrived by now into the FIFO.
+
+static void uartadvance(void) {
+  while ((pendhead != pendtail) && (pendt[pendhead % SIM_PENDLEN] <= simtime)) {
+    if (fifocnt < cf.fifo) {
+      fifo[(fifohead + fifocnt) % cf.fifo] = pend[pendhead % SIM_PENDLEN];
+      fifocnt++;
+      if (fifocnt > st.fifomax) {
+        st.fifomax = fifocnt;
+      }
+    } else {
+      st.overruns++;
+    }
+    st.rxbytes++;
+    pendhead++;
+  }
+}
+
+// Every API call starts with apienter() and ends with apiexit().
+
+static void apienter(void) {
+  if (cf.cpu_scale > 0.0) {
+    simtime += (int64_t)((cputime() - cpumark) * cf.cpu_scale);
+  }
+  simtime += cf.api_ns;
+  if (peerpoll(0) < 0) {
+    peerin = -1;
+  }
+  apierr = API_ERROR_NONE;
+}
+
+static void apiexit(void) {
+  if (cf.cpu_scale > 0.0) {
+    cpumark = cputime();
+  }
+}
+
+void neosim_defaults(struct neosim_config *c) {
+  memset(c, 0, sizeof(*c));
+  c->dir = ".";
+  c->fifo = NEOSIM_FIFO;
+  c->api_ns = NEOSIM_API_NS;
+  c->write_ns = NEOSIM_WRITE_NS;
+  c->write_ns_byte = NEOSIM_WRITE_NS_BYTE;
+  c->read_ns = NEOSIM_READ_NS;
+}
+
+// An interrupted run (e.g. one stalled by overruns) still reports
+static void onsignal(int sig) {
+  neosim_report(stderr);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+// Run the peer command with pipes to its stdin and stdout
+
+static int peerrun(char *cmd) {
+  int tochild[2], fromchild[2];
+  pid_t pid;
+
+  if (pipe(tochild) < 0 || pipe(fromchild) < 0) {
+    perror("pipe");
+    return (-1);
+  }
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return (-1);
+  }
+  if (pid == 0) {
+    dup2(tochild[0], 0);
+    dup2(fromchild[1], 1);
+    close(tochild[0]);
+    close(tochild[1]);
+    close(fromchild[0]);
+    close(fromchild[1]);
+    execl("/bin/sh", "sh", "-c", cmd, (char *)0);
+    perror("/bin/sh");
+    _exit(127);
+  }
+  close(tochild[0]);
+  close(fromchild[1]);
+  peerin = fromchild[0];
+  peerout = tochild[1];
+  signal(SIGPIPE, SIG_IGN);
+  return (0);
+}
+
+int neosim_init(struct neosim_config *c) {
+  int i, fd;
+
+  cf = *c;
+  if (cf.fifo < 1) {
+    cf.fifo = 1;
+  }
+  fifo = malloc(cf.fifo);
+  if (!fifo) {
+    return (-1);
+  }
+  if (cf.line) {
+    fd = open(cf.line, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+      perror(cf.line);
+      return (-1);
+    }
+    if (isatty(fd)) {
+      struct termios t;
+      if (tcgetattr(fd, &t) == 0) {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+      }
+    }
+    peerin = peerout = fd;
+  } else if (cf.peer) {
+    if (peerrun(cf.peer) < 0) {
+      return (-1);
+    }
+  } else if (cf.script) {
+    peerin = open(cf.script, O_RDONLY);
+    if (peerin < 0) {
+      perror(cf.script);
+      return (-1);
+    }
+    peerout = open("/dev/null", O_WRONLY);
+  } else {
+    // The peer is on stdin and stdout; console output goes to stderr
+    peerin = 0;
+    peerout = dup(1);
+    dup2(2, 1);
+  }
+  if (cf.record) {
+    recfp = fopen(cf.record, "wb");
+    if (!recfp) {
+      perror(cf.record);
+      return (-1);
+    }
+  }
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  for (i = 0; i < SIM_CHANNELS; i++) {
+    chfd[i] = -1;
+  }
+  if (cf.baud > 0) {
+    bytetime = 10000000000LL / cf.baud;
+  }
+  signal(SIGINT, onsignal);
+  signal(SIGTERM, onsignal);
+  cpumark = cputime();
+  return (0);
+}
+
+int64_t neosim_time(void) { return (simtime); }
+
+// Time spent by the program outside the API, e.g. by an emulated CPU
+
+void neosim_advance(int64_t ns) { simtime += ns; }
+
+void neosim_report(FILE *fp) {
+  double sec = simtime / 1e9;
+
+  if (recfp) {
+    fflush(recfp);
+  }
+  fprintf(fp, "neosim: simulated time %.3f sec at %ld bps, FIFO %d bytes\n",
+          sec, (bytetime > 0) ? (long)(10000000000LL / bytetime) : 0L,
+          cf.fifo);
+  fprintf(fp, "neosim: UART rx %ld tx %ld bytes, overruns %ld, FIFO max %ld\n",
+          st.rxbytes, st.txbytes, st.overruns, st.fifomax);
+  fprintf(fp, "neosim: UART wait %.3f sec, file I/O %.3f sec\n",
+          st.waitns / 1e9, st.filens / 1e9);
+  fprintf(fp, "neosim: file writes %ld (%ld bytes), reads %ld (%ld bytes)\n",
+          st.fwrites, st.fwbytes, st.freads, st.frbytes);
+}
+
+// System
+
+uint32_t neo_system_timer(void) {
+  apienter();
+  apiexit();
+  return ((uint32_t)(simtime / 10000000LL)); /* 100 Hz */
+}
+
+// Console
+
+void neo_console_clear_screen(void) {
+  apienter();
+  putchar('\n');
+  apiexit();
+}
+
+// File I/O
+
+static int chopen(uint8_t channel) {
+  if ((channel >= SIM_CHANNELS) || (chfd[channel] < 0)) {
+    apierr = API_ERROR_UNKNOWN;
+    return (0);
+  }
+  return (1);
+}
+
+static void simpath(char *path, const char *filename) {
+  snprintf(path, SIM_PATHLEN, "%s/%s", cf.dir, filename);
+}
+
+void neo_file_list_directory(void) {
+  DIR *dp;
+  struct dirent *de;
+  struct stat sb;
+  char path[SIM_PATHLEN];
+
+  apienter();
+  dp = opendir(cf.dir);
+  if (!dp) {
+    apierr = API_ERROR_UNKNOWN;
+    apiexit();
+    return;
+  }
+  while ((de = readdir(dp))) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+    simpath(path, de->d_name);
+    if (stat(path, &sb) == 0) {
+      printf("%-32s %ld\n", de->d_name, (long)sb.st_size);
+    }
+  }
+  closedir(dp);
+  apiexit();
+}
+
+void neo_file_open(uint8_t channel, const char *filename, uint8_t mode) {
+  static const int flags[4] = {O_RDONLY, O_WRONLY | O_CREAT, O_RDWR | O_CREAT,
+                               O_RDWR | O_CREAT | O_TRUNC};
+  char path[SIM_PATHLEN];
+
+  apienter();
+  if ((channel >= SIM_CHANNELS) || (chfd[channel] >= 0) || (mode > 3)) {
+    apierr = API_ERROR_UNKNOWN;
+    apiexit();
+    return;
+  }
+  simpath(path, filename);
+  chfd[channel] = open(path, flags[mode], 0644);
+  if (chfd[channel] < 0) {
+    apierr = API_ERROR_UNKNOWN;
+  }
+  apiexit();
+}
+
+void neo_file_close(uint8_t channel) {
+  int i;
+
+  apienter();
+  for (i = 0; i < SIM_CHANNELS; i++) {
+    // Channel 0xff closes all
+    if (((channel == 0xff) || (channel == i)) && (chfd[i] >= 0)) {
+      close(chfd[i]);
+      chfd[i] = -1;
+    }
+  }
+  apiexit();
+}
+
+uint16_t neo_file_read(uint8_t channel, void *dest, uint16_t len) {
+  int n;
+
+  apienter();
+  n = 0;
+  if (chopen(channel)) {
+    n = read(chfd[channel], dest, len);
+    if (n < 0) {
+      apierr = API_ERROR_UNKNOWN;
+      n = 0;
+    }
+    simtime += cf.read_ns;
+    st.filens += cf.read_ns;
+    st.freads++;
+    st.frbytes += n;
+  }
+  apiexit();
+  return ((uint16_t)n);
+}
+
+uint16_t neo_file_write(uint8_t channel, const void *src, uint16_t len) {
+  int n;
+  int64_t t;
+
+  apienter();
+  n = 0;
+  if (chopen(channel)) {
+    n = write(chfd[channel], src, len);
+    if (n < 0) {
+      apierr = API_ERROR_UNKNOWN;
+      n = 0;
+    }
+    t = cf.write_ns + (int64_t)n * cf.write_ns_byte;
+    simtime += t;
+    st.filens += t;
+    st.fwrites++;
+    st.fwbytes += n;
+  }
+  apiexit();
+  return ((uint16_t)n);
+}
+
+uint32_t neo_file_size(uint8_t channel) {
+  struct stat sb;
+  uint32_t size;
+
+  apienter();
+  size = 0;
+  if (chopen(channel)) {
+    if (fstat(chfd[channel], &sb) == 0) {
+      size = (uint32_t)sb.st_size;
+    } else {
+      apierr = API_ERROR_UNKNOWN;
+    }
+  }
+  apiexit();
+  return (size);
+}
+
+void neo_file_seek(uint8_t channel, uint32_t position) {
+  apienter();
+  if (chopen(channel)) {
+    if (lseek(chfd[channel], (off_t)position, SEEK_SET) < 0) {
+      apierr = API_ERROR_UNKNOWN;
+    }
+  }
+  apiexit();
+}
+
+void neo_file_delete(const char *filename) {
+  char path[SIM_PATHLEN];
+
+  apienter();
+  simpath(path, filename);
+  if (unlink(path) < 0) {
+    apierr = API_ERROR_UNKNOWN;
+  }
+  apiexit();
+}
+
+// Directory reading, "" for the current directory
+
+void neo_file_opendir(const char *filename) {
+  char path[SIM_PATHLEN];
+
+  apienter();
+  if (dirp) {
+    closedir(dirp);
+  }
+  simpath(path, filename);
+  dirp = opendir(path);
+  if (!dirp) {
+    apierr = API_ERROR_UNKNOWN;
+  }
+  apiexit();
+}
+
+// An empty name and an error at the end of the directory
+
+void neo_file_readdir(char *filename, neo_file_stat_t *stat) {
+  struct dirent *de;
+  struct stat sb;
+  char path[SIM_PATHLEN];
+
+  apienter();
+  filename[0] = '\0';
+  if (!dirp) {
+    apierr = API_ERROR_UNKNOWN;
+    apiexit();
+    return;
+  }
+  while ((de = readdir(dirp)) && (de->d_name[0] == '.')) {
+  }
+  if (!de) {
+    apierr = API_ERROR_UNKNOWN;
+    apiexit();
+    return;
+  }
+  snprintf(filename, 256, "%s", de->d_name);
+  simpath(path, de->d_name);
+  stat->size = 0;
+  stat->attr = 0;
+  if (lstat(path, &sb) == 0) {
+    stat->size = S_ISDIR(sb.st_mode) ? 0 : (uint32_t)sb.st_size;
+    stat->attr = S_ISDIR(sb.st_mode) ? FIO_ATTR_DIR : 0;
+  }
+  apiexit();
+}
+
+void neo_file_closedir(void) {
+  apienter();
+  if (dirp) {
+    closedir(dirp);
+    dirp = 0;
+  }
+  apiexit();
+}
+
+// UEXT UART
+
+void neo_uext_uart_configure(uint32_t baudrate, uint8_t protocol) {
+  apienter();
+  if (cf.baud <= 0) { /* Not overridden by the simulator */
+    cf.baud = baudrate;
+    bytetime = 10000000000LL / baudrate;
+  }
+  apiexit();
+}
+
+void neo_uext_uart_write(uint8_t value) {
+  neo_uext_uart_block_write(0, &value, 1);
+}
+
+uint8_t neo_uext_uart_read(void) {
+  uint8_t c;
+
+  apienter();
+  uartadvance();
+  c = 0;
+  if (fifocnt > 0) {
+    c = fifo[fifohead];
+    fifohead = (fifohead + 1) % cf.fifo;
+    fifocnt--;
+  }
+  apiexit();
+  return (c);
+}
+
+uint8_t neo_uext_uart_available(void) {
+  int64_t t;
+
+  apienter();
+  uartadvance();
+  if (fifocnt == 0) {
+    // The program is busy-waiting: skip ahead to the next arrival,
+    // or block until the peer sends something.
+    if (pendhead == pendtail) {
+      if (peerin < 0 || peerpoll(-1) < 0) {
+        neosim_report(stderr);
+        fprintf(stderr, "neosim: peer closed\n");
+        doexit(1);
+      }
+    }
+    t = pendt[pendhead % SIM_PENDLEN];
+    if (t > simtime) {
+      st.waitns += t - simtime;
+      simtime = t;
+    }
+    uartadvance();
+  }
+  apiexit();
+  return (fifocnt > 0);
+}
+
+void neo_uext_uart_block_write(uint8_t device, const void *src, uint16_t len) {
+  const uint8_t *p = src;
+  int n, x;
+
+  apienter();
+  n = len;
+  while (n > 0) {
+    x = write(peerout, p, n);
+    if (x < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      apierr = API_ERROR_UNKNOWN;
+      break;
+    }
+    p += x;
+    n -= x;
+  }
+  simtime += (int64_t)len * bytetime;
+  st.txbytes += len;
+  apiexit();
+}
+
+// Error status of the last API call
+
+uint8_t neo_api_error(void) { return (apierr); }
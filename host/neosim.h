@@ -0,0 +1,40 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// neosim.h -- Neo6502 API simulator configuration and report
+
+#ifndef __NEOSIM_H__
+#define __NEOSIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct neosim_config {
+  char *line;         /* Peer tty or pty, or 0 for stdin and stdout */
+  char *peer;         /* Peer command run with pipes, or 0 */
+  char *script;       /* Scripted peer input, or 0 */
+  char *record;       /* File to save the peer input in, or 0 */
+  char *dir;          /* Host directory backing the Neo filesystem */
+  long baud;          /* UART speed, 0 = as configured by the program */
+  int fifo;           /* UART receive FIFO depth in bytes */
+  long api_ns;        /* Time of each API call */
+  long write_ns;      /* File write latency per call */
+  long write_ns_byte; /* and per byte */
+  long read_ns;       /* File read latency per call */
+  double cpu_scale;   /* 6502 time per host CPU time, 0 = none */
+};
+
+// Defaults (FIFO depth and timings are those of a nominal board)
+#define NEOSIM_FIFO (32)
+#define NEOSIM_API_NS (20000L)
+#define NEOSIM_WRITE_NS (2000000L)
+#define NEOSIM_WRITE_NS_BYTE (2000L)
+#define NEOSIM_READ_NS (1000000L)
+
+void neosim_defaults(struct neosim_config *);
+int neosim_init(struct neosim_config *);
+int64_t neosim_time(void);
+void neosim_advance(int64_t);
+void neosim_report(FILE *);
+
+#endif /* __NEOSIM_H__ */
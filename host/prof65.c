@@ -0,0 +1,624 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// prof65.c
+// Cycle-counting profiler of the Neo6502 program on an emulated 65C02
+// Author: Kenji Rikitake
+
+// This runs the Neo6502 program itself (kermit.neo, or the ELF file
+// kermit.neo.elf) on the W65C02S emulator in cpu65c02.c, with the
+// Neo6502 kernel entry points trapped and the API calls served by the
+// simulator in neosim.c, so that the UART byte stream from the peer
+// can be scripted or recorded, and replayed the same way every run.
+//
+// Every cycle is attributed to the symbol of the instruction running,
+// from the ELF symbol table or the symbol listing of llvm-objdump -t
+// (kermit.neo.elf.txt), or to the 256-byte page without symbols.
+// The time of the API calls (simulated by neosim.c, including the
+// UART wait and the file I/O latency) is counted in cycles of the
+// nominal 6.25MHz clock, as pseudo symbols in brackets.
+//
+// The keys typed on the console are given as a string, and the run
+// is split into sessions at each key read.  For each session with
+// UART traffic, a flat profile is shown with the cycles per KB of
+// the file data received or sent.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <neo/api.h>
+
+#include "cpu65c02.h"
+#include "load65.h"
+#include "neosim.h"
+
+static char *cmdname = "kermit-prof65";
+
+// Nominal Neo6502 65C02 clock
+#define CPU_HZ (6250000L)
+#define NS_PER_CYCLE (1000000000L / CPU_HZ)
+
+// Kernel entry points and the API control block
+#define K_SENDMESSAGE (0xfff7)
+#define K_WAITMESSAGE (0xfff4)
+#define K_WRITECHAR (0xfff1)
+#define K_READCHAR (0xffee)
+#define K_BREAK (0xff80) /* BRK vector, set by the loader */
+#define K_TRAP (0xff00)  /* Trapped from here up */
+#define API_BASE (0xff00)
+#define API_GROUP (API_BASE + 0)
+#define API_FUNCTION (API_BASE + 1)
+#define API_ERROR (API_BASE + 2)
+#define API_PARAMS (API_BASE + 4)
+
+// Cycles of a kernel call besides the API itself
+#define KERNEL_CYCLES (20)
+
+// Debug log of neoio.c, not counted as file data
+#define DEBUG_CHANNEL_NAME "KDEBUG.LOG"
+
+#define SYMMAX (8192)
+#define NAMELEN (48)
+#define SESSMAX (64)
+#define TOPROWS (30)
+
+static uint8_t mem[65536];
+static struct cpu65c02 cpu;
+
+// Symbols: 1 to 256 are the pages, then the loaded ones
+
+static struct {
+  char name[NAMELEN];
+  uint16_t addr;
+  uint32_t size;
+} sym[SYMMAX];
+static int nsym = 257;
+static uint16_t symof[65536];
+
+// Profile of each session
+
+struct session {
+  uint64_t *cyc;         /* Cycles of each symbol */
+  uint64_t total;        /* All cycles */
+  uint64_t waitcyc;      /* Cycles waiting for the UART */
+  long rxbytes, txbytes; /* File data written and read */
+  long uartrx, uarttx;   /* UART bytes */
+};
+
+static struct session sess[SESSMAX];
+static int nsess = 0;
+static struct session *cur;
+
+static char *keys = "r"; /* Keys typed on the console */
+static int quiet = 0;
+static int toprows = TOPROWS;
+static int dbgchannel = -1;
+static int64_t nsrem = 0;
+
+static void newsession(void) {
+  if (nsess == SESSMAX) {
+    return; /* The last one continues */
+  }
+  cur = &sess[nsess++];
+  memset(cur, 0, sizeof(*cur));
+  cur->cyc = calloc(SYMMAX, sizeof(uint64_t));
+  if (!cur->cyc) {
+    perror(cmdname);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Symbol of a pseudo name (e.g. an API call), added if not known
+
+static int pseudo(const char *name) {
+  int i;
+
+  for (i = 257; i < nsym; i++) {
+    if ((sym[i].size == 0) && !strcmp(sym[i].name, name)) {
+      return (i);
+    }
+  }
+  if (nsym == SYMMAX) {
+    return (0);
+  }
+  snprintf(sym[nsym].name, NAMELEN, "%s", name);
+  sym[nsym].size = 0;
+  return (nsym++);
+}
+
+static void charge(int s, uint64_t n) {
+  cur->cyc[s] += n;
+  cur->total += n;
+}
+
+static uint32_t rd16(const uint8_t *p) { return (p[0] | (p[1] << 8)); }
+
+static uint32_t rd32(const uint8_t *p) {
+  return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+// Symbols loaded by load65.c
+
+static void addsym(const char *name, uint32_t addr, uint32_t size) {
+  if ((addr > 0xffff) || (nsym == SYMMAX) || !name[0]) {
+    return;
+  }
+  snprintf(sym[nsym].name, NAMELEN, "%s", name);
+  sym[nsym].addr = addr;
+  sym[nsym].size = size;
+  nsym++;
+}
+
+static int symcmp(const void *a, const void *b) {
+  const uint16_t x = *(const uint16_t *)a, y = *(const uint16_t *)b;
+  return ((sym[x].addr > sym[y].addr) - (sym[x].addr < sym[y].addr));
+}
+
+// Map each address to its symbol; a symbol without a size extends
+// to the next one
+
+static void mapsyms(void) {
+  static uint16_t order[SYMMAX];
+  uint32_t a, end;
+  int i, n;
+
+  for (i = 0; i < 256; i++) {
+    snprintf(sym[i + 1].name, NAMELEN, "$%02X00", i);
+  }
+  n = 0;
+  for (i = 257; i < nsym; i++) {
+    order[n++] = i;
+  }
+  qsort(order, n, sizeof(order[0]), symcmp);
+  for (a = 0; a < 0x10000; a++) {
+    symof[a] = (a >> 8) + 1;
+  }
+  for (i = 0; i < n; i++) {
+    a = sym[order[i]].addr;
+    end = a + sym[order[i]].size;
+    if (sym[order[i]].size == 0) {
+      end = (i + 1 < n) ? sym[order[i + 1]].addr : a + 1;
+      sym[order[i]].size = end - a;
+    }
+    for (; (a < end) && (a < 0x10000); a++) {
+      symof[a] = order[i];
+    }
+  }
+}
+
+// API calls
+
+static uint64_t synced = 0; /* Cycles on the simulated clock */
+
+static void syncclock(void) {
+  neosim_advance((int64_t)(cpu.cycles - synced) * NS_PER_CYCLE);
+  synced = cpu.cycles;
+}
+
+// Charge simulated time to a symbol, as cycles
+
+static void chargens(int s, int64_t ns) {
+  uint64_t n;
+
+  ns += nsrem;
+  n = ns / NS_PER_CYCLE;
+  nsrem = ns % NS_PER_CYCLE;
+  cpu.cycles += n;
+  synced += n; /* Already on the simulated clock */
+  charge(s, n);
+}
+
+static void pstring(char *buf, uint16_t addr) {
+  int len = mem[addr];
+
+  memcpy(buf, mem + addr + 1, len);
+  buf[len] = '\0';
+}
+
+static uint16_t param16(int i) { return (rd16(mem + API_PARAMS + i)); }
+
+static void setparam16(int i, uint16_t v) {
+  mem[API_PARAMS + i] = v & 0xff;
+  mem[API_PARAMS + i + 1] = v >> 8;
+}
+
+static void setparam32(int i, uint32_t v) {
+  setparam16(i, v & 0xffff);
+  setparam16(i + 2, v >> 16);
+}
+
+static int apicall(int group, int fn) {
+  char name[256], label[NAMELEN];
+  uint16_t addr, len, n;
+  uint32_t baud;
+  int64_t t0, wait;
+
+  syncclock();
+  t0 = neosim_time();
+  wait = 0;
+  snprintf(label, NAMELEN, "[neo %d,%d]", group, fn);
+  switch ((group << 8) | fn) {
+  case 0x0101:
+    setparam32(0, neo_system_timer());
+    snprintf(label, NAMELEN, "[neo system_timer]");
+    break;
+  case 0x0103: /* Exit to BASIC */
+    return (-1);
+  case 0x020c:
+  case 0x0301:
+    // Console output is not simulated, only its time
+    neosim_advance(NEOSIM_API_NS);
+    snprintf(label, NAMELEN, "[neo console]");
+    break;
+  case 0x0304:
+    pstring(name, param16(1));
+    neo_file_open(mem[API_PARAMS], name, mem[API_PARAMS + 3]);
+    if (!strcmp(name, DEBUG_CHANNEL_NAME) && !neo_api_error()) {
+      dbgchannel = mem[API_PARAMS];
+    }
+    snprintf(label, NAMELEN, "[neo file_open]");
+    break;
+  case 0x0305:
+    neo_file_close(mem[API_PARAMS]);
+    if ((mem[API_PARAMS] == dbgchannel) || (mem[API_PARAMS] == 0xff)) {
+      dbgchannel = -1;
+    }
+    snprintf(label, NAMELEN, "[neo file_close]");
+    break;
+  case 0x0306:
+    neo_file_seek(mem[API_PARAMS],
+                  param16(1) | ((uint32_t)param16(3) << 16));
+    snprintf(label, NAMELEN, "[neo file_seek]");
+    break;
+  case 0x0308:
+  case 0x0309:
+    addr = param16(1);
+    len = param16(3);
+    if (addr + len > 0x10000) {
+      len = 0x10000 - addr;
+    }
+    if (fn == 8) {
+      n = neo_file_read(mem[API_PARAMS], mem + addr, len);
+      cur->txbytes += n;
+      snprintf(label, NAMELEN, "[neo file_read]");
+    } else {
+      n = neo_file_write(mem[API_PARAMS], mem + addr, len);
+      if (mem[API_PARAMS] != dbgchannel) {
+        cur->rxbytes += n;
+      }
+      snprintf(label, NAMELEN, "[neo file_write]");
+    }
+    setparam16(3, n);
+    break;
+  case 0x030a:
+    setparam32(1, neo_file_size(mem[API_PARAMS]));
+    snprintf(label, NAMELEN, "[neo file_size]");
+    break;
+  case 0x030d:
+    pstring(name, param16(0));
+    neo_file_delete(name);
+    snprintf(label, NAMELEN, "[neo file_delete]");
+    break;
+  case 0x0a0e:
+    addr = param16(1);
+    len = param16(3);
+    if (addr + len > 0x10000) {
+      len = 0x10000 - addr;
+    }
+    neo_uext_uart_block_write(mem[API_PARAMS], mem + addr, len);
+    cur->uarttx += len;
+    snprintf(label, NAMELEN, "[neo uart_write]");
+    break;
+  case 0x0a0f:
+    baud = rd32(mem + API_PARAMS);
+    neo_uext_uart_configure(baud, mem[API_PARAMS + 4]);
+    snprintf(label, NAMELEN, "[neo uart_configure]");
+    break;
+  case 0x0a10:
+    neo_uext_uart_write(mem[API_PARAMS]);
+    cur->uarttx++;
+    snprintf(label, NAMELEN, "[neo uart_write]");
+    break;
+  case 0x0a11:
+    mem[API_PARAMS] = neo_uext_uart_read();
+    cur->uartrx++;
+    snprintf(label, NAMELEN, "[neo uart_read]");
+    break;
+  case 0x0a12:
+    mem[API_PARAMS] = neo_uext_uart_available();
+    // Beyond the API call itself, the time is waiting for a byte
+    wait = neosim_time() - t0 - NEOSIM_API_NS;
+    if (wait > 0) {
+      chargens(pseudo("[UART wait]"), wait);
+      cur->waitcyc += wait / NS_PER_CYCLE;
+    } else {
+      wait = 0;
+    }
+    snprintf(label, NAMELEN, "[neo uart_available]");
+    break;
+  default:
+    fprintf(stderr, "%s: unknown API call %d,%d at $%04X\n", cmdname, group,
+            fn, cpu.pc);
+    break;
+  }
+  mem[API_ERROR] = neo_api_error();
+  mem[API_GROUP] = 0; /* Done */
+  chargens(pseudo(label), neosim_time() - t0 - wait);
+  syncclock();
+  return (0);
+}
+
+// Kernel entry points; returns nonzero to end the run
+
+static int kernel(void) {
+  uint16_t ret;
+  uint8_t group, fn;
+  int c;
+
+  if (cpu.pc == K_BREAK) {
+    fprintf(stderr, "%s: BRK at $%04X\n", cmdname,
+            (cpu.mem[0x100 + ((cpu.s + 3) & 0xff)] << 8 |
+             cpu.mem[0x100 + ((cpu.s + 2) & 0xff)]) -
+                2);
+    return (-1);
+  }
+  ret = cpu65c02_pull(&cpu);
+  ret |= cpu65c02_pull(&cpu) << 8;
+  ret++;
+  cpu.cycles += KERNEL_CYCLES;
+  charge(pseudo("[kernel]"), KERNEL_CYCLES);
+  switch (cpu.pc) {
+  case K_SENDMESSAGE:
+    group = mem[ret];
+    fn = mem[ret + 1];
+    ret += 2;
+    mem[API_GROUP] = group;
+    mem[API_FUNCTION] = fn;
+    if (apicall(group, fn) < 0) {
+      return (-1);
+    }
+    break;
+  case K_WAITMESSAGE:
+    break;
+  case K_WRITECHAR:
+    c = cpu.a;
+    if (!quiet) {
+      if (c == 13) {
+        fputc('\n', stderr);
+      } else if ((c >= 32) && (c < 127)) {
+        fputc(c, stderr);
+      }
+    }
+    break;
+  case K_READCHAR:
+    // The next session starts with each key
+    if (!*keys) {
+      return (-1);
+    }
+    cpu.a = (uint8_t)*keys++;
+    newsession();
+    break;
+  default:
+    fprintf(stderr, "%s: unknown kernel call $%04X\n", cmdname, cpu.pc);
+    return (-1);
+  }
+  cpu.pc = ret;
+  return (0);
+}
+
+// Keys, with \n or \r for Enter, \xHH and \\ as escapes
+
+static char *unescape(char *s) {
+  char *t, *d;
+  unsigned int x;
+
+  t = d = malloc(strlen(s) + 1);
+  while (*s) {
+    if (*s != '\\') {
+      *d++ = *s++;
+      continue;
+    }
+    s++;
+    if ((*s == 'n') || (*s == 'r')) {
+      *d++ = 13;
+      s++;
+    } else if ((*s == 'x') && (sscanf(s + 1, "%2x", &x) == 1)) {
+      *d++ = (char)x;
+      s += 3;
+    } else if (*s) {
+      *d++ = *s++;
+    }
+  }
+  *d = '\0';
+  return (t);
+}
+
+// Report
+
+static int rowcmp(const void *a, const void *b) {
+  uint64_t x = cur->cyc[*(const uint16_t *)a];
+  uint64_t y = cur->cyc[*(const uint16_t *)b];
+  return ((x < y) - (x > y));
+}
+
+static void report(FILE *fp) {
+  static uint16_t rows[SYMMAX];
+  uint64_t other, busy;
+  double kb;
+  long bytes;
+  int i, j, n;
+
+  for (i = 0; i < nsess; i++) {
+    cur = &sess[i];
+    if ((cur->uartrx == 0) && (cur->uarttx == 0)) {
+      continue;
+    }
+    bytes = (cur->rxbytes >= cur->txbytes) ? cur->rxbytes : cur->txbytes;
+    kb = bytes / 1024.0;
+    busy = cur->total - cur->waitcyc;
+    fprintf(fp,
+            "session %d: %ld bytes %s, UART rx %ld tx %ld bytes\n"
+            "  %llu cycles (%.3f sec), %llu busy, %.0f bytes/sec\n",
+            i + 1, bytes, (cur->rxbytes >= cur->txbytes) ? "received" : "sent",
+            cur->uartrx, cur->uarttx, (unsigned long long)cur->total,
+            (double)cur->total / CPU_HZ, (unsigned long long)busy,
+            (cur->total > 0) ? bytes * (double)CPU_HZ / cur->total : 0.0);
+    n = 0;
+    for (j = 0; j < nsym; j++) {
+      if (cur->cyc[j] > 0) {
+        rows[n++] = j;
+      }
+    }
+    qsort(rows, n, sizeof(rows[0]), rowcmp);
+    fprintf(fp, "  %-28s %12s %6s %12s\n", "symbol", "cycles", "%",
+            "cycles/KB");
+    other = 0;
+    for (j = 0; j < n; j++) {
+      if (j >= toprows) {
+        other += cur->cyc[rows[j]];
+        continue;
+      }
+      fprintf(fp, "  %-28s %12llu %6.2f %12.0f\n", sym[rows[j]].name,
+              (unsigned long long)cur->cyc[rows[j]],
+              100.0 * cur->cyc[rows[j]] / cur->total,
+              (kb > 0) ? cur->cyc[rows[j]] / kb : 0.0);
+    }
+    if (other > 0) {
+      fprintf(fp, "  %-28s %12llu %6.2f %12.0f\n", "(other)",
+              (unsigned long long)other, 100.0 * other / cur->total,
+              (kb > 0) ? other / kb : 0.0);
+    }
+  }
+}
+
+// Exit function, also called by neosim.c when the peer is gone
+
+void doexit(int status) {
+  fflush(stderr);
+  report(stdout);
+  neosim_report(stderr);
+  exit(status);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options] program\n"
+          "  program   kermit.neo, or its ELF file\n"
+          "  -k keys   keys typed on the console (default: r)\n"
+          "  -y file   symbols, an ELF file or llvm-objdump -t output\n"
+          "  -n rows   symbols shown per session (default %d)\n"
+          "  -q        do not show the console output\n"
+          "  -l line   tty or pty of the peer\n"
+          "  -p cmd    run the peer command with pipes\n"
+          "  -u file   scripted peer input, a packet at a time\n"
+          "  -U file   save the peer input as a script\n"
+          "  -d dir    host directory for the Neo filesystem (default: .)\n"
+          "  -B bps    UART speed (default: as set by the program)\n"
+          "  -F n      UART receive FIFO depth in bytes (default %d)\n"
+          "  -W us     file write latency per call (default %ld)\n"
+          "  -w ns     file write latency per byte (default %ld)\n"
+          "  -R us     file read latency per call (default %ld)\n",
+          cmdname, TOPROWS, NEOSIM_FIFO, NEOSIM_WRITE_NS / 1000,
+          NEOSIM_WRITE_NS_BYTE, NEOSIM_READ_NS / 1000);
+  exit(EXIT_FAILURE);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  struct neosim_config cf;
+  char *symfile = 0;
+  uint8_t *prog, *st;
+  long len, stlen;
+  uint16_t exec;
+  int i, s;
+
+  neosim_defaults(&cf);
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-q")) {
+      quiet = 1;
+    } else if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-k")) {
+      keys = unescape(argv[++i]);
+    } else if (!strcmp(argv[i], "-y")) {
+      symfile = argv[++i];
+    } else if (!strcmp(argv[i], "-n")) {
+      toprows = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-l")) {
+      cf.line = argv[++i];
+    } else if (!strcmp(argv[i], "-p")) {
+      cf.peer = argv[++i];
+    } else if (!strcmp(argv[i], "-u")) {
+      cf.script = argv[++i];
+    } else if (!strcmp(argv[i], "-U")) {
+      cf.record = argv[++i];
+    } else if (!strcmp(argv[i], "-d")) {
+      cf.dir = argv[++i];
+    } else if (!strcmp(argv[i], "-B")) {
+      cf.baud = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-F")) {
+      cf.fifo = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-W")) {
+      cf.write_ns = atol(argv[++i]) * 1000L;
+    } else if (!strcmp(argv[i], "-w")) {
+      cf.write_ns_byte = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-R")) {
+      cf.read_ns = atol(argv[++i]) * 1000L;
+    } else {
+      usage();
+    }
+  }
+  if (i + 1 != argc) {
+    usage();
+  }
+  // The API calls are timed here, not by neosim.c
+  cf.api_ns = NEOSIM_API_NS;
+  cf.cpu_scale = 0.0;
+
+  prog = load65_file(argv[i], &len);
+  if (!prog) {
+    exit(EXIT_FAILURE);
+  }
+  if (load65_neo(mem, prog, len, &exec) < 0 &&
+      load65_elf(mem, prog, len, &exec, symfile ? 0 : addsym) < 0) {
+    fprintf(stderr, "%s: %s: not a .neo or ELF file\n", cmdname, argv[i]);
+    exit(EXIT_FAILURE);
+  }
+  if (symfile) {
+    st = load65_file(symfile, &stlen);
+    if (!st) {
+      exit(EXIT_FAILURE);
+    }
+    if (load65_elf(mem, st, stlen, 0, addsym) < 0) {
+      load65_listing((char *)st, addsym);
+    }
+  }
+  mapsyms();
+
+  mem[0xfffe] = K_BREAK & 0xff;
+  mem[0xffff] = K_BREAK >> 8;
+  if (neosim_init(&cf) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  newsession();
+  cpu65c02_reset(&cpu, mem, exec);
+  for (;;) {
+    if (cpu.pc >= K_TRAP) {
+      if (kernel() < 0) {
+        break;
+      }
+      continue;
+    }
+    if (cpu.stopped) {
+      fprintf(stderr, "%s: stopped at $%04X\n", cmdname, cpu.pc - 1);
+      break;
+    }
+    s = symof[cpu.pc];
+    charge(s, cpu65c02_step(&cpu));
+  }
+  doexit(EXIT_SUCCESS);
+  return (0);
+}
@@ -0,0 +1,356 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// Neo6502-Kermit simulator main program
+// By Kenji Rikitake
+
+// This runs the Neo6502 I/O backend (neoio.c) unmodified with the
+// protocol engine (kermit.c) on a host, over the Neo6502 API
+// simulator in neosim.c, so that the UART overrun ceiling and the
+// effect of file I/O latency can be reproduced without a board.
+// Messages go to stderr; times and speeds are simulated ones.
+
+#include "arena.h"    // Memory arena of the buffers
+#include "cdefs.h"    // Data types for all modules
+#include "debug.h"    // Debugging
+#include "kermit.h"   // Kermit symbols and data structures
+#include "kio.h"      // I/O backend (neoio.c)
+#include "phase.h"    // Phase timing
+#include "progress.h" // Status line of a transfer
+#include "sendlist.h" // Files to send
+#include "trace.h"    // Tracing
+
+#include <neo/api.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "neosim.h"
+
+// Data global to this module
+
+struct k_data k;     /* Kermit data structure */
+struct k_response r; /* Kermit response structure */
+#ifdef ZPHOT
+ZEROPAGE struct k_hot zphot; /* Hot part of k (see kermit.h) */
+#endif                       /* ZPHOT */
+
+static char *cmdname = "kermit-sim";
+
+// Default bytes of the memory arena, about the free RAM of a Neo6502
+#define SIM_ARENA (24576)
+
+// Exit function for the program
+
+void doexit(int status) {
+#ifdef DEBUG
+  // Close debug log
+  debug(DB_CLS, "", 0, 0);
+#endif // DEBUG
+  // Write the trace, with the error if any
+  if (status != 0) {
+    trace(TR_ERROR, k.state, 0, 0, status);
+  }
+  traceflush();
+  // Close all files
+  neo_file_close((uint8_t)0xff);
+  neosim_report(stderr);
+  if (status != 0) {
+    fprintf(stderr, "%s: doexit status=%d\n", cmdname, status);
+  }
+  exit(status);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options] -r | -S | -s file...\n"
+          "  -r        receive files\n"
+          "  -S        serve GET, SEND, REMOTE DIR until FINISH or BYE\n"
+          "  -s file.. send files or patterns (* and ?) in the Neo directory\n"
+          "  -l line   tty or pty of the peer (default: stdin and stdout)\n"
+          "  -p cmd    run the peer command with pipes\n"
+          "  -u file   scripted peer input, a packet at a time\n"
+          "  -U file   save the peer input as a script\n"
+          "  -d dir    host directory for the Neo filesystem (default: .)\n"
+          "  -B bps    UART speed (default: as set by neoio.c)\n"
+          "  -F n      UART receive FIFO depth in bytes (default %d)\n"
+          "  -A us     time of each API call (default %ld)\n"
+          "  -W us     file write latency per call (default %ld)\n"
+          "  -w ns     file write latency per byte (default %ld)\n"
+          "  -R us     file read latency per call (default %ld)\n"
+          "  -x n      6502 time per host CPU time (default: not counted)\n"
+          "  -b n      block check type 1, 2, or 3 (default 3)\n"
+          "  -P        prefix all control characters (default: minimal)\n"
+          "  -M bytes  free RAM for the buffers (default %d)\n",
+          cmdname, NEOSIM_FIFO, NEOSIM_API_NS / 1000, NEOSIM_WRITE_NS / 1000,
+          NEOSIM_WRITE_NS_BYTE, NEOSIM_READ_NS / 1000, SIM_ARENA);
+  exit(FAILURE);
+}
+
+// Show the statistics of the session (see struct k_metrics)
+
+static void statsshow(struct k_metrics *m) {
+  fprintf(stderr,
+          "%s: line %lu bytes in, %lu out, %lu file bytes in %lu.%02lu sec\n",
+          cmdname, m->wirein, m->wireout, m->payload, m->elapsed / 100,
+          m->elapsed % 100);
+  fprintf(stderr,
+          "%s: packets %lu in, %lu out, %lu NAKs, %lu resent, "
+          "%lu block check errors, %lu timeouts\n",
+          cmdname, m->pktsin, m->pktsout, m->naks, m->resends, m->chkerrs,
+          m->timeouts);
+}
+
+// Server: answer a GET by sending the files, or an Error packet
+// if nothing can be read
+
+static int serverget(void) {
+  sendlistclear();
+  if (sendlistadd((const char *)r.filename) <= 0) {
+    fprintf(stderr, "%s: GET %s: no such file\n", cmdname, r.filename);
+    return kermit(K_ERROR, &k, 0, 0, "No such file", &r);
+  }
+  progressbegin(sendlistbytes());
+  return kermit(K_SEND, &k, 0, 0, "", &r);
+}
+
+// Server: answer a REMOTE DIR by sending the listing as text to display
+
+static int serverdir(void) {
+  static UCHAR *dirlist[2];
+
+  dirlist[0] = r.filename;
+  dirlist[1] = (UCHAR *)0;
+  k.filelist = dirlist;
+  k.nextf = 0;
+  k.display = 1;
+  k.openf = openlisting;
+  k.readf = readlisting;
+  k.closef = closelisting;
+  return kermit(K_SEND, &k, 0, 0, "", &r);
+}
+
+// Main program
+
+int main(int argc, char **argv) {
+  struct neosim_config cf;
+  char **sendargs;
+  int rx_len, i;
+  UCHAR *inbuf;
+  short r_slot;
+  int status;
+  int action;
+  int check;
+  int prefixing;
+  long total;
+  double sec;
+  long arena;
+  UCHAR *mem;
+
+  neosim_defaults(&cf);
+  action = A_NONE;
+  check = 3;
+  prefixing = PFX_MINIMAL;
+  sendargs = 0;
+  arena = SIM_ARENA;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r")) {
+      action = A_RECV;
+    } else if (!strcmp(argv[i], "-s")) {
+      action = A_SEND;
+      // Files or patterns to send are the remaining arguments
+      sendargs = &argv[i + 1];
+      if (!argv[i + 1]) {
+        usage();
+      }
+      break;
+    } else if (!strcmp(argv[i], "-S")) {
+      action = A_SERV;
+    } else if (!strcmp(argv[i], "-P")) {
+      prefixing = PFX_ALL;
+    } else if (i + 1 >= argc) {
+      usage();
+    } else if (!strcmp(argv[i], "-l")) {
+      cf.line = argv[++i];
+    } else if (!strcmp(argv[i], "-p")) {
+      cf.peer = argv[++i];
+    } else if (!strcmp(argv[i], "-u")) {
+      cf.script = argv[++i];
+    } else if (!strcmp(argv[i], "-U")) {
+      cf.record = argv[++i];
+    } else if (!strcmp(argv[i], "-d")) {
+      cf.dir = argv[++i];
+    } else if (!strcmp(argv[i], "-B")) {
+      cf.baud = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-F")) {
+      cf.fifo = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-A")) {
+      cf.api_ns = atol(argv[++i]) * 1000L;
+    } else if (!strcmp(argv[i], "-W")) {
+      cf.write_ns = atol(argv[++i]) * 1000L;
+    } else if (!strcmp(argv[i], "-w")) {
+      cf.write_ns_byte = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "-R")) {
+      cf.read_ns = atol(argv[++i]) * 1000L;
+    } else if (!strcmp(argv[i], "-x")) {
+      cf.cpu_scale = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-b")) {
+      check = atoi(argv[++i]);
+      if ((check < 1) || (check > 3)) {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "-M")) {
+      arena = atol(argv[++i]);
+      if ((arena < 1) || (arena > 0xffffL)) {
+        usage();
+      }
+    } else {
+      usage();
+    }
+  }
+  if (action == A_NONE) {
+    usage();
+  }
+  if (neosim_init(&cf) < 0) {
+    exit(FAILURE);
+  }
+
+#ifdef DEBUG
+  debug(DB_OPN, "DEBUG enabled", 0, 0);
+#endif // DEBUG
+
+  // Buffers from the free RAM, as in main.c
+  mem = malloc(arena);
+  if (!mem || (arenainit(mem, (unsigned int)arena) < 0)) {
+    fprintf(stderr, "%s: not enough memory in %ld bytes\n", cmdname, arena);
+    exit(FAILURE);
+  }
+  arenashow();
+  arenaattach(&k);
+  devinit();
+
+  // Files to send, as entered in main.c
+  for (; sendargs && *sendargs; sendargs++) {
+    if ((i = sendlistadd(*sendargs)) < 0) {
+      fprintf(stderr, "%s: too many names at %s\n", cmdname, *sendargs);
+      doexit(FAILURE);
+    } else if (i == 0) {
+      fprintf(stderr, "%s: %s: no such file\n", cmdname, *sendargs);
+    }
+  }
+  if ((action == A_SEND) && (sendlistfiles() == 0)) {
+    doexit(FAILURE);
+  }
+
+  // A server runs a session for each transaction until FINISH
+  total = 0;
+  do {
+    // Parameters for this run
+
+    k.xfermode = 0;
+    k.remote = 1;
+    k.binary = 1;
+    k.parity = P_PARITY;
+    k.prefixing = prefixing;
+    k.bct = check;
+    k.bctf = 0;
+    k.ikeep = 0;
+    k.cancel = 0;
+    k.server = (action == A_SERV);
+
+    //  The buffers are set up by arenaattach()
+
+    khot(&k)->zincnt = 0;  /* File input buffer position */
+    khot(&k)->obufpos = 0; /* File output buffer position */
+
+    // Fill in function pointers
+
+    k.rxd = readpkt;        /* for reading packets */
+    k.txd = tx_data;        /* for sending packets */
+    k.ixd = inchk;          /* for checking connection */
+    k.openf = openfile;     /* for opening files */
+    k.finfo = fileinfo;     /* for getting file info */
+    k.readf = readfile;     /* for reading files */
+    k.writef = writefile;   /* for writing to output file */
+    k.closef = closefile;   /* for closing files */
+    k.nextf = sendlistnext; /* for the next file to send */
+#ifdef DEBUG
+    k.dbf = dodebug; /* for debugging */
+#else
+    k.dbf = 0;
+#endif /* DEBUG */
+#ifdef PHASE
+    k.phf = dophase; /* for phase timing */
+#else
+    k.phf = 0;
+#endif /* PHASE */
+
+    // Initialize Kermit protocol
+    status = kermit(K_INIT, &k, 0, 0, "", &r);
+    if (status == X_ERROR) {
+      doexit(FAILURE);
+    }
+    trace(TR_OPEN, k.state, action, 0, 0);
+    phasereset();
+    progressbegin((action == A_SEND) ? sendlistbytes() : 0L);
+    if (action == A_SEND) {
+      sendlistrewind();
+      status = kermit(K_SEND, &k, 0, 0, "", &r);
+    }
+
+    while (status != X_DONE) {
+      inbuf = getrslot(&k, &r_slot);       /* Allocate a window slot */
+      rx_len = k.rxd(&k, inbuf, k.pktmax); /* Try to read a packet */
+      if (rx_len < 1) {                    /* No data was read */
+        freerslot(&k, r_slot);             /* So free the window slot */
+        if (rx_len < 0) {                  /* If there was a fatal error */
+          doexit(FAILURE);                 /* give up */
+        }
+      }
+      status = kermit(K_RUN, &k, r_slot, rx_len, "", &r);
+      switch (status) {
+      case X_OK:
+        if (r.status == SV_GET) {
+          status = serverget();
+        } else if (r.status == SV_DIR) {
+          status = serverdir();
+        } else if (((k.what == W_SEND) && (r.status == S_EOF)) ||
+                   ((k.what == W_RECV) && (r.status == R_FILE) &&
+                    (r.filename[0] != '\0'))) {
+          // End of a file
+          progressend(&k, &r);
+          if (r.sofar > 0) {
+            fprintf(stderr, "%s: %s %ld bytes\n", cmdname, r.filename,
+                    r.sofar);
+            total += r.sofar;
+            r.sofar = 0;
+          }
+        } else {
+          progress(&k, &r);
+        }
+        break;
+      case X_DONE:
+        trace(TR_DONE, k.state, 0, 0, 0);
+        traceflush();
+        phasereport();
+        break;
+      case X_ERROR:
+        if (action == A_SERV) { /* Wait for the next command */
+          fprintf(stderr, "%s: server transaction failed\n", cmdname);
+          status = X_DONE;
+          break;
+        }
+        doexit(FAILURE);
+      }
+    }
+  } while ((action == A_SERV) && (r.status != SV_FINISH));
+  sec = neosim_time() / 1e9;
+  fprintf(stderr, "%s: %ld bytes in %.3f sec, %.0f bytes/sec\n", cmdname,
+          total, sec, (sec > 0.0) ? total / sec : 0.0);
+  (void)kermit(K_STATUS, &k, 0, 0, "", &r);
+  statsshow(&r.metrics);
+  doexit(SUCCESS);
+  return (SUCCESS);
+}
@@ -0,0 +1,228 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// Neo6502-Kermit host (POSIX) main program
+// By Kenji Rikitake
+// Based on E-Kermit 1.8 main.c
+// Author: Frank da Cruz, the Kermit Project, Columbia University, New York.
+
+// This runs the same protocol engine (kermit.c) as the Neo6502
+// program, with the posixio.c backend, so that transfers against
+// C-Kermit can be run and measured on a host.
+// Messages go to stderr, since stdin and stdout may be the
+// communication device.
+
+#include "cdefs.h"   // Data types for all modules
+#include "debug.h"   // Debugging
+#include "kermit.h"  // Kermit symbols and data structures
+#include "kio.h"     // I/O backend (posixio.c)
+#include "posixio.h" // Host only functions of the backend
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Data global to this module
+
+struct k_data k;     /* Kermit data structure */
+struct k_response r; /* Kermit response structure */
+
+static char *cmdname = "kermit-host";
+
+// Exit function for the program
+
+void doexit(int status) {
+#ifdef DEBUG
+  // Close debug log
+  debug(DB_CLS, "", 0, 0);
+#endif // DEBUG
+  devrestore();
+  if (status != 0) {
+    fprintf(stderr, "%s: doexit status=%d\n", cmdname, status);
+  }
+  exit(status);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [options] -r | -s file...\n"
+          "  -r        receive files\n"
+          "  -s file.. send files\n"
+          "  -l line   tty or pty to use (default: stdin and stdout)\n"
+          "  -b n      block check type 1, 2, or 3 (default 3)\n"
+          "  -P        prefix all control characters (default: minimal)\n"
+          "  -k        keep incompletely received files\n",
+          cmdname);
+  exit(FAILURE);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Main program
+
+// Show the statistics of the session (see struct k_metrics)
+
+static void statsshow(struct k_metrics *m) {
+  fprintf(stderr,
+          "%s: line %lu bytes in, %lu out, %lu file bytes in %lu.%02lu sec\n",
+          cmdname, m->wirein, m->wireout, m->payload, m->elapsed / 100,
+          m->elapsed % 100);
+  fprintf(stderr,
+          "%s: packets %lu in, %lu out, %lu NAKs, %lu resent, "
+          "%lu block check errors, %lu timeouts\n",
+          cmdname, m->pktsin, m->pktsout, m->naks, m->resends, m->chkerrs,
+          m->timeouts);
+}
+
+int main(int argc, char **argv) {
+  int rx_len, i;
+  UCHAR *inbuf;
+  short r_slot;
+  int status;
+  int action;
+  int check;
+  int prefixing;
+  int keep;
+  char *line;
+  double t0, t1;
+  long total;
+
+  action = A_NONE;
+  check = 3;
+  prefixing = PFX_MINIMAL;
+  keep = 0;
+  line = (char *)0;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r")) {
+      action = A_RECV;
+    } else if (!strcmp(argv[i], "-s")) {
+      action = A_SEND;
+      // Files to send are the remaining arguments
+      k.filelist = (UCHAR **)&argv[i + 1];
+      if (!argv[i + 1]) {
+        usage();
+      }
+      break;
+    } else if (!strcmp(argv[i], "-l") && (i + 1 < argc)) {
+      line = argv[++i];
+    } else if (!strcmp(argv[i], "-b") && (i + 1 < argc)) {
+      check = atoi(argv[++i]);
+      if ((check < 1) || (check > 3)) {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "-P")) {
+      prefixing = PFX_ALL;
+    } else if (!strcmp(argv[i], "-k")) {
+      keep = 1;
+    } else {
+      usage();
+    }
+  }
+  if (action == A_NONE) {
+    usage();
+  }
+
+#ifdef DEBUG
+  debug(DB_OPN, "DEBUG enabled", 0, 0);
+#endif // DEBUG
+
+  if (devopen(line) < 0) {
+    doexit(FAILURE);
+  }
+  devinit();
+
+  // Parameters for this run
+
+  k.xfermode = 0;
+  k.remote = 1;
+  k.binary = 1;
+  k.parity = P_PARITY;
+  k.prefixing = prefixing;
+  k.bct = check;
+  k.bctf = 0;
+  k.ikeep = keep;
+  k.cancel = 0;
+
+  //  Fill in the i/o pointers
+
+  k.zinbuf = i_buf;      /* File input buffer */
+  k.zinlen = IBUFLEN;    /* File input buffer length */
+  khot(&k)->zincnt = 0;  /* File input buffer position */
+  k.obuf = o_buf;        /* File output buffer */
+  k.obuflen = OBUFLEN;   /* File output buffer length */
+  khot(&k)->obufpos = 0; /* File output buffer position */
+
+  // Fill in function pointers
+
+  k.rxd = readpkt;      /* for reading packets */
+  k.txd = tx_data;      /* for sending packets */
+  k.ixd = inchk;        /* for checking connection */
+  k.openf = openfile;   /* for opening files */
+  k.finfo = fileinfo;   /* for getting file info */
+  k.readf = readfile;   /* for reading files */
+  k.writef = writefile; /* for writing to output file */
+  k.closef = closefile; /* for closing files */
+#ifdef DEBUG
+  k.dbf = dodebug; /* for debugging */
+#else
+  k.dbf = 0;
+#endif /* DEBUG */
+  k.phf = 0;   /* No phase timing */
+  k.nextf = 0; /* File names from k.filelist */
+  k.io = 0;    /* The session of devopen() */
+
+  // Initialize Kermit protocol
+  status = kermit(K_INIT, &k, 0, 0, "", &r);
+  if (status == X_ERROR) {
+    doexit(FAILURE);
+  }
+  if (action == A_SEND) {
+    status = kermit(K_SEND, &k, 0, 0, "", &r);
+  }
+
+  t0 = now();
+  total = 0;
+  while (status != X_DONE) {
+    inbuf = getrslot(&k, &r_slot);       /* Allocate a window slot */
+    rx_len = k.rxd(&k, inbuf, P_PKTLEN); /* Try to read a packet */
+    if (rx_len < 1) {                    /* No data was read */
+      freerslot(&k, r_slot);             /* So free the window slot */
+      if (rx_len < 0) {                  /* If there was a fatal error */
+        doexit(FAILURE);                 /* give up */
+      }
+    }
+    status = kermit(K_RUN, &k, r_slot, rx_len, "", &r);
+    switch (status) {
+    case X_OK:
+      if (((action == A_SEND) && (r.status == S_EOF)) ||
+          ((action == A_RECV) && (r.status == R_FILE) &&
+           (r.filename[0] != '\0'))) {
+        // End of a file
+        if (r.sofar > 0) {
+          fprintf(stderr, "%s: %s %ld bytes\n", cmdname, r.filename,
+                  r.sofar);
+          total += r.sofar;
+          r.sofar = 0;
+        }
+      }
+      break;
+    case X_DONE:
+      break;
+    case X_ERROR:
+      doexit(FAILURE);
+    }
+  }
+  t1 = now();
+  fprintf(stderr, "%s: %ld bytes in %.3f sec, %.0f bytes/sec\n", cmdname,
+          total, t1 - t0, (t1 > t0) ? total / (t1 - t0) : 0.0);
+  (void)kermit(K_STATUS, &k, 0, 0, "", &r);
+  statsshow(&r.metrics);
+  doexit(SUCCESS);
+  return (SUCCESS);
+}
@@ -0,0 +1,99 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// kasm.c
+// C reference versions of the kernels in kasm.s
+// Author: Kenji Rikitake
+
+// These do what the 65C02 assembler versions do, byte for byte, in the
+// way of the loops of kermit.c they replace.  See kasm.h.  A repeat
+// count below 1, which no Kermit sends, is taken as 1.
+
+#include <neo/api.h>
+
+#include "cdefs.h"
+#include "kasm.h"
+
+// CRC tables of chk3(), as set up by K_INIT in kermit.c
+
+static const USHORT crcta[16] = {0,       010201,  020402,  030603,
+                                 041004,  051205,  061406,  071607,
+                                 0102010, 0112211, 0122412, 0132613,
+                                 0143014, 0153215, 0163416, 0173617};
+
+static const USHORT crctb[16] = {0,       010611,  021422,  031233,
+                                 043044,  053655,  062466,  072277,
+                                 0106110, 0116701, 0127532, 0137323,
+                                 0145154, 0155745, 0164576, 0174367};
+
+USHORT kchk2(UCHAR *p) {
+  USHORT chk;
+
+  for (chk = 0; *p != '\0'; p++) {
+    chk += *p;
+  }
+  return (chk);
+}
+
+USHORT kchk3(UCHAR *p) {
+  USHORT c, crc;
+
+  for (crc = 0; *p != '\0'; p++) {
+    c = crc ^ *p;
+    crc = (crc >> 8) ^ (crcta[(c & 0xF0) >> 4] ^ crctb[c & 0x0F]);
+  }
+  return (crc);
+}
+
+void kdecode(struct kdec *d) {
+  UCHAR a, a7;
+  int n;
+
+  for (;;) {
+    while (d->rpt > 0) { /* Write the copies */
+      *d->out++ = d->byte;
+      d->rpt--;
+      if (d->out == d->end) {
+        return;
+      }
+    }
+    a = *d->in;
+    if (a == '\0') { /* End of the data field */
+      return;
+    }
+    d->in++;
+    n = 1;
+    if (a == d->rptq) { /* Repeat prefix, count, and the character */
+      n = *d->in++ - 32;
+      if (n < 1) {
+        n = 1;
+      }
+      a = *d->in++;
+    }
+    if (a == d->ctlq) { /* Control prefix and its operand */
+      a = *d->in++;
+      a7 = a & 0x7F;
+      if ((a7 >= 0100 && a7 <= 0137) || a7 == '?') {
+        a ^= 64;
+      }
+    }
+    d->byte = a;
+    d->rpt = (UCHAR)n;
+  }
+}
+
+void krecv(struct krx *x) {
+  UCHAR c;
+
+  while (x->n > 0) {
+    while (!neo_uext_uart_available()) {
+    }
+    c = neo_uext_uart_read();
+    if ((c == x->soh) || (c == x->eom) || (c == x->brk)) {
+      x->stop = c;
+      return;
+    }
+    *x->p++ = c;
+    x->n--;
+  }
+}
@@ -0,0 +1,60 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// kasm.h -- Kernels of the hot loops, in 65C02 assembler or C
+
+// With KASM defined (KASM = -DKASM in Makefile), the block checks and
+// decode() in kermit.c, and the receive loop of readpkt() in neoio.c,
+// run their per-byte loops in these kernels.  kasm.s has them in 65C02
+// assembler for kermit.neo, with the state in the zero page and the
+// loops unrolled; kasm.c has the C reference versions, which kermit-sim
+// uses, and which kermit-asmtest compares the assembler versions with.
+//
+// Each kernel takes a single pointer, so that the assembler versions
+// get it in __rc2/__rc3 under the LLVM-MOS calling convention, and the
+// structures have only 8-bit and 16-bit members, laid out on the Neo6502
+// at the offsets given: keep kasm.s in step with them.
+
+#ifndef __KASM_H__
+#define __KASM_H__
+
+#include "cdefs.h"
+
+// State of kdecode(), kept between calls while the output is flushed
+
+struct kdec {
+  UCHAR *in;  /* 0: Next byte of the data field, NUL-terminated */
+  UCHAR *out; /* 2: Next byte of the output */
+  UCHAR *end; /* 4: End of the output, more than out on entry */
+  UCHAR ctlq; /* 6: Control prefix */
+  UCHAR rptq; /* 7: Repeat prefix, or NUL if not negotiated */
+  UCHAR rpt;  /* 8: Copies of byte still to be written */
+  UCHAR byte; /* 9: Byte being repeated */
+};
+
+// State of krecv()
+
+struct krx {
+  UCHAR *p;   /* 0: Where to store the next byte */
+  USHORT n;   /* 2: Bytes still to be read, at least 1 on entry */
+  UCHAR soh;  /* 4: The bytes that stop the read, not stored: */
+  UCHAR eom;  /* 5:   start and end of packet, */
+  UCHAR brk;  /* 6:   and ^C in remote mode (else one of the others) */
+  UCHAR stop; /* 7: The byte that stopped it, if n is not 0 */
+};
+
+// Sum of the bytes of a NUL-terminated string, 16 bits
+USHORT kchk2(UCHAR *);
+
+// CRC-CCITT of a NUL-terminated string, as chk3() in kermit.c
+USHORT kchk3(UCHAR *);
+
+// Decode the data field to the output until either ends: the output
+// is full if out == end on return, else the data field has ended
+// (*in is NUL) with no copies left to write
+void kdecode(struct kdec *);
+
+// Read bytes from the UART until n is 0 or a stop byte comes
+void krecv(struct krx *);
+
+#endif /* __KASM_H__ */
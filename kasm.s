@@ -0,0 +1,335 @@
+; This file is a part of Neo6502-Kermit.
+; See LICENSE for the licensing details.
+
+; kasm.s
+; Kernels of the hot loops in 65C02 assembler
+; Author: Kenji Rikitake
+
+; See kasm.h for what each kernel does, and kasm.c for the C reference
+; versions.  The only argument, a pointer, comes in __rc2/__rc3, and a
+; 16-bit result goes back in A (low) and X (high), under the LLVM-MOS
+; calling convention; A, X, Y and __rc2 to __rc13 are not preserved.
+; The state is kept in the zero page, in the imaginary registers from
+; __rc4 up, while a kernel runs.
+
+; Neo6502 kernel entry points and API, as called by the LLVM-MOS SDK
+KSendMessage = $fff7           ; Followed by the group and function bytes
+KWaitMessage = $fff4
+API_PARAMS = $ff04
+API_GROUP_UEXT = 10
+API_FN_UART_READ = 17
+API_FN_UART_AVAILABLE = 18
+
+; USHORT kchk2(UCHAR *p)
+; Sum in X (high) and __rc4 (low), Y indexes the page of p, unrolled
+; twice: about 22 cycles a byte
+
+  .section .text.kchk2,"ax",@progbits
+  .global kchk2
+  .type kchk2,@function
+kchk2:
+  ldx #0
+  stz __rc4
+  ldy #0
+.Lchk2a:
+  lda (__rc2),y
+  beq .Lchk2end
+  clc
+  adc __rc4
+  sta __rc4
+  bcc .Lchk2b
+  inx
+.Lchk2b:
+  iny                          ; Now odd, so not 0
+  lda (__rc2),y
+  beq .Lchk2end
+  clc
+  adc __rc4
+  sta __rc4
+  bcc .Lchk2c
+  inx
+.Lchk2c:
+  iny
+  bne .Lchk2a
+  inc __rc3                    ; Next page
+  bra .Lchk2a
+.Lchk2end:
+  lda __rc4
+  rts
+  .size kchk2, .-kchk2
+
+; USHORT kchk3(UCHAR *p)
+; CRC in __rc5 (high) and __rc4 (low), a byte at a time with the tables
+; below, which are the nibble tables of kermit.c combined, unrolled
+; twice: about 34 cycles a byte
+
+  .section .text.kchk3,"ax",@progbits
+  .global kchk3
+  .type kchk3,@function
+kchk3:
+  stz __rc4
+  stz __rc5
+  ldy #0
+.Lchk3a:
+  lda (__rc2),y
+  beq .Lchk3end
+  eor __rc4                    ; Index: low byte of CRC ^ c
+  tax
+  lda __rc5                    ; CRC >> 8 ^ table
+  eor kcrclo,x
+  sta __rc4
+  lda kcrchi,x
+  sta __rc5
+  iny                          ; Now odd, so not 0
+  lda (__rc2),y
+  beq .Lchk3end
+  eor __rc4
+  tax
+  lda __rc5
+  eor kcrclo,x
+  sta __rc4
+  lda kcrchi,x
+  sta __rc5
+  iny
+  bne .Lchk3a
+  inc __rc3                    ; Next page
+  bra .Lchk3a
+.Lchk3end:
+  lda __rc4
+  ldx __rc5
+  rts
+  .size kchk3, .-kchk3
+
+; void kdecode(struct kdec *d)
+; The struct kdec is copied to __rc4-__rc13 (in, out, end, ctlq, rptq,
+; rpt, byte), and back on return.  Y indexes the page of in, X counts
+; the copies of the byte: about 30 cycles a byte written, and 15 more
+; for each prefix.
+
+  .section .text.kdecode,"ax",@progbits
+  .global kdecode
+  .type kdecode,@function
+kdecode:
+  ldy #9
+.Ldecin:
+  lda (__rc2),y
+  sta __rc4,y
+  dey
+  bpl .Ldecin
+  iny                          ; Y = 0
+  ldx __rc12                   ; Copies left from the last call
+  bne .Ldecput
+.Ldecnext:
+  lda (__rc4),y
+  beq .Ldecend                 ; End of the data field
+  iny
+  bne .Ldecrpt
+  inc __rc5
+.Ldecrpt:
+  ldx #1
+  cmp __rc11                   ; Repeat prefix (never NUL)
+  bne .Ldecctl
+  lda (__rc4),y                ; Count
+  iny
+  bne .Ldecrpt1
+  inc __rc5
+.Ldecrpt1:
+  sec
+  sbc #32
+  tax
+  beq .Ldecrpt2                ; Count 0
+  bcs .Ldecrpt3
+.Ldecrpt2:
+  ldx #1                       ; Count below 1
+.Ldecrpt3:
+  lda (__rc4),y                ; Character
+  iny
+  bne .Ldecctl
+  inc __rc5
+.Ldecctl:
+  cmp __rc10                   ; Control prefix
+  bne .Ldecbyte
+  lda (__rc4),y                ; Operand
+  iny
+  bne .Ldecctl1
+  inc __rc5
+.Ldecctl1:
+  sta __rc13
+  and #$7f
+  cmp #$3f                     ; '?'
+  beq .Ldecctl2
+  cmp #$40                     ; $40-$5f
+  bcc .Ldecput
+  cmp #$60
+  bcs .Ldecput
+.Ldecctl2:
+  lda __rc13                   ; Controllify
+  eor #$40
+.Ldecbyte:
+  sta __rc13
+.Ldecput:                      ; X copies of __rc13
+  lda __rc13
+  sta (__rc6)
+  inc __rc6
+  bne .Ldecput1
+  inc __rc7
+.Ldecput1:
+  lda __rc6                    ; Output full?
+  cmp __rc8
+  bne .Ldecput2
+  lda __rc7
+  cmp __rc9
+  beq .Ldecfull
+.Ldecput2:
+  dex
+  bne .Ldecput
+  bra .Ldecnext
+.Ldecfull:
+  dex
+  stx __rc12                   ; Copies left
+  bra .Ldecout
+.Ldecend:
+  stz __rc12
+.Ldecout:
+  tya                          ; in += Y
+  clc
+  adc __rc4
+  sta __rc4
+  bcc .Ldecout1
+  inc __rc5
+.Ldecout1:
+  ldy #9
+.Ldecout2:
+  lda __rc4,y
+  sta (__rc2),y
+  dey
+  bpl .Ldecout2
+  rts
+  .size kdecode, .-kdecode
+
+; void krecv(struct krx *x)
+; The struct krx is copied to __rc4-__rc11 (p, n, soh, eom, brk, stop),
+; and back on return.  The API calls are made as the SDK functions do,
+; without their calls and returns.
+
+  .section .text.krecv,"ax",@progbits
+  .global krecv
+  .type krecv,@function
+krecv:
+  ldy #7
+.Lrxin:
+  lda (__rc2),y
+  sta __rc4,y
+  dey
+  bpl .Lrxin
+.Lrxwait:
+  jsr KSendMessage
+  .byte API_GROUP_UEXT, API_FN_UART_AVAILABLE
+  jsr KWaitMessage
+  lda API_PARAMS
+  beq .Lrxwait
+  jsr KSendMessage
+  .byte API_GROUP_UEXT, API_FN_UART_READ
+  jsr KWaitMessage
+  lda API_PARAMS
+  cmp __rc8                    ; Stop bytes
+  beq .Lrxstop
+  cmp __rc9
+  beq .Lrxstop
+  cmp __rc10
+  beq .Lrxstop
+  sta (__rc4)
+  inc __rc4
+  bne .Lrxcount
+  inc __rc5
+.Lrxcount:
+  lda __rc6                    ; n--
+  bne .Lrxcount1
+  dec __rc7
+.Lrxcount1:
+  dec __rc6
+  lda __rc6
+  ora __rc7
+  bne .Lrxwait
+  bra .Lrxout
+.Lrxstop:
+  sta __rc11
+.Lrxout:
+  ldy #7
+.Lrxout1:
+  lda __rc4,y
+  sta (__rc2),y
+  dey
+  bpl .Lrxout1
+  rts
+  .size krecv, .-krecv
+
+; CRC-CCITT of each byte value, low and high bytes
+
+  .section .rodata.kcrc,"a",@progbits
+kcrclo:
+  .byte $00, $89, $12, $9b, $24, $ad, $36, $bf
+  .byte $48, $c1, $5a, $d3, $6c, $e5, $7e, $f7
+  .byte $81, $08, $93, $1a, $a5, $2c, $b7, $3e
+  .byte $c9, $40, $db, $52, $ed, $64, $ff, $76
+  .byte $02, $8b, $10, $99, $26, $af, $34, $bd
+  .byte $4a, $c3, $58, $d1, $6e, $e7, $7c, $f5
+  .byte $83, $0a, $91, $18, $a7, $2e, $b5, $3c
+  .byte $cb, $42, $d9, $50, $ef, $66, $fd, $74
+  .byte $04, $8d, $16, $9f, $20, $a9, $32, $bb
+  .byte $4c, $c5, $5e, $d7, $68, $e1, $7a, $f3
+  .byte $85, $0c, $97, $1e, $a1, $28, $b3, $3a
+  .byte $cd, $44, $df, $56, $e9, $60, $fb, $72
+  .byte $06, $8f, $14, $9d, $22, $ab, $30, $b9
+  .byte $4e, $c7, $5c, $d5, $6a, $e3, $78, $f1
+  .byte $87, $0e, $95, $1c, $a3, $2a, $b1, $38
+  .byte $cf, $46, $dd, $54, $eb, $62, $f9, $70
+  .byte $08, $81, $1a, $93, $2c, $a5, $3e, $b7
+  .byte $40, $c9, $52, $db, $64, $ed, $76, $ff
+  .byte $89, $00, $9b, $12, $ad, $24, $bf, $36
+  .byte $c1, $48, $d3, $5a, $e5, $6c, $f7, $7e
+  .byte $0a, $83, $18, $91, $2e, $a7, $3c, $b5
+  .byte $42, $cb, $50, $d9, $66, $ef, $74, $fd
+  .byte $8b, $02, $99, $10, $af, $26, $bd, $34
+  .byte $c3, $4a, $d1, $58, $e7, $6e, $f5, $7c
+  .byte $0c, $85, $1e, $97, $28, $a1, $3a, $b3
+  .byte $44, $cd, $56, $df, $60, $e9, $72, $fb
+  .byte $8d, $04, $9f, $16, $a9, $20, $bb, $32
+  .byte $c5, $4c, $d7, $5e, $e1, $68, $f3, $7a
+  .byte $0e, $87, $1c, $95, $2a, $a3, $38, $b1
+  .byte $46, $cf, $54, $dd, $62, $eb, $70, $f9
+  .byte $8f, $06, $9d, $14, $ab, $22, $b9, $30
+  .byte $c7, $4e, $d5, $5c, $e3, $6a, $f1, $78
+kcrchi:
+  .byte $00, $11, $23, $32, $46, $57, $65, $74
+  .byte $8c, $9d, $af, $be, $ca, $db, $e9, $f8
+  .byte $10, $01, $33, $22, $56, $47, $75, $64
+  .byte $9c, $8d, $bf, $ae, $da, $cb, $f9, $e8
+  .byte $21, $30, $02, $13, $67, $76, $44, $55
+  .byte $ad, $bc, $8e, $9f, $eb, $fa, $c8, $d9
+  .byte $31, $20, $12, $03, $77, $66, $54, $45
+  .byte $bd, $ac, $9e, $8f, $fb, $ea, $d8, $c9
+  .byte $42, $53, $61, $70, $04, $15, $27, $36
+  .byte $ce, $df, $ed, $fc, $88, $99, $ab, $ba
+  .byte $52, $43, $71, $60, $14, $05, $37, $26
+  .byte $de, $cf, $fd, $ec, $98, $89, $bb, $aa
+  .byte $63, $72, $40, $51, $25, $34, $06, $17
+  .byte $ef, $fe, $cc, $dd, $a9, $b8, $8a, $9b
+  .byte $73, $62, $50, $41, $35, $24, $16, $07
+  .byte $ff, $ee, $dc, $cd, $b9, $a8, $9a, $8b
+  .byte $84, $95, $a7, $b6, $c2, $d3, $e1, $f0
+  .byte $08, $19, $2b, $3a, $4e, $5f, $6d, $7c
+  .byte $94, $85, $b7, $a6, $d2, $c3, $f1, $e0
+  .byte $18, $09, $3b, $2a, $5e, $4f, $7d, $6c
+  .byte $a5, $b4, $86, $97, $e3, $f2, $c0, $d1
+  .byte $29, $38, $0a, $1b, $6f, $7e, $4c, $5d
+  .byte $b5, $a4, $96, $87, $f3, $e2, $d0, $c1
+  .byte $39, $28, $1a, $0b, $7f, $6e, $5c, $4d
+  .byte $c6, $d7, $e5, $f4, $80, $91, $a3, $b2
+  .byte $4a, $5b, $69, $78, $0c, $1d, $2f, $3e
+  .byte $d6, $c7, $f5, $e4, $90, $81, $b3, $a2
+  .byte $5a, $4b, $79, $68, $1c, $0d, $3f, $2e
+  .byte $e7, $f6, $c4, $d5, $a1, $b0, $82, $93
+  .byte $6b, $7a, $48, $59, $2d, $3c, $0e, $1f
+  .byte $f7, $e6, $d4, $c5, $b1, $a0, $92, $83
+  .byte $7b, $6a, $58, $49, $3d, $2c, $1e, $0f
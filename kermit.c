@@ -18,12 +18,16 @@
 // Kenji Rikitake 23-MAR-2025:
 // xerror() removed to avoid dependency to rand()
 
-#include "kermit.h" /* Kermit protocol definitions */
-#include "cdefs.h"  /* C language defs for all modules */
-#include "debug.h"  /* Debugging */
+#include "kermit.h"  /* Kermit protocol definitions */
+#include "cdefs.h"   /* C language defs for all modules */
+#include "debug.h"   /* Debugging */
+#include "capture.h" /* Packet capture verdicts */
+#include "phase.h"   /* Phase timing */
+#include "kasm.h"    /* Kernels of the hot loops */
 
 #define zgetc()                                                                \
-  ((--(k->zincnt)) >= 0) ? ((int)(*(k->zinptr)++) & 0xff) : (*(k->readf))(k)
+  ((--(khot(k)->zincnt)) >= 0) ? ((int)(*(khot(k)->zinptr)++) & 0xff)         \
+                               : (*(k->readf))(k)
 
 /* See cdefs.h for meaning of STATIC, ULONG, and UCHAR */
 
@@ -52,8 +56,29 @@ int STATIC getpkt(struct k_data *, struct k_response *);
 int STATIC encstr(UCHAR *, struct k_data *, struct k_response *);
 void STATIC decstr(UCHAR *, struct k_data *, struct k_response *);
 void STATIC encode(int, int, struct k_data *);
+void STATIC codecsel(struct k_data *);
+void STATIC enc0(int, int, struct k_data *);
+void STATIC encr(int, int, struct k_data *);
+int STATIC dec0(struct k_data *, struct k_response *, short, UCHAR *);
+int STATIC decr(struct k_data *, struct k_response *, short, UCHAR *);
+#ifndef FIXEDCFG
+void STATIC ence(int, int, struct k_data *);
+void STATIC encre(int, int, struct k_data *);
+int STATIC dece(struct k_data *, struct k_response *, short, UCHAR *);
+int STATIC decre(struct k_data *, struct k_response *, short, UCHAR *);
+#endif /* FIXEDCFG */
+void STATIC ctlmap(struct k_data *);
 int STATIC nxtpkt(struct k_data *);
+#ifndef RECVONLY
+STATIC UCHAR *nxtfile(struct k_data *);
+#endif /* RECVONLY */
 int STATIC resend(struct k_data *);
+int STATIC reack(struct k_data *, short, char);
+void STATIC getmetrics(struct k_data *, struct k_response *);
+#ifndef RECVONLY
+int STATIC serve(struct k_data *, struct k_response *, char, UCHAR *, int);
+void STATIC srverr(char *, struct k_data *);
+#endif /* RECVONLY */
 
 int                            /* The kermit() function */
 kermit(short f,                /* Function code */
@@ -77,10 +102,11 @@ kermit(short f,                /* Function code */
 #endif              /* F_CRC */
   int ok;
 
-  debug(DB_MSG, "----------", 0, 0); /* Marks each entry */
-  debug(DB_LOG, "f", 0, f);
-  debug(DB_LOG, "state", 0, k->state);
-  debug(DB_LOG, "zincnt", 0, (k->zincnt));
+  /* Marks each entry */
+  debug(DB_MSG | DBC_STATE | DBL_DETAIL, "----------", 0, 0);
+  debug(DB_LOG | DBC_STATE | DBL_DETAIL, "f", 0, f);
+  debug(DB_LOG | DBC_STATE | DBL_DETAIL, "state", 0, k->state);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "zincnt", 0, (khot(k)->zincnt));
 
   if (f == K_INIT) { /* Initialize packet buffers etc */
 
@@ -90,6 +116,13 @@ kermit(short f,                /* Function code */
     r->filesize = 0L;              /* No filesize yet. */
     r->sofar = 0L;                 /* No bytes transferred yet */
 
+#ifndef KARENA
+    k->ipktbuf = &(k->ipktarea[0][0]); /* Packet buffers of their own */
+    k->opktbuf = k->opktarea;
+    k->xdatabuf = k->xdataarea;
+    k->pktmax = P_PKTLEN;
+    k->wmax = P_WSLOTS;
+#endif /* KARENA */
     for (i = 0; i < P_WSLOTS; i++) { /* Packet info for each window slot */
       freerslot(k, i);
       freesslot(k, i);
@@ -117,23 +150,41 @@ kermit(short f,                /* Function code */
     k->s_type = k->r_type = 0; /* Packet type */
     k->r_timo = P_R_TIMO;      /* Timeout interval for me to use */
     k->s_timo = P_S_TIMO;      /* Timeout for other Kermit to use */
-    k->r_maxlen = P_PKTLEN;    /* Maximum packet length */
-    k->s_maxlen = P_PKTLEN;    /* Maximum packet length */
-    k->window = P_WSLOTS;      /* Maximum window slots */
+    k->r_maxlen = k->pktmax;   /* Maximum packet length */
+    k->s_maxlen = k->pktmax;   /* Maximum packet length */
+    k->window = k->wmax;       /* Maximum window slots */
     k->wslots = 1;             /* Current window slots */
-    k->zincnt = 0;
+    khot(k)->zincnt = 0;
+    k->f_pkt = (UCHAR *)0; /* Nothing framed by kermit_feed() yet */
+    k->f_len = 0;
+    k->f_want = 0;
+    k->f_skip = 0;
+    k->f_ctlc = 0;
     k->dummy = 0;
     k->filename = (UCHAR *)0;
+    k->display = 0; /* Files, not text to display */
+    k->bcpkts = 0; /* No packets checked yet */
+    k->bcerrs = 0; /* No line errors seen yet */
+    k->metrics.pktsin = k->metrics.pktsout = 0L; /* No statistics yet */
+    k->metrics.naks = k->metrics.resends = 0L;
+    k->metrics.chkerrs = k->metrics.timeouts = 0L;
+    k->metrics.wirein = k->metrics.wireout = 0L;
+    k->metrics.payload = 0L;
+    k->metrics.start = k->metrics.elapsed = 0L;
 
     /* Parity must be filled in by the caller */
 
     k->retry = P_RETRY;          /* Retransmission limit */
     k->s_ctlq = k->r_ctlq = '#'; /* Control prefix */
+#ifdef FIXEDCFG
+    k->ebq = 'N'; /* No 8th-bit prefixing */
+#else
     k->ebq = 'Y';                /* 8th-bit prefix negotiation */
-    k->ebqflg = 0;               /* 8th-bit prefixing flag */
-    k->rptq = '~';               /* Send repeat prefix */
-    k->rptflg = 0;               /* Repeat counts negotiated */
-    k->s_rpt = 0;                /* Current repeat count */
+#endif /* FIXEDCFG */
+    k->ebqflg = 0;      /* 8th-bit prefixing flag */
+    k->rptq = '~';      /* Send repeat prefix */
+    k->rptflg = 0;      /* Repeat counts negotiated */
+    khot(k)->s_rpt = 0; /* Current repeat count */
     k->capas = 0                 /* Capabilities */
 #ifdef F_LP
                | CAP_LP /* Long packets */
@@ -148,6 +199,7 @@ kermit(short f,                /* Function code */
 
     k->opktbuf[0] = '\0'; /* No packets sent yet. */
     k->opktlen = 0;
+    ctlmap(k); /* Control characters to prefix on send */
 
 #ifdef F_CRC
     /* This is the only way to initialize these tables -- no static data. */
@@ -200,6 +252,7 @@ kermit(short f,                /* Function code */
 #endif /* RECVONLY */
 
   } else if (f == K_STATUS) { /* Status report requested. */
+    getmetrics(k, r);         /* Statistics so far */
     return (X_STATUS);        /* File name, date, size, if any. */
 
   } else if (f == K_QUIT) { /* You told me to quit */
@@ -219,16 +272,30 @@ kermit(short f,                /* Function code */
 
   /* If we're in the protocol, check to make sure we got a new packet */
 
-  debug(DB_LOG, "r_slot", 0, r_slot);
-  debug(DB_LOG, "len", 0, len);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "r_slot", 0, r_slot);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "len", 0, len);
 
   if (r_slot < 0) { /* We should have a slot here */
     return (K_ERROR);
   } else {
     k->ipktinfo[r_slot].len = len; /* Copy packet length to ipktinfo. */
   }
+  if (len > 0) { /* Count it */
+    k->metrics.pktsin++;
+  } else {
+    k->metrics.timeouts++;
+  }
 
   if (len < 4) { /* Packet obviously no good? */
+    if (len > 0) { /* Garbage on the line counts as an error */
+      k->bcpkts++;
+      k->bcerrs++;
+      debug(DB_PKT | DBC_PKT | DBL_EVENT, "VPKT", 0, CAP_SHORT);
+    }
+    freerslot(k, r_slot); /* Nothing in it to keep */
+    if (k->server && (k->state == R_WAIT)) { /* Idle server, */
+      return (X_OK);                         /* no NAKs, just keep waiting */
+    }
 #ifdef RECVONLY
     return (nak(k, k->r_seq, r_slot)); /* Send NAK for the packet we want */
 #else
@@ -255,7 +322,7 @@ kermit(short f,                /* Function code */
       break;
     }
   }
-  p = &(k->ipktbuf[0][r_slot]); /* Point to it */
+  p = kslot(k, r_slot); /* Point to it */
 
   q = p;                                   /* Pointer to data to be checked */
   k->ipktinfo[r_slot].len = xunchar(*p++); /* Length field */
@@ -277,7 +344,10 @@ kermit(short f,                /* Function code */
     p[2] = '\0';
     if (xunchar(c) != chk1(p - 3, k)) { /* Check it */
       freerslot(k, r_slot);             /* Bad */
-      debug(DB_MSG, "HDR CHKSUM BAD", 0, 0);
+      k->bcpkts++;
+      k->bcerrs++;
+      debug(DB_MSG | DBC_CRC | DBL_ERROR, "HDR CHKSUM BAD", 0, 0);
+      debug(DB_PKT | DBC_PKT | DBL_EVENT, "VPKT", 0, CAP_BADHDR);
 #ifdef RECVONLY
       return (nak(k, k->r_seq, r_slot)); /* Send NAK */
 #else
@@ -288,7 +358,7 @@ kermit(short f,                /* Function code */
       }
 #endif /* RECVONLY */
     }
-    debug(DB_MSG, "HDR CHKSUM OK", 0, 0);
+    debug(DB_MSG | DBC_CRC | DBL_DETAIL, "HDR CHKSUM OK", 0, 0);
     p[2] = c; /* Put checksum back */
               /* Data length */
     datalen = xunchar(p[0]) * 95 + xunchar(p[1]) - ((k->bctf) ? 3 : k->bct);
@@ -304,13 +374,17 @@ kermit(short f,                /* Function code */
   if (k->bctf) { /* FORCE 3 */
     chklen = 3;
   } else {
-    if (t == 'S' || k->state == S_INIT) { /* S-packet was retransmitted? */
-      if (q[10] == '5') {                 /* Block check type requested is 5 */
-        k->bctf = 1;                      /* FORCE 3 */
+    if (t == 'S' || k->state == S_INIT || /* S-packet was retransmitted? */
+        (k->state == R_WAIT &&            /* or a server command, */
+         k->ipktinfo[r_slot].len > 0)) {  /* if not a long packet */
+      if ((t == 'S' || k->state == S_INIT) && /* Not server commands */
+          q[10] == '5') { /* Block check type requested is 5 */
+        k->bctf = 1;      /* FORCE 3, this packet too */
         chklen = 3;
+      } else {
+        chklen = 1; /* Block check is type 1 */
       }
-      chklen = 1;                            /* Block check is always type 1 */
-      datalen = k->ipktinfo[r_slot].len - 3; /* Data length */
+      datalen = k->ipktinfo[r_slot].len - 2 - chklen; /* Data length */
     } else {
       chklen = k->bct;
     }
@@ -319,9 +393,9 @@ kermit(short f,                /* Function code */
   chklen = 1;                            /* Block check is always type 1 */
   datalen = k->ipktinfo[r_slot].len - 3; /* Data length */
 #endif /* F_CRC */
-  debug(DB_LOG, "bct", 0, (k->bct));
-  debug(DB_LOG, "datalen", 0, datalen);
-  debug(DB_LOG, "chkalen", 0, chklen);
+  debug(DB_LOG | DBC_CRC | DBL_DETAIL, "bct", 0, (k->bct));
+  debug(DB_LOG | DBC_CRC | DBL_DETAIL, "datalen", 0, datalen);
+  debug(DB_LOG | DBC_CRC | DBL_DETAIL, "chkalen", 0, chklen);
 
 #ifdef F_CRC
   for (i = 0; i < chklen; i++) { /* Copy the block check */
@@ -333,6 +407,7 @@ kermit(short f,                /* Function code */
   pbc[1] = '\0';
 #endif               /* F_CRC */
   p[datalen] = '\0'; /* and the packet DATA field. */
+  k->bcpkts++;       /* One more packet checked */
 #ifdef F_CRC
   switch (chklen) { /* Check the block check  */
   case 1:           /* Type 1, 6-bit checksum */
@@ -340,6 +415,8 @@ kermit(short f,                /* Function code */
     ok = (xunchar(*pbc) == chk1(q, k));
     if (!ok) {
       freerslot(k, r_slot);
+      k->bcerrs++;
+      debug(DB_PKT | DBC_PKT | DBL_EVENT, "VPKT", 0, CAP_BADCHK);
 #ifdef RECVONLY
       nak(k, k->r_seq, r_slot);
 #else
@@ -356,7 +433,7 @@ kermit(short f,                /* Function code */
 
   case 2: /* Type 2, 12-bit checksum */
     i = xunchar(*pbc) << 6 | xunchar(pbc[1]);
-    ok = (i == chk2(q, k));
+    ok = (i == (chk2(q, k) & 07777)); /* Only 12 bits are sent */
     if (!ok) {        /* No match */
       if (t == 'E') { /* Allow E packets to have type 1 */
         int j;
@@ -370,6 +447,8 @@ kermit(short f,                /* Function code */
         }
       }
       freerslot(k, r_slot);
+      k->bcerrs++;
+      debug(DB_PKT | DBC_PKT | DBL_EVENT, "VPKT", 0, CAP_BADCHK);
 #ifdef RECVONLY
       nak(k, k->r_seq, r_slot);
 #else
@@ -387,7 +466,7 @@ kermit(short f,                /* Function code */
     crc = (xunchar(pbc[0]) << 12) | (xunchar(pbc[1]) << 6) | (xunchar(pbc[2]));
     ok = (crc == chk3(q, k));
     if (!ok) {
-      debug(DB_LOG, "CRC ERROR t", 0, t);
+      debug(DB_LOG | DBC_CRC | DBL_ERROR, "CRC ERROR t", 0, t);
       if (t == 'E') { /* Allow E packets to have type 1 */
         int j;
         j = datalen;
@@ -402,6 +481,8 @@ kermit(short f,                /* Function code */
         }
       }
       freerslot(k, r_slot);
+      k->bcerrs++;
+      debug(DB_PKT | DBC_PKT | DBL_EVENT, "VPKT", 0, CAP_BADCHK);
 #ifdef RECVONLY
       nak(k, k->r_seq, r_slot);
 #else
@@ -415,6 +496,7 @@ kermit(short f,                /* Function code */
     }
   }
 #endif            /* F_CRC */
+  debug(DB_PKT | DBC_PKT | DBL_EVENT, "VPKT", 0, CAP_OK);
   if (t == 'E') { /* (AND CLOSE FILES?) */
     return (X_ERROR);
   }
@@ -424,21 +506,37 @@ kermit(short f,                /* Function code */
     prev = 63;
   }
 
-  debug(DB_LOG, "Seq", 0, seq);
-  debug(DB_LOG, "Prev", 0, prev);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "Seq", 0, seq);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "Prev", 0, prev);
 
+#ifndef RECVONLY
+  if (k->what == W_SEND && t == 'N' && /* A NAK for the next packet */
+      k->state != S_INIT &&            /* (not one without our params) */
+      seq == (k->r_seq + 1) % 64) {    /* is an ACK for this one */
+    seq = k->ipktinfo[r_slot].seq = k->r_seq;
+    t = k->ipktinfo[r_slot].typ = 'Y';
+  }
+#endif /* RECVONLY */
   if (seq == k->r_seq) {         /* Is this the packet we want? */
     k->ipktinfo[r_slot].rtr = 0; /* Yes */
   } else {
     freerslot(k, r_slot); /* No, discard it. */
 
     if (seq == prev) { /* If it's the previous packet again */
-      debug(DB_LOG, "PREVIOUS PKT RETRIES", 0, (long)(k->ipktinfo[r_slot].rtr));
+      debug(DB_LOG | DBC_PKT | DBL_EVENT, "PREVIOUS PKT RETRIES", 0,
+            (long)(k->ipktinfo[r_slot].rtr));
       if (k->ipktinfo[r_slot].rtr++ > k->retry) { /* Count retries */
         epkt("Too many retries", k);              /* Too may */
         return (X_ERROR);                         /* Give up */
-      } else {                                    /* Otherwise */
+#ifndef RECVONLY
+      } else if (k->what == W_SEND) { /* Sending */
+        if (t == 'Y') {               /* Duplicate ACK, ignored: */
+          return (X_OK); /* resending for it doubles every packet */
+        }
         return (resend(k)); /* Send old outbound packet buffer */
+#endif                      /* RECVONLY */
+      } else {              /* Receiving */
+        return (reack(k, prev, t)); /* ACK it again */
       }
 #ifdef RECVONLY
     } else {
@@ -454,7 +552,7 @@ kermit(short f,                /* Function code */
 #ifndef RECVONLY
   if (k->what == W_SEND) { /* Sending, check for ACK */
     if (t != 'Y') {        /* Not an ACK */
-      debug(DB_LOG, "t!=Y t", 0, t);
+      debug(DB_LOG | DBC_PKT | DBL_DETAIL, "t!=Y t", 0, t);
       freerslot(k, r_slot); /* added 2004-06-30 -- JHD */
       return (resend(k));
     }
@@ -467,10 +565,9 @@ kermit(short f,                /* Function code */
           return (rc);
         }
         if (*p == 'Z' || k->cancel == I_GROUP) { /* Cancel Group? */
-          debug(DB_MSG, "Group Cancel (Send)", 0, 0);
-          while (*(k->filelist)) { /* Go to end of file list */
-            debug(DB_LOG, "Skip", *(k->filelist), 0);
-            (k->filelist)++;
+          debug(DB_MSG | DBC_STATE | DBL_EVENT, "Group Cancel (Send)", 0, 0);
+          while ((s = nxtfile(k))) { /* Go to end of file list */
+            debug(DB_LOG | DBC_FILE | DBL_EVENT, "Skip", s, 0);
           }
         }
         k->state = S_EOF; /* Wait for ACK to EOF */
@@ -485,8 +582,8 @@ kermit(short f,                /* Function code */
 
   /* Now we have an incoming packet with the expected sequence number. */
 
-  debug(DB_CHR, "Packet OK", 0, t);
-  debug(DB_LOG, "State", 0, k->state);
+  debug(DB_CHR | DBC_PKT | DBL_EVENT, "Packet OK", 0, t);
+  debug(DB_LOG | DBC_STATE | DBL_EVENT, "State", 0, k->state);
 
   switch (k->state) { /* Kermit protocol state switcher */
 
@@ -496,12 +593,12 @@ kermit(short f,                /* Function code */
     nxtpkt(k);                /* Get next packet number etc */
     if (k->state == S_INIT) { /* Got ACK to S packet? */
       spar(k, p, datalen);    /* Set negotiated parameters */
-      debug(DB_CHR, "Parity", 0, k->parity);
-      debug(DB_LOG, "Ebqflg", 0, (k->ebqflg));
-      debug(DB_CHR, "Ebq", 0, (k->ebq));
+      debug(DB_CHR | DBC_STATE | DBL_DETAIL, "Parity", 0, k->parity);
+      debug(DB_LOG | DBC_STATE | DBL_DETAIL, "Ebqflg", 0, (k->ebqflg));
+      debug(DB_CHR | DBC_STATE | DBL_DETAIL, "Ebq", 0, (k->ebq));
     }
-    k->filename = *(k->filelist); /* Get next filename */
-    if (k->filename) {            /* If there is one */
+    k->filename = nxtfile(k); /* Get next filename */
+    if (k->filename) {        /* If there is one */
       int i;
       for (i = 0; i < FN_MAX; i++) { /* Copy name to result struct */
         r->filename[i] = k->filename[i];
@@ -509,14 +606,14 @@ kermit(short f,                /* Function code */
           break;
         }
       }
-      (k->filelist)++;
-      debug(DB_LOG, "Filename", k->filename, 0);
+      debug(DB_LOG | DBC_FILE | DBL_EVENT, "Filename", k->filename, 0);
       if ((rc = (k->openf)(k, k->filename, 1)) != X_OK) { /* Try to open */
         return (rc);
       }
       encstr(k->filename, k, r); /* Encode the name for transmission */
-      if ((rc = spkt('F', k->s_seq, -1, k->xdata, k)) != X_OK) {
-        return (rc); /* Send F packet */
+      if ((rc = spkt(k->display ? 'X' : 'F', k->s_seq, -1, k->xdata, k)) !=
+          X_OK) {
+        return (rc); /* Send F packet (X for text to display) */
       }
       r->sofar = 0L;
       k->state = S_FILE; /* Wait for ACK */
@@ -534,7 +631,7 @@ kermit(short f,                /* Function code */
   case S_FILE: /* Got ACK to F packet */
     nxtpkt(k); /* Get next packet number etc */
 #ifdef F_AT
-    if (k->capas & CAP_AT) {            /* A-packets negotiated? */
+    if ((k->capas & CAP_AT) && !k->display) { /* A-packets negotiated? */
       if ((rc = sattr(k, r)) != X_OK) { /* Yes, send Attribute packet */
         return (rc);
       }
@@ -568,8 +665,8 @@ kermit(short f,                /* Function code */
     }
     rc = sdata(k, r); /* Send first or next data packet */
 
-    debug(DB_LOG, "Seq", 0, (k->s_seq));
-    debug(DB_LOG, "sdata()", 0, rc);
+    debug(DB_LOG | DBC_PKT | DBL_DETAIL, "Seq", 0, (k->s_seq));
+    debug(DB_LOG | DBC_PKT | DBL_DETAIL, "sdata()", 0, rc);
 
     if (rc == 0) { /* If there was no data to send */
       if ((rc = spkt('Z', k->s_seq, 0, (UCHAR *)0, k)) != X_OK) {
@@ -590,12 +687,16 @@ kermit(short f,                /* Function code */
     if (t == 'S') {        /* Got it */
       spar(k, p, datalen); /* Set parameters from it */
       rc = rpar(k, 'Y');   /* ACK with my parameters */
-      debug(DB_LOG, "rpar rc", 0, rc);
+      debug(DB_LOG | DBC_STATE | DBL_DETAIL, "rpar rc", 0, rc);
       if (rc != X_OK) {
         return (X_ERROR); /* I/O error, quit. */
       }
       k->state = R_FILE; /* All OK, switch states */
       r->status = R_FILE;
+#ifndef RECVONLY
+    } else if (k->server) { /* Server command */
+      rc = serve(k, r, t, p, datalen);
+#endif                     /* RECVONLY */
     } else { /* Wrong kind of packet, send NAK */
       epkt("Unexpected packet type", k);
       rc = X_ERROR;
@@ -609,8 +710,8 @@ kermit(short f,                /* Function code */
         k->state = R_ATTR;                     /* Switch to next state */
       }
       r->status = k->state;
-      debug(DB_LOG, "R_FILE decode rc", 0, rc);
-      debug(DB_LOG, "R_FILE FILENAME", r->filename, 0);
+      debug(DB_LOG | DBC_FILE | DBL_DETAIL, "R_FILE decode rc", 0, rc);
+      debug(DB_LOG | DBC_FILE | DBL_EVENT, "R_FILE FILENAME", r->filename, 0);
       if (rc == X_OK) {                     /* All OK so far */
         r->filedate[0] = '\0';              /* No file date yet */
         r->filesize = 0L;                   /* Or file size */
@@ -643,14 +744,16 @@ kermit(short f,                /* Function code */
       return (X_OK);
     } else
 #endif                  /* F_AT */
-      if (t == 'D') {   /* First data packet */
-        k->obufpos = 0; /* Initialize output buffer */
+      if (t == 'D') {         /* First data packet */
+        khot(k)->obufpos = 0; /* Initialize output buffer */
         k->filename = r->filename;
         r->sofar = 0L;
         if ((rc = (*(k->openf))(k, r->filename, 2)) == X_OK) {
           k->state = R_DATA; /* Switch to Data state */
           r->status = k->state;
+          phase(PH_DECODE, 1);
           rc = decode(k, r, 1, p); /* Write out first data packet */
+          phase(PH_DECODE, 0);
           freerslot(k, r_slot);
         } else {
           epkt("File refused or can't be opened", k);
@@ -664,8 +767,9 @@ kermit(short f,                /* Function code */
         }
         return (rc);
       } else if (t == 'Z') { /* Empty file */
-        debug(DB_LOG, "R_ATTR empty file", r->filename, 0);
-        k->obufpos = 0; /* Initialize output buffer */
+        debug(DB_LOG | DBC_FILE | DBL_EVENT, "R_ATTR empty file", r->filename,
+              0);
+        khot(k)->obufpos = 0; /* Initialize output buffer */
         k->filename = r->filename;
         r->sofar = 0L; /* Open and close the file */
         if ((rc = (*(k->openf))(k, r->filename, 2)) == X_OK) {
@@ -684,7 +788,7 @@ kermit(short f,                /* Function code */
         }
         r->status = k->state;
         freerslot(k, r_slot);
-
+        return (rc);
       } else {
         epkt("Unexpected packet type", k);
         return (X_ERROR);
@@ -692,22 +796,25 @@ kermit(short f,                /* Function code */
     break;
 
   case R_DATA: /* Want a D or Z packet */
-    debug(DB_CHR, "R_DATA t", 0, t);
-    if (t == 'D') {            /* Data */
+    debug(DB_CHR | DBC_PKT | DBL_DETAIL, "R_DATA t", 0, t);
+    if (t == 'D') { /* Data */
+      phase(PH_DECODE, 1);
       rc = decode(k, r, 1, p); /* Decode it */
+      phase(PH_DECODE, 0);
       freerslot(k, r_slot);
     } else if (t == 'Z') { /* End of file */
-      debug(DB_CHR, "R_DATA", 0, t);
-      if (k->obufpos > 0) { /* Flush output buffer */
-        rc = (*(k->writef))(k, k->obuf, k->obufpos);
-        debug(DB_LOG, "R_DATA writef rc", 0, rc);
-        r->sofar += k->obufpos;
-        k->obufpos = 0;
+      debug(DB_CHR | DBC_PKT | DBL_DETAIL, "R_DATA", 0, t);
+      if (khot(k)->obufpos > 0) { /* Flush output buffer */
+        rc = (*(k->writef))(k, k->obuf, khot(k)->obufpos);
+        debug(DB_LOG | DBC_FILE | DBL_DETAIL, "R_DATA writef rc", 0, rc);
+        r->sofar += khot(k)->obufpos;
+        k->metrics.payload += khot(k)->obufpos;
+        khot(k)->obufpos = 0;
       }
       if (((rc = (*(k->closef))(k, *p, 2)) == X_OK) && (rc == X_OK)) {
         k->state = R_FILE;
       }
-      debug(DB_LOG, "R_DATA closef rc", 0, rc);
+      debug(DB_LOG | DBC_FILE | DBL_EVENT, "R_DATA closef rc", 0, rc);
       r->status = k->state;
       freerslot(k, r_slot);
     } else {
@@ -729,6 +836,162 @@ kermit(short f,                /* Function code */
   return (X_ERROR);
 }
 
+/*
+  framelen() -- Length-driven framing, for readpkt() and kermit_feed().
+
+  Call with the n bytes of a packet read so far after its SOH, each time
+  one is added, until it returns nonzero.  Returns:
+    0   if more of the header is needed to know the length;
+    > 0 the length the header announces, without the SOH and the EOM:
+        the packet ends when that many bytes have been read;
+    < 0 if the header is bad: give the first -(return) bytes to kermit()
+        as the packet, which is counted as an error and NAKed at once,
+        and skip the rest up to the next SOH.
+  A header is bad if LEN is not a length, if the packet would be longer
+  than k->r_maxlen, or if the header checksum of a long packet is wrong.
+*/
+int framelen(struct k_data *k, UCHAR *p, int n) {
+  int i, len;
+  unsigned int s;
+  UCHAR m;
+
+  m = kparity(k) ? 0x7f : 0xff;
+  for (i = 0; i < n && i < 6; i++) { /* Header bytes are all printable */
+    if ((p[i] & m) < SP || (p[i] & m) > '~') {
+      return (-((n < 3) ? n : 3)); /* Too short to be parsed */
+    }
+  }
+  len = xunchar(p[0] & m);
+  if (len > 2) { /* Normal packet: LEN counts the bytes after it */
+    len++;
+  } else if (len > 0) { /* 1 and 2 are not lengths */
+    return (-1);
+  } else { /* Long packet */
+#ifdef F_LP
+    if (n < 6) { /* LEN SEQ TYPE LENX1 LENX2 HCHECK */
+      return (0);
+    }
+    for (s = 0, i = 0; i < 5; i++) {
+      s += p[i] & m;
+    }
+    if (xunchar(p[5] & m) != ((s + ((s & 0300) >> 6)) & 077)) {
+      debug(DB_MSG | DBC_PKT | DBL_ERROR, "framelen HDR CHKSUM BAD", 0, 0);
+      return (-6); /* kermit() finds it bad too */
+    }
+    len = xunchar(p[3] & m) * 95 + xunchar(p[4] & m) + 6;
+#else
+    return (-1);
+#endif /* F_LP */
+  }
+  if (len - 1 > k->r_maxlen) { /* As LEN, not counting itself */
+    debug(DB_LOG | DBC_PKT | DBL_ERROR, "framelen too long", 0, len);
+    return (-((n < 3) ? n : 3));
+  }
+  return (len);
+}
+
+/*
+  kermit_feed() -- Push-style input.
+
+  Instead of reading whole packets with k->rxd and calling kermit() with
+  K_RUN for each of them, a program that gets bytes in chunks of any size
+  (an event loop, a DMA receive buffer) gives them here as they come.
+  They are framed into packets in the window slots by their lengths, as
+  readpkt() does (see framelen()), with the state kept in k_data between
+  the calls, and each complete packet is run through kermit().  Every
+  status kermit() returns is an event, given to k->evf if set.  Call with
+  n = 0 when nothing has come in for the timeout, to run kermit() without
+  a packet (if a window slot is free to run it with; else nothing is
+  done and X_OK is returned).
+
+  Returns the status of the last packet run, or X_OK if none was
+  complete.  Stops at X_DONE or X_ERROR; the rest of buf is not used.
+*/
+int kermit_feed(struct k_data *k, UCHAR *buf, int n, struct k_response *r) {
+  int i, rc;
+  UCHAR c;
+
+  rc = X_OK;
+  if (n < 1) { /* Timeout: drop a partial packet */
+    if (k->f_pkt) {
+      k->f_skip += k->f_len;
+      k->f_pkt = (UCHAR *)0;
+      k->f_len = 0;
+      k->f_want = 0;
+    } else if (!getrslot(k, &(k->f_slot))) { /* No free slot */
+      return (X_OK);                         /* to run it with */
+    }
+    freerslot(k, k->f_slot);
+    k->metrics.wirein += k->f_skip;
+    k->f_skip = 0;
+    rc = kermit(K_RUN, k, k->f_slot, 0, "", r);
+    if (k->evf) {
+      (*(k->evf))(k, rc, r);
+    }
+    return (rc);
+  }
+  for (i = 0; i < n; i++) {
+    c = kparity(k) ? buf[i] & 0x7f : buf[i]; /* Strip parity */
+#ifdef F_CTRLC
+    /* In remote mode only: three consecutive ^C's to quit */
+    if (k->remote && c == (UCHAR)3) {
+      if (++(k->f_ctlc) > 2) {
+        debug(DB_MSG | DBC_PKT | DBL_ERROR, "kermit_feed ^C^C^C", 0, 0);
+        rc = X_ERROR;
+        if (k->evf) {
+          (*(k->evf))(k, rc, r);
+        }
+        return (rc);
+      }
+    } else {
+      k->f_ctlc = 0;
+    }
+#endif /* F_CTRLC */
+    if (c == k->r_soh) { /* Start of packet, maybe again */
+      if (!k->f_pkt) {
+        k->f_pkt = getrslot(k, &(k->f_slot));
+      }
+      k->f_skip += k->f_len + 1; /* What was framed so far is lost */
+      k->f_len = 0;
+      k->f_want = 0;
+      continue;
+    }
+    if (!k->f_pkt) { /* No start of packet (or no free slot) */
+      k->f_skip++;
+      continue;
+    }
+    if (c == kreom(k)) { /* Cut short: run it as it is, to be NAKed */
+      k->f_skip++;
+    } else {
+      k->f_pkt[k->f_len++] = buf[i];
+      if (!k->f_want) { /* Length not known yet */
+        k->f_want = framelen(k, k->f_pkt, k->f_len);
+        if (k->f_want < 0) { /* Bad header */
+          k->f_skip += k->f_len + k->f_want;
+          k->f_len = -(k->f_want);
+          k->f_want = k->f_len;
+        }
+      }
+      if (!k->f_want || k->f_len < k->f_want) {
+        continue;
+      }
+    }
+    k->metrics.wirein += k->f_skip + k->f_len; /* End of the packet */
+    k->f_skip = 0;
+    k->f_pkt = (UCHAR *)0;
+    rc = kermit(K_RUN, k, k->f_slot, k->f_len, "", r);
+    k->f_len = 0;
+    k->f_want = 0;
+    if (k->evf) {
+      (*(k->evf))(k, rc, r);
+    }
+    if (rc == X_DONE || rc == X_ERROR) {
+      break;
+    }
+  }
+  return (rc);
+}
+
 /* Utility routines */
 
 UCHAR *getrslot(struct k_data *k, short *n) { /* Find a free packet buffer */
@@ -738,7 +1001,7 @@ UCHAR *getrslot(struct k_data *k, short *n) { /* Find a free packet buffer */
     It is cleared only after the NEXT packet arrives, which
     indicates that the other Kermit got our ACK for THIS packet.
   */
-  for (i = 0; i < P_WSLOTS; i++) { /* Search */
+  for (i = 0; i < k->wmax; i++) { /* Search */
     if (k->ipktinfo[i].len < 1) {
       *n = i;                  /* Slot number */
       k->ipktinfo[i].len = -1; /* Mark it as allocated but not used */
@@ -746,7 +1009,7 @@ UCHAR *getrslot(struct k_data *k, short *n) { /* Find a free packet buffer */
       k->ipktinfo[i].typ = SP;
       /* k->ipktinfo[i].rtr =  0; */ /* (see comment above) */
       k->ipktinfo[i].dat = (UCHAR *)0;
-      return (&(k->ipktbuf[0][i]));
+      return (kslot(k, i));
     }
   }
   *n = -1;
@@ -808,9 +1071,15 @@ STATIC int chk1(UCHAR *pkt, struct k_data *k) {
 
 STATIC USHORT chk2(UCHAR *pkt, struct k_data *k) {
   register USHORT chk;
+  phase(PH_CHECK, 1);
+#ifdef KASM
+  chk = kchk2(pkt);
+#else
   for (chk = 0; *pkt != '\0'; pkt++) {
     chk += *pkt;
   }
+#endif /* KASM */
+  phase(PH_CHECK, 0);
   return (chk);
 }
 
@@ -822,7 +1091,14 @@ STATIC USHORT chk2(UCHAR *pkt, struct k_data *k) {
  table.  Assumes the argument string contains no embedded nulls.
 */
 STATIC USHORT chk3(UCHAR *pkt, struct k_data *k) {
-  register USHORT c, crc;
+  register USHORT crc;
+#ifndef KASM
+  register USHORT c;
+#endif /* KASM */
+  phase(PH_CHECK, 1);
+#ifdef KASM
+  crc = kchk3(pkt);
+#else
   for (crc = 0; *pkt != '\0'; pkt++) {
 #ifdef COMMENT
     c = crc ^ (long)(*pkt);
@@ -832,10 +1108,31 @@ STATIC USHORT chk3(UCHAR *pkt, struct k_data *k) {
     crc = (crc >> 8) ^ ((k->crcta[(c & 0xF0) >> 4]) ^ (k->crctb[c & 0x0F]));
 #endif /*  COMMENT */
   }
+#endif /* KASM */
+  phase(PH_CHECK, 0);
   return (crc);
 }
 #endif /* F_CRC */
 
+/*  B L O C K C H K  --  Compute a block check of the given type.  */
+/*
+  Exported so the control program can measure what each block check type
+  costs per packet on its own CPU.  Call after K_INIT (the CRC tables are
+  set up there).  Types other than 2 and 3 (or 3 without F_CRC) give type 1.
+*/
+unsigned int blockchk(struct k_data *k, short type, UCHAR *pkt) {
+  switch (type) {
+  case 2:
+    return ((unsigned int)chk2(pkt, k));
+#ifdef F_CRC
+  case 3:
+    return ((unsigned int)chk3(pkt, k));
+#endif /* F_CRC */
+  default:
+    return ((unsigned int)chk1(pkt, k));
+  }
+}
+
 /*   S P K T  --  Send a packet.  */
 /*
   Call with packet type, sequence number, data length, data, Kermit struct.
@@ -849,7 +1146,7 @@ STATIC int spkt(char typ, short seq, int len, UCHAR *data, struct k_data *k) {
   int i, j, lenpos, m, n, x; /* Workers */
   UCHAR *s, *buf;
 
-  debug(DB_LOG, "spkt len 1", 0, len);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "spkt len 1", 0, len);
   if (len < 0) { /* Calculate data length ourselves? */
     len = 0;
     s = data;
@@ -857,7 +1154,7 @@ STATIC int spkt(char typ, short seq, int len, UCHAR *data, struct k_data *k) {
       len++;
     }
   }
-  debug(DB_LOG, "spkt len 2", 0, len);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "spkt len 2", 0, len);
   buf = k->opktbuf; /* Where to put packet (FOR NOW) */
 
   i = 0;                  /* Packet buffer position */
@@ -940,9 +1237,11 @@ STATIC int spkt(char typ, short seq, int len, UCHAR *data, struct k_data *k) {
   k->s_seq = seq;      /* Remember sequence number */
 
   k->opktlen = i; /* Remember length for retransmit */
+  k->metrics.pktsout++;
 
 #ifdef DEBUG
-  debug(DB_PKT, "SPKT", (char *)&buf[1], 0);
+  /* Without the SOH and the packet terminator */
+  debug(DB_PKT | DBC_PKT | DBL_EVENT, "SPKT", (char *)&buf[1], i - 2);
 #endif /* DEBUG */
 
   return ((*(k->txd))(k, buf, k->opktlen)); /* Send it. */
@@ -952,6 +1251,7 @@ STATIC int spkt(char typ, short seq, int len, UCHAR *data, struct k_data *k) {
 
 STATIC int nak(struct k_data *k, short seq, short slot) {
   int rc;
+  k->metrics.naks++;
   rc = spkt('N', seq, 0, (UCHAR *)0, k);
   if (k->ipktinfo[slot].rtr++ > k->retry) {
     rc = X_ERROR;
@@ -971,7 +1271,7 @@ STATIC int ack(struct k_data *k, short seq, UCHAR *text) {
       ;
   }
   rc = spkt('Y', seq, len, text, k); /* Send the packet */
-  debug(DB_LOG, "ack spkt rc", 0, rc);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "ack spkt rc", 0, rc);
   if (rc == X_OK) {                 /* If OK */
     k->r_seq = (k->r_seq + 1) % 64; /* bump the packet number */
   }
@@ -1004,6 +1304,7 @@ STATIC void spar(struct k_data *k, UCHAR *s, int datalen) {
     k->r_ctlq = s[6];
   }
 
+#ifndef FIXEDCFG
   if (datalen >= 7) { /* 8th bit prefix */
     k->ebq = s[7];
     if ((s[7] > 32 && s[7] < 63) || (s[7] > 95 && s[7] < 127)) {
@@ -1018,12 +1319,20 @@ STATIC void spar(struct k_data *k, UCHAR *s, int datalen) {
       /* WHAT? */
     }
   }
+#endif /* FIXEDCFG */
   if (datalen >= 8) { /* Block check */
-    k->bct = s[8] - '0';
+    x = s[8] - '0';
 #ifdef F_CRC
-    if ((k->bct < 1) || (k->bct > 3))
+    /*
+      Both Kermits must ask for the same type, otherwise type 1 is used.
+      This lets the control program's block check policy (k->bct before
+      negotiation) lower the cost of checking on clean links even when the
+      other Kermit asks for a CRC.
+    */
+    if ((x < 1) || (x > 3) || (x != k->bct))
 #endif /* F_CRC */
-      k->bct = 1;
+      x = 1;
+    k->bct = x;
     if (k->bctf) {
       k->bct = 3;
     }
@@ -1066,13 +1375,16 @@ STATIC void spar(struct k_data *k, UCHAR *s, int datalen) {
 
     for (y = 10; (xunchar(s[y]) & 1) && (datalen >= y); y++)
       ;
+  } else { /* No capabilities field, no capabilities */
+    k->capas = 0;
+    y = datalen;
   }
 
 #ifdef F_LP /* Long Packets */
   if (k->capas & CAP_LP) {
     if (datalen > y + 1) {
       x = xunchar(s[y + 2]) * 95 + xunchar(s[y + 3]);
-      k->s_maxlen = (x > P_PKTLEN) ? P_PKTLEN : x;
+      k->s_maxlen = (x > k->pktmax) ? k->pktmax : x;
       if (k->s_maxlen < 10) {
         k->s_maxlen = 60;
       }
@@ -1080,13 +1392,14 @@ STATIC void spar(struct k_data *k, UCHAR *s, int datalen) {
   }
 #endif /* F_LP */
 
-  debug(DB_LOG, "S_MAXLEN", 0, k->s_maxlen);
+  debug(DB_LOG | DBC_STATE | DBL_DETAIL, "S_MAXLEN", 0, k->s_maxlen);
+  ctlmap(k); /* Outbound packet terminator may have changed */
 
 #ifdef F_SW
   if (k->capas & CAP_SW) {
     if (datalen > y) {
       x = xunchar(s[y + 1]);
-      k->window = (x > P_WSLOTS) ? P_WSLOTS : x;
+      k->window = (x > k->wmax) ? k->wmax : x;
       if (k->window < 1) { /* Watch out for bad negotiation */
         k->window = 1;
       }
@@ -1116,7 +1429,7 @@ STATIC int rpar(struct k_data *k, char type) {
   d[3] = ctl(0);                        /* Padding character I want */
   d[4] = tochar(k->r_eom);              /* End-of message character I want */
   d[5] = k->s_ctlq;                     /* Control prefix I send */
-  if ((k->ebq == 'Y') && (k->parity)) { /* 8th-bit prefix */
+  if ((k->ebq == 'Y') && kparity(k)) {  /* 8th-bit prefix */
     d[6] = k->ebq = '&';                /* I need to request it */
   } else {                              /* else just agree with other Kermit */
     d[6] = k->ebq;
@@ -1170,21 +1483,30 @@ STATIC int rpar(struct k_data *k, char type) {
     k = kermit data structure
     r = kermit response structure
     f = function code
-      0 = decode filename
+      0 = decode filename (into r->filename)
       1 = decode file data
     inbuf = pointer to packet data to be decoded
   Returns:
     X_OK on success
-    X_ERROR if output function fails
+    X_ERROR if output function fails, or the filename is longer than
+      r->filename (it is cut short)
 */
-STATIC int decode(struct k_data *k, struct k_response *r, short f,
-                  UCHAR *inbuf) {
+/*
+  The body of decode(), compiled for each combination of the flags given
+  as constants: ebqflg for 8th-bit prefixes (taken with parity), rptflg
+  for repeat counts.  See codecsel().
+*/
+INLINE int decbody(struct k_data *k, struct k_response *r, short f,
+                   UCHAR *inbuf, int ebqflg, int rptflg) {
 
   register unsigned int a, a7; /* Current character */
   unsigned int b8;             /* 8th bit */
   int rpt;                     /* Repeat count */
   int rc;                      /* Return code */
   UCHAR *p;
+#ifdef KASM
+  struct kdec d; /* State of the kernel */
+#endif           /* KASM */
 
   rc = X_OK;
   rpt = 0;      /* Initialize repeat count. */
@@ -1192,15 +1514,42 @@ STATIC int decode(struct k_data *k, struct k_response *r, short f,
     p = r->filename;
   }
 
+#ifdef KASM
+  if (!ebqflg && (f == 1)) { /* File data: the loop is in kdecode() */
+    d.in = inbuf;
+    d.out = k->obuf + khot(k)->obufpos;
+    d.end = k->obuf + k->obuflen;
+    d.ctlq = k->r_ctlq;
+    d.rptq = rptflg ? k->rptq : NUL;
+    d.rpt = 0;
+    while (1) {
+      kdecode(&d);
+      khot(k)->obufpos = d.out - k->obuf;
+      if (khot(k)->obufpos < k->obuflen) { /* Data field done */
+        break;
+      }
+      rc = (*(k->writef))(k, k->obuf, k->obuflen); /* Buffer full */
+      r->sofar += k->obuflen;
+      k->metrics.payload += k->obuflen;
+      if (rc != X_OK) {
+        break;
+      }
+      khot(k)->obufpos = 0;
+      d.out = k->obuf;
+    }
+    return (rc);
+  }
+#endif /* KASM */
+
   while ((a = *inbuf++ & 0xFF) != '\0') { /* Character loop */
-    if (k->rptflg && a == k->rptq) {      /* Got a repeat prefix? */
+    if (rptflg && a == k->rptq) {         /* Got a repeat prefix? */
       rpt = xunchar(*inbuf++ & 0xFF);     /* Yes, get the repeat count, */
       a = *inbuf++ & 0xFF;                /* and get the prefixed character. */
     }
-    b8 = 0;                           /* 8th-bit value */
-    if (k->parity && (a == k->ebq)) { /* Have 8th-bit prefix? */
-      b8 = 0200;                      /* Yes, flag the 8th bit */
-      a = *inbuf++ & 0x7F;            /* and get the prefixed character. */
+    b8 = 0;                       /* 8th-bit value */
+    if (ebqflg && (a == k->ebq)) { /* Have 8th-bit prefix? */
+      b8 = 0200;                  /* Yes, flag the 8th bit */
+      a = *inbuf++ & 0x7F;        /* and get the prefixed character. */
     }
     if (a == k->r_ctlq) {                            /* If control prefix, */
       a = *inbuf++ & 0xFF;                           /* get its operand */
@@ -1216,17 +1565,22 @@ STATIC int decode(struct k_data *k, struct k_response *r, short f,
     }
 
     for (; rpt > 0; rpt--) { /* Output the char 'rpt' times */
-      if (f == 0) {
-        *p++ = (UCHAR)a;                               /* to memory */
+      if (f == 0) { /* to memory */
+        if (p < r->filename + sizeof(r->filename) - 1) {
+          *p++ = (UCHAR)a;
+        } else { /* Does not fit */
+          rc = X_ERROR;
+        }
       } else {                                         /* or to file */
-        k->obuf[k->obufpos++] = (UCHAR)a;              /* Deposit the byte */
-        if (k->obufpos == k->obuflen) {                /* Buffer full? */
+        k->obuf[khot(k)->obufpos++] = (UCHAR)a;        /* Deposit the byte */
+        if (khot(k)->obufpos == k->obuflen) {          /* Buffer full? */
           rc = (*(k->writef))(k, k->obuf, k->obuflen); /* Dump it. */
           r->sofar += k->obuflen;
+          k->metrics.payload += k->obuflen;
           if (rc != X_OK) {
             break;
           }
-          k->obufpos = 0;
+          khot(k)->obufpos = 0;
         }
       }
     }
@@ -1237,6 +1591,33 @@ STATIC int decode(struct k_data *k, struct k_response *r, short f,
   return (rc);
 }
 
+STATIC int dec0(struct k_data *k, struct k_response *r, short f,
+                UCHAR *inbuf) {
+  return (decbody(k, r, f, inbuf, 0, 0));
+}
+
+STATIC int decr(struct k_data *k, struct k_response *r, short f,
+                UCHAR *inbuf) {
+  return (decbody(k, r, f, inbuf, 0, 1));
+}
+
+#ifndef FIXEDCFG
+STATIC int dece(struct k_data *k, struct k_response *r, short f,
+                UCHAR *inbuf) {
+  return (decbody(k, r, f, inbuf, 1, 0));
+}
+
+STATIC int decre(struct k_data *k, struct k_response *r, short f,
+                 UCHAR *inbuf) {
+  return (decbody(k, r, f, inbuf, 1, 1));
+}
+#endif /* FIXEDCFG */
+
+STATIC int decode(struct k_data *k, struct k_response *r, short f,
+                  UCHAR *inbuf) {
+  return ((*(k->decf))(k, r, f, inbuf));
+}
+
 STATIC ULONG /* Convert decimal string to number  */
 stringnum(UCHAR *s, struct k_data *k) {
   long n;
@@ -1317,8 +1698,8 @@ STATIC int gattr(struct k_data *k, UCHAR *s, struct k_response *r) {
         } else if (sizebuf[0] == 'B') { /* Binary */
           rc = 1;
         }
-        debug(DB_LOG, "gattr rc", 0, rc);
-        debug(DB_LOG, "gattr size", sizebuf, 0);
+        debug(DB_LOG | DBC_FILE | DBL_DETAIL, "gattr rc", 0, rc);
+        debug(DB_LOG | DBC_FILE | DBL_DETAIL, "gattr size", sizebuf, 0);
       }
       break;
 
@@ -1353,8 +1734,8 @@ STATIC int gattr(struct k_data *k, UCHAR *s, struct k_response *r) {
   } else if (fsizek > -1L) {
     r->filesize = fsizek * 1024L;
   }
-  debug(DB_LOG, "gattr r->filesize", 0, (r->filesize));
-  debug(DB_LOG, "gattr r->filedate=", r->filedate, 0);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "gattr r->filesize", 0, (r->filesize));
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "gattr r->filedate=", r->filedate, 0);
   return (rc);
 }
 
@@ -1367,22 +1748,23 @@ STATIC int sattr(struct k_data *k,
   long filelength;
   UCHAR datebuf[DATE_MAX], *p;
 
-  debug(DB_LOG, "sattr k->zincnt 0", 0, (k->zincnt));
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr k->zincnt 0", 0,
+        (khot(k)->zincnt));
 
   tmp = k->binary;
   filelength =
       (*(k->finfo))(k, k->filename, datebuf, DATE_MAX, &tmp, k->xfermode);
   k->binary = tmp;
 
-  debug(DB_LOG, "sattr filename: ", k->filename, 0);
-  debug(DB_LOG, "sattr filedate: ", datebuf, 0);
-  debug(DB_LOG, "sattr filelength", 0, filelength);
-  debug(DB_LOG, "sattr binary", 0, (k->binary));
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr filename: ", k->filename, 0);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr filedate: ", datebuf, 0);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr filelength", 0, filelength);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr binary", 0, (k->binary));
 
   i = 0;
 
   k->xdata[i++] = '"';
-  if (k->binary) {             /* Binary */
+  if (kbinary(k)) {            /* Binary */
     k->xdata[i++] = tochar(2); /*  Two characters */
     k->xdata[i++] = 'B';       /*  B for Binary */
     k->xdata[i++] = '8';       /*  8-bit bytes (note assumption...) */
@@ -1411,7 +1793,7 @@ STATIC int sattr(struct k_data *k,
       }
     }
   }
-  debug(DB_LOG, "sattr DATEBUF: ", datebuf, 0);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr DATEBUF: ", datebuf, 0);
 
   if (datebuf[0]) { /* File modtime */
     p = datebuf;
@@ -1433,7 +1815,7 @@ STATIC int sattr(struct k_data *k,
   k->xdata[i++] = '@'; /* End of Attributes */
   k->xdata[i++] = ' ';
   k->xdata[i] = '\0'; /* Terminate attribute string */
-  debug(DB_LOG, "sattr k->xdata: ", k->xdata, 0);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "sattr k->xdata: ", k->xdata, 0);
   return (spkt('A', k->s_seq, -1, k->xdata, k));
 }
 #endif /* F_AT */
@@ -1441,12 +1823,18 @@ STATIC int sattr(struct k_data *k,
 STATIC int getpkt(struct k_data *k,
                   struct k_response *r) { /* Fill a packet from file */
   int i, next, rpt, maxlen;
-  static int c; /* PUT THIS IN STRUCT */
+  int c; /* Lookahead byte, kept in k->s_next between calls */
 
-  debug(DB_LOG, "getpkt k->s_first", 0, (k->s_first));
-  debug(DB_LOG, "getpkt k->s_remain=", k->s_remain, 0);
+  debug(DB_LOG | DBC_ENC | DBL_DETAIL, "getpkt k->s_first", 0, (k->s_first));
+  debug(DB_LOG | DBC_ENC | DBL_DETAIL, "getpkt k->s_remain=", k->s_remain, 0);
 
   maxlen = k->s_maxlen - k->bct - 3; /* Maximum data length */
+#ifdef F_LP
+  if (maxlen + k->bct + 2 > 94) { /* Long packet header is 3 bytes longer */
+    maxlen -= 3;
+  }
+#endif /* F_LP */
+  c = k->s_next;
   if (k->s_first == 1) {             /* If first time thru...  */
     k->s_first = 0;                  /* don't do this next time, */
     k->s_remain[0] = '\0';           /* discard any old leftovers. */
@@ -1457,33 +1845,34 @@ STATIC int getpkt(struct k_data *k,
       }
     } else { /* or file... */
 #ifdef DEBUG
-      k->zincnt = -1234;
+      khot(k)->zincnt = -1234;
       k->dummy = 0;
 #endif /* DEBUG */
       c = zgetc();
 
 #ifdef DEBUG
       if (k->dummy) {
-        debug(DB_LOG, "DUMMY CLOBBERED (A)", 0, 0);
+        debug(DB_LOG | DBC_ENC | DBL_ERROR, "DUMMY CLOBBERED (A)", 0, 0);
       }
 #endif /* DEBUG */
     }
     if (c < 0) { /* Watch out for empty file. */
-      debug(DB_CHR, "getpkt first c", 0, c);
+      debug(DB_CHR | DBC_ENC | DBL_DETAIL, "getpkt first c", 0, c);
       k->s_first = -1;
-      return (k->size = 0);
+      return (khot(k)->size = 0);
     }
     r->sofar++;
-    debug(DB_LOG, "getpkt first c", 0, c);
+    debug(DB_LOG | DBC_ENC | DBL_DETAIL, "getpkt first c", 0, c);
   } else if (k->s_first == -1 && !k->s_remain[0]) { /* EOF from last time? */
-    return (k->size = 0);
+    return (khot(k)->size = 0);
   }
-  for (k->size = 0; (k->xdata[k->size] = k->s_remain[k->size]) != '\0';
-       (k->size)++)
+  for (khot(k)->size = 0;
+       (k->xdata[khot(k)->size] = k->s_remain[khot(k)->size]) != '\0';
+       (khot(k)->size)++)
     ;
   k->s_remain[0] = '\0';
   if (k->s_first == -1) {
-    return (k->size);
+    return (khot(k)->size);
   }
 
   rpt = 0;                  /* Initialize repeat counter. */
@@ -1500,7 +1889,7 @@ STATIC int getpkt(struct k_data *k,
       next = zgetc();
 #ifdef DEBUG
       if (k->dummy) {
-        debug(DB_LOG, "DUMMY CLOBBERED B", 0, k->dummy);
+        debug(DB_LOG | DBC_ENC | DBL_ERROR, "DUMMY CLOBBERED B", 0, k->dummy);
       }
 #endif /* DEBUG */
     }
@@ -1509,41 +1898,50 @@ STATIC int getpkt(struct k_data *k,
     } else {      /* Otherwise */
       r->sofar++; /* count this byte */
     }
-    k->osize = k->size; /* Remember current size. */
-    encode(c, next, k); /* Encode the character. */
-    /* k->xdata[k->size] = '\0'; */
+    k->osize = khot(k)->size; /* Remember current size. */
+    (*(k->encf))(c, next, k); /* Encode the character. */
+    /* k->xdata[khot(k)->size] = '\0'; */
     c = next; /* Old next char is now current. */
 
-    if (k->size == maxlen) { /* Just at end, done. */
-      return (k->size);
+    if (khot(k)->size == maxlen) { /* Just at end, done. */
+      k->s_next = c;
+      return (khot(k)->size);
     }
 
-    if (k->size > maxlen) { /* Past end, must save some. */
+    if (khot(k)->size > maxlen) { /* Past end, must save some. */
       for (i = 0; (k->s_remain[i] = k->xdata[(k->osize) + i]) != '\0'; i++)
         ;
-      k->size = k->osize;
-      k->xdata[k->size] = '\0';
-      return (k->size); /* Return size. */
+      khot(k)->size = k->osize;
+      k->xdata[khot(k)->size] = '\0';
+      k->s_next = c;
+      return (khot(k)->size); /* Return size. */
     }
   }
-  return (k->size); /* EOF, return size. */
+  k->s_next = c;
+  return (khot(k)->size); /* EOF, return size. */
 }
 
 #ifndef RECVONLY
 STATIC int sdata(struct k_data *k,
                  struct k_response *r) { /* Send a data packet */
   int len, rc;
+  long sofar;
   if (k->cancel) { /* Interrupted */
-    debug(DB_LOG, "sdata interrupted k->cancel", 0, (k->cancel));
+    debug(DB_LOG | DBC_STATE | DBL_EVENT, "sdata interrupted k->cancel", 0,
+          (k->cancel));
     return (0);
   }
+  sofar = r->sofar;
+  phase(PH_ENCODE, 1);
   len = getpkt(k, r); /* Fill data field from input file */
-  debug(DB_LOG, "sdata getpkt", 0, len);
+  phase(PH_ENCODE, 0);
+  k->metrics.payload += r->sofar - sofar; /* File bytes in the packet */
+  debug(DB_LOG | DBC_ENC | DBL_DETAIL, "sdata getpkt", 0, len);
   if (len < 1) {
     return (0);
   }
   rc = spkt('D', k->s_seq, len, k->xdata, k); /* Send the packet */
-  debug(DB_LOG, "sdata spkt", 0, rc);
+  debug(DB_LOG | DBC_PKT | DBL_DETAIL, "sdata spkt", 0, rc);
   return ((rc == X_ERROR) ? rc : len);
 }
 #endif /* RECVONLY */
@@ -1564,7 +1962,7 @@ encstr(UCHAR *s, struct k_data *k, struct k_response *r) {
   getpkt(k, r);            /* Fill a packet */
   k->istring = (UCHAR *)0; /* Reset input string pointer */
   k->s_first = 1;          /* "Rewind" */
-  return (k->size);        /* Return data field length */
+  return (khot(k)->size);  /* Return data field length */
 }
 
 /* Decode packet data into a string */
@@ -1576,55 +1974,169 @@ STATIC void decstr(UCHAR *s, struct k_data *k, struct k_response *r) {
   k->ostring = (UCHAR *)0; /* Reset output string pointer */
 }
 
-STATIC void encode(int a, int next,
-                   struct k_data *k) { /* Encode character into packet */
-  int a7, b8, maxlen;
+/*
+  The body of encode(), compiled for each combination of the flags given
+  as constants: ebqflg for 8th-bit prefixing, rptflg for repeat counts.
+  See codecsel().  encchar() puts one character into the packet, prefixed as
+  needed; encbody() counts runs of it first.
+*/
+INLINE void encchar(int a, struct k_data *k, int ebqflg, int rptflg) {
+  struct k_hot *h = khot(k);
+  int a7, b8;
 
-  maxlen = k->s_maxlen - 4;
-  if (k->rptflg) {             /* Doing run-length encoding? */
+  a7 = a & 127; /* Get low 7 bits of character */
+  b8 = a & 128; /* And "parity" bit */
+
+  if (ebqflg && b8) {               /* If doing 8th bit prefixing */
+    k->xdata[(h->size)++] = k->ebq; /* and 8th bit on, insert prefix */
+    a = a7;                         /* and clear the 8th bit. */
+  }
+  if (k->s_ctlmap[a >> 3] & (1 << (a & 7))) { /* If in prefixed set */
+    k->xdata[(h->size)++] = k->s_ctlq;    /* insert control prefix */
+    a = ctl(a);                           /* and make character printable. */
+  } else if (a7 == k->s_ctlq) {           /* If data is control prefix, */
+    k->xdata[(h->size)++] = k->s_ctlq;    /* prefix it. */
+  } else if (ebqflg && a7 == k->ebq) {    /* If doing 8th-bit prefixing, */
+    k->xdata[(h->size)++] = k->s_ctlq;    /* ditto for 8th-bit prefix. */
+  } else if (rptflg && a7 == k->rptq) {   /* If doing run-length encoding, */
+    k->xdata[(h->size)++] = k->s_ctlq;    /* ditto for repeat prefix. */
+  }
+
+  k->xdata[(h->size)++] = a;  /* Finally, emit the character. */
+  k->xdata[(h->size)] = '\0'; /* Terminate string with null. */
+}
+
+INLINE void encbody(int a, int next, struct k_data *k, int ebqflg, int rptflg) {
+  struct k_hot *h = khot(k);
+
+  if (rptflg) {                /* Doing run-length encoding? */
     if (a == next) {           /* Yes, got a run? */
-      if (++(k->s_rpt) < 94) { /* Yes, count. */
+      if (++(h->s_rpt) < 94) { /* Yes, count. */
         return;
-      } else if (k->s_rpt == 94) {                /* If at maximum */
-        k->xdata[(k->size)++] = k->rptq;          /* Emit prefix, */
-        k->xdata[(k->size)++] = tochar(k->s_rpt); /* and count, */
-        k->s_rpt = 0;                             /* and reset counter. */
+      } else if (h->s_rpt == 94) {                /* If at maximum */
+        k->xdata[(h->size)++] = k->rptq;          /* Emit prefix, */
+        k->xdata[(h->size)++] = tochar(h->s_rpt); /* and count, */
+        h->s_rpt = 0;                             /* and reset counter. */
       }
-    } else if (k->s_rpt == 1) { /* Run broken, only two? */
-      k->s_rpt = 0;             /* Yes, do the character twice */
-      encode(a, -1, k);         /* by calling self recursively. */
-      if (k->size <= maxlen) {  /* Watch boundary. */
-        k->osize = k->size;
+    } else if (h->s_rpt == 1) {          /* Run broken, only two? */
+      h->s_rpt = 0;                      /* Yes, do the character twice */
+      encchar(a, k, ebqflg, rptflg);
+      if (h->size <= k->s_maxlen - 4) { /* Watch boundary. */
+        k->osize = h->size;
       }
-      k->s_rpt = 0; /* Call self second time. */
-      encode(a, -1, k);
+      encchar(a, k, ebqflg, rptflg);
       return;
-    } else if (k->s_rpt > 1) {         /* Run broken, more than two? */
-      k->xdata[(k->size)++] = k->rptq; /* Yes, emit prefix and count */
-      k->xdata[(k->size)++] = tochar(++(k->s_rpt));
-      k->s_rpt = 0; /* and reset counter. */
+    } else if (h->s_rpt > 1) {         /* Run broken, more than two? */
+      k->xdata[(h->size)++] = k->rptq; /* Yes, emit prefix and count */
+      k->xdata[(h->size)++] = tochar(++(h->s_rpt));
+      h->s_rpt = 0; /* and reset counter. */
     }
   }
-  a7 = a & 127; /* Get low 7 bits of character */
-  b8 = a & 128; /* And "parity" bit */
+  encchar(a, k, ebqflg, rptflg);
+}
 
-  if (k->ebqflg && b8) {            /* If doing 8th bit prefixing */
-    k->xdata[(k->size)++] = k->ebq; /* and 8th bit on, insert prefix */
-    a = a7;                         /* and clear the 8th bit. */
+STATIC void enc0(int a, int next, struct k_data *k) {
+  encbody(a, next, k, 0, 0);
+}
+
+STATIC void encr(int a, int next, struct k_data *k) {
+  encbody(a, next, k, 0, 1);
+}
+
+#ifndef FIXEDCFG
+STATIC void ence(int a, int next, struct k_data *k) {
+  encbody(a, next, k, 1, 0);
+}
+
+STATIC void encre(int a, int next, struct k_data *k) {
+  encbody(a, next, k, 1, 1);
+}
+#endif /* FIXEDCFG */
+
+STATIC void encode(int a, int next,
+                   struct k_data *k) { /* Encode character into packet */
+  (*(k->encf))(a, next, k);
+}
+
+/*  C O D E C S E L  --  Select the encode() and decode() variants  */
+/*
+  Called whenever the parameters they depend on may have changed (see
+  ctlmap()).  The variants are picked by a switch rather than from a table,
+  since this module has no static data.  With FIXEDCFG there are no 8th-bit
+  prefixing variants at all.
+*/
+STATIC void codecsel(struct k_data *k) {
+  switch ((kebqflg(k) ? 2 : 0) | (k->rptflg ? 1 : 0)) {
+  case 0:
+    k->encf = enc0;
+    break;
+  case 1:
+    k->encf = encr;
+    break;
+#ifndef FIXEDCFG
+  case 2:
+    k->encf = ence;
+    break;
+  case 3:
+    k->encf = encre;
+    break;
+#endif /* FIXEDCFG */
   }
-  if (a7 < 32 || a7 == 127) {              /* If in control range */
-    k->xdata[(k->size)++] = k->s_ctlq;     /* insert control prefix */
-    a = ctl(a);                            /* and make character printable. */
-  } else if (a7 == k->s_ctlq) {            /* If data is control prefix, */
-    k->xdata[(k->size)++] = k->s_ctlq;     /* prefix it. */
-  } else if (k->ebqflg && a7 == k->ebq) {  /* If doing 8th-bit prefixing, */
-    k->xdata[(k->size)++] = k->s_ctlq;     /* ditto for 8th-bit prefix. */
-  } else if (k->rptflg && a7 == k->rptq) { /* If doing run-length encoding, */
-    k->xdata[(k->size)++] = k->s_ctlq;     /* ditto for repeat prefix. */
+  switch ((kparity(k) ? 2 : 0) | (k->rptflg ? 1 : 0)) {
+  case 0:
+    k->decf = dec0;
+    break;
+  case 1:
+    k->decf = decr;
+    break;
+#ifndef FIXEDCFG
+  case 2:
+    k->decf = dece;
+    break;
+  case 3:
+    k->decf = decre;
+    break;
+#endif /* FIXEDCFG */
   }
+}
 
-  k->xdata[(k->size)++] = a;  /* Finally, emit the character. */
-  k->xdata[(k->size)] = '\0'; /* Terminate string with null. */
+/*  C T L M A P  --  Build the bitmap of bytes to control-prefix on send  */
+/*
+  With PFX_ALL, every control character (C0, C1, DEL and 255) is prefixed.
+  With PFX_MINIMAL, only the bytes that can upset the other Kermit or the
+  link stay prefixed: NUL (string terminator), SOH and the packet
+  terminator (framing), LF (taken as a terminator by some Kermits), ^C
+  (three in a row abort a remote Kermit), and XON/XOFF (flow control),
+  plus their 8th-bit twins for links that strip parity.
+*/
+#define ctlset(m, c) ((m)[(UCHAR)(c) >> 3] |= (UCHAR)(1 << ((c) & 7)))
+
+STATIC void ctlmap(struct k_data *k) {
+  UCHAR *m;
+  int i;
+
+  m = k->s_ctlmap;
+  for (i = 0; i < 32; i++) {
+    m[i] = 0;
+  }
+  if (k->prefixing == PFX_MINIMAL) {
+    for (i = 0; i < 256; i += 128) {
+      ctlset(m, i | NUL);
+      ctlset(m, i | k->s_soh);
+      ctlset(m, i | k->s_eom);
+      ctlset(m, i | LF);
+      ctlset(m, i | 3);
+      ctlset(m, i | XON);
+      ctlset(m, i | XOFF);
+    }
+  } else {
+    for (i = 0; i < 4; i++) { /* 0-31 */
+      m[i] = m[i + 16] = 0xff; /* and 128-159 */
+    }
+    ctlset(m, DEL);
+    ctlset(m, 255);
+  }
+  codecsel(k); /* The other parameters of the encoding may have changed too */
 }
 
 STATIC int nxtpkt(struct k_data *k) { /* Get next packet to send */
@@ -1633,12 +2145,184 @@ STATIC int nxtpkt(struct k_data *k) { /* Get next packet to send */
   return (0);
 }
 
+#ifndef RECVONLY
+/*  N X T F I L E  --  Get the name of the next file to send, or NULL  */
+/*
+  From k->nextf if the control program gives the names one at a time
+  (e.g. expanding wildcards as the batch advances), else from the
+  NULL-terminated k->filelist.
+*/
+STATIC UCHAR *nxtfile(struct k_data *k) {
+  UCHAR *s;
+
+  if (k->nextf) {
+    return ((*(k->nextf))(k));
+  }
+  s = *(k->filelist);
+  if (s) {
+    (k->filelist)++;
+  }
+  return (s);
+}
+#endif /* RECVONLY */
+
 STATIC int resend(struct k_data *k) {
   UCHAR *buf;
   if (!k->opktlen) { /* Nothing to resend */
     return (X_OK);
   }
   buf = k->opktbuf;
-  debug(DB_PKT, ">PKT", &buf[1], k->opktlen);
+  k->metrics.resends++;
+  debug(DB_PKT | DBC_PKT | DBL_EVENT, "TPKT", &buf[1], k->opktlen - 2);
   return ((*(k->txd))(k, buf, k->opktlen));
 }
+
+/*  R E A C K  --  ACK again a packet received again  */
+/*
+  Its ACK was lost.  If that is still the last packet sent, it is sent
+  again as it was.  Otherwise a NAK for the next packet was sent since
+  (resending that would only get the packet again, until the retries
+  run out), so the ACK is made again: with our parameters for an S
+  packet, as rpar() does, empty for any other.  k->r_seq is not bumped.
+*/
+STATIC int reack(struct k_data *k, short seq, char t) {
+  int rc;
+#ifdef F_CRC
+  short b;
+#endif /* F_CRC */
+
+  if (k->opktlen > 3 && k->opktbuf[2] == tochar(seq) &&
+      k->opktbuf[3] == 'Y') {
+    return (resend(k));
+  }
+  k->metrics.resends++;
+  if (t != 'S') {
+    return (spkt('Y', seq, 0, (UCHAR *)0, k));
+  }
+#ifdef F_CRC
+  b = k->bct;
+  if (!(k->bctf)) { /* Unless FORCE 3 */
+    k->bct = 1;     /* Always use block check type 1 */
+  }
+#endif /* F_CRC */
+  rc = spkt('Y', seq, -1, k->ack_s, k);
+#ifdef F_CRC
+  k->bct = b;
+#endif /* F_CRC */
+  return (rc);
+}
+
+/*  G E T M E T R I C S  --  Copy the statistics to the response struct  */
+/*
+  Field by field, without a struct assignment that could turn into a
+  library call.  The block check failures include the garbage on the
+  line (k->bcerrs).
+*/
+void STATIC getmetrics(struct k_data *k, struct k_response *r) {
+  r->metrics.pktsin = k->metrics.pktsin;
+  r->metrics.pktsout = k->metrics.pktsout;
+  r->metrics.naks = k->metrics.naks;
+  r->metrics.resends = k->metrics.resends;
+  r->metrics.chkerrs = k->bcerrs;
+  r->metrics.timeouts = k->metrics.timeouts;
+  r->metrics.wirein = k->metrics.wirein;
+  r->metrics.wireout = k->metrics.wireout;
+  r->metrics.payload = k->metrics.payload;
+  r->metrics.start = k->metrics.start;
+  r->metrics.elapsed = k->metrics.elapsed;
+}
+
+#ifndef RECVONLY
+/*  S E R V E  --  Handle a server command received in R_WAIT  */
+/*
+  I: take the other Kermit's parameters and keep waiting.
+  R: GET; the file specification goes to r->filename with r->status
+     SV_GET, and the control program answers with K_SEND for the files
+     it names (or K_ERROR if none).
+  G: generic command, the subcommand in the first data character.
+     D (REMOTE DIR) is answered as R, with the file specification
+     (* if none) in r->filename and r->status SV_DIR; the control
+     program sets k->display and sends the listing.  F (FINISH) and
+     L (BYE) are ACKed, and return X_DONE with r->status SV_FINISH.
+  Anything else gets an Error packet, and the server keeps waiting.
+  Until a transaction starts, packets have a type 1 block check, and
+  k->bct keeps the type to ask for in the S packet exchange.
+*/
+int STATIC serve(struct k_data *k, struct k_response *r, char t, UCHAR *p,
+                 int datalen) {
+  short b;
+  int i, n, rc;
+
+  b = k->bct;
+  switch (t) {
+  case 'I': /* Initialize */
+    spar(k, p, datalen);
+    k->bct = b;
+    rc = rpar(k, 'Y'); /* ACK with my parameters */
+    k->r_seq = 0;      /* Each transaction starts at 0 */
+    return ((rc == X_OK) ? X_OK : X_ERROR);
+
+  case 'R': /* GET */
+    if (decode(k, r, 0, p) != X_OK) { /* Longer than r->filename */
+      r->filename[0] = '\0';
+      srverr("File specification too long", k);
+      return (X_OK);
+    }
+    if (!r->filename[0]) {
+      srverr("Bad file specification", k);
+      return (X_OK);
+    }
+    r->status = SV_GET;
+    return (X_OK);
+
+  case 'G': /* Generic command */
+    if (decode(k, r, 0, p) != X_OK) {
+      srverr("Bad server command", k);
+      return (X_OK);
+    }
+    switch (r->filename[0]) {
+    case 'D': /* Directory, with an optional length-prefixed spec */
+      n = r->filename[1] ? xunchar(r->filename[1]) : 0;
+      for (i = 0; (i < n) && (i < FN_MAX - 3) && r->filename[i + 2]; i++) {
+        r->filename[i] = r->filename[i + 2];
+      }
+      if (i == 0) { /* No spec: all files */
+        r->filename[i++] = '*';
+      }
+      r->filename[i] = '\0';
+      r->status = SV_DIR;
+      return (X_OK);
+    case 'F': /* Finish */
+    case 'L': /* Logout (BYE) */
+      if (!(k->bctf)) {
+        k->bct = 1;
+      }
+      rc = ack(k, k->r_seq, (UCHAR *)0);
+      k->bct = b;
+      r->filename[0] = '\0';
+      r->status = SV_FINISH;
+      return ((rc == X_OK) ? X_DONE : X_ERROR);
+    default:
+      break;
+    }
+    break;
+
+  default:
+    break;
+  }
+  r->filename[0] = '\0';
+  srverr("Unimplemented server command", k);
+  return (X_OK);
+}
+
+/*  S R V E R R  --  Send an Error packet and keep serving  */
+
+void STATIC srverr(char *msg, struct k_data *k) {
+  short b;
+
+  b = k->bct; /* epkt() leaves type 1 for the end of a session */
+  epkt(msg, k);
+  k->bct = b;
+  k->r_seq = 0;
+}
+#endif /* RECVONLY */
@@ -139,6 +139,56 @@
 #define SP 040   /* Space */
 #define DEL 0177 /* Delete (Rubout) */
 
+/*
+  FIXEDCFG: the session parameters the Neo6502 program never changes, and
+  does not let the other Kermit change, are compile-time constants: no
+  parity (so no 8th-bit prefixing, which is refused in the negotiation),
+  binary mode, and CR as the packet terminator to receive.  The tests of
+  them in the per-byte loops go away.  Repeat counts are still negotiated;
+  the encode() and decode() variants for the session are selected when the
+  parameters are known (see codecsel() in kermit.c).  Without FIXEDCFG,
+  the macros read the k_data members as before.
+*/
+#ifdef FIXEDCFG
+#define kparity(k) 0   /* Parity */
+#define kebqflg(k) 0   /* 8th-bit prefixing negotiated */
+#define kbinary(k) 1   /* Binary mode */
+#define kreom(k) CR    /* Packet terminator received */
+#else /* FIXEDCFG */
+#define kparity(k) ((k)->parity)
+#define kebqflg(k) ((k)->ebqflg)
+#define kbinary(k) ((k)->binary)
+#define kreom(k) ((k)->r_eom)
+#endif /* FIXEDCFG */
+
+/*
+  ZPHOT: the members of k_data the per-byte loops of encoding, decoding,
+  and file I/O use most are kept apart in a struct k_hot, reached with
+  khot(k).  With ZPHOT, for a program with a single session such as the
+  Neo6502 one, it is the one struct k_hot zphot, which the program
+  defines in the zero page (see ZEROPAGE in cdefs.h), so that the 6502
+  reads and writes them with zero-page addressing instead of indexing
+  through k.  Without ZPHOT, it is a member of each k_data.
+*/
+#ifdef ZPHOT
+extern struct k_hot zphot;
+#define khot(k) (&zphot)
+#else /* ZPHOT */
+#define khot(k) (&(k)->hot)
+#endif /* ZPHOT */
+
+/*
+  KARENA: the packet buffers are given by the program before K_INIT, as
+  the Neo6502 program does from its memory arena (see arena.h): wmax
+  buffers for incoming packets back to back at ipktbuf, and the buffers
+  at opktbuf and xdatabuf, all for packets of up to pktmax bytes
+  (pktmax + 8 bytes for each packet, pktmax + 2 for the data field);
+  wmax and pktmax may be less than P_WSLOTS and P_PKTLEN.  Without
+  KARENA, K_INIT sets them to the buffers in the k_data itself, of the
+  full sizes.  kslot(k, n) is the buffer of window slot n.
+*/
+#define kslot(k, n) ((k)->ipktbuf + (n) * ((k)->pktmax + 8))
+
 #ifndef HAVE_VERSION /* k_data struct has version member */
 #define HAVE_VERSION /* as of version 1.1 */
 #endif               /* HAVE_VERSION */
@@ -207,6 +257,11 @@
 #define BINARY 1 /* Corrected in E-Kermit 1.8 */
 #define TEXT 0   /* Corrected in E-Kermit 1.8 */
 
+/* Control prefixing on send */
+
+#define PFX_ALL 0     /* Prefix all control characters */
+#define PFX_MINIMAL 1 /* Prefix only framing and flow-control characters */
+
 /* Parity values */
 
 #define PAR_NONE 0
@@ -239,6 +294,7 @@
 #define A_NONE 0 /* Do nothing */
 #define A_SEND 1 /* Send file(s) */
 #define A_RECV 2 /* Receive file(s) */
+#define A_SERV 3 /* Serve the other Kermit */
 
 /* Receive protocol states */
 
@@ -260,6 +316,12 @@
 #define S_EOF 15   /* Sent Z packet */
 #define S_EOT 16   /* Sent B packet */
 
+/* Server statuses, reported in r->status with X_OK or X_DONE */
+
+#define SV_GET 20    /* GET: send the files r->filename names */
+#define SV_DIR 21    /* REMOTE DIR: send a listing of r->filename */
+#define SV_FINISH 22 /* FINISH or BYE: leave server mode */
+
 /* What I'm Doing */
 
 #define W_NOTHING 0
@@ -299,6 +361,31 @@ struct packet {
     short flg;  /* Flags */
 };
 
+struct k_metrics {   /* Transfer statistics of a session */
+    ULONG pktsin;    /* Packets received */
+    ULONG pktsout;   /* Packets sent, not counting retransmissions */
+    ULONG naks;      /* NAKs sent */
+    ULONG resends;   /* Packets retransmitted */
+    ULONG chkerrs;   /* Block check failures */
+    ULONG timeouts;  /* Reads that returned nothing */
+    ULONG wirein;    /* Bytes received on the line */
+    ULONG wireout;   /* Bytes sent on the line */
+    ULONG payload;   /* File data bytes transferred */
+    ULONG start;     /* Timer ticks (100 Hz) at the first packet */
+    ULONG elapsed;   /* Ticks from the first to the last packet */
+};
+
+struct k_hot {     /* State of the per-byte loops, see khot() */
+    int obufpos;   /* Output file buffer position */
+    int zincnt;    /* Input buffer position */
+    UCHAR* zinptr; /* Pointer to input file buffer */
+    int size;      /* Current size of output pkt data */
+    int s_rpt;     /* Current repeat count */
+};
+
+struct k_io; /* Session state of the I/O module, defined there */
+struct k_response; /* Report from Kermit, below */
+
 struct k_data {           /* The Kermit data structure */
     UCHAR* version;       /* Version number of Kermit module */
     short remote;         /* 0 = local, 1 = remote */
@@ -316,7 +403,6 @@ struct k_data {           /* The Kermit data structure */
     short r_soh;          /* Packet start received */
     short s_eom;          /* Packet end sent */
     short r_eom;          /* Packet end received */
-    int size;             /* Current size of output pkt data */
     int osize;            /* Previous output packet data size */
     int r_timo;           /* Receive and send timers */
     int s_timo;           /* ... */
@@ -325,15 +411,17 @@ struct k_data {           /* The Kermit data structure */
     short window;         /* maximum window slots */
     short wslots;         /* current window slots */
     short parity;         /* 0 = none, nonzero = some */
+    short prefixing;      /* PFX_ALL or PFX_MINIMAL */
     short retry;          /* retry limit */
     short cancel;         /* Cancellation */
     short ikeep;          /* Keep incompletely received files */
+    short server;         /* Serve commands while waiting (R_WAIT) */
+    short display;        /* Send text to display (X), not files */
     char s_ctlq;          /* control-prefix out */
     char r_ctlq;          /* control-prefix in */
     char ebq;             /* 8-bit prefix */
     char ebqflg;          /* 8-bit prefixing negotiated */
     char rptq;            /* Repeat-count prefix */
-    int s_rpt;            /* Current repeat count */
     short rptflg;         /* flag for repeat counts negotiated */
     short bct;            /* Block-check type 1..3 */
     unsigned short capas; /* Capability bits */
@@ -342,15 +430,23 @@ struct k_data {           /* The Kermit data structure */
     USHORT crctb[16];                      /* CRC generation table B */
 #endif                                     /* F_CRC */
     UCHAR s_remain[6];                     /* Send data leftovers */
-    UCHAR ipktbuf[P_PKTLEN + 8][P_WSLOTS]; /* Buffers for incoming packets */
+    UCHAR s_ctlmap[32];                    /* Bytes to control-prefix */
+    UCHAR* ipktbuf;                        /* Buffers for incoming packets */
     struct packet ipktinfo[P_WSLOTS];      /* Incoming packet info */
 #ifdef COMMENT
     UCHAR opktbuf[P_PKTLEN + 8][P_WSLOTS]; /* Buffers for outbound packets */
 #else
-    UCHAR opktbuf[P_PKTLEN + 8];  /* Outbound packet buffer */
-    int opktlen;                  /* Outbound packet length */
-    UCHAR xdatabuf[P_PKTLEN + 2]; /* Buffer for building data field */
+    UCHAR* opktbuf;  /* Outbound packet buffer */
+    int opktlen;     /* Outbound packet length */
+    UCHAR* xdatabuf; /* Buffer for building data field */
 #endif                                /* COMMENT */
+    int pktmax;                       /* Packet length the buffers hold */
+    short wmax;                       /* Incoming packet buffers */
+#ifndef KARENA
+    UCHAR ipktarea[P_WSLOTS][P_PKTLEN + 8]; /* The buffers themselves */
+    UCHAR opktarea[P_PKTLEN + 8];
+    UCHAR xdataarea[P_PKTLEN + 2];
+#endif /* KARENA */
     struct packet opktinfo[P_WSLOTS]; /* Outbound packet info */
     UCHAR* xdata;                     /* Pointer to data field of outpkt */
 #ifdef F_TSW
@@ -361,7 +457,6 @@ struct k_data {           /* The Kermit data structure */
     UCHAR* obuf;
     int rx_avail;                              /* Comms bytes available for reading */
     int obuflen;                               /* Length of output file buffer */
-    int obufpos;                               /* Output file buffer position */
     UCHAR** filelist;                          /* List of files to send */
     UCHAR* dir;                                /* Directory */
     UCHAR* filename;                           /* Name of current file */
@@ -376,11 +471,27 @@ struct k_data {           /* The Kermit data structure */
     int (*writef)(struct k_data*, UCHAR*, int); /* write-file function */
     int (*closef)(struct k_data*, UCHAR, int);  /* close-file function */
     void (*dbf)(int, UCHAR*, UCHAR*, long);     /* debug function */
+    void (*phf)(int, int);                      /* phase timing function */
+    UCHAR* (*nextf)(struct k_data*);            /* next-file-to-send function */
+    void (*encf)(int, int, struct k_data*);     /* encode() variant of the session */
+    int (*decf)(struct k_data*, struct k_response*, short, UCHAR*); /* and decode() */
+    struct k_io* io;                            /* I/O module session, or 0 */
+    void (*evf)(struct k_data*, int, struct k_response*); /* kermit_feed() event function */
+    UCHAR* f_pkt;                               /* kermit_feed(): packet being framed, or 0 */
+    short f_slot;                               /* its window slot */
+    int f_len;                                  /* its length so far */
+    int f_want;                                 /* and in all, 0 if not known yet */
+    int f_skip;                                 /* Bytes outside of packets */
+    short f_ctlc;                               /* Consecutive ^C's */
     UCHAR* zinbuf;                              /* Input file buffer itself */
-    int zincnt;                                 /* Input buffer position */
     int zinlen;                                 /* Length of input file buffer */
-    UCHAR* zinptr;                              /* Pointer to input file buffer */
     int bctf;                                   /* Flag to force type 3 block check */
+    unsigned int bcpkts;                        /* Packets block-checked */
+    unsigned int bcerrs;                        /* Of which failed (line errors) */
+    struct k_metrics metrics;                   /* Counted by kermit.c and the I/O module */
+#ifndef ZPHOT
+    struct k_hot hot; /* State of the per-byte loops */
+#endif /* ZPHOT */
     int dummy;
 };
 
@@ -390,6 +501,7 @@ struct k_response {           /* Report from Kermit */
     UCHAR filedate[DATE_MAX]; /* Date of file */
     long filesize;            /* Size of file */
     long sofar;               /* Bytes transferred so far */
+    struct k_metrics metrics; /* Statistics, filled in by K_STATUS */
 };
 
 /* Macro definitions */
@@ -407,9 +519,12 @@ struct k_response {           /* Report from Kermit */
 /* Prototypes for kermit() functions */
 
 int kermit(short, struct k_data*, short, int, char*, struct k_response*);
+int kermit_feed(struct k_data*, UCHAR*, int, struct k_response*);
+int framelen(struct k_data*, UCHAR*, int);
 UCHAR* getrslot(struct k_data*, short*);
 UCHAR* getsslot(struct k_data*, short*);
 void freerslot(struct k_data*, short);
 void freesslot(struct k_data*, short);
+unsigned int blockchk(struct k_data*, short, UCHAR*);
 
 #endif /* __KERMIT_H__ */
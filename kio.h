@@ -0,0 +1,39 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// kio.h -- Interface between the control program and an I/O backend.
+// Backends: neoio.c (Neo6502 API), posixio.c (POSIX host build).
+
+#ifndef __KIO_H__
+#define __KIO_H__
+
+#include "cdefs.h"
+#include "kermit.h"
+
+// Device I/O
+
+void devinit(void);
+int readpkt(struct k_data *, UCHAR *, int);
+int tx_data(struct k_data *, UCHAR *, int);
+int inchk(struct k_data *);
+
+// File I/O
+
+int openfile(struct k_data *, UCHAR *, int);
+int writefile(struct k_data *, UCHAR *, int);
+int readfile(struct k_data *);
+int closefile(struct k_data *, UCHAR, int);
+ULONG fileinfo(struct k_data *, UCHAR *, UCHAR *, int, short *, short);
+
+// Directory listing for the server, and file name matching (neoio.c)
+
+int openlisting(struct k_data *, UCHAR *, int);
+int readlisting(struct k_data *);
+int closelisting(struct k_data *, UCHAR, int);
+int wildmatch(const UCHAR *, const UCHAR *);
+
+// Provided by the control program
+
+void doexit(int status);
+
+#endif /* __KIO_H__ */
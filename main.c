@@ -12,9 +12,15 @@
 
 #define NEO6502_KERMIT_VERSION "v0.1.9"
 
-#include "cdefs.h"  // Data types for all modules
-#include "debug.h"  // Debugging
-#include "kermit.h" // Kermit symbols and data structures
+#include "arena.h"    // Memory arena of the buffers
+#include "cdefs.h"    // Data types for all modules
+#include "debug.h"    // Debugging
+#include "kermit.h"   // Kermit symbols and data structures
+#include "kio.h"      // I/O backend (neoio.c)
+#include "phase.h"    // Phase timing
+#include "progress.h" // Status line of a transfer
+#include "sendlist.h" // Files to send
+#include "trace.h"    // Tracing
 
 // Neo6502 I/O
 #include <kernel.h>
@@ -24,34 +30,24 @@
 #include <stdio.h>
 #include <string.h>
 
-// Prototypes of functions in neoio.c
+// External data
 
-void devinit(void);
-int readpkt(struct k_data *, UCHAR *, int);
-int tx_data(struct k_data *, UCHAR *, int);
-int inchk(struct k_data *);
-
-int openfile(struct k_data *, UCHAR *, int);
-int writefile(struct k_data *, UCHAR *, int);
-int readfile(struct k_data *);
-int closefile(struct k_data *, UCHAR, int);
-ULONG fileinfo(struct k_data *, UCHAR *, UCHAR *, int, short *, short);
-
-// External data in neoio.c
-
-extern UCHAR o_buf[];
-extern UCHAR i_buf[];
 extern int errno;
 
+// Free RAM from the end of the program and its data up to the top of
+// the soft stack (LLVM-MOS linker symbols), of which ARENA_STACK bytes
+// are left to the stack
+extern char __heap_start[];
+extern char __stack[];
+#define ARENA_STACK (1024)
+
 // Data global to this module
 
 struct k_data k;     /* Kermit data structure */
 struct k_response r; /* Kermit response structure */
-
-// Sending filenames
-#define MAXSENDFILENUM (16)
-UCHAR sendfilearea[MAXSENDFILENUM][FN_MAX + 1];
-UCHAR *sendfilelist[MAXSENDFILENUM + 1];
+#ifdef ZPHOT
+ZEROPAGE struct k_hot zphot; /* Hot part of k (see kermit.h) */
+#endif                       /* ZPHOT */
 
 // Simple line input
 // Echoing back input (printables only)
@@ -61,6 +57,39 @@ UCHAR *sendfilelist[MAXSENDFILENUM + 1];
 #define LINELEN (50)
 char linebuf[LINELEN];
 
+// Block check policy
+// 1, 2, 3: ask for that type (used only if the other Kermit agrees)
+// BC_AUTO: choose from the line errors seen in the earlier sessions
+#define BC_AUTO (0)
+#ifdef F_CRC
+#define BC_MAX (3)
+#else
+#define BC_MAX (2)
+#endif // F_CRC
+// Auto policy: errors per 1000 packets to go straight to BC_MAX
+#define BC_AUTO_RATE_MAX (10)
+// Auto policy: error-free packets needed to step down one type
+#define BC_AUTO_CLEAN (256)
+
+// Control prefixing on send
+// (PFX_MINIMAL assumes an 8-bit transparent link)
+int prefixing = PFX_MINIMAL;
+
+int bcpolicy = BC_AUTO;
+int bcauto = BC_MAX; // Start safe, step down on a clean line
+unsigned int bcclean = 0;
+
+// Ticks per second of neo_system_timer()
+#define TIMER_HZ (100L)
+// Nominal Neo6502 65C02 clock, for converting time to cycles
+#define NEO_CPU_HZ (6250000L)
+// Measure each block check type for this many timer ticks
+#define BC_MEASURE_TICKS (50)
+
+// Transfer statistics of each session, appended as a CSV line
+#define STATS_FILE "KSTATS.CSV"
+#define CHANNEL_STATS (7)
+
 int lineinput(void) {
   int c;
   int i;
@@ -123,6 +152,11 @@ void doexit(int status) {
   // Close debug log
   debug(DB_CLS, "", 0, 0);
 #endif // DEBUG
+  // Write the trace, with the error if any
+  if (status != 0) {
+    trace(TR_ERROR, k.state, 0, 0, status);
+  }
+  traceflush();
   // Close all files
   neo_file_close((uint8_t)0xff);
   // Print only if exit status is not 0
@@ -135,6 +169,284 @@ void doexit(int status) {
   load_basic_and_restart();
 }
 
+// Block check type for the next session
+
+int bcselect(void) { return (bcpolicy == BC_AUTO) ? bcauto : bcpolicy; }
+
+// Feed the block check results of a finished session to the auto policy.
+// Any line error raises the type at once (to BC_MAX on a noisy line);
+// BC_AUTO_CLEAN error-free packets in a row lower it by one.
+
+void bcupdate(unsigned int pkts, unsigned int errs) {
+  if (errs > 0) {
+    if ((long)errs * 1000L >= (long)pkts * BC_AUTO_RATE_MAX) {
+      bcauto = BC_MAX;
+    } else if (bcauto < BC_MAX) {
+      bcauto++;
+    }
+    bcclean = 0;
+  } else if (bcauto > 1) {
+    bcclean += pkts;
+    if (bcclean >= BC_AUTO_CLEAN) {
+      bcauto--;
+      bcclean = 0;
+    }
+  }
+}
+
+// Count how many block checks of the type run in BC_MEASURE_TICKS ticks.
+// Type 0 runs the timer polling alone, as the baseline.
+
+long bccount(int type, UCHAR *pkt) {
+  uint32_t t0, t;
+  long n;
+
+  // Start on a tick edge
+  t0 = neo_system_timer();
+  while ((t = neo_system_timer()) == t0) {
+  }
+  n = 0;
+  do {
+    if (type > 0) {
+      (void)blockchk(&k, type, pkt);
+    }
+    n++;
+  } while ((neo_system_timer() - t) < BC_MEASURE_TICKS);
+  return n;
+}
+
+// Report the CPU cycles each block check type costs per packet
+// of the largest size we receive, i.e. for the k.pktmax - 8 bytes it covers
+
+void bcmeasure(void) {
+  UCHAR *pkt;
+  long n, base, cycles;
+  int i, type, len;
+
+  // The CRC tables are set up here
+  (void)kermit(K_INIT, &k, 0, 0, "", &r);
+  // Printable packet contents, as on the wire
+  pkt = k.xdatabuf;
+  len = k.pktmax - 8;
+  for (i = 0; i < len; i++) {
+    pkt[i] = (UCHAR)(SP + (i % 95));
+  }
+  pkt[len] = '\0';
+  puts("Measuring block check cost...");
+  base = bccount(0, pkt);
+  for (type = 1; type <= BC_MAX; type++) {
+    n = bccount(type, pkt);
+    cycles = (BC_MEASURE_TICKS * (NEO_CPU_HZ / TIMER_HZ)) / n -
+             (BC_MEASURE_TICKS * (NEO_CPU_HZ / TIMER_HZ)) / base;
+    printf("Type %d: %ld cycles/packet, %ld cycles/byte\n", type, cycles,
+           cycles / len);
+  }
+}
+
+// Block check command
+
+void bccommand(void) {
+  int c;
+
+  if (bcpolicy == BC_AUTO) {
+    printf("Block check: auto (now type %d)\n", bcauto);
+  } else {
+    printf("Block check: type %d\n", bcpolicy);
+  }
+  printf("Set 1-%d, A)uto, or M)easure cost? ", BC_MAX);
+  c = toupper(getchar());
+  if (isalnum(c)) {
+    putchar(c);
+  }
+  putchar('\n');
+  if ((c >= '1') && (c <= '0' + BC_MAX)) {
+    bcpolicy = c - '0';
+  } else if (c == 'A') {
+    bcpolicy = BC_AUTO;
+  } else if (c == 'M') {
+    bcmeasure();
+  } else {
+    puts("Block check unchanged");
+  }
+}
+
+// Effective characters per second of the file data
+
+long statscps(struct k_metrics *m) {
+  return (m->elapsed > 0) ? (long)((m->payload * TIMER_HZ) / m->elapsed)
+                          : 0L;
+}
+
+// Percentage of the bytes on the line carrying the file data
+
+int statsefficiency(struct k_metrics *m) {
+  ULONG wire;
+
+  wire = m->wirein + m->wireout;
+  return (wire > 0) ? (int)((m->payload * 100) / wire) : 0;
+}
+
+// Show the statistics of a finished session
+
+void statsshow(struct k_metrics *m) {
+  printf("%ld bytes in %ld.%02ld sec, %ld CPS, %d%% efficiency\n",
+         (long)m->payload, (long)(m->elapsed / TIMER_HZ),
+         (long)(m->elapsed % TIMER_HZ), statscps(m), statsefficiency(m));
+  printf("Line: %ld bytes in, %ld bytes out\n", (long)m->wirein,
+         (long)m->wireout);
+  printf("Packets: %ld in, %ld out, %ld NAKs, %ld resent\n", (long)m->pktsin,
+         (long)m->pktsout, (long)m->naks, (long)m->resends);
+  printf("Errors: %ld block checks, %ld timeouts\n", (long)m->chkerrs,
+         (long)m->timeouts);
+}
+
+// Append the statistics of a finished session to STATS_FILE,
+// with a header line when the file is new
+
+void statsappend(struct k_metrics *m, int action) {
+  char line[160];
+  uint32_t size;
+
+  neo_file_open(CHANNEL_STATS, STATS_FILE, 2); // read-write
+  if (neo_api_error() != API_ERROR_NONE) {
+    neo_file_open(CHANNEL_STATS, STATS_FILE, 3); // create
+    if (neo_api_error() != API_ERROR_NONE) {
+      puts("Unable to open " STATS_FILE);
+      return;
+    }
+  }
+  size = neo_file_size(CHANNEL_STATS);
+  if (size == 0) {
+    snprintf(line, sizeof(line),
+             "action,check,bytes,ticks,cps,efficiency,wirein,wireout,"
+             "pktsin,pktsout,naks,resends,chkerrs,timeouts\n");
+    (void)neo_file_write(CHANNEL_STATS, line, strlen(line));
+  } else {
+    neo_file_seek(CHANNEL_STATS, size);
+  }
+  snprintf(line, sizeof(line),
+           "%s,%d,%ld,%ld,%ld,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld\n",
+           (action == A_SEND) ? "send" : "receive", k.bct, (long)m->payload,
+           (long)m->elapsed, statscps(m), statsefficiency(m), (long)m->wirein,
+           (long)m->wireout, (long)m->pktsin, (long)m->pktsout, (long)m->naks,
+           (long)m->resends, (long)m->chkerrs, (long)m->timeouts);
+  (void)neo_file_write(CHANNEL_STATS, line, strlen(line));
+  if (neo_api_error() != API_ERROR_NONE) {
+    puts("Unable to write " STATS_FILE);
+  }
+  neo_file_close(CHANNEL_STATS);
+}
+
+#ifdef DEBUG
+// Debug log categories command
+
+void logcommand(void) {
+  static const char keys[] = "PSFCE"; // In the order of DBC_* bits
+  int c, i;
+
+  printf("Log categories:");
+  for (i = 0; keys[i]; i++) {
+    printf(" %c%c", keys[i], (debugmask & (DBC_PKT << i)) ? '+' : '-');
+  }
+  printf("\nToggle P)ackets, S)tates, F)ile I/O, C)RC, E)ncoding? ");
+  c = toupper(getchar());
+  for (i = 0; keys[i]; i++) {
+    if (c == keys[i]) {
+      putchar(c);
+      debugmask ^= (DBC_PKT << i);
+    }
+  }
+  putchar('\n');
+}
+#endif // DEBUG
+
+// Set up the Kermit parameters, buffers and functions for a session
+
+void kermitsetup(int parity) {
+  int check;
+
+  // Block check type from the policy
+  check = bcselect();
+  // Manual mode transfer only
+  k.xfermode = 0;
+  // Remote mode
+  k.remote = 1;
+  // Binary mode transfer only
+  k.binary = 1;
+  // Set communications parity
+  k.parity = parity;
+  // Control characters to prefix on send
+  k.prefixing = prefixing;
+  // Block check type
+  k.bct = check;
+  // Do not force Type 3 Block Check (16-bit CRC) on all packets
+  k.bctf = 0;
+  // Do not keep incompletely received files
+  k.ikeep = 0;
+  // Not canceled yet
+  k.cancel = 0;
+  // Files to send (if any), one at a time from the list
+  k.filelist = (UCHAR **)0;
+  k.nextf = sendlistnext;
+
+  //  The buffers are set up by arenaattach()
+
+  khot(&k)->zincnt = 0;  /* File input buffer position */
+  khot(&k)->obufpos = 0; /* File output buffer position */
+
+  // Fill in function pointers
+
+  k.rxd = readpkt;      /* for reading packets */
+  k.txd = tx_data;      /* for sending packets */
+  k.ixd = inchk;        /* for checking connection */
+  k.openf = openfile;   /* for opening files */
+  k.finfo = fileinfo;   /* for getting file info */
+  k.readf = readfile;   /* for reading files */
+  k.writef = writefile; /* for writing to output file */
+  k.closef = closefile; /* for closing files */
+#ifdef DEBUG
+  k.dbf = dodebug; /* for debugging */
+#else
+  k.dbf = 0;
+#endif /* DEBUG */
+#ifdef PHASE
+  k.phf = dophase; /* for phase timing */
+#else
+  k.phf = 0;
+#endif /* PHASE */
+}
+
+// Server: answer a GET by sending the files, or an Error packet
+// if nothing can be read
+
+int serverget(void) {
+  sendlistclear();
+  if (sendlistadd((const char *)r.filename) <= 0) {
+    printf("GET \"%s\": no such file\n", r.filename);
+    return kermit(K_ERROR, &k, 0, 0, "No such file", &r);
+  }
+  printf("GET \"%s\": %d files\n", r.filename, sendlistfiles());
+  progressbegin(sendlistbytes());
+  return kermit(K_SEND, &k, 0, 0, "", &r);
+}
+
+// Server: answer a REMOTE DIR by sending the listing as text to display
+
+int serverdir(void) {
+  static UCHAR *dirlist[2];
+
+  dirlist[0] = r.filename; /* File specification, * for all */
+  dirlist[1] = (UCHAR *)0;
+  k.filelist = dirlist;
+  k.nextf = 0;
+  k.display = 1;
+  k.openf = openlisting;
+  k.readf = readlisting;
+  k.closef = closelisting;
+  puts("REMOTE DIR");
+  return kermit(K_SEND, &k, 0, 0, "", &r);
+}
+
 // Output the banner for startup
 
 void start_banner(void) {
@@ -152,7 +464,7 @@ void start_banner(void) {
 // Main program
 
 int main(int argc, char **argv) {
-  int rx_len, i, x;
+  int rx_len, x;
   char c;
   UCHAR *inbuf;
   short r_slot;
@@ -160,7 +472,7 @@ int main(int argc, char **argv) {
   int parity;
   int status;
   int action;
-  int check;
+  long total;
 
   // Code starts here
 
@@ -171,14 +483,17 @@ int main(int argc, char **argv) {
   // Initialization
 
   start_banner();
-  devinit();
 
-  // Allocate sendfile list string pointers
-  for (i = 0; i < MAXSENDFILENUM; i++) {
-    UCHAR *p;
-    p = sendfilearea[i];
-    sendfilelist[i] = p;
+  // Buffers from the free RAM, with no files to send yet
+  if ((__stack - __heap_start < ARENA_STACK) ||
+      (arenainit((UCHAR *)__heap_start,
+                 (unsigned int)(__stack - __heap_start) - ARENA_STACK) < 0)) {
+    puts("Not enough memory");
+    return (FAILURE);
   }
+  arenashow();
+  arenaattach(&k);
+  devinit();
 
   // State of running main loop
   running = true;
@@ -187,65 +502,22 @@ int main(int argc, char **argv) {
   // Initial Kermit status
   status = X_OK;
   action = A_NONE;
-  // Block check
-#ifdef F_CRC
-  check = 3;
-#else
-  check = 1;
-#endif // F_CRC
+  // Bytes of the files to send
+  total = 0;
 
   // Toplevel loop for send/receive multiple files
   while (running) {
 
     // Parameters for this run
 
-    // Manual mode transfer only
-    k.xfermode = 0;
-    // Remote mode
-    k.remote = 1;
-    // Binary mode transfer only
-    k.binary = 1;
-    // Set communications parity
-    k.parity = parity;
-    // Block check type
-    k.bct = (check == 5) ? 3 : check;
-    // Force Type 3 Block Check (16-bit CRC) on all packets, or not
-    k.bctf = (check == 5) ? 1 : 0;
-    // Do not keep incompletely received files
-    k.ikeep = 0;
-    // Not canceled yet
-    k.cancel = 0;
-    // List of files to send (if any)
-    k.filelist = (UCHAR **)sendfilelist;
-
-    //  Fill in the i/o pointers
-
-    k.zinbuf = i_buf;    /* File input buffer */
-    k.zinlen = IBUFLEN;  /* File input buffer length */
-    k.zincnt = 0;        /* File input buffer position */
-    k.obuf = o_buf;      /* File output buffer */
-    k.obuflen = OBUFLEN; /* File output buffer length */
-    k.obufpos = 0;       /* File output buffer position */
-
-    // Fill in function pointers
-
-    k.rxd = readpkt;      /* for reading packets */
-    k.txd = tx_data;      /* for sending packets */
-    k.ixd = inchk;        /* for checking connection */
-    k.openf = openfile;   /* for opening files */
-    k.finfo = fileinfo;   /* for getting file info */
-    k.readf = readfile;   /* for reading files */
-    k.writef = writefile; /* for writing to output file */
-    k.closef = closefile; /* for closing files */
-#ifdef DEBUG
-    k.dbf = dodebug; /* for debugging */
-#else
-    k.dbf = 0;
-#endif /* DEBUG */
-
     // Prompting user for actions
     int cmd;
-    printf("S)end, R)eceive, show D)irectory, or Q)uit? ");
+    printf("S)end, R)eceive, show D)irectory, B)lock check, P)refixing,\n"
+           "K)ermit server, "
+#ifdef DEBUG
+           "L)og categories, "
+#endif // DEBUG
+           "or Q)uit? ");
     c = getchar();
     cmd = toupper(c);
     // Echo back if alphabet
@@ -262,17 +534,12 @@ int main(int argc, char **argv) {
       bool entering;
       char name[FN_MAX + 1];
       int count;
-      // this channel ID is available here
-      uint8_t tchannel = 1;
-      uint8_t error;
 
       // Clear sendfile list
-      for (i = 0; i < MAXSENDFILENUM; i++) {
-        sendfilelist[i][0] = '\0';
-      }
-      count = 0;
+      sendlistclear();
+      total = 0;
 
-      puts("Enter filenames to send");
+      puts("Enter filenames or patterns (* for all) to send");
       entering = true;
       while (entering) {
         puts("Filename+Return to add, '>'+Return to finish,\n"
@@ -297,38 +564,25 @@ int main(int argc, char **argv) {
             // Show directory
             neo_file_list_directory();
           } else {
-            // Test if file is readable
-            neo_file_open(tchannel, (const char *)name, 0);
-            if ((error = neo_api_error()) != API_ERROR_NONE) {
+            // Test if any file is readable
+            count = sendlistadd(name);
+            if (count < 0) {
+              puts("No room for more names, '>'+Return to send");
+            } else if (count == 0) {
               printf("Unable to open file %s\n", name);
             } else {
-              neo_file_close(tchannel);
-              // File readable
-              strncpy((char *)sendfilelist[count], name, FN_MAX);
-              sendfilelist[count][FN_MAX] = '\0';
-              printf("Set File number %d to \"%s\"\n", count + 1, name);
-              count++;
+              printf("Added \"%s\": %d files, %d in total\n", name, count,
+                     sendlistfiles());
             }
           }
-          // Exit if exceeding the MAXSENDFILENUM
-          if (count >= MAXSENDFILENUM) {
-            printf("Number of files sent reached to maximum %d",
-                   MAXSENDFILENUM);
-            puts("No more entering filenames");
-            entering = false;
-            action = A_SEND;
-          }
         }
       }
-      if ((action != A_NONE) && (count > 0)) {
+      if ((action != A_NONE) && (sendlistfiles() > 0)) {
         // List sending files
-        printf("\nNumber of sending files: %d\n", count);
-        int i;
-        for (i = 0; i < count; i++) {
-          printf("Sending file number %d: \"%s\"\n", i + 1, sendfilelist[i]);
-        }
-        // Add a NULL pointer to the end of the list
-        sendfilelist[count] = (UCHAR *)0;
+        puts("\nSending files:");
+        sendlistshow();
+        // Bytes of the batch, for the progress line
+        total = sendlistbytes();
         printf("Press ^C or Q to cancel, others to go:");
         c = getchar();
         if ((c == 0x03) || (toupper(c) == 'Q')) {
@@ -350,6 +604,30 @@ int main(int argc, char **argv) {
       puts("Waiting to receive files...");
       action = A_RECV;
       break;
+    // Serve GET, SEND, REMOTE DIR and FINISH from the other Kermit
+    case 'K':
+      puts("Kermit server, waiting for commands (FINISH or BYE to end)...");
+      action = A_SERV;
+      break;
+    // Block check policy and cost
+    case 'B':
+      action = A_NONE;
+      bccommand();
+      break;
+    // Toggle control prefixing on send
+    case 'P':
+      action = A_NONE;
+      prefixing = (prefixing == PFX_ALL) ? PFX_MINIMAL : PFX_ALL;
+      printf("Control prefixing on send: %s\n",
+             (prefixing == PFX_ALL) ? "all" : "minimal");
+      break;
+#ifdef DEBUG
+    // Debug log categories
+    case 'L':
+      action = A_NONE;
+      logcommand();
+      break;
+#endif // DEBUG
     // Show current directory listing
     case 'D':
       action = A_NONE;
@@ -369,131 +647,174 @@ int main(int argc, char **argv) {
     }
 
     // Activate Kermit only if action is not A_NONE
+    // (a server runs a session for each transaction until FINISH)
     if (action != A_NONE) {
 
-      // Initialize Kermit protocol
-      status = kermit(K_INIT, &k, 0, 0, "", &r);
+      do {
+        kermitsetup(parity);
+        k.server = (action == A_SERV);
+
+        // Initialize Kermit protocol
+        status = kermit(K_INIT, &k, 0, 0, "", &r);
 #ifdef DEBUG
-      debug(DB_LOG, "init status:", 0, status);
-      debug(DB_LOG, "E-Kermit version:", k.version, 0);
+        debug(DB_LOG | DBC_STATE | DBL_EVENT, "init status:", 0, status);
+        debug(DB_LOG | DBC_STATE | DBL_EVENT, "E-Kermit version:", k.version,
+              0);
 #endif /* DEBUG */
-      if (status == X_ERROR) {
-        doexit(FAILURE);
-      }
-
-      // Sending files starts here
-      if (action == A_SEND) {
-        status = kermit(K_SEND, &k, 0, 0, "", &r);
-      }
+        if (status == X_ERROR) {
+          doexit(FAILURE);
+        }
+        trace(TR_OPEN, k.state, action, 0, 0);
+        phasereset();
+        progressbegin((action == A_SEND) ? total : 0L);
+
+        // Sending files starts here
+        if (action == A_SEND) {
+          sendlistrewind();
+          status = kermit(K_SEND, &k, 0, 0, "", &r);
+        }
 
-      // Kermit protocol begins
-      // To interrupt a transfer in progress:
-      // * Set k.cancel to:
-      //   * I_FILE to interrupt only the current file
-      //   * I_GROUP to cancel the current file and all remaining files
-      // To cancel the whole operation
-      // in such a way that the both Kermits return an error status:
-      // call Kermit with K_ERROR.
-
-      while (status != X_DONE) {
-
-        // Here we block waiting for a packet to come in.
-        // TODO: add CTRL/C acceptance code here
-
-        inbuf = getrslot(&k, &r_slot);       /* Allocate a window slot */
-        rx_len = k.rxd(&k, inbuf, P_PKTLEN); /* Try to read a packet */
-        debug(DB_PKT, "main packet", &(k.ipktbuf[0][r_slot]), rx_len);
-
-        // For simplicity, kermit() ACKs the packet immediately after verifying
-        // it was received correctly.  If, afterwards, the control program fails
-        // to handle the data correctly (e.g. can't open file, can't write data,
-        // can't close file), then it tells Kermit to send an Error packet next
-        // time through the loop.
-
-        if (rx_len < 1) {        /* No data was read */
-          freerslot(&k, r_slot); /* So free the window slot */
-          if (rx_len < 0) {      /* If there was a fatal error */
-            doexit(FAILURE);     /* give up */
+        // Kermit protocol begins
+        // To interrupt a transfer in progress:
+        // * Set k.cancel to:
+        //   * I_FILE to interrupt only the current file
+        //   * I_GROUP to cancel the current file and all remaining files
+        // To cancel the whole operation
+        // in such a way that the both Kermits return an error status:
+        // call Kermit with K_ERROR.
+
+        while (status != X_DONE) {
+
+          // Here we block waiting for a packet to come in.
+          // TODO: add CTRL/C acceptance code here
+
+          inbuf = getrslot(&k, &r_slot);       /* Allocate a window slot */
+          rx_len = k.rxd(&k, inbuf, k.pktmax); /* Try to read a packet */
+          debug(DB_LOG | DBC_PKT | DBL_DETAIL, "main packet",
+                kslot(&k, r_slot), rx_len);
+
+          // For simplicity, kermit() ACKs the packet immediately after
+          // verifying it was received correctly.  If, afterwards, the control
+          // program fails to handle the data correctly (e.g. can't open file,
+          // can't write data, can't close file), then it tells Kermit to send
+          // an Error packet next time through the loop.
+
+          if (rx_len < 1) {        /* No data was read */
+            freerslot(&k, r_slot); /* So free the window slot */
+            if (rx_len < 0) {      /* If there was a fatal error */
+              doexit(FAILURE);     /* give up */
+            }
+            // This would be another place to dispatch to another task
+            // while waiting for a Kermit packet to show up.
           }
-          // This would be another place to dispatch to another task
-          // while waiting for a Kermit packet to show up.
-        }
 
-        // Handle the input
+          // Handle the input
 
-        status = kermit(K_RUN, &k, r_slot, rx_len, "", &r);
-        switch (status) {
-        case X_OK:
+          status = kermit(K_RUN, &k, r_slot, rx_len, "", &r);
+          switch (status) {
+          case X_OK:
 #ifdef DEBUG
-          // After each packet, you get the protocol state, filename,
-          // date, size, and bytes transferred so far.
-          debug(DB_LOG, "NAME",
-                (UCHAR *)(r.filename != (UCHAR *)(0) ? (char *)r.filename
-                                                     : "(NULL)"),
-                0);
-          debug(DB_LOG, "DATE",
-                (UCHAR *)(r.filedate != (UCHAR *)(0) ? (char *)r.filedate
-                                                     : "(NULL)"),
-                0);
-          debug(DB_LOG, "SIZE", 0, r.filesize);
-          debug(DB_LOG, "STATE", 0, r.status);
-          debug(DB_LOG, "SOFAR", 0, r.sofar);
+            // After each packet, you get the protocol state, filename,
+            // date, size, and bytes transferred so far.
+            debug(DB_LOG | DBC_FILE | DBL_DETAIL, "NAME",
+                  (UCHAR *)(r.filename != (UCHAR *)(0) ? (char *)r.filename
+                                                       : "(NULL)"),
+                  0);
+            debug(DB_LOG | DBC_FILE | DBL_DETAIL, "DATE",
+                  (UCHAR *)(r.filedate != (UCHAR *)(0) ? (char *)r.filedate
+                                                       : "(NULL)"),
+                  0);
+            debug(DB_LOG | DBC_FILE | DBL_DETAIL, "SIZE", 0, r.filesize);
+            debug(DB_LOG | DBC_STATE | DBL_DETAIL, "STATE", 0, r.status);
+            debug(DB_LOG | DBC_FILE | DBL_DETAIL, "SOFAR", 0, r.sofar);
 #endif /* DEBUG */
-          // Non-debug display of file states
-          switch (action) {
-          // Sending
-          case A_SEND:
-            if (r.status == S_ATTR) {
-              // Start sending files
-              // File size obtained
-              printf("\nFile \"%s\" to send\n", r.filename);
-              printf("Size: %ld bytes\n", r.filesize);
-            } else if (r.status == S_EOF) {
-              printf("\nFile \"%s\" sending completed\n", r.filename);
-            } else {
-              // Put a character for the sign of sending a packet
-              putchar('>');
+            // Server commands
+            if (r.status == SV_GET) {
+              status = serverget();
+              break;
+            } else if (r.status == SV_DIR) {
+              status = serverdir();
+              break;
             }
-            break;
-          // Receiving
-          case A_RECV:
-            if ((r.status == R_FILE) && (r.filename[0] != '\0')) {
-              if (r.filesize == r.sofar) {
-                // Receiving of a file completed
-                printf("\nFile \"%s\" receiving completed\n", r.filename);
-                printf("File date info: %s\n", r.filedate);
+            // Non-debug display of file states
+            switch ((k.what == W_SEND) ? A_SEND : A_RECV) {
+            // Sending
+            case A_SEND:
+              if (r.status == S_ATTR) {
+                // Start sending files
+                // File size obtained
+                printf("File \"%s\" to send\n", r.filename);
                 printf("Size: %ld bytes\n", r.filesize);
+              } else if ((r.status == S_EOF) && !k.display) {
+                progressend(&k, &r);
+                printf("File \"%s\" sending completed\n", r.filename);
               } else {
-                // File reception canceled by sender
-                printf("\nFile \"%s\" receiving terminated, incomplete\n",
-                       r.filename);
+                // Update the status line, after the packet is sent
+                progress(&k, &r);
               }
-            } else if ((r.status == R_ATTR) && (r.filedate[0] == '\0')) {
-              // The name of receiving file is received
-              // Waiting for the attribute packet
-              printf("\nFile \"%s\" to be received:\n", r.filename);
-            } else {
-              // Put a character for the sign of receiving a packet
-              putchar('*');
+              break;
+            // Receiving
+            case A_RECV:
+              if ((r.status == R_FILE) && (r.filename[0] != '\0')) {
+                progressend(&k, &r);
+                if (r.filesize == r.sofar) {
+                  // Receiving of a file completed
+                  printf("File \"%s\" receiving completed\n", r.filename);
+                  printf("File date info: %s\n", r.filedate);
+                  printf("Size: %ld bytes\n", r.filesize);
+                } else {
+                  // File reception canceled by sender
+                  printf("File \"%s\" receiving terminated, incomplete\n",
+                         r.filename);
+                }
+              } else if ((r.status == R_ATTR) && (r.filedate[0] == '\0')) {
+                // The name of receiving file is received
+                // Waiting for the attribute packet
+                printf("File \"%s\" to be received:\n", r.filename);
+              } else {
+                // Update the status line, after the packet is ACKed
+                progress(&k, &r);
+              }
+              break;
+            default:
+              // NOTREACHED
+              break;
             }
-            break;
-          default:
-            // NOTREACHED
-            break;
-          }
-          // Maybe do other brief tasks here...
-          break; // Exit the switch statement and keep looping
-        case X_DONE:
+            // Maybe do other brief tasks here...
+            break; // Exit the switch statement and keep looping
+          case X_DONE:
 #ifdef DEBUG
-          debug(DB_MSG, "Status X_DONE", 0, 0);
+            debug(DB_MSG | DBC_STATE | DBL_EVENT, "Status X_DONE", 0, 0);
 #endif // DEBUG
-          puts("\nKermit session completed");
-          break; /* Finished */
-        case X_ERROR:
-          doexit(FAILURE); /* Failed */
-          // NOTREACHABLE
+            if (r.status == SV_FINISH) {
+              puts("Server finished");
+            } else {
+              puts("\nKermit session completed");
+            }
+            (void)kermit(K_STATUS, &k, 0, 0, "", &r);
+            if (r.metrics.payload > 0) {
+              statsshow(&r.metrics);
+              statsappend(&r.metrics,
+                          (k.what == W_SEND) ? A_SEND : A_RECV);
+            }
+            phasereport();
+            bcupdate(k.bcpkts, k.bcerrs);
+            trace(TR_DONE, k.state, 0, 0, 0);
+            traceflush();
+            break; /* Finished */
+          case X_ERROR:
+            if (action == A_SERV) { /* A server waits for the next command */
+              puts("\nServer transaction failed");
+              trace(TR_ERROR, k.state, 0, 0, status);
+              traceflush();
+              status = X_DONE;
+              break;
+            }
+            doexit(FAILURE); /* Failed */
+            // NOTREACHABLE
+          }
         }
-      }
+      } while ((action == A_SERV) && (r.status != SV_FINISH));
     }
   }
   doexit(SUCCESS);
@@ -17,7 +17,7 @@
 
 // Functions defined:
 // (See unixio.c for the UNIX example and explanation)
-// (prototypes in kermit.h)
+// (prototypes in kio.h)
 // UART/device I/O:
 // int readpkt()
 // int tx_data()
@@ -29,30 +29,33 @@
 // int readfile()
 // int writefile()
 // int closefile()
+// Server directory listing:
+// int openlisting()
+// int readlisting()
+// int closelisting()
+// int wildmatch()
 
+#include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <neo/api.h>
 
+#include "capture.h"
 #include "cdefs.h"
 #include "debug.h"
+#include "kasm.h"
 #include "kermit.h"
-
-// File I/O buffers
-UCHAR o_buf[OBUFLEN + 8];
-UCHAR i_buf[IBUFLEN + 8];
+#include "kio.h"
+#include "phase.h"
+#include "trace.h"
 
 // File I/O channel IDs
 #define CHANNEL_INPUT_FILE (1)
 #define CHANNEL_OUTPUT_FILE (2)
 #define CHANNEL_FILE_SIZE (3)
 
-// Prototypes in main.c
-// TODO: merge prototype to a new header
-void doexit(int status);
-
 // Debugging functions
 // Output written simultaneoutly to
 // Neo Console and file "KDEBUG.LOG"
@@ -84,7 +87,53 @@ void debugout(char *str) {
   putchar(0x98);
 }
 
+// Packet capture, buffered in RAM
+// and written to file "KCAPTURE.BIN" (see capture.h)
+
+#define CHANNEL_CAPTURE_OUTPUT (6)
+
+static UCHAR cbuf[CAPTURE_BUFLEN];
+static uint16_t cpos = 0; /* Bytes in cbuf */
+
+static void captureflush(void) {
+  if (cpos > 0) {
+    (void)neo_file_write(CHANNEL_CAPTURE_OUTPUT, cbuf, cpos);
+    cpos = 0;
+  }
+}
+
+static void capture(int kind, int verdict, UCHAR *s, int len) {
+  struct capture_record r;
+
+  if (len < 0) {
+    len = 0;
+  }
+  r.kind = (UCHAR)kind;
+  r.verdict = (UCHAR)verdict;
+  r.len = (USHORT)len;
+  r.time = (USHORT)neo_system_timer();
+  if (cpos + sizeof(r) + len > CAPTURE_BUFLEN) {
+    captureflush();
+  }
+  memcpy(&cbuf[cpos], &r, sizeof(r));
+  cpos += sizeof(r);
+  if (cpos + len > CAPTURE_BUFLEN) { /* Larger than the buffer */
+    captureflush();
+    (void)neo_file_write(CHANNEL_CAPTURE_OUTPUT, s, len);
+  } else if (len > 0) {
+    memcpy(&cbuf[cpos], s, len);
+    cpos += len;
+  }
+}
+
+// Categories enabled at run time (see debug.h)
+unsigned int debugmask = DEBUG_CATEGORIES;
+
 void dodebug(int fc, UCHAR *label, UCHAR *sval, long nval) {
+  if (!DB_ENABLED(fc)) {
+    return;
+  }
+  fc = DB_FC(fc);
   if (fc != DB_OPN && !xdebug) {
     return;
   }
@@ -100,6 +149,14 @@ void dodebug(int fc, UCHAR *label, UCHAR *sval, long nval) {
       puts("dodebug: neo_file_open error");
       doexit(FAILURE);
     }
+    neo_file_open(CHANNEL_CAPTURE_OUTPUT, (const char *)CAPTURE_FILE,
+                  3); // truncate and read-write
+    if (neo_api_error() != API_ERROR_NONE) {
+      puts("dodebug: neo_file_open capture error");
+      doexit(FAILURE);
+    }
+    memcpy(cbuf, CAPTURE_MAGIC, 4);
+    cpos = 4;
     snprintf(dbuf, DBUFLEN, "DEBUG LOG OPEN\n");
     debugout(dbuf);
     return;
@@ -111,9 +168,13 @@ void dodebug(int fc, UCHAR *label, UCHAR *sval, long nval) {
     snprintf(dbuf, DBUFLEN, "%s=[%c]\n", label, (char)nval);
     debugout(dbuf);
     return;
-  // TODO: for DB_PKT, we need to output a more decent string
-  case DB_PKT: /* Log a packet */
-               /* (fill in later, fall thru for now...) */
+  case DB_PKT: /* Capture a packet, not formatted */
+    if (sval) {
+      capture(label[0], CAP_UNCHECKED, sval, (int)nval);
+    } else {
+      capture(label[0], (int)nval, (UCHAR *)0, 0);
+    }
+    return;
   case DB_LOG: /* Write label and string or number */
     if (sval) {
       snprintf(dbuf, DBUFLEN, "%s[%s]\n", label, sval);
@@ -128,11 +189,163 @@ void dodebug(int fc, UCHAR *label, UCHAR *sval, long nval) {
     debugout(dbuf);
     xdebug = 0;
     neo_file_close(dchannel);
+    captureflush();
+    neo_file_close(CHANNEL_CAPTURE_OUTPUT);
     return;
   }
 }
 #endif /* DEBUG */
 
+// Tracing functions
+// Events are kept in a ring buffer in RAM,
+// and written to file "KTRACE.BIN" only by traceflush()
+
+#ifdef TRACE
+
+#define CHANNEL_TRACE_OUTPUT (5)
+
+static struct trace_event tbuf[TRACE_EVENTS];
+static uint32_t tcount = 0; /* Events recorded */
+
+void dotrace(int id, int state, int seq, int aux, int len) {
+  struct trace_event *e;
+
+  e = &tbuf[(uint16_t)tcount & (TRACE_EVENTS - 1)];
+  e->id = (UCHAR)id;
+  e->state = (UCHAR)state;
+  e->seq = (UCHAR)seq;
+  e->aux = (UCHAR)aux;
+  e->len = (USHORT)len;
+  e->time = (USHORT)neo_system_timer();
+  tcount++;
+}
+
+// Write the events since the last flush, oldest first
+
+void traceflush(void) {
+  UCHAR head[10];
+  uint16_t n, first;
+
+  if (tcount == 0) {
+    return;
+  }
+  n = (tcount < TRACE_EVENTS) ? (uint16_t)tcount : TRACE_EVENTS;
+  first = (uint16_t)(tcount - n) & (TRACE_EVENTS - 1);
+  memcpy(head, TRACE_MAGIC, 4);
+  head[4] = tcount & 0xff;
+  head[5] = (tcount >> 8) & 0xff;
+  head[6] = (tcount >> 16) & 0xff;
+  head[7] = (tcount >> 24) & 0xff;
+  head[8] = n & 0xff;
+  head[9] = n >> 8;
+  tcount = 0;
+  neo_file_open(CHANNEL_TRACE_OUTPUT, (const char *)TRACE_FILE,
+                3); // truncate and read-write
+  if (neo_api_error() != API_ERROR_NONE) {
+    puts("traceflush: neo_file_open error");
+    return;
+  }
+  (void)neo_file_write(CHANNEL_TRACE_OUTPUT, head, sizeof(head));
+  if (first + n > TRACE_EVENTS) { /* Wrapped around */
+    (void)neo_file_write(CHANNEL_TRACE_OUTPUT, &tbuf[first],
+                         (TRACE_EVENTS - first) * sizeof(tbuf[0]));
+    n -= TRACE_EVENTS - first;
+    first = 0;
+  }
+  (void)neo_file_write(CHANNEL_TRACE_OUTPUT, &tbuf[first],
+                       n * sizeof(tbuf[0]));
+  if (neo_api_error() != API_ERROR_NONE) {
+    puts("traceflush: neo_file_write error");
+  }
+  neo_file_close(CHANNEL_TRACE_OUTPUT);
+}
+#endif /* TRACE */
+
+// Phase timing functions (see phase.h)
+// Times are neo_system_timer() ticks (100 Hz); a phase shorter than
+// a tick is counted as 0 or 1 tick, which averages out over many runs
+
+#ifdef PHASE
+
+static struct phase_stats pstats[PH_NUM];
+static struct {
+  uint8_t ph;      /* Phase */
+  uint8_t reentry; /* Same phase started again within */
+  uint32_t start;  /* Timer ticks at start */
+  uint32_t nested; /* Ticks of the phases within */
+} pstack[PHASE_DEPTH];
+static int pdepth = 0;
+
+void dophase(int ph, int begin) {
+  static const uint8_t bucketmax[PH_BUCKETS - 1] = {0, 1, 2, 4, 8, 16, 32};
+  uint32_t t, d;
+  int b;
+
+  t = neo_system_timer();
+  if (begin) {
+    if ((pdepth > 0) && (pstack[pdepth - 1].ph == ph)) {
+      pstack[pdepth - 1].reentry++;
+      return;
+    }
+    if (pdepth >= PHASE_DEPTH) { /* Too deep, not timed */
+      return;
+    }
+    pstack[pdepth].ph = (uint8_t)ph;
+    pstack[pdepth].reentry = 0;
+    pstack[pdepth].start = t;
+    pstack[pdepth].nested = 0;
+    pdepth++;
+    return;
+  }
+  if ((pdepth == 0) || (pstack[pdepth - 1].ph != ph)) { /* Not timed */
+    return;
+  }
+  if (pstack[pdepth - 1].reentry > 0) {
+    pstack[pdepth - 1].reentry--;
+    return;
+  }
+  pdepth--;
+  d = t - pstack[pdepth].start;
+  if (pdepth > 0) {
+    pstack[pdepth - 1].nested += d;
+  }
+  d -= pstack[pdepth].nested;
+  for (b = 0; (b < PH_BUCKETS - 1) && (d > bucketmax[b]); b++) {
+  }
+  pstats[ph].count++;
+  pstats[ph].ticks += d;
+  pstats[ph].hist[b]++;
+}
+
+// Clear the times at the start of a session
+
+void phasereset(void) {
+  memset(pstats, 0, sizeof(pstats));
+  pdepth = 0;
+}
+
+// Show the times of the session, in 53 columns
+
+void phasereport(void) {
+  static const char *names[PH_NUM] = {"wait",   "recv", "check", "decode",
+                                      "fwrite", "xmit", "fread", "encode"};
+  int i, b;
+
+  puts("phase  runs  ticks   0   1   2 3-4 5-8 -16 -32 33+");
+  for (i = 0; i < PH_NUM; i++) {
+    if (pstats[i].count == 0) {
+      continue;
+    }
+    printf("%-6s%5lu %6lu", names[i], (unsigned long)pstats[i].count,
+           (unsigned long)pstats[i].ticks);
+    for (b = 0; b < PH_BUCKETS; b++) {
+      printf("%4lu", (unsigned long)pstats[i].hist[b]);
+    }
+    putchar('\n');
+  }
+}
+#endif /* PHASE */
+
 // UART section
 
 #define SERIAL_PROTOCOL_8N1 (0)
@@ -146,6 +359,19 @@ void devinit(void) {
   printf("Serial port speed: %d bps\n", SERIAL_TRANSFER_BAUD_RATE);
 }
 
+// Line statistics (see struct k_metrics in kermit.h)
+// Called before counting the bytes of each packet read or written
+
+static void linetime(struct k_data *k) {
+  uint32_t t;
+
+  t = neo_system_timer();
+  if ((k->metrics.wirein | k->metrics.wireout) == 0) { /* First packet */
+    k->metrics.start = t;
+  }
+  k->metrics.elapsed = t - k->metrics.start;
+}
+
 // Read a Kermit packet from UART
 // Call with:
 //    k   - Kermit struct pointer
@@ -153,9 +379,12 @@ void devinit(void) {
 //    len - length of read buffer
 //
 // When reading a packet, this function looks for start of Kermit packet
-// (k->r_soh), then reads everything between it and the end of the packet
-// (k->r_eom) into the indicated buffer.  Returns the number of bytes read,
-// or:
+// (k->r_soh), then reads the packet into the indicated buffer up to the
+// length its header announces (see framelen() in kermit.c), or up to the
+// end of the packet (k->r_eom) if that comes first.  A new start of packet
+// starts over, and a packet with a bad header is returned as soon as the
+// header is in, so that it is NAKed at once.  Returns the number of bytes
+// read, or:
 //    0   - timeout or other possibly correctable error;
 //   -1   - fatal error, such as loss of connection, or no buffer to read into.
 //
@@ -163,12 +392,12 @@ void devinit(void) {
 // Maximum packet length to receive: k->r_maxlen
 
 int readpkt(struct k_data *k, UCHAR *p, int len) {
-  int x, n, max;
+  int x, n, want, skipped;
   short flag;
   UCHAR c;
-#ifdef DEBUG
-  UCHAR *p2;
-#endif /* DEBUG */
+#ifdef KASM
+  struct krx rx; /* State of the kernel */
+#endif           /* KASM */
 
 #ifdef F_CTRLC
   short ccn;
@@ -176,30 +405,59 @@ int readpkt(struct k_data *k, UCHAR *p, int len) {
 #endif /* F_CTRLC */
 
   if (!p) { /* Device not open or no buffer */
-    debug(DB_MSG, "readpkt FAIL", 0, 0);
+    debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt FAIL", 0, 0);
+    trace(TR_RERR, k->state, 0, TR_RERR_NOBUF, 0);
     return (-1);
   }
 
   flag = 0;
   n = 0;
-
-#ifdef DEBUG
-  p2 = p;
-#endif /* DEBUG */
+  want = 0;    /* Length of the packet, 0 if not known yet */
+  skipped = 0; /* Bytes outside of the packet */
+  phase(PH_UARTWAIT, 1);
 
   while (1) {
-    // Busy-wait required for UART receiving
-    while (!neo_uext_uart_available()) {
-      // Maybe you can do something here
+#ifdef KASM
+    // Once the length is known, the rest of the packet is read by
+    // krecv() up to a byte that needs a look here
+    if ((want > n) && !kparity(k)) {
+      rx.p = p + n;
+      rx.n = want - n;
+      rx.soh = k->r_soh;
+      rx.eom = kreom(k);
+#ifdef F_CTRLC
+      rx.brk = k->remote ? 3 : k->r_soh;
+#else
+      rx.brk = k->r_soh;
+#endif /* F_CTRLC */
+      krecv(&rx);
+#ifdef F_CTRLC
+      if (want - rx.n > n) { /* Not ^C */
+        ccn = 0;
+      }
+#endif /* F_CTRLC */
+      n = want - rx.n;
+      if (n >= want) { /* Packet complete */
+        break;
+      }
+      x = rx.stop;
+    } else
+#endif /* KASM */
+    {
+      // Busy-wait required for UART receiving
+      while (!neo_uext_uart_available()) {
+        // Maybe you can do something here
+      }
+      x = neo_uext_uart_read();
     }
-    x = neo_uext_uart_read();
-    c = (k->parity) ? x & 0x7f : x & 0xff; /* Strip parity */
+    c = kparity(k) ? x & 0x7f : x & 0xff; /* Strip parity */
 
 #ifdef F_CTRLC
     /* In remote mode only: three consecutive ^C's to quit */
     if (k->remote && c == (UCHAR)3) {
       if (++ccn > 2) {
-        debug(DB_MSG, "readpkt ^C^C^C", 0, 0);
+        debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt ^C^C^C", 0, 0);
+        trace(TR_RERR, k->state, 0, TR_RERR_CTRLC, n);
         return (-1);
       }
     } else {
@@ -207,32 +465,50 @@ int readpkt(struct k_data *k, UCHAR *p, int len) {
     }
 #endif /* F_CTRLC */
 
-    if (!flag && c != k->r_soh) { /* No start of packet yet */
-      continue;                   /* so discard these bytes. */
+    if (c == k->r_soh) { /* Start of packet, maybe again */
+      if (!flag) {
+        phase(PH_UARTWAIT, 0);
+        phase(PH_RECV, 1);
+      }
+      flag = 1;         /* Remember */
+      skipped += n + 1; /* But discard, with a packet cut short by it */
+      n = 0;
+      want = 0;
+      continue;
     }
-    if (c == k->r_soh) {      /* Start of packet */
-      flag = 1;               /* Remember */
-      continue;               /* But discard. */
-    } else if (c == k->r_eom  /* Packet terminator */
-               || c == '\012' /* 1.3: For HyperTerminal */
-    ) {
-#ifdef DEBUG
-      *p = NUL; /* Terminate for printing */
-      debug(DB_PKT, "RPKT", p2, n);
-#endif /* DEBUG */
-      return (n);
-    } else {                   /* Contents of packet */
-      if (n++ > k->r_maxlen) { /* Check length */
-        // Too long packet is not correctable
-        debug(DB_MSG, "readpkt packet too long", 0, 0);
-        return (-1);
-      } else {
-        *p++ = x & 0xff;
+    if (!flag) { /* No start of packet yet */
+      skipped++;
+      continue; /* so discard these bytes. */
+    }
+    if (c == kreom(k)) { /* End of packet before its length */
+      skipped++;
+      break;
+    }
+    p[n++] = x & 0xff; /* Contents of packet */
+    if (!want) {
+      want = framelen(k, p, n);
+      if (want < 0) { /* Bad header: hand it over now */
+        debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt bad header", 0, 0);
+        trace(TR_RERR, k->state, 0, TR_RERR_BADHDR, n);
+        skipped += n + want;
+        n = -want;
+        break;
       }
     }
+    if (want && n >= want) { /* Packet complete */
+      break;
+    }
   }
-  debug(DB_MSG, "READPKT FAIL (end)", 0, 0);
-  return (-1);
+#ifdef DEBUG
+  p[n] = NUL; /* Terminate for printing */
+  debug(DB_PKT | DBC_PKT | DBL_EVENT, "RPKT", p, n);
+#endif /* DEBUG */
+  phase(PH_RECV, 0);
+  linetime(k);
+  k->metrics.wirein += n + skipped;
+  // LEN, SEQ, TYPE
+  trace(TR_RPKT, k->state, xunchar(p[1]), p[2], n);
+  return (n);
 }
 
 // Writes n bytes of data to UART.
@@ -245,8 +521,14 @@ int readpkt(struct k_data *k, UCHAR *p, int len) {
 //   (Unable to detect write error here)
 
 int tx_data(struct k_data *k, UCHAR *p, int n) {
+  phase(PH_XMIT, 1);
   neo_uext_uart_block_write(0, p, n);
-  debug(DB_MSG, "tx_data write", 0, n);
+  phase(PH_XMIT, 0);
+  linetime(k);
+  k->metrics.wireout += n;
+  debug(DB_MSG | DBC_PKT | DBL_DETAIL, "tx_data write", 0, n);
+  // SOH, LEN, SEQ, TYPE
+  trace(TR_SPKT, k->state, xunchar(p[2]), p[3], n);
   return (X_OK); /* Success */
 }
 
@@ -266,11 +548,8 @@ int inchk(struct k_data *k) {
 
 // File I/O section
 
-// Static variables
-
-static uint8_t ichannel = CHANNEL_INPUT_FILE;
-static uint8_t ochannel = CHANNEL_OUTPUT_FILE;
-static uint8_t schannel = CHANNEL_FILE_SIZE;
+// The file channels are fixed (see above), and the files of the
+// session are reached only through k, so nothing else is kept here.
 
 // Open output file
 //  Call with:
@@ -287,34 +566,44 @@ int openfile(struct k_data *k, UCHAR *s, int mode) {
 
   switch (mode) {
   case 1:                                        /* Read */
-    neo_file_open(ichannel, (const char *)s, 0); // read-only
+    neo_file_open(CHANNEL_INPUT_FILE, (const char *)s, 0); // read-only
     if ((error = neo_api_error()) != API_ERROR_NONE) {
-      debug(DB_LOG, "openfile: neo_file_open read error", s, 0);
-      debug(DB_LOG, "error code", 0, error);
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "openfile: neo_file_open read error",
+            s, 0);
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "error code", 0, error);
+      trace(TR_FERR, k->state, 0, error, 0);
       return (X_ERROR);
     }
-    k->s_first = 1;        /* Set up for getkpt */
-    k->zinbuf[0] = '\0';   /* Initialize buffer */
-    k->zinptr = k->zinbuf; /* Set up buffer pointer */
-    k->zincnt = 0;         /* and count */
-    debug(DB_LOG, "openfile read ok", s, 0);
+    k->s_first = 1;              /* Set up for getkpt */
+    k->zinbuf[0] = '\0';         /* Initialize buffer */
+    khot(k)->zinptr = k->zinbuf; /* Set up buffer pointer */
+    khot(k)->zincnt = 0;         /* and count */
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "openfile read ok", s, 0);
+    trace(TR_FOPEN, k->state, 0, mode, 0);
     return (X_OK);
 
   case 2:                                        /* Write (create) */
-    neo_file_open(ochannel, (const char *)s, 3); // truncate and read-write
+    // truncate and read-write
+    neo_file_open(CHANNEL_OUTPUT_FILE, (const char *)s, 3);
     if ((error = neo_api_error()) != API_ERROR_NONE) {
-      debug(DB_LOG, "openfile: neo_file_open truncate error", s, 0);
-      debug(DB_LOG, "error code", 0, error);
+      debug(DB_LOG | DBC_FILE | DBL_ERROR,
+            "openfile: neo_file_open truncate error", s, 0);
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "error code", 0, error);
+      trace(TR_FERR, k->state, 0, error, 0);
       return (X_ERROR);
     }
-    neo_file_close(ochannel);                    // close the file first
-    neo_file_open(ochannel, (const char *)s, 1); // re-open for write-only
+    // close the file first, and re-open for write-only
+    neo_file_close(CHANNEL_OUTPUT_FILE);
+    neo_file_open(CHANNEL_OUTPUT_FILE, (const char *)s, 1);
     if ((error = neo_api_error()) != API_ERROR_NONE) {
-      debug(DB_LOG, "openfile: neo_file_open write error", s, 0);
-      debug(DB_LOG, "error code", 0, error);
+      debug(DB_LOG | DBC_FILE | DBL_ERROR,
+            "openfile: neo_file_open write error", s, 0);
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "error code", 0, error);
+      trace(TR_FERR, k->state, 0, error, 0);
       return (X_ERROR);
     }
-    debug(DB_LOG, "openfile write ok", s, 0);
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "openfile write ok", s, 0);
+    trace(TR_FOPEN, k->state, 0, mode, 0);
     return (X_OK);
 
   default:
@@ -355,19 +644,21 @@ fileinfo(struct k_data *k, UCHAR *filename, UCHAR *buf, int buflen, short *type,
   if (buflen < 18) {
     return (X_ERROR);
   }
-  neo_file_open(schannel, (const char *)filename, 0); // read-only
+  neo_file_open(CHANNEL_FILE_SIZE, (const char *)filename, 0); // read-only
   if ((error = neo_api_error()) != API_ERROR_NONE) {
-    debug(DB_LOG, "fileinfo: neo_file_open read error", filename, 0);
-    debug(DB_LOG, "error code", 0, error);
+    debug(DB_LOG | DBC_FILE | DBL_ERROR, "fileinfo: neo_file_open read error",
+          filename, 0);
+    debug(DB_LOG | DBC_FILE | DBL_ERROR, "error code", 0, error);
     return (X_ERROR);
   }
-  size = neo_file_size(schannel);
+  size = neo_file_size(CHANNEL_FILE_SIZE);
   if ((error = neo_api_error()) != API_ERROR_NONE) {
-    debug(DB_LOG, "fileinfo: neo_file_size error", 0, schannel);
-    debug(DB_LOG, "error code", 0, error);
+    debug(DB_LOG | DBC_FILE | DBL_ERROR, "fileinfo: neo_file_size error", 0,
+          CHANNEL_FILE_SIZE);
+    debug(DB_LOG | DBC_FILE | DBL_ERROR, "error code", 0, error);
     return (X_ERROR);
   }
-  neo_file_close(schannel);
+  neo_file_close(CHANNEL_FILE_SIZE);
   *type = 1; // File type is always binary regardless of mode
   return ((ULONG)(size));
 }
@@ -377,34 +668,42 @@ fileinfo(struct k_data *k, UCHAR *filename, UCHAR *buf, int buflen, short *type,
 int readfile(struct k_data *k) {
   uint8_t error;
 
-  if (!k->zinptr) {
+  if (!khot(k)->zinptr) {
 #ifdef DEBUG
     printf("readfile ZINPTR NOT SET\n");
 #endif /* DEBUG */
     return (X_ERROR);
   }
-  if (k->zincnt < 1) {
+  if (khot(k)->zincnt < 1) {
     // Nothing in buffer - must refill
     // Binary mode only
     // k->binary is ignored
     k->dummy = 0;
-    k->zincnt = neo_file_read(ichannel, k->zinbuf, k->zinlen);
-    if ((error = neo_api_error()) != API_ERROR_NONE) {
-      debug(DB_LOG, "readfile: binary neo_file_read error, code", 0, error);
+    phase(PH_FREAD, 1);
+    khot(k)->zincnt = neo_file_read(CHANNEL_INPUT_FILE, k->zinbuf, k->zinlen);
+    error = neo_api_error(); /* Before the timer call of phase() */
+    phase(PH_FREAD, 0);
+    if (error != API_ERROR_NONE) {
+      debug(DB_LOG | DBC_FILE | DBL_ERROR,
+            "readfile: binary neo_file_read error, code", 0, error);
+      trace(TR_FERR, k->state, 0, error, 0);
       return (X_ERROR);
     }
-    debug(DB_LOG, "readfile binary ok zincnt", 0, k->zincnt);
-    k->zinbuf[k->zincnt] = '\0'; /* Terminate. */
-    if (k->zincnt == 0) {        /* Check for EOF */
+    debug(DB_LOG | DBC_FILE | DBL_DETAIL, "readfile binary ok zincnt", 0,
+          khot(k)->zincnt);
+    k->zinbuf[khot(k)->zincnt] = '\0'; /* Terminate. */
+    if (khot(k)->zincnt == 0) {        /* Check for EOF */
       return (-1);
     }
-    k->zinptr = k->zinbuf; /* Not EOF - reset pointer */
+    khot(k)->zinptr = k->zinbuf; /* Not EOF - reset pointer */
   }
-  (k->zincnt)--; /* Return first byte. */
+  (khot(k)->zincnt)--; /* Return first byte. */
 
-  debug(DB_LOG, "readfile exit zincnt", 0, k->zincnt);
-  debug(DB_LOG, "readfile exit zinptr", 0, k->zinptr);
-  return (*(k->zinptr)++ & 0xff);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "readfile exit zincnt", 0,
+        khot(k)->zincnt);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "readfile exit zinptr", 0,
+        khot(k)->zinptr);
+  return (*(khot(k)->zinptr)++ & 0xff);
 }
 
 // Write data to file
@@ -418,17 +717,23 @@ int readfile(struct k_data *k) {
 //   X_ERROR on failure, such as i/o error, space used up, etc
 
 int writefile(struct k_data *k, UCHAR *s, int n) {
-  int rc;
+  int rc, x;
   uint8_t error;
   rc = X_OK;
 
-  debug(DB_LOG, "writefile binary (no text)", 0, k->binary);
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "writefile binary (no text)", 0,
+        k->binary);
   // Binary mode only
   // k->binary is ignored
   // Binary mode, just write it
-  if (neo_file_write(ochannel, s, n) != n) {
-    error = neo_api_error();
-    debug(DB_LOG, "writefile: binary neo_file_write error, code", 0, error);
+  phase(PH_FWRITE, 1);
+  x = neo_file_write(CHANNEL_OUTPUT_FILE, s, n);
+  error = neo_api_error(); /* Before the timer call of phase() */
+  phase(PH_FWRITE, 0);
+  if (x != n) {
+    debug(DB_LOG | DBC_FILE | DBL_ERROR,
+          "writefile: binary neo_file_write error, code", 0, error);
+    trace(TR_FERR, k->state, 0, error, n);
     rc = X_ERROR;
   }
   return (rc);
@@ -450,22 +755,29 @@ int closefile(struct k_data *k, UCHAR c, int mode) {
 
   switch (mode) {
   case 1: /* Closing input file */
-    debug(DB_LOG, "closefile (input)", k->filename, 0);
-    neo_file_close(ichannel);
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "closefile (input)", k->filename, 0);
+    neo_file_close(CHANNEL_INPUT_FILE);
+    trace(TR_FCLOSE, k->state, 0, mode, 0);
     break;
   case 2: /* Closing output file */
   case 3:
-    debug(DB_LOG, "closefile (output) name", k->filename, 0);
-    debug(DB_LOG, "closefile (output) keep", 0, k->ikeep);
-    neo_file_close(ochannel);
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "closefile (output) name", k->filename,
+          0);
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "closefile (output) keep", 0,
+          k->ikeep);
+    neo_file_close(CHANNEL_OUTPUT_FILE);
+    trace(TR_FCLOSE, k->state, 0, mode, c);
     if ((k->ikeep == 0) && /* Don't keep incomplete files */
         (c == 'D')) {      /* This file was incomplete */
       if (k->filename) {
-        debug(DB_LOG, "deleting incomplete", k->filename, 0);
+        debug(DB_LOG | DBC_FILE | DBL_EVENT, "deleting incomplete", k->filename,
+              0);
         neo_file_delete((const char *)k->filename); /* Delete it. */
         if ((error = neo_api_error()) != API_ERROR_NONE) {
-          debug(DB_LOG, "closefile: neo_file_delete error", k->filename, 0);
-          debug(DB_LOG, "error code", 0, error);
+          debug(DB_LOG | DBC_FILE | DBL_ERROR,
+                "closefile: neo_file_delete error", k->filename, 0);
+          debug(DB_LOG | DBC_FILE | DBL_ERROR, "error code", 0, error);
+          trace(TR_FERR, k->state, 0, error, 0);
           rc = X_ERROR;
         }
       }
@@ -476,3 +788,108 @@ int closefile(struct k_data *k, UCHAR c, int mode) {
   }
   return (rc);
 }
+
+// File name matching, case-insensitive as in the Neo6502 FAT filesystem
+// '*' matches any characters, '?' any one character
+
+int wildmatch(const UCHAR *pattern, const UCHAR *name) {
+  const UCHAR *star = 0, *resume = 0;
+
+  while (*name) {
+    if (*pattern == '*') {
+      star = ++pattern; /* Try matching nothing first */
+      resume = name;
+    } else if ((*pattern == '?') || (tolower(*pattern) == tolower(*name))) {
+      pattern++;
+      name++;
+    } else if (star) { /* Let the last '*' take one more character */
+      pattern = star;
+      name = ++resume;
+    } else {
+      return (0);
+    }
+  }
+  while (*pattern == '*') {
+    pattern++;
+  }
+  return (*pattern == '\0');
+}
+
+// Directory listing for the server (REMOTE DIR), read as a text file:
+// set k->openf, k->readf and k->closef to these for the transfer.
+// One line per entry, with the size or <DIR>, in CRLF text.
+
+#define LISTLINE (48) /* Bytes of a listing line */
+
+static UCHAR listspec[FN_MAX]; /* Entries to list, all if empty */
+static int listopen = 0;       /* Directory being read */
+
+int openlisting(struct k_data *k, UCHAR *s, int mode) {
+  uint8_t error;
+
+  if (mode != 1) {
+    return (X_ERROR);
+  }
+  strncpy((char *)listspec, (const char *)s, FN_MAX - 1);
+  listspec[FN_MAX - 1] = '\0';
+  neo_file_opendir("");
+  if ((error = neo_api_error()) != API_ERROR_NONE) {
+    debug(DB_LOG | DBC_FILE | DBL_ERROR, "openlisting: neo_file_opendir error",
+          0, error);
+    trace(TR_FERR, k->state, 0, error, 0);
+    return (X_ERROR);
+  }
+  listopen = 1;
+  k->s_first = 1;              /* Set up for getkpt */
+  k->zinbuf[0] = '\0';         /* Initialize buffer */
+  khot(k)->zinptr = k->zinbuf; /* Set up buffer pointer */
+  khot(k)->zincnt = 0;         /* and count */
+  trace(TR_FOPEN, k->state, 0, mode, 0);
+  return (X_OK);
+}
+
+int readlisting(struct k_data *k) {
+  static char name[256]; /* Longest name the API returns */
+  neo_file_stat_t st;
+
+  if (khot(k)->zincnt < 1) {
+    // Refill the buffer with whole lines
+    khot(k)->zincnt = 0;
+    while (listopen && (k->zinlen - khot(k)->zincnt > LISTLINE)) {
+      neo_file_readdir(name, &st);
+      if ((neo_api_error() != API_ERROR_NONE) || !name[0]) { /* End */
+        neo_file_closedir();
+        listopen = 0;
+        break;
+      }
+      if (listspec[0] && !wildmatch(listspec, (UCHAR *)name)) {
+        continue;
+      }
+      if (st.attr & FIO_ATTR_DIR) {
+        khot(k)->zincnt +=
+            snprintf((char *)&k->zinbuf[khot(k)->zincnt], LISTLINE,
+                     "%-32.32s %10s\r\n", name, "<DIR>");
+      } else {
+        khot(k)->zincnt +=
+            snprintf((char *)&k->zinbuf[khot(k)->zincnt], LISTLINE,
+                     "%-32.32s %10lu\r\n", name, (unsigned long)st.size);
+      }
+    }
+    if (khot(k)->zincnt == 0) { /* End of the listing */
+      return (-1);
+    }
+    khot(k)->zinptr = k->zinbuf;
+  }
+  (khot(k)->zincnt)--;
+  return (*(khot(k)->zinptr)++ & 0xff);
+}
+
+int closelisting(struct k_data *k, UCHAR c, int mode) {
+  (void)c;
+  if (listopen) {
+    neo_file_closedir();
+    listopen = 0;
+  }
+  trace(TR_FCLOSE, k->state, 0, mode, 0);
+  return (X_OK);
+}
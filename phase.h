@@ -0,0 +1,62 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// phase.h -- Timing of the transfer phases with latency histograms
+
+// With PHASE defined, each phase of the transfer loop is timed by the
+// timer of the I/O module, and the times are counted per session in a
+// histogram of a few fixed buckets for each phase, shown at the end of
+// the session by phasereport().  A phase started within another one
+// (e.g. a file write within a decode) is not counted in the outer one.
+// Without PHASE, the macros disappear entirely.
+
+#ifndef __PHASE_H__
+#define __PHASE_H__
+
+#include "cdefs.h"
+
+// Phases
+
+#define PH_UARTWAIT 0 /* Waiting for the start of a packet */
+#define PH_RECV 1     /* Receiving a packet, from SOH to terminator */
+#define PH_CHECK 2    /* Computing a block check */
+#define PH_DECODE 3   /* Decoding a data packet into the file buffer */
+#define PH_FWRITE 4   /* Writing the file buffer */
+#define PH_XMIT 5     /* Transmitting a packet (ACK when receiving) */
+#define PH_FREAD 6    /* Reading into the file buffer */
+#define PH_ENCODE 7   /* Encoding file data into a packet */
+#define PH_NUM 8
+
+// Buckets of timer ticks: 0, 1, 2, 3-4, 5-8, 9-16, 17-32, 33 and more
+
+#define PH_BUCKETS 8
+
+struct phase_stats {
+  ULONG count;            /* Times run */
+  ULONG ticks;            /* Total timer ticks */
+  ULONG hist[PH_BUCKETS]; /* Histogram of ticks per run */
+};
+
+#ifndef PHASE_DEPTH
+#define PHASE_DEPTH (4) /* Phases started within each other */
+#endif /* PHASE_DEPTH */
+
+#ifdef PHASE
+void dophase(int, int);
+void phasereset(void);
+void phasereport(void);
+#ifdef KERMIT_C
+/* In kermit.c we time only through a function pointer, as with debug() */
+#define phase(ph, begin)                                                       \
+  if (k->phf)                                                                  \
+  (*(k->phf))(ph, begin)
+#else /* KERMIT_C */
+#define phase(ph, begin) dophase(ph, begin)
+#endif /* KERMIT_C */
+#else /* PHASE */
+#define phase(ph, begin)
+#define phasereset()
+#define phasereport()
+#endif /* PHASE */
+
+#endif /* __PHASE_H__ */
@@ -0,0 +1,652 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// posixio.c
+// I/O routines of the host (POSIX) build of Neo6502 Kermit
+// Author: Kenji Rikitake
+// Based on unixio.c:
+// Author: Frank da Cruz.
+
+// Style: C99.
+
+// This is the second I/O backend next to neoio.c, so that the
+// protocol engine in kermit.c can be run, profiled and tested on
+// a Linux or other POSIX host without Neo6502 hardware.
+// The communication device is a tty, a pty, or the standard
+// input and output (e.g., when run by C-Kermit "set host /pty").
+// The file I/O is performed over the host filesystem.
+
+// Functions defined:
+// (prototypes in kio.h)
+// UART/device I/O:
+// int readpkt()
+// int tx_data()
+// int inchk()
+// File I/O:
+// int openfile()
+// ULONG fileinfo()
+// int readfile()
+// int writefile()
+// int closefile()
+// Host only (prototypes in posixio.h):
+// int devopen()
+// void devrestore()
+// void ioattach()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef X_OK /* unistd.h access() mode clashes with kermit.h */
+#undef X_OK
+#endif /* X_OK */
+
+#include "capture.h"
+#include "cdefs.h"
+#include "debug.h"
+#include "kermit.h"
+#include "kio.h"
+#include "posixio.h"
+
+// File I/O buffers
+UCHAR o_buf[OBUFLEN + 8];
+UCHAR i_buf[IBUFLEN + 8];
+
+// Debugging functions
+// Output written to file "debug.log"
+
+#ifdef DEBUG
+
+#define DBUFLEN (256)
+#define DEBUG_FILE "debug.log"
+
+static int xdebug = 0; /* Debugging on/off */
+static FILE *dp = (FILE *)0;
+
+// Packet capture, written to file "capture.bin" (see capture.h)
+
+#define CAPTURE_HOST_FILE "capture.bin"
+
+static FILE *cp = (FILE *)0;
+
+static void capture(int kind, int verdict, UCHAR *s, int len) {
+  struct capture_record r;
+  struct timespec ts;
+
+  if (len < 0) {
+    len = 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  r.kind = (UCHAR)kind;
+  r.verdict = (UCHAR)verdict;
+  r.len = (USHORT)len;
+  r.time = (USHORT)(ts.tv_sec * 100 + ts.tv_nsec / 10000000);
+  fwrite(&r, sizeof(r), 1, cp);
+  if (len > 0) {
+    fwrite(s, 1, len, cp);
+  }
+}
+
+// Categories enabled at run time (see debug.h)
+unsigned int debugmask = DEBUG_CATEGORIES;
+
+void dodebug(int fc, UCHAR *label, UCHAR *sval, long nval) {
+  if (!DB_ENABLED(fc)) {
+    return;
+  }
+  fc = DB_FC(fc);
+  if (fc != DB_OPN && !xdebug) {
+    return;
+  }
+  if (!label) {
+    label = (UCHAR *)"";
+  }
+  switch (fc) { /* Function code */
+  case DB_OPN:  /* Open debug log */
+    xdebug = 1;
+    dp = fopen(DEBUG_FILE, "w");
+    if (!dp) {
+      perror("dodebug: fopen");
+      doexit(FAILURE);
+    }
+    cp = fopen(CAPTURE_HOST_FILE, "wb");
+    if (!cp) {
+      perror("dodebug: fopen capture");
+      doexit(FAILURE);
+    }
+    fwrite(CAPTURE_MAGIC, 1, 4, cp);
+    fprintf(dp, "DEBUG LOG OPEN\n");
+    return;
+  case DB_MSG: /* Write a message */
+    fprintf(dp, "%s\n", label);
+    return;
+  case DB_CHR: /* Write label and character */
+    fprintf(dp, "%s=[%c]\n", label, (char)nval);
+    return;
+  case DB_PKT: /* Capture a packet, not formatted */
+    if (sval) {
+      capture(label[0], CAP_UNCHECKED, sval, (int)nval);
+    } else {
+      capture(label[0], (int)nval, (UCHAR *)0, 0);
+    }
+    return;
+  case DB_LOG: /* Write label and string or number */
+    if (sval) {
+      fprintf(dp, "%s[%s]\n", label, sval);
+    } else {
+      fprintf(dp, "%s=%ld\n", label, nval);
+    }
+    return;
+  case DB_CLS: /* Close debug log */
+    fprintf(dp, "DEBUG LOG CLOSE\n");
+    xdebug = 0;
+    fclose(dp);
+    dp = (FILE *)0;
+    fclose(cp);
+    cp = (FILE *)0;
+    return;
+  }
+}
+#endif /* DEBUG */
+
+// Sessions
+
+// The session of a program with one, used when k->io is not set
+static struct k_io devio = {.ttyin = 0, .ttyout = 1, .ifd = -1, .ofd = -1};
+
+static struct k_io *session(struct k_data *k) {
+  return (k->io ? k->io : &devio);
+}
+
+// Set up a session on the given descriptors, with the files in the
+// directory dir (or 0 for the current one), and attach it to k
+// with its own file buffers.  Call after K_INIT.
+
+void ioattach(struct k_data *k, struct k_io *io, int in, int out,
+              const char *dir) {
+  memset(io, 0, sizeof(*io));
+  io->ttyin = in;
+  io->ttyout = out;
+  io->ifd = -1;
+  io->ofd = -1;
+  io->dir = dir;
+  k->io = io;
+  k->zinbuf = io->ibuf;
+  k->zinlen = IBUFLEN;
+  khot(k)->zincnt = 0;
+  k->obuf = io->obuf;
+  k->obuflen = OBUFLEN;
+  khot(k)->obufpos = 0;
+}
+
+// Path of a file of the session
+
+#define PATHLEN (FN_MAX + 256)
+
+static const char *iopath(struct k_io *io, UCHAR *s, char *path) {
+  if (!io->dir) {
+    return ((const char *)s);
+  }
+  snprintf(path, PATHLEN, "%s/%s", io->dir, (const char *)s);
+  return (path);
+}
+
+// Device section
+
+// Open the communication device.
+// Call with:
+//   line - tty or pty path, or (char *)0 for the standard input and output
+// Returns:
+//   0 on success, -1 on failure.
+
+int devopen(char *line) {
+  int fd;
+
+  if (!line) {
+    devio.ttyin = 0;
+    devio.ttyout = 1;
+    return (0);
+  }
+  fd = open(line, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(line);
+    return (-1);
+  }
+  devio.ttyin = devio.ttyout = fd;
+  return (0);
+}
+
+// Initialize the communication device.
+// A tty is put into raw 8-bit mode; anything else is used as is.
+
+void devinit(void) {
+  struct termios t;
+
+  if (!isatty(devio.ttyin)) {
+    debug(DB_MSG, "devinit: not a tty", 0, 0);
+    return;
+  }
+  if (tcgetattr(devio.ttyin, &devio.ttyold) < 0) {
+    perror("devinit: tcgetattr");
+    return;
+  }
+  t = devio.ttyold;
+  cfmakeraw(&t);
+  t.c_cc[VMIN] = 1;
+  t.c_cc[VTIME] = 0;
+  if (tcsetattr(devio.ttyin, TCSAFLUSH, &t) < 0) {
+    perror("devinit: tcsetattr");
+    return;
+  }
+  devio.ttyraw = 1;
+  debug(DB_MSG, "devinit: tty in raw mode", 0, 0);
+}
+
+// Restore the communication device modes changed by devinit().
+
+void devrestore(void) {
+  if (devio.ttyraw) {
+    (void)tcsetattr(devio.ttyin, TCSADRAIN, &devio.ttyold);
+    devio.ttyraw = 0;
+  }
+}
+
+// Get one byte from the device, waiting at most timo seconds.
+// Returns the byte, -2 on timeout, or -1 on end of file or error.
+
+static int devgetc(struct k_io *io, int timo) {
+  fd_set fds;
+  struct timeval tv;
+  int n;
+
+  if (io->tbufpos < io->tbufcnt) {
+    return (io->tbuf[io->tbufpos++]);
+  }
+  FD_ZERO(&fds);
+  FD_SET(io->ttyin, &fds);
+  tv.tv_sec = timo;
+  tv.tv_usec = 0;
+  n = select(io->ttyin + 1, &fds, (fd_set *)0, (fd_set *)0, &tv);
+  if (n < 0) {
+    return ((errno == EINTR) ? -2 : -1);
+  }
+  if (n == 0) {
+    return (-2);
+  }
+  n = read(io->ttyin, io->tbuf, TBUFLEN);
+  if (n <= 0) {
+    return (-1);
+  }
+  io->tbufcnt = n;
+  io->tbufpos = 1;
+  return (io->tbuf[0]);
+}
+
+// Line statistics (see struct k_metrics in kermit.h)
+// Called before counting the bytes of each packet read or written;
+// the time is counted in 100 Hz ticks as on the Neo6502
+
+static void linetime(struct k_data *k) {
+  struct timespec ts;
+  ULONG t;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  t = (ULONG)ts.tv_sec * 100 + ts.tv_nsec / 10000000;
+  if ((k->metrics.wirein | k->metrics.wireout) == 0) { /* First packet */
+    k->metrics.start = t;
+  }
+  k->metrics.elapsed = t - k->metrics.start;
+}
+
+// Read a Kermit packet from the device
+// Call with:
+//    k   - Kermit struct pointer
+//    p   - pointer to read buffer
+//    len - length of read buffer
+//
+// When reading a packet, this function looks for start of Kermit packet
+// (k->r_soh), then reads the packet into the indicated buffer up to the
+// length its header announces (see framelen() in kermit.c), or up to the
+// end of the packet (k->r_eom) if that comes first.  A new start of packet
+// starts over, and a packet with a bad header is returned as soon as the
+// header is in, so that it is NAKed at once.  Returns the number of bytes
+// read, or:
+//    0   - timeout or other possibly correctable error;
+//   -1   - fatal error, such as loss of connection, or no buffer to read into.
+//
+// Timeout: k->r_timo seconds per byte.
+// Maximum packet length to receive: k->r_maxlen
+
+int readpkt(struct k_data *k, UCHAR *p, int len) {
+  struct k_io *io = session(k);
+  int x, n, want, skipped, timo;
+  short flag;
+  UCHAR c;
+
+#ifdef F_CTRLC
+  short ccn;
+  ccn = 0;
+#endif /* F_CTRLC */
+
+  if (!p) { /* Device not open or no buffer */
+    debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt FAIL", 0, 0);
+    return (-1);
+  }
+
+  flag = 0;
+  n = 0;
+  want = 0;    /* Length of the packet, 0 if not known yet */
+  skipped = 0; /* Bytes outside of the packet */
+  timo = (k->r_timo > 0) ? k->r_timo : P_R_TIMO;
+
+  while (1) {
+    x = devgetc(io, timo);
+    if (x == -2) {
+      debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt timeout", 0, 0);
+      k->metrics.wirein += n + skipped;
+      return (0);
+    } else if (x < 0) {
+      debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt EOF", 0, 0);
+      return (-1);
+    }
+    c = (k->parity) ? x & 0x7f : x & 0xff; /* Strip parity */
+
+#ifdef F_CTRLC
+    /* In remote mode only: three consecutive ^C's to quit */
+    if (k->remote && c == (UCHAR)3) {
+      if (++ccn > 2) {
+        debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt ^C^C^C", 0, 0);
+        return (-1);
+      }
+    } else {
+      ccn = 0;
+    }
+#endif /* F_CTRLC */
+
+    if (c == k->r_soh) { /* Start of packet, maybe again */
+      flag = 1;          /* Remember */
+      skipped += n + 1;  /* But discard, with a packet cut short by it */
+      n = 0;
+      want = 0;
+      continue;
+    }
+    if (!flag) {  /* No start of packet yet */
+      skipped++;
+      continue; /* so discard these bytes. */
+    }
+    if (c == k->r_eom) { /* End of packet before its length */
+      skipped++;
+      break;
+    }
+    p[n++] = x & 0xff; /* Contents of packet */
+    if (!want) {
+      want = framelen(k, p, n);
+      if (want < 0) { /* Bad header: hand it over now */
+        debug(DB_MSG | DBC_PKT | DBL_ERROR, "readpkt bad header", 0, 0);
+        skipped += n + want;
+        n = -want;
+        break;
+      }
+    }
+    if (want && n >= want) { /* Packet complete */
+      break;
+    }
+  }
+#ifdef DEBUG
+  p[n] = NUL; /* Terminate for printing */
+  debug(DB_PKT | DBC_PKT | DBL_EVENT, "RPKT", p, n);
+#endif /* DEBUG */
+  linetime(k);
+  k->metrics.wirein += n + skipped;
+  return (n);
+}
+
+// Writes n bytes of data to the device.
+// Call with:
+//   k = pointer to Kermit struct.
+//   p = pointer to data to transmit.
+//   n = length.
+// Returns:
+//   X_OK on success.
+//   X_ERROR on failure to write - i/o error.
+
+int tx_data(struct k_data *k, UCHAR *p, int n) {
+  struct k_io *io = session(k);
+  int x;
+
+  linetime(k);
+  k->metrics.wireout += n;
+  while (n > 0) {
+    x = write(io->ttyout, p, n);
+    if (x < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      debug(DB_LOG | DBC_PKT | DBL_ERROR, "tx_data write error", 0, errno);
+      return (X_ERROR);
+    }
+    debug(DB_LOG | DBC_PKT | DBL_DETAIL, "tx_data write", 0, x);
+    p += x;
+    n -= x;
+  }
+  return (X_OK); /* Success */
+}
+
+// Check if input waiting
+//
+// Returns the number of characters waiting to be read,
+// i.e. that can be safely read without blocking,
+// or -1 if it can't be determined.
+
+int inchk(struct k_data *k) {
+  struct k_io *io = session(k);
+  int n;
+
+  if (ioctl(io->ttyin, FIONREAD, &n) < 0) {
+    return (-1);
+  }
+  return (n + (io->tbufcnt - io->tbufpos));
+}
+
+// File I/O section
+
+// Open output file
+//  Call with:
+//    Pointer to filename.
+//    Size in bytes.
+//    Creation date in format yyyymmdd hh:mm:ss, e.g. 19950208 14:00:00
+//    Mode: 1 = read, 2 = create.
+//  Returns:
+//    X_OK on success.
+//    X_ERROR on failure, including rejection based on name, size, or date.
+
+int openfile(struct k_data *k, UCHAR *s, int mode) {
+  struct k_io *io = session(k);
+  char path[PATHLEN];
+
+  switch (mode) {
+  case 1: /* Read */
+    io->ifd = open(iopath(io, s, path), O_RDONLY);
+    if (io->ifd < 0) {
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "openfile read error", s, errno);
+      return (X_ERROR);
+    }
+    k->s_first = 1;              /* Set up for getkpt */
+    k->zinbuf[0] = '\0';         /* Initialize buffer */
+    khot(k)->zinptr = k->zinbuf; /* Set up buffer pointer */
+    khot(k)->zincnt = 0;         /* and count */
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "openfile read ok", s, 0);
+    return (X_OK);
+
+  case 2: /* Write (create) */
+    io->ofd = open(iopath(io, s, path), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (io->ofd < 0) {
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "openfile write error", s, errno);
+      return (X_ERROR);
+    }
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "openfile write ok", s, 0);
+    return (X_OK);
+
+  default:
+    return (X_ERROR);
+  }
+}
+
+// Get info about existing file.
+
+// Call with:
+//   Pointer to filename
+//   Pointer to buffer for date-time string
+//   Length of date-time string buffer (must be at least 18 bytes)
+//   Pointer to int file type = always 1
+//   Transfer mode (0 = auto, 1 = manual) = always 1
+// Returns:
+//   X_ERROR on failure.
+//   0L or greater on success == file length.
+//   Date-time string set to yyyymmdd hh:mm:ss.
+//   Type set to 1 (binary) as in neoio.c.
+
+ULONG
+fileinfo(struct k_data *k, UCHAR *filename, UCHAR *buf, int buflen, short *type,
+         short mode) {
+  struct stat st;
+  struct tm tm;
+  char path[PATHLEN];
+
+  if (!buf) {
+    return (X_ERROR);
+  }
+  buf[0] = '\0';
+  if (buflen < 18) {
+    return (X_ERROR);
+  }
+  if (stat(iopath(session(k), filename, path), &st) < 0) {
+    debug(DB_LOG | DBC_FILE | DBL_ERROR, "fileinfo stat error", filename,
+          errno);
+    return (X_ERROR);
+  }
+  if (localtime_r(&st.st_mtime, &tm)) {
+    strftime((char *)buf, buflen, "%Y%m%d %H:%M:%S", &tm);
+  }
+  *type = 1; // File type is always binary regardless of mode
+  return ((ULONG)st.st_size);
+}
+
+// Read data from a file
+
+int readfile(struct k_data *k) {
+  if (!khot(k)->zinptr) {
+#ifdef DEBUG
+    fprintf(stderr, "readfile ZINPTR NOT SET\n");
+#endif /* DEBUG */
+    return (X_ERROR);
+  }
+  if (khot(k)->zincnt < 1) {
+    // Nothing in buffer - must refill
+    // Binary mode only
+    k->dummy = 0;
+    khot(k)->zincnt = read(session(k)->ifd, k->zinbuf, k->zinlen);
+    if (khot(k)->zincnt < 0) {
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "readfile: read error", 0, errno);
+      return (X_ERROR);
+    }
+    debug(DB_LOG | DBC_FILE | DBL_DETAIL, "readfile binary ok zincnt", 0,
+          khot(k)->zincnt);
+    k->zinbuf[khot(k)->zincnt] = '\0'; /* Terminate. */
+    if (khot(k)->zincnt == 0) {        /* Check for EOF */
+      return (-1);
+    }
+    khot(k)->zinptr = k->zinbuf; /* Not EOF - reset pointer */
+  }
+  (khot(k)->zincnt)--; /* Return first byte. */
+
+  debug(DB_LOG | DBC_FILE | DBL_DETAIL, "readfile exit zincnt", 0,
+        khot(k)->zincnt);
+  return (*(khot(k)->zinptr)++ & 0xff);
+}
+
+// Write data to file
+//
+// Call with:
+//   Kermit struct
+//   String pointer
+//   Length
+// Returns:
+//   X_OK on success
+//   X_ERROR on failure, such as i/o error, space used up, etc
+
+int writefile(struct k_data *k, UCHAR *s, int n) {
+  struct k_io *io = session(k);
+  int x;
+
+  while (n > 0) {
+    x = write(io->ofd, s, n);
+    if (x < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      debug(DB_LOG | DBC_FILE | DBL_ERROR, "writefile: write error", 0, errno);
+      return (X_ERROR);
+    }
+    s += x;
+    n -= x;
+  }
+  return (X_OK);
+}
+
+// Close output file
+
+//  Mode = 1 for input file, mode = 2 or 3 for output file.
+//
+//  For output files, the character c is the character (if any) from the Z
+//  packet data field.  If it is D, it means the file transfer was canceled
+//  in midstream by the sender, and the file is therefore incomplete.
+
+int closefile(struct k_data *k, UCHAR c, int mode) {
+  struct k_io *io = session(k);
+  char path[PATHLEN];
+  int rc = X_OK; /* Return code */
+
+  switch (mode) {
+  case 1: /* Closing input file */
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "closefile (input)", k->filename, 0);
+    if (io->ifd >= 0) {
+      (void)close(io->ifd);
+      io->ifd = -1;
+    }
+    break;
+  case 2: /* Closing output file */
+  case 3:
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "closefile (output) name", k->filename,
+          0);
+    debug(DB_LOG | DBC_FILE | DBL_EVENT, "closefile (output) keep", 0,
+          k->ikeep);
+    if (io->ofd >= 0) {
+      if (close(io->ofd) < 0) {
+        rc = X_ERROR;
+      }
+      io->ofd = -1;
+    }
+    if ((k->ikeep == 0) && /* Don't keep incomplete files */
+        (c == 'D')) {      /* This file was incomplete */
+      if (k->filename) {
+        debug(DB_LOG | DBC_FILE | DBL_EVENT, "deleting incomplete", k->filename,
+              0);
+        if (unlink(iopath(io, k->filename, path)) < 0) {
+          rc = X_ERROR;
+        }
+      }
+    }
+    break;
+  default:
+    rc = X_ERROR;
+  }
+  return (rc);
+}
@@ -0,0 +1,45 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// posixio.h -- Sessions of the host (POSIX) I/O backend
+
+// Everything posixio.c keeps for a transfer is in a struct k_io, found
+// through k->io, so that any number of sessions can run at once, e.g.
+// one per thread.  A k_data without k->io uses the session of devopen(),
+// devinit() and devrestore(), as a program with one session does.
+
+#ifndef __POSIXIO_H__
+#define __POSIXIO_H__
+
+#include <termios.h>
+
+#include "cdefs.h"
+#include "kermit.h"
+
+#define TBUFLEN (512) /* Device read buffer */
+
+struct k_io {
+  int ttyin;                  /* Input file descriptor */
+  int ttyout;                 /* Output file descriptor */
+  int ttyraw;                 /* Nonzero if tty modes were changed */
+  struct termios ttyold;      /* Modes to restore */
+  UCHAR tbuf[TBUFLEN];        /* Device read buffer */
+  int tbufpos;                /* Next byte in tbuf */
+  int tbufcnt;                /* Bytes in tbuf */
+  int ifd;                    /* File being sent */
+  int ofd;                    /* File being received */
+  const char *dir;            /* Directory of the files, or 0 for . */
+  UCHAR obuf[OBUFLEN + 8];    /* File output buffer */
+  UCHAR ibuf[IBUFLEN + 8];    /* File input buffer */
+};
+
+// File I/O buffers of the session of devopen()
+
+extern UCHAR o_buf[];
+extern UCHAR i_buf[];
+
+int devopen(char *);
+void devrestore(void);
+void ioattach(struct k_data *, struct k_io *, int, int, const char *);
+
+#endif /* __POSIXIO_H__ */
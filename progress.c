@@ -0,0 +1,161 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// progress.c
+// Status line of a transfer in progress
+// Author: Kenji Rikitake
+
+// The line is rewritten in place by backspacing over the previous one,
+// as lineinput() in main.c does, so only putchar() is needed from the
+// console.  See progress.h for the scheduling.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cdefs.h"
+#include "kermit.h"
+#include "progress.h"
+
+// Ticks per second of the k->metrics times
+#define PROGRESS_HZ (100L)
+
+static long batchsize; /* Bytes of the whole batch, 0 if unknown */
+static long batchdone; /* Bytes of the files finished in the batch */
+static ULONG lasttick; /* Time of the last rebuild */
+static long lastsofar; /* Bytes of the file at the last rebuild */
+static long cps;       /* Current characters per second, smoothed */
+static int shown;      /* Characters of the line on the console */
+
+// Console output waiting to be written: backspaces, then the line
+static char pending[2 * PROGRESS_COLS + 1];
+static int pendpos, pendlen;
+
+// Start the line for a session, with the total bytes to transfer if known
+
+void progressbegin(long total) {
+  batchsize = total;
+  batchdone = 0;
+  lasttick = 0;
+  lastsofar = 0;
+  cps = 0;
+  shown = 0;
+  pendpos = pendlen = 0;
+}
+
+// Bytes of the current file so far.  When receiving, r->sofar only
+// counts the bytes written out, which move a whole file output buffer
+// at a time, so the bytes decoded into the buffer are added.
+
+static long sofar(struct k_data *k, struct k_response *r) {
+  if (k->what == W_RECV) {
+    return (r->sofar + khot(k)->obufpos);
+  }
+  return (r->sofar);
+}
+
+// Append the time left for the bytes at the current rate
+
+static int eta(char *s, int size, const char *label, long left) {
+  long sec;
+
+  if (cps <= 0) {
+    return snprintf(s, size, " %s --:--", label);
+  }
+  sec = (left > 0) ? left / cps : 0;
+  return snprintf(s, size, " %s %2ld:%02ld", label, sec / 60, sec % 60);
+}
+
+// Build the line and queue it to replace the one on the console
+
+static void rebuild(struct k_data *k, struct k_response *r) {
+  char line[128];
+  ULONG now, dt;
+  long bytes, done, retries;
+  int i, n;
+
+  now = k->metrics.elapsed;
+  dt = now - lasttick;
+  done = sofar(k, r);
+  if (done < lastsofar) { /* A new file */
+    lastsofar = 0;
+  }
+  if (dt > 0) {
+    bytes = (long)(((done - lastsofar) * PROGRESS_HZ) / (long)dt);
+    cps = (cps > 0) ? (cps + bytes) / 2 : bytes;
+  }
+  lasttick = now;
+  lastsofar = done;
+  retries = (long)(k->metrics.naks + k->metrics.resends + k->metrics.timeouts);
+
+  n = snprintf(line, sizeof(line), "%6ld/", done);
+  if (r->filesize > 0) {
+    n += snprintf(line + n, sizeof(line) - n, "%-6ld", r->filesize);
+  } else {
+    n += snprintf(line + n, sizeof(line) - n, "%-6s", "?");
+  }
+  n += snprintf(line + n, sizeof(line) - n, " %5ld cps %3ld rtr", cps,
+                retries);
+  if (r->filesize > 0) {
+    n += eta(line + n, sizeof(line) - n, "eta", r->filesize - done);
+  }
+  if (batchsize > 0) {
+    n += eta(line + n, sizeof(line) - n, "all",
+             batchsize - batchdone - done);
+  }
+  if (n > PROGRESS_COLS) {
+    n = PROGRESS_COLS;
+  }
+
+  // Back over the old line, and blank out what the new one does not cover
+  pendlen = 0;
+  for (i = 0; i < shown; i++) {
+    pending[pendlen++] = '\b';
+  }
+  memcpy(&pending[pendlen], line, n);
+  pendlen += n;
+  for (; n < shown; n++) {
+    pending[pendlen++] = ' ';
+  }
+  pendpos = 0;
+  shown = n;
+}
+
+// Write up to max characters of the queued output
+
+static void drain(int max) {
+  if (pendpos >= pendlen) {
+    return;
+  }
+  while ((pendpos < pendlen) && (max-- > 0)) {
+    putchar(pending[pendpos++]);
+  }
+  fflush(stdout);
+}
+
+// Call after each packet handled: rebuilds the line when it is due and
+// the previous one has been written out, and writes a piece of it
+
+void progress(struct k_data *k, struct k_response *r) {
+  if ((pendpos >= pendlen) && (sofar(k, r) > 0) &&
+      ((k->metrics.elapsed - lasttick) >= PROGRESS_TICKS)) {
+    rebuild(k, r);
+  }
+  drain(PROGRESS_CHUNK);
+}
+
+// Call at the end of each file: shows its final line, and moves on to
+// the next console line
+
+void progressend(struct k_data *k, struct k_response *r) {
+  drain(sizeof(pending));
+  if (sofar(k, r) > 0) {
+    rebuild(k, r);
+    drain(sizeof(pending));
+  }
+  if (shown > 0) {
+    putchar('\n');
+  }
+  batchdone += sofar(k, r);
+  lastsofar = 0;
+  shown = 0;
+}
@@ -0,0 +1,33 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// progress.h -- Status line of a transfer in progress
+
+// One console line shows the bytes of the current file so far against
+// its size, the current CPS, the retries, and the estimated time left
+// for the file and, when the total is known, for the whole batch.
+// The line is rebuilt at most every PROGRESS_TICKS timer ticks, and
+// written out at most PROGRESS_CHUNK characters at a time after each
+// packet has been handled, i.e. after its ACK has been sent, so that the
+// console output never holds up an ACK nor overruns the UART.
+// The time is taken from k->metrics, with no timer calls of its own.
+
+#ifndef __PROGRESS_H__
+#define __PROGRESS_H__
+
+#include "cdefs.h"
+#include "kermit.h"
+
+#ifndef PROGRESS_TICKS
+#define PROGRESS_TICKS (25) /* Rebuild the line up to 4 times a second */
+#endif                      /* PROGRESS_TICKS */
+#ifndef PROGRESS_CHUNK
+#define PROGRESS_CHUNK (8) /* Console characters written per packet */
+#endif                     /* PROGRESS_CHUNK */
+#define PROGRESS_COLS (52) /* Fits the 53-column Neo6502 console */
+
+void progressbegin(long);
+void progress(struct k_data *, struct k_response *);
+void progressend(struct k_data *, struct k_response *);
+
+#endif /* __PROGRESS_H__ */
@@ -0,0 +1,180 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// sendlist.c
+// List of files to send, with wildcards
+// Author: Kenji Rikitake
+
+// The pool holds each entry as a NUL-terminated string, and an empty
+// string after the last one.  See sendlist.h for the use.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <neo/api.h>
+
+#include "cdefs.h"
+#include "kermit.h"
+#include "kio.h"
+#include "sendlist.h"
+
+// The directory API reads into this, and the names are sent from it
+#define DIRNAME (256)
+
+static UCHAR *pool;     /* Entries, back to back */
+static int poolsize;    /* Bytes of the pool */
+static int poollen = 0; /* Bytes used, without the final NUL */
+static int files = 0;   /* Files the entries name */
+static long bytes = 0;  /* Bytes of those files */
+
+static UCHAR *cur;            /* Entry being sent */
+static int expanding = 0;     /* Reading the directory for the entry */
+static char dirname[DIRNAME]; /* Name read from the directory */
+
+// Does the entry need to be expanded?
+
+static int iswild(const UCHAR *s) {
+  return (strchr((const char *)s, '*') || strchr((const char *)s, '?'));
+}
+
+// Read the next directory entry that matches the pattern, if any:
+// only files, with names short enough to be sent
+
+static int nextmatch(const UCHAR *pattern, uint32_t *size) {
+  neo_file_stat_t st;
+
+  for (;;) {
+    neo_file_readdir(dirname, &st);
+    if ((neo_api_error() != API_ERROR_NONE) || !dirname[0]) {
+      return (0);
+    }
+    if (!(st.attr & FIO_ATTR_DIR) && (strlen(dirname) <= FN_MAX) &&
+        wildmatch(pattern, (UCHAR *)dirname)) {
+      *size = st.size;
+      return (1);
+    }
+  }
+}
+
+// Use this pool, of at least SENDPOOL bytes, and empty the list
+
+void sendlistinit(UCHAR *p, int size) {
+  pool = p;
+  poolsize = size;
+  sendlistclear();
+}
+
+// Empty the list
+
+void sendlistclear(void) {
+  pool[0] = '\0';
+  poollen = 0;
+  files = 0;
+  bytes = 0;
+  sendlistrewind();
+}
+
+// Add a file name or a pattern, if anything can be sent for it.
+// Returns the number of files it names, or -1 if the pool is full.
+
+int sendlistadd(const char *spec) {
+  int len, n;
+  long size;
+  uint32_t s;
+
+  len = strlen(spec);
+  if ((len == 0) || (len > FN_MAX)) {
+    return (0);
+  }
+  if (poollen + len + 2 > poolsize) { /* With the NUL and the final one */
+    return (-1);
+  }
+  n = 0;
+  size = 0;
+  if (iswild((const UCHAR *)spec)) {
+    neo_file_opendir("");
+    if (neo_api_error() != API_ERROR_NONE) {
+      return (0);
+    }
+    while (nextmatch((const UCHAR *)spec, &s)) {
+      n++;
+      size += (long)s;
+    }
+    neo_file_closedir();
+  } else {
+    neo_file_open(1, spec, 0);
+    if (neo_api_error() != API_ERROR_NONE) {
+      return (0);
+    }
+    size = (long)neo_file_size(1);
+    neo_file_close(1);
+    n = 1;
+  }
+  if (n > 0) {
+    memcpy(&pool[poollen], spec, len + 1);
+    poollen += len + 1;
+    pool[poollen] = '\0';
+    files += n;
+    bytes += size;
+  }
+  return (n);
+}
+
+// Files and bytes in the list, as found when they were added
+
+int sendlistfiles(void) { return (files); }
+
+long sendlistbytes(void) { return (bytes); }
+
+// Show the entries
+
+void sendlistshow(void) {
+  UCHAR *p;
+  int i;
+
+  for (p = pool, i = 1; *p; p += strlen((char *)p) + 1, i++) {
+    printf("%3d: %s\n", i, (char *)p);
+  }
+  printf("%d files, %ld bytes\n", files, bytes);
+}
+
+// Start sending from the first entry
+
+void sendlistrewind(void) {
+  if (expanding) {
+    neo_file_closedir();
+    expanding = 0;
+  }
+  cur = pool;
+}
+
+// The next file to send, or NULL at the end of the list (k->nextf)
+
+UCHAR *sendlistnext(struct k_data *k) {
+  UCHAR *p;
+  uint32_t s;
+
+  (void)k;
+  while (*cur) {
+    if (expanding) {
+      if (nextmatch(cur, &s)) {
+        return ((UCHAR *)dirname);
+      }
+      neo_file_closedir();
+      expanding = 0;
+    } else if (iswild(cur)) {
+      neo_file_opendir("");
+      if (neo_api_error() == API_ERROR_NONE) {
+        expanding = 1;
+        continue;
+      }
+    } else {
+      p = cur;
+      cur += strlen((char *)cur) + 1;
+      return (p);
+    }
+    cur += strlen((char *)cur) + 1;
+  }
+  return ((UCHAR *)0);
+}
@@ -0,0 +1,33 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// sendlist.h -- List of files to send, with wildcards
+
+// The names and the wildcard patterns entered for a batch are kept back
+// to back in one string pool, so that the number of entries is limited
+// only by their total length.  A pattern (with * or ?) is expanded by
+// reading the directory while the batch is sent, one matching file at a
+// time: set k->nextf to sendlistnext, and no list of the names is ever
+// made.  "*" sends the whole current directory.  The pool is given by
+// sendlistinit(), from the memory arena (see arena.h).
+
+#ifndef __SENDLIST_H__
+#define __SENDLIST_H__
+
+#include "cdefs.h"
+#include "kermit.h"
+
+#ifndef SENDPOOL
+#define SENDPOOL (16 * (FN_MAX + 1)) /* Bytes of the pool, at least */
+#endif                               /* SENDPOOL */
+
+void sendlistinit(UCHAR *, int);
+void sendlistclear(void);
+int sendlistadd(const char *);
+int sendlistfiles(void);
+long sendlistbytes(void);
+void sendlistshow(void);
+void sendlistrewind(void);
+UCHAR *sendlistnext(struct k_data *);
+
+#endif /* __SENDLIST_H__ */
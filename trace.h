@@ -0,0 +1,66 @@
+// This file is a part of Neo6502-Kermit.
+// See LICENSE for the licensing details.
+
+// trace.h -- Binary trace of protocol events in a RAM ring buffer
+
+// With TRACE defined, each event is recorded as a fixed-size binary
+// record in a ring buffer in RAM, without formatting or file I/O.
+// The buffer is written to TRACE_FILE only at the end of a session
+// or on a fatal error, and decoded on a host by kermit-trace.
+// Without TRACE, the macros disappear entirely.
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "cdefs.h"
+
+// Event ids
+
+#define TR_OPEN 1   /* Session started (seq: action) */
+#define TR_RPKT 2   /* Packet received (aux: type, len: bytes) */
+#define TR_SPKT 3   /* Packet sent (aux: type, len: bytes) */
+#define TR_RERR 4   /* Packet read failed (aux: reason, len: bytes) */
+#define TR_FOPEN 5  /* File opened (aux: mode) */
+#define TR_FCLOSE 6 /* File closed (aux: mode, len: Z packet data) */
+#define TR_FERR 7   /* File I/O failed (aux: API error code) */
+#define TR_DONE 8   /* Session completed */
+#define TR_ERROR 9  /* Fatal error (len: exit status) */
+
+// Reasons of TR_RERR
+
+#define TR_RERR_NOBUF 1   /* No buffer */
+#define TR_RERR_CTRLC 2   /* ^C^C^C */
+#define TR_RERR_TOOLONG 3 /* Packet too long */
+#define TR_RERR_BADHDR 4  /* Bad header, packet not read to its end */
+
+// Event record, 8 bytes, little endian on both the Neo6502 and hosts
+
+struct trace_event {
+  UCHAR id;    /* Event id */
+  UCHAR state; /* Protocol state (k->state) */
+  UCHAR seq;   /* Packet sequence number */
+  UCHAR aux;   /* Packet type or event detail */
+  USHORT len;  /* Packet length or event detail */
+  USHORT time; /* Timer ticks (100 Hz), modulo 65536 */
+};
+
+// File layout: TRACE_MAGIC, the number of events recorded (4 bytes)
+// and of those in the file (2 bytes), then the events, oldest first
+
+#define TRACE_MAGIC "KTR1"
+#define TRACE_FILE "KTRACE.BIN"
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS (256) /* Ring buffer size, power of 2 */
+#endif /* TRACE_EVENTS */
+
+#ifdef TRACE
+void dotrace(int, int, int, int, int);
+void traceflush(void);
+#define trace(id, state, seq, aux, len)                                        \
+  dotrace(id, (int)(state), (int)(seq), (int)(aux), (int)(len))
+#else /* TRACE */
+#define trace(id, state, seq, aux, len)
+#define traceflush()
+#endif /* TRACE */
+
+#endif /* __TRACE_H__ */